@@ -0,0 +1,386 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: BoxBVH.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Binned SAH build of the box BVH. See BoxBVH.h.
+
+Each node looks at the box centers (centroids) in its range, drops them into a few bins per axis,
+and evaluates the SAH cost of splitting between every pair of neighbouring bins.
+The best split partitions the range in place, and both halves are built the same way.
+When a node is big enough, its right half is built on another thread into its own node array,
+which is then appended behind the left half with its child indices shifted.
+*/
+
+#include "BoxBVH.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+	// Bounds that can grow one box at a time.
+	struct Bounds
+	{
+		float min[3], max[3];
+
+		Bounds()
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				min[a] = 3.4e38f;
+				max[a] = -3.4e38f;
+			}
+		}
+
+		void grow(const float* lo, const float* hi)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				min[a] = std::min(min[a], lo[a]);
+				max[a] = std::max(max[a], hi[a]);
+			}
+		}
+
+		void grow(const Bounds &b) { grow(b.min, b.max); }
+
+		float area() const
+		{
+			float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+			if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+				return 0.0f;
+			return 2.0f * (dx * dy + dy * dz + dz * dx);
+		}
+	};
+
+	// Everything the recursive build needs. Boxes are read through `order`, which the build permutes.
+	struct Builder
+	{
+		const BoxArrays* input;
+		std::vector<uint32_t>* order;
+		std::vector<float> centroid[3];
+		BoxBVH::BuildOptions options;
+
+		// Ranges smaller than this are built on the current thread; spawning costs more than it saves.
+		static const uint32_t PARALLEL_MIN = 4096;
+
+		void box_bounds(uint32_t id, float* lo, float* hi) const
+		{
+			lo[0] = input->minX[id]; lo[1] = input->minY[id]; lo[2] = input->minZ[id];
+			hi[0] = input->maxX[id]; hi[1] = input->maxY[id]; hi[2] = input->maxZ[id];
+		}
+
+		// Picks the best SAH split of [begin, end). Returns false if a leaf is cheaper (or nothing can be split).
+		bool find_split(uint32_t begin, uint32_t end, const Bounds &bounds, int &bestAxis, float &bestPlane) const
+		{
+			struct Bin { Bounds bounds; uint32_t count = 0; };
+
+			const int binCount = std::max(2, std::min(options.bins, 32));
+			Bin bins[32];
+			Bounds rightBounds[32];
+			uint32_t rightCount[32];
+
+			// Bounds of the centroids: the bins are spread over these, not over the boxes.
+			Bounds centers;
+			for (uint32_t k = begin; k < end; k++)
+			{
+				uint32_t id = (*order)[k];
+				float c[3] = { centroid[0][id], centroid[1][id], centroid[2][id] };
+				centers.grow(c, c);
+			}
+
+			float leafCost = (float)(end - begin) * bounds.area();
+			float bestCost = leafCost;
+			bestAxis = -1;
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float lo = centers.min[axis], hi = centers.max[axis];
+				if (!(hi > lo))
+					continue;
+
+				for (int b = 0; b < binCount; b++)
+					bins[b] = Bin();
+
+				float scale = binCount / (hi - lo);
+				for (uint32_t k = begin; k < end; k++)
+				{
+					uint32_t id = (*order)[k];
+					int b = std::min(binCount - 1, (int)((centroid[axis][id] - lo) * scale));
+					float bl[3], bh[3];
+					box_bounds(id, bl, bh);
+					bins[b].bounds.grow(bl, bh);
+					bins[b].count++;
+				}
+
+				// Sweep from the right to know the right side of every split, then from the left.
+				Bounds acc;
+				uint32_t n = 0;
+				for (int b = binCount - 1; b > 0; b--)
+				{
+					acc.grow(bins[b].bounds);
+					n += bins[b].count;
+					rightBounds[b] = acc;
+					rightCount[b] = n;
+				}
+
+				acc = Bounds();
+				n = 0;
+				for (int b = 0; b < binCount - 1; b++)
+				{
+					acc.grow(bins[b].bounds);
+					n += bins[b].count;
+					if (n == 0 || rightCount[b + 1] == 0)
+						continue;
+
+					// One unit of cost for visiting the node itself, measured in "box tests over the node's area".
+					float cost = bounds.area() + n * acc.area() + rightCount[b + 1] * rightBounds[b + 1].area();
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestPlane = lo + (b + 1) / scale;
+					}
+				}
+			}
+
+			// Too many boxes for one leaf: split even when SAH prefers a leaf.
+			if (bestAxis < 0 && (int)(end - begin) > options.maxLeafSize)
+			{
+				int axis = 0;
+				for (int a = 1; a < 3; a++)
+				{
+					if (centers.max[a] - centers.min[a] > centers.max[axis] - centers.min[axis])
+						axis = a;
+				}
+				if (centers.max[axis] > centers.min[axis])
+				{
+					bestAxis = axis;
+					bestPlane = 0.5f * (centers.min[axis] + centers.max[axis]);
+				}
+			}
+			return bestAxis >= 0;
+		}
+
+		// Builds [begin, end) into out, depth first, starting at out.size(). Returns the subtree's depth.
+		int build(uint32_t begin, uint32_t end, std::vector<BVHNode> &out, int depth, int parallelLevels)
+		{
+			Bounds bounds;
+			for (uint32_t k = begin; k < end; k++)
+			{
+				float lo[3], hi[3];
+				box_bounds((*order)[k], lo, hi);
+				bounds.grow(lo, hi);
+			}
+
+			uint32_t index = (uint32_t)out.size();
+			BVHNode node;
+			for (int a = 0; a < 3; a++)
+			{
+				node.min[a] = bounds.min[a];
+				node.max[a] = bounds.max[a];
+			}
+			node.rightOrFirst = begin;
+			node.count = end - begin;
+			out.push_back(node);
+
+			if ((int)(end - begin) <= std::max(1, std::min(options.minLeafSize, options.maxLeafSize)))
+				return 1;
+
+			uint32_t mid = begin;
+			int axis;
+			float plane;
+			bool split = depth < BoxBVH::MAX_DEPTH - 32 && find_split(begin, end, bounds, axis, plane);
+			if (split)
+			{
+				std::vector<uint32_t> &ids = *order;
+				const std::vector<float> &c = centroid[axis];
+				mid = (uint32_t)(std::partition(ids.begin() + begin, ids.begin() + end,
+					[&](uint32_t id) { return c[id] < plane; }) - ids.begin());
+			}
+			else if ((int)(end - begin) <= options.maxLeafSize)
+				return 1;
+
+			// Every centroid on one side (or the tree is getting too deep): split the range in half by position.
+			if (mid == begin || mid == end)
+				mid = begin + (end - begin) / 2;
+
+			out[index].count = 0;
+
+			int leftDepth, rightDepth;
+			if (parallelLevels > 0 && end - begin >= PARALLEL_MIN)
+			{
+				std::vector<BVHNode> right;
+				std::thread worker([&]() { rightDepth = build(mid, end, right, depth + 1, parallelLevels - 1); });
+				leftDepth = build(begin, mid, out, depth + 1, parallelLevels - 1);
+				worker.join();
+
+				uint32_t offset = (uint32_t)out.size();
+				out[index].rightOrFirst = offset;
+				for (BVHNode n : right)
+				{
+					if (!n.is_leaf())
+						n.rightOrFirst += offset;
+					out.push_back(n);
+				}
+			}
+			else
+			{
+				leftDepth = build(begin, mid, out, depth + 1, 0);
+				out[index].rightOrFirst = (uint32_t)out.size();
+				rightDepth = build(mid, end, out, depth + 1, 0);
+			}
+
+			return 1 + std::max(leftDepth, rightDepth);
+		}
+	};
+}
+
+void BoxBVH::build(const BoxArrays &input, size_t count, const BuildOptions &options)
+{
+	tree.clear();
+	boxes.clear();
+	boxIds.clear();
+	treeDepth = 0;
+	if (count == 0)
+		return;
+
+	std::vector<uint32_t> order(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = (uint32_t)i;
+
+	Builder builder;
+	builder.input = &input;
+	builder.order = &order;
+	builder.options = options;
+	for (int a = 0; a < 3; a++)
+		builder.centroid[a].resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		builder.centroid[0][i] = 0.5f * (input.minX[i] + input.maxX[i]);
+		builder.centroid[1][i] = 0.5f * (input.minY[i] + input.maxY[i]);
+		builder.centroid[2][i] = 0.5f * (input.minZ[i] + input.maxZ[i]);
+	}
+
+	// Each parallel level doubles the number of threads working.
+	int threads = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+	int parallelLevels = 0;
+	while ((1 << parallelLevels) < threads)
+		parallelLevels++;
+
+	tree.reserve(2 * count);
+	treeDepth = builder.build(0, (uint32_t)count, tree, 1, parallelLevels);
+
+	// Store the boxes in leaf order, so a leaf's boxes are read from consecutive memory.
+	boxes.reserve(count);
+	boxIds.resize(count);
+	for (size_t k = 0; k < count; k++)
+	{
+		uint32_t id = order[k];
+		boxIds[k] = id;
+		AABB b = { { input.minX[id], input.minY[id], input.minZ[id] }, { input.maxX[id], input.maxY[id], input.maxZ[id] } };
+		boxes.add(b);
+	}
+}
+
+size_t BoxBVH::query_sphere(float cx, float cy, float cz, float radius, uint32_t* out, size_t capacity) const
+{
+	size_t found = 0;
+	for_each_overlap(cx, cy, cz, radius, [&](uint32_t id) {
+		if (found < capacity)
+			out[found] = id;
+		found++;
+	});
+	return found;
+}
+
+bool BoxBVHView::any_overlap(float cx, float cy, float cz, float radius) const
+{
+	if (nodeCount == 0)
+		return false;
+
+	uint32_t stack[BVH_MAX_DEPTH];
+	int top = 0;
+	uint32_t i = 0;
+
+	for (;;)
+	{
+		const BVHNode &node = nodes[i];
+		if (sphere_aabb_overlap(cx, cy, cz, radius, node.min[0], node.min[1], node.min[2], node.max[0], node.max[1], node.max[2]))
+		{
+			if (!node.is_leaf())
+			{
+				stack[top++] = node.rightOrFirst;
+				i = i + 1;
+				continue;
+			}
+
+			for (uint32_t k = node.rightOrFirst; k < node.rightOrFirst + node.count; k++)
+			{
+				if (sphere_aabb_overlap(cx, cy, cz, radius, boxes.minX[k], boxes.minY[k], boxes.minZ[k], boxes.maxX[k], boxes.maxY[k], boxes.maxZ[k]))
+					return true;
+			}
+		}
+
+		if (top == 0)
+			return false;
+		i = stack[--top];
+	}
+}
+
+BoxBVHView BoxBVH::view() const
+{
+	BoxBVHView v = { tree.data(), tree.size(), boxes.arrays(), boxIds.data(), boxIds.size() };
+	return v;
+}
+
+bool BoxBVH::any_overlap(float cx, float cy, float cz, float radius) const
+{
+	return view().any_overlap(cx, cy, cz, radius);
+}
+
+void BoxBVH::find_overlaps(const SphereArrays &spheres, size_t count, std::vector<CollisionPair> &overlaps) const
+{
+	for (size_t s = 0; s < count; s++)
+	{
+		for_each_overlap(spheres.x[s], spheres.y[s], spheres.z[s], spheres.radius[s], [&](uint32_t id) {
+			CollisionPair pair = { (uint32_t)s, id };
+			overlaps.push_back(pair);
+		});
+	}
+}
+
+float BoxBVH::sah_cost() const
+{
+	if (tree.empty())
+		return 0.0f;
+
+	Bounds root;
+	root.grow(tree[0].min, tree[0].max);
+	float rootArea = root.area();
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	// Interior nodes cost one visit, leaves cost one test per box, both weighted by the chance of being reached.
+	float cost = 0.0f;
+	for (const BVHNode &node : tree)
+	{
+		Bounds b;
+		b.grow(node.min, node.max);
+		cost += (node.is_leaf() ? (float)node.count : 1.0f) * b.area() / rootArea;
+	}
+	return cost;
+}
@@ -0,0 +1,179 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: BoxBVH.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A bounding volume hierarchy (BVH) over static boxes, for "which boxes does this sphere touch?" queries.
+Boxes are grouped into a binary tree; every node stores the box around everything below it.
+A query walks down from the root and skips any node the sphere doesn't touch, so it visits
+a handful of nodes instead of every box.
+
+Where to split each node is chosen with the surface area heuristic (SAH): the chance that a query hits
+a node is roughly proportional to the node's surface area, so we pick the split that minimizes
+(area of left x boxes on the left) + (area of right x boxes on the right).
+
+The nodes live in one flat array in depth-first order: the left child of node i is node i + 1, and
+only the right child's index is stored. Each node is 32 bytes, so two fit in a cache line.
+The boxes themselves are reordered so each leaf's boxes are next to each other in memory.
+
+The top levels of the tree are built on several threads. Queries never allocate and never write to
+the tree, so any number of threads can query the same BVH at once.
+The node and leaf tests are the same closest-point test as clamp_on_rectangle in main.cpp.
+*/
+
+#ifndef _BOX_BVH_H
+#define _BOX_BVH_H
+
+#include "CollisionTypes.h"
+#include "SphereAABBBatch.h"
+
+// One node of the flat tree. 32 bytes: each half (corner + integer) fits in one 16 byte SIMD register.
+struct BVHNode
+{
+	float min[3];
+	uint32_t rightOrFirst;	// Interior: index of the right child. Leaf: index of the first box.
+	float max[3];
+	uint32_t count;			// Interior: 0. Leaf: number of boxes.
+
+	bool is_leaf() const { return count != 0; }
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode must stay 32 bytes");
+
+// The deepest tree a query can walk. The builder falls back to median splits before reaching it.
+const int BVH_MAX_DEPTH = 64;
+
+// A built tree as plain pointers, for querying it wherever its arrays live: in a BoxBVH, or straight
+// out of a memory-mapped scene file (SceneFile.h). It owns nothing and never writes.
+struct BoxBVHView
+{
+	const BVHNode* nodes;
+	size_t nodeCount;
+	BoxArrays boxes;			// In leaf order.
+	const uint32_t* boxIds;		// The input index of each leaf box.
+	size_t boxCount;
+
+	// Calls report(boxId) for every box the sphere overlaps. No allocation, safe from many threads.
+	template <class Report>
+	void for_each_overlap(float cx, float cy, float cz, float radius, Report &&report) const;
+
+	// True as soon as one overlapping box is found.
+	bool any_overlap(float cx, float cy, float cz, float radius) const;
+};
+
+class BoxBVH
+{
+public:
+	static const int MAX_DEPTH = BVH_MAX_DEPTH;
+
+	struct BuildOptions
+	{
+		int maxLeafSize;	// Leaves hold at most this many boxes.
+		int minLeafSize;	// Ranges of this many boxes or fewer become leaves without trying a split.
+		int bins;			// Candidate split planes per axis for the SAH.
+		int threads;		// Threads used for the build; 0 means one per hardware thread.
+
+		BuildOptions() : maxLeafSize(4), minLeafSize(1), bins(12), threads(0) {}
+	};
+
+	BoxBVH() : treeDepth(0) {}
+
+	// Builds the tree over boxes [0, count). Box ids reported by queries are indices into this input.
+	void build(const BoxArrays &boxes, size_t count, const BuildOptions &options = BuildOptions());
+
+	// Calls report(boxId) for every box the sphere overlaps. No allocation, safe from many threads.
+	template <class Report>
+	void for_each_overlap(float cx, float cy, float cz, float radius, Report &&report) const;
+
+	// Writes up to capacity overlapping box ids to out, and returns how many overlap in total.
+	// If the result is larger than capacity, the rest were not written.
+	size_t query_sphere(float cx, float cy, float cz, float radius, uint32_t* out, size_t capacity) const;
+
+	// True as soon as one overlapping box is found.
+	bool any_overlap(float cx, float cy, float cz, float radius) const;
+
+	// Appends (sphere index, box id) for every overlapping pair.
+	void find_overlaps(const SphereArrays &spheres, size_t count, std::vector<CollisionPair> &overlaps) const;
+
+	const std::vector<BVHNode> &nodes() const { return tree; }
+
+	// Boxes in leaf order, and the input index of each.
+	const BoxSet &leaf_boxes() const { return boxes; }
+	const std::vector<uint32_t> &leaf_box_ids() const { return boxIds; }
+
+	size_t size() const { return boxIds.size(); }
+
+	// The tree's arrays as a view. It is only good until the next build().
+	BoxBVHView view() const;
+
+	int depth() const { return treeDepth; }
+
+	// Sum of node surface areas relative to the root's: the SAH cost of the tree. Lower is better.
+	float sah_cost() const;
+
+private:
+	std::vector<BVHNode> tree;
+	BoxSet boxes;
+	std::vector<uint32_t> boxIds;
+	int treeDepth;
+};
+
+template <class Report>
+void BoxBVHView::for_each_overlap(float cx, float cy, float cz, float radius, Report &&report) const
+{
+	if (nodeCount == 0)
+		return;
+
+	// Right children waiting to be visited. The tree is never deeper than MAX_DEPTH, so this can't overflow.
+	uint32_t stack[BVH_MAX_DEPTH];
+	int top = 0;
+	uint32_t i = 0;
+
+	const float* minX = boxes.minX; const float* minY = boxes.minY; const float* minZ = boxes.minZ;
+	const float* maxX = boxes.maxX; const float* maxY = boxes.maxY; const float* maxZ = boxes.maxZ;
+
+	for (;;)
+	{
+		const BVHNode &node = nodes[i];
+		if (sphere_aabb_overlap(cx, cy, cz, radius, node.min[0], node.min[1], node.min[2], node.max[0], node.max[1], node.max[2]))
+		{
+			if (!node.is_leaf())
+			{
+				stack[top++] = node.rightOrFirst;
+				i = i + 1;
+				continue;
+			}
+
+			for (uint32_t k = node.rightOrFirst; k < node.rightOrFirst + node.count; k++)
+			{
+				if (sphere_aabb_overlap(cx, cy, cz, radius, minX[k], minY[k], minZ[k], maxX[k], maxY[k], maxZ[k]))
+					report(boxIds[k]);
+			}
+		}
+
+		if (top == 0)
+			return;
+		i = stack[--top];
+	}
+}
+
+template <class Report>
+void BoxBVH::for_each_overlap(float cx, float cy, float cz, float radius, Report &&report) const
+{
+	view().for_each_overlap(cx, cy, cz, radius, report);
+}
+
+#endif // _BOX_BVH_H
@@ -0,0 +1,307 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: BoxCast.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Packet traversal of a BoxBVH for batches of ray and sphere casts. See BoxCast.h.
+*/
+
+#include "BoxCast.h"
+#include "SimdSupport.h"
+#include "SphereAABBBatch.h"
+
+namespace
+{
+	// One packet of casts, structure-of-arrays so the node test loads each field of all lanes at once.
+	template <int LANES>
+	struct Packet
+	{
+		float x[LANES], y[LANES], z[LANES], radius[LANES];
+		float dx[LANES], dy[LANES], dz[LANES];
+		float inverseX[LANES], inverseY[LANES], inverseZ[LANES];
+		float limit[LANES];		// Hits later than this don't matter. For First, the best time so far.
+		uint32_t box[LANES];	// First and Any: the hit so far.
+	};
+
+	struct CastBatch
+	{
+		const BoxBVHView* bvh;
+		SphereArrays starts;
+		MotionArrays motion;
+		size_t count;
+		CastMode mode;
+		CastHit* hits;
+		size_t capacity;
+	};
+
+	inline int lowest_bit(uint32_t mask)
+	{
+		int l = 0;
+		while (!(mask & (1u << l)))
+			l++;
+		return l;
+	}
+
+	// Casts [first, first + LANES) down the tree. NodeTest returns a bit for each lane that reaches the node
+	// (grown by the lane's radius) before the lane's limit. Adds to total the casts that hit (First, Any) or the hits (All).
+	template <int LANES, class NodeTest>
+	FORCE_INLINE void cast_packet(const CastBatch &batch, size_t first, size_t &total, NodeTest nodeTest)
+	{
+		const BoxBVHView &bvh = *batch.bvh;
+		const BoxArrays &b = bvh.boxes;
+		CastMode mode = batch.mode;
+		int lanes = batch.count - first < (size_t)LANES ? (int)(batch.count - first) : LANES;
+
+		// Lanes past the end of the batch copy the last cast and stay out of the mask.
+		Packet<LANES> p;
+		for (int l = 0; l < LANES; l++)
+		{
+			size_t i = first + (l < lanes ? l : lanes - 1);
+			p.x[l] = batch.starts.x[i]; p.y[l] = batch.starts.y[i]; p.z[l] = batch.starts.z[i];
+			p.radius[l] = batch.starts.radius ? batch.starts.radius[i] : 0.0f;
+			p.dx[l] = batch.motion.dx[i]; p.dy[l] = batch.motion.dy[i]; p.dz[l] = batch.motion.dz[i];
+			p.inverseX[l] = 1.0f / p.dx[l]; p.inverseY[l] = 1.0f / p.dy[l]; p.inverseZ[l] = 1.0f / p.dz[l];
+			p.limit[l] = 1.0f;
+			p.box[l] = CAST_NO_HIT;
+		}
+		uint32_t active = (uint32_t)((1ull << lanes) - 1);
+
+		if (bvh.nodeCount > 0)
+		{
+			struct Entry { uint32_t node; uint32_t mask; };
+			Entry stack[BVH_MAX_DEPTH];
+			int top = 0;
+			uint32_t i = 0;
+			uint32_t mask = active;
+
+			for (;;)
+			{
+				const BVHNode &node = bvh.nodes[i];
+				mask &= active;
+				mask = mask ? mask & nodeTest(p, node) : 0;
+				if (mask)
+				{
+					if (!node.is_leaf())
+					{
+						// Visit first the child whose center comes first along the motion of the lowest active lane.
+						uint32_t near = i + 1, far = node.rightOrFirst;
+						const BVHNode &left = bvh.nodes[near];
+						const BVHNode &right = bvh.nodes[far];
+						int l = lowest_bit(mask);
+						float along = (right.min[0] + right.max[0] - left.min[0] - left.max[0]) * p.dx[l]
+							+ (right.min[1] + right.max[1] - left.min[1] - left.max[1]) * p.dy[l]
+							+ (right.min[2] + right.max[2] - left.min[2] - left.max[2]) * p.dz[l];
+						if (along < 0.0f)
+						{
+							near = node.rightOrFirst;
+							far = i + 1;
+						}
+						stack[top++] = Entry{ far, mask };
+						i = near;
+						continue;
+					}
+
+					for (uint32_t k = node.rightOrFirst; k < node.rightOrFirst + node.count; k++)
+					{
+						uint32_t id = bvh.boxIds[k];
+						for (uint32_t m = mask & active; m; m &= m - 1)
+						{
+							int l = lowest_bit(m);
+							float t = sphere_aabb_sweep_time(p.x[l], p.y[l], p.z[l], p.radius[l], p.dx[l], p.dy[l], p.dz[l],
+								b.minX[k], b.minY[k], b.minZ[k], b.maxX[k], b.maxY[k], b.maxZ[k]);
+							if (!(t <= p.limit[l]))
+								continue;
+
+							if (mode == CastMode::All)
+							{
+								if (total < batch.capacity)
+									batch.hits[total] = CastHit{ (uint32_t)(first + l), id, t };
+								total++;
+							}
+							else if (mode == CastMode::Any)
+							{
+								p.limit[l] = t;
+								p.box[l] = id;
+								active &= ~(1u << l);
+							}
+							else if (t < p.limit[l] || id < p.box[l])
+							{
+								p.limit[l] = t;
+								p.box[l] = id;
+							}
+						}
+					}
+				}
+
+				if (top == 0 || active == 0)
+					break;
+				top--;
+				i = stack[top].node;
+				mask = stack[top].mask;
+			}
+		}
+
+		if (mode != CastMode::All)
+		{
+			for (int l = 0; l < lanes; l++)
+			{
+				bool hit = p.box[l] != CAST_NO_HIT;
+				batch.hits[first + l] = CastHit{ (uint32_t)(first + l), p.box[l], hit ? p.limit[l] : SWEEP_MISS };
+				total += hit;
+			}
+		}
+	}
+
+	template <int LANES>
+	struct NodeScalar
+	{
+		uint32_t operator()(const Packet<LANES> &p, const BVHNode &node) const
+		{
+			uint32_t mask = 0;
+			for (int l = 0; l < LANES; l++)
+			{
+				float r = p.radius[l];
+				float enter = 0.0f, leave = p.limit[l];
+				clip_slab(p.x[l], p.dx[l], p.inverseX[l], node.min[0] - r, node.max[0] + r, enter, leave);
+				clip_slab(p.y[l], p.dy[l], p.inverseY[l], node.min[1] - r, node.max[1] + r, enter, leave);
+				clip_slab(p.z[l], p.dz[l], p.inverseZ[l], node.min[2] - r, node.max[2] + r, enter, leave);
+				mask |= (uint32_t)(enter <= leave) << l;
+			}
+			return mask;
+		}
+	};
+
+	template <int LANES>
+	size_t cast_scalar(const CastBatch &batch)
+	{
+		size_t total = 0;
+		for (size_t first = 0; first < batch.count; first += LANES)
+			cast_packet<LANES>(batch, first, total, NodeScalar<LANES>());
+		return total;
+	}
+
+#if COLLISION_X86
+	// clip_slab on 4 lanes, the same operations in the same order: minps(a, b) is a < b ? a : b, and maxps(a, b) is a > b ? a : b.
+	struct NodeSse
+	{
+		SIMD_TARGET("sse4.2")
+		static void clip4(const float* c, const float* d, const float* inverse, const float* radius, float min, float max, __m128 &enter, __m128 &leave)
+		{
+			__m128 vc = _mm_loadu_ps(c), vd = _mm_loadu_ps(d), r = _mm_loadu_ps(radius);
+			__m128 lo = _mm_sub_ps(_mm_set1_ps(min), r);
+			__m128 hi = _mm_add_ps(_mm_set1_ps(max), r);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(lo, vc), _mm_loadu_ps(inverse));
+			__m128 t2 = _mm_mul_ps(_mm_sub_ps(hi, vc), _mm_loadu_ps(inverse));
+			__m128 near = _mm_min_ps(t1, t2);
+			__m128 far = _mm_max_ps(t2, t1);
+
+			__m128 parallel = _mm_cmpeq_ps(vd, _mm_setzero_ps());
+			__m128 within = _mm_and_ps(_mm_cmpge_ps(vc, lo), _mm_cmple_ps(vc, hi));
+			near = _mm_blendv_ps(near, _mm_blendv_ps(_mm_set1_ps(2.0f), _mm_setzero_ps(), within), parallel);
+			far = _mm_blendv_ps(far, _mm_blendv_ps(_mm_set1_ps(-1.0f), _mm_set1_ps(1.0f), within), parallel);
+
+			enter = _mm_max_ps(near, enter);
+			leave = _mm_min_ps(far, leave);
+		}
+
+		SIMD_TARGET("sse4.2")
+		static uint32_t test4(const Packet<CAST_PACKET_SIZE> &p, const BVHNode &node, int l)
+		{
+			__m128 enter = _mm_setzero_ps(), leave = _mm_loadu_ps(p.limit + l);
+			clip4(p.x + l, p.dx + l, p.inverseX + l, p.radius + l, node.min[0], node.max[0], enter, leave);
+			clip4(p.y + l, p.dy + l, p.inverseY + l, p.radius + l, node.min[1], node.max[1], enter, leave);
+			clip4(p.z + l, p.dz + l, p.inverseZ + l, p.radius + l, node.min[2], node.max[2], enter, leave);
+			return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(enter, leave));
+		}
+
+		SIMD_TARGET("sse4.2")
+		uint32_t operator()(const Packet<CAST_PACKET_SIZE> &p, const BVHNode &node) const
+		{
+			return test4(p, node, 0) | test4(p, node, 4) << 4;
+		}
+	};
+
+	SIMD_TARGET("sse4.2")
+	size_t cast_sse(const CastBatch &batch)
+	{
+		size_t total = 0;
+		for (size_t first = 0; first < batch.count; first += CAST_PACKET_SIZE)
+			cast_packet<CAST_PACKET_SIZE>(batch, first, total, NodeSse());
+		return total;
+	}
+
+	// The whole packet in one register. AVX-512 machines use this too: 8 lanes don't fill a wider one.
+	struct NodeAvx2
+	{
+		SIMD_TARGET("avx2")
+		static void clip8(const float* c, const float* d, const float* inverse, const float* radius, float min, float max, __m256 &enter, __m256 &leave)
+		{
+			__m256 vc = _mm256_loadu_ps(c), vd = _mm256_loadu_ps(d), r = _mm256_loadu_ps(radius);
+			__m256 lo = _mm256_sub_ps(_mm256_set1_ps(min), r);
+			__m256 hi = _mm256_add_ps(_mm256_set1_ps(max), r);
+			__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(lo, vc), _mm256_loadu_ps(inverse));
+			__m256 t2 = _mm256_mul_ps(_mm256_sub_ps(hi, vc), _mm256_loadu_ps(inverse));
+			__m256 near = _mm256_min_ps(t1, t2);
+			__m256 far = _mm256_max_ps(t2, t1);
+
+			__m256 parallel = _mm256_cmp_ps(vd, _mm256_setzero_ps(), _CMP_EQ_OQ);
+			__m256 within = _mm256_and_ps(_mm256_cmp_ps(vc, lo, _CMP_GE_OQ), _mm256_cmp_ps(vc, hi, _CMP_LE_OQ));
+			near = _mm256_blendv_ps(near, _mm256_blendv_ps(_mm256_set1_ps(2.0f), _mm256_setzero_ps(), within), parallel);
+			far = _mm256_blendv_ps(far, _mm256_blendv_ps(_mm256_set1_ps(-1.0f), _mm256_set1_ps(1.0f), within), parallel);
+
+			enter = _mm256_max_ps(near, enter);
+			leave = _mm256_min_ps(far, leave);
+		}
+
+		SIMD_TARGET("avx2")
+		uint32_t operator()(const Packet<CAST_PACKET_SIZE> &p, const BVHNode &node) const
+		{
+			__m256 enter = _mm256_setzero_ps(), leave = _mm256_loadu_ps(p.limit);
+			clip8(p.x, p.dx, p.inverseX, p.radius, node.min[0], node.max[0], enter, leave);
+			clip8(p.y, p.dy, p.inverseY, p.radius, node.min[1], node.max[1], enter, leave);
+			clip8(p.z, p.dz, p.inverseZ, p.radius, node.min[2], node.max[2], enter, leave);
+			return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(enter, leave, _CMP_LE_OQ));
+		}
+	};
+
+	SIMD_TARGET("avx2")
+	size_t cast_avx2(const CastBatch &batch)
+	{
+		size_t total = 0;
+		for (size_t first = 0; first < batch.count; first += CAST_PACKET_SIZE)
+			cast_packet<CAST_PACKET_SIZE>(batch, first, total, NodeAvx2());
+		return total;
+	}
+#endif // COLLISION_X86
+}
+
+size_t cast_spheres(const BoxBVHView &bvh, const SphereArrays &starts, const MotionArrays &motion, size_t count,
+	CastMode mode, CastHit* hits, size_t capacity, CastTraversal traversal)
+{
+	CastBatch batch = { &bvh, starts, motion, count, mode, hits, capacity };
+	if (traversal == CastTraversal::Single)
+		return cast_scalar<1>(batch);
+
+	switch (active_simd_level())
+	{
+#if COLLISION_X86
+	case SimdLevel::AVX512:
+	case SimdLevel::AVX2:	return cast_avx2(batch);
+	case SimdLevel::SSE42:	return cast_sse(batch);
+#endif
+	default:				return cast_scalar<CAST_PACKET_SIZE>(batch);
+	}
+}
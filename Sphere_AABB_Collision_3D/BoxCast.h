@@ -0,0 +1,84 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: BoxCast.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Ray casts and sphere casts against the boxes of a BoxBVH, many at a time.
+
+is_colliding() asks whether a sphere touches a box where it stands. Gameplay code mostly asks something
+else: what does this line of sight, this bullet, this character moving this far hit first? Those are
+casts: a ray, or a sphere swept along a line (SphereAABBSweep.h), from a start point by a motion vector,
+with hits reported as the fraction of the motion, 0 to 1. A ray is a sphere of radius 0.
+
+A batch of casts goes down the tree in packets of CAST_PACKET_SIZE. At each node the whole packet is
+tested at once (a slab test per cast against the node grown by the cast's radius, all 8 in one AVX2
+register or two SSE4.2 ones, as chosen by SphereAABBBatch.h), and the packet goes on with the casts that
+hit it. Casts that start near each other and point the same way (a fan of sight lines, a volley of
+bullets) visit mostly the same nodes, so each node is loaded once per packet instead of once per cast.
+Put such casts next to each other in the batch. At each split, the child whose center comes first along
+the motion of the packet's lowest active cast is visited first, so first hit queries find a close hit
+early and skip everything behind it.
+
+Modes:
+	First	each cast's earliest hit (ties go to the lower box id)
+	Any		some hit of each cast, as soon as one is found. The cheapest: for "is anything in the way?"
+	All		every hit of every cast, in no particular order
+Results go into the caller's array, nothing is allocated, and the tree is only read: split a batch
+between threads freely. Leaf boxes are tested with sphere_aabb_sweep_time, so the times are exact.
+*/
+
+#ifndef _BOX_CAST_H
+#define _BOX_CAST_H
+
+#include "BoxBVH.h"
+#include "CollisionTypes.h"
+#include "SphereAABBSweep.h"
+
+// Casts per packet. 8 floats fill one AVX register.
+const int CAST_PACKET_SIZE = 8;
+
+// The box of a CastHit for a cast that hit nothing.
+const uint32_t CAST_NO_HIT = 0xFFFFFFFFu;
+
+enum class CastMode
+{
+	First,
+	Any,
+	All
+};
+
+// How casts go down the tree.
+enum class CastTraversal
+{
+	Packets,	// CAST_PACKET_SIZE casts at a time.
+	Single		// Every cast on its own (for comparison).
+};
+
+struct CastHit
+{
+	uint32_t cast;		// Index of the cast in the batch.
+	uint32_t box;		// Box id, or CAST_NO_HIT.
+	float time;			// Fraction of the motion at first touch, or SWEEP_MISS.
+};
+
+// Casts spheres from starts (centers and radii; a null radius array means every cast is a ray) along
+// motion, against the tree's boxes.
+// First and Any: hits must hold count entries; hits[i] is cast i's hit, or CAST_NO_HIT. Returns how many casts hit.
+// All: up to capacity hits are written; returns how many there are in total. If that is more than capacity, the rest were not written.
+size_t cast_spheres(const BoxBVHView &bvh, const SphereArrays &starts, const MotionArrays &motion, size_t count,
+	CastMode mode, CastHit* hits, size_t capacity, CastTraversal traversal = CastTraversal::Packets);
+
+#endif // _BOX_CAST_H
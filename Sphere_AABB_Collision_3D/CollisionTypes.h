@@ -0,0 +1,181 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: CollisionTypes.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The plain data types shared by all of the collision code.
+The demo in main.cpp keeps one Sphere and one Cuboid, each carrying its own MVP and buffer handle.
+That is fine for drawing, but when we want to test millions of pairs we want the numbers packed
+tightly together, one array per component (structure-of-arrays), so the CPU can load 4, 8 or 16
+of them with a single instruction.
+Nothing in here depends on OpenGL or glm, so the collision code can be built on machines without a GPU.
+*/
+
+#ifndef _COLLISION_TYPES_H
+#define _COLLISION_TYPES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// An axis aligned box stored by its two extreme corners.
+// A Cuboid (origin, breadth, length, depth) becomes min = origin - half extents, max = origin + half extents.
+struct AABB
+{
+	float min[3];
+	float max[3];
+};
+
+// Read-only view of a set of spheres stored as structure-of-arrays.
+// Sphere i is (x[i], y[i], z[i]) with radius radius[i].
+struct SphereArrays
+{
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* radius;
+};
+
+// Read-only view of a set of boxes stored as structure-of-arrays.
+// Box i spans [minX[i], maxX[i]] x [minY[i], maxY[i]] x [minZ[i], maxZ[i]].
+struct BoxArrays
+{
+	const float* minX;
+	const float* minY;
+	const float* minZ;
+	const float* maxX;
+	const float* maxY;
+	const float* maxZ;
+};
+
+// Owning storage for spheres, one std::vector per component.
+struct SphereSet
+{
+	std::vector<float> x, y, z, radius;
+
+	size_t size() const { return x.size(); }
+
+	void reserve(size_t n)
+	{
+		x.reserve(n); y.reserve(n); z.reserve(n); radius.reserve(n);
+	}
+
+	void clear()
+	{
+		x.clear(); y.clear(); z.clear(); radius.clear();
+	}
+
+	void add(float cx, float cy, float cz, float r)
+	{
+		x.push_back(cx); y.push_back(cy); z.push_back(cz); radius.push_back(r);
+	}
+
+	SphereArrays arrays() const
+	{
+		SphereArrays a = { x.data(), y.data(), z.data(), radius.data() };
+		return a;
+	}
+};
+
+// Owning storage for boxes, one std::vector per component.
+struct BoxSet
+{
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+	size_t size() const { return minX.size(); }
+
+	void reserve(size_t n)
+	{
+		minX.reserve(n); minY.reserve(n); minZ.reserve(n);
+		maxX.reserve(n); maxY.reserve(n); maxZ.reserve(n);
+	}
+
+	void clear()
+	{
+		minX.clear(); minY.clear(); minZ.clear();
+		maxX.clear(); maxY.clear(); maxZ.clear();
+	}
+
+	void add(const AABB &b)
+	{
+		minX.push_back(b.min[0]); minY.push_back(b.min[1]); minZ.push_back(b.min[2]);
+		maxX.push_back(b.max[0]); maxY.push_back(b.max[1]); maxZ.push_back(b.max[2]);
+	}
+
+	AABB get(size_t i) const
+	{
+		AABB b = { { minX[i], minY[i], minZ[i] }, { maxX[i], maxY[i], maxZ[i] } };
+		return b;
+	}
+
+	BoxArrays arrays() const
+	{
+		BoxArrays a = { minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data() };
+		return a;
+	}
+};
+
+// Builds the AABB of a box given the same way the demo's Cuboid is: a center and full extents along x, y and z.
+inline AABB make_aabb(float cx, float cy, float cz, float breadth, float length, float depth)
+{
+	AABB b;
+	b.min[0] = cx - (breadth / 2.0f);
+	b.min[1] = cy - (length / 2.0f);
+	b.min[2] = cz - (depth / 2.0f);
+	b.max[0] = cx + (breadth / 2.0f);
+	b.max[1] = cy + (length / 2.0f);
+	b.max[2] = cz + (depth / 2.0f);
+	return b;
+}
+
+// A sphere/box pair found by a broadphase: indices into the sphere set and the box set.
+struct CollisionPair
+{
+	uint32_t sphere;
+	uint32_t box;
+};
+
+inline bool operator==(const CollisionPair &a, const CollisionPair &b)
+{
+	return a.sphere == b.sphere && a.box == b.box;
+}
+
+inline bool operator<(const CollisionPair &a, const CollisionPair &b)
+{
+	return a.sphere < b.sphere || (a.sphere == b.sphere && a.box < b.box);
+}
+
+// A sphere and a box that started (begin = true) or stopped (begin = false) touching in a frame.
+struct CollisionEvent
+{
+	uint32_t frame;
+	CollisionPair pair;
+	bool begin;
+};
+
+// Number of 64 bit words needed to hold one bit per pair.
+inline size_t hit_mask_words(size_t count)
+{
+	return (count + 63) / 64;
+}
+
+// Reads bit i of a hit mask.
+inline bool hit_mask_test(const uint64_t* hits, size_t i)
+{
+	return ((hits[i >> 6] >> (i & 63)) & 1u) != 0;
+}
+
+#endif // _COLLISION_TYPES_H
@@ -0,0 +1,127 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: DrawInstances.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Filling the draw instances, and their level of detail grouping. See DrawInstances.h.
+*/
+
+#include "DrawInstances.h"
+
+void multiply_matrix(const float* a, const float* b, float* out)
+{
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			out[column * 4 + row] = a[row] * b[column * 4] + a[4 + row] * b[column * 4 + 1] +
+				a[8 + row] * b[column * 4 + 2] + a[12 + row] * b[column * 4 + 3];
+		}
+	}
+}
+
+static void set_instance(float x, float y, float z, float sx, float sy, float sz, bool hit, DrawInstance &instance)
+{
+	instance.position[0] = x;
+	instance.position[1] = y;
+	instance.position[2] = z;
+	instance.blue = hit ? 1.0f : 0.0f;
+	instance.scale[0] = sx;
+	instance.scale[1] = sy;
+	instance.scale[2] = sz;
+	instance.padding = 0.0f;
+}
+
+// Index maps the i-th instance to its object: i itself, or visible[i].
+struct AllObjects
+{
+	size_t operator()(size_t i) const { return i; }
+};
+
+struct ListedObjects
+{
+	const uint32_t* visible;
+	size_t operator()(size_t i) const { return visible[i]; }
+};
+
+template <class Index>
+static void build_spheres(const float* PV, float pixelScale, const SphereArrays &spheres, Index index, size_t count, const uint8_t* hits,
+	SphereLods &groups, DrawInstance* out)
+{
+	// Counting sort by level: count each level, turn the counts into start positions, then place each sphere.
+	std::vector<uint8_t> &lods = groups.lods;
+	lods.resize(count);
+
+	size_t counts[SPHERE_LOD_COUNT] = {};
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t j = index(i);
+		// w of the center in clip space is its distance in front of the camera.
+		float w = PV[3] * spheres.x[j] + PV[7] * spheres.y[j] + PV[11] * spheres.z[j] + PV[15];
+		if (w < 0.01f)
+			w = 0.01f;
+		lods[i] = (uint8_t)sphere_lod_for_size(spheres.radius[j] * pixelScale / w);
+		counts[lods[i]]++;
+	}
+
+	groups.first[0] = 0;
+	for (int l = 0; l < SPHERE_LOD_COUNT; l++)
+		groups.first[l + 1] = groups.first[l] + counts[l];
+
+	size_t next[SPHERE_LOD_COUNT];
+	for (int l = 0; l < SPHERE_LOD_COUNT; l++)
+		next[l] = groups.first[l];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t j = index(i);
+		float r = spheres.radius[j];
+		set_instance(spheres.x[j], spheres.y[j], spheres.z[j], r, r, r, hits && hits[j], out[next[lods[i]]++]);
+	}
+}
+
+template <class Index>
+static void build_boxes(const BoxArrays &boxes, Index index, size_t count, const uint8_t* hits, DrawInstance* out)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t j = index(i);
+		set_instance((boxes.minX[j] + boxes.maxX[j]) * 0.5f, (boxes.minY[j] + boxes.maxY[j]) * 0.5f, (boxes.minZ[j] + boxes.maxZ[j]) * 0.5f,
+			boxes.maxX[j] - boxes.minX[j], boxes.maxY[j] - boxes.minY[j], boxes.maxZ[j] - boxes.minZ[j], hits && hits[j], out[i]);
+	}
+}
+
+void build_sphere_instances(const float* PV, float pixelScale, const SphereArrays &spheres, size_t count, const uint8_t* hits,
+	SphereLods &groups, DrawInstance* out)
+{
+	build_spheres(PV, pixelScale, spheres, AllObjects(), count, hits, groups, out);
+}
+
+void build_sphere_instances(const float* PV, float pixelScale, const SphereArrays &spheres, const uint32_t* visible, size_t count,
+	const uint8_t* hits, SphereLods &groups, DrawInstance* out)
+{
+	build_spheres(PV, pixelScale, spheres, ListedObjects{ visible }, count, hits, groups, out);
+}
+
+void build_box_instances(const BoxArrays &boxes, size_t count, const uint8_t* hits, DrawInstance* out)
+{
+	build_boxes(boxes, AllObjects(), count, hits, out);
+}
+
+void build_box_instances(const BoxArrays &boxes, const uint32_t* visible, size_t count, const uint8_t* hits, DrawInstance* out)
+{
+	build_boxes(boxes, ListedObjects{ visible }, count, hits, out);
+}
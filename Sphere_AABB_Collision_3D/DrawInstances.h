@@ -0,0 +1,87 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: DrawInstances.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Per-instance data for drawing many spheres and boxes with one draw call per mesh.
+
+renderScene() used to draw each object on its own: set the MVP uniform, set the "blue" uniform, draw.
+Every one of those calls costs driver time, so a few thousand objects would take longer to submit than
+to draw. With instancing, the position, size and collision flag of every object go into one buffer,
+VertexShader.glsl reads them as vertex attributes that advance once per instance (glVertexAttribDivisor),
+and the whole set is drawn with glDrawElementsInstanced / glDrawArraysInstanced.
+
+An instance is only where the object is and how big: 32 bytes. The shader scales and moves the mesh
+and multiplies by the one PV uniform, so the CPU doesn't build a matrix per object, and the instances
+can be written straight into mapped GPU memory (InstanceRing.h) without a copy.
+
+Spheres are grouped by level of detail (SphereMesh.h), so each level is one draw of its own mesh.
+Boxes are drawn from a unit cube scaled to each box's size.
+Matrices are column major, like glm::mat4 and what glUniformMatrix4fv expects with transpose off.
+Nothing here calls OpenGL; the demo and the offscreen check (tools/RenderCheck.cpp) both use it.
+*/
+
+#ifndef _DRAW_INSTANCES_H
+#define _DRAW_INSTANCES_H
+
+#include "CollisionTypes.h"
+#include "SphereMesh.h"
+
+// One object's attributes in the instance buffer. Only written, never read back, since it may be write-combined GPU memory.
+struct DrawInstance
+{
+	float position[3];		// Center, in world space.
+	float blue;				// Added to the vertex colors' blue, like the "blue" uniform was: 1 if the object collides.
+	float scale[3];			// The radius on all three axes for a sphere; breadth, length, depth for a box.
+	float padding;
+};
+
+static_assert(sizeof(DrawInstance) == 32, "DrawInstance must stay 32 bytes");
+
+// Attribute locations in VertexShader.glsl, in this order, so the instance attributes are locations
+// INSTANCE_POSITION_LOCATION to INSTANCE_BLUE_LOCATION.
+const int INSTANCE_POSITION_LOCATION = 2;
+const int INSTANCE_SCALE_LOCATION = 3;
+const int INSTANCE_BLUE_LOCATION = 4;
+
+// Where each level of detail's spheres are in the instances. Level l is instances [first[l], first[l + 1]).
+struct SphereLods
+{
+	size_t first[SPHERE_LOD_COUNT + 1];
+	std::vector<uint8_t> lods;		// Each input sphere's level, kept so refilling doesn't allocate.
+};
+
+// out = a * b, 4 x 4 column major.
+void multiply_matrix(const float* a, const float* b, float* out);
+
+// Writes spheres [0, count) to out[0, count), sorted by level of detail, and where each level starts to groups.
+// pixelScale turns radius / distance into pixels on screen: proj[1][1] * (viewport height / 2).
+// The distance is the w that PV gives the center, so PV must be a perspective projection times a view.
+// hits may be null (no sphere is marked).
+void build_sphere_instances(const float* PV, float pixelScale, const SphereArrays &spheres, size_t count, const uint8_t* hits,
+	SphereLods &groups, DrawInstance* out);
+
+// Writes boxes [0, count) to out[0, count): a unit cube around the origin, scaled to each box and moved to its center.
+// hits may be null.
+void build_box_instances(const BoxArrays &boxes, size_t count, const uint8_t* hits, DrawInstance* out);
+
+// The same, for only the spheres (boxes) listed in visible[0, count), e.g. what FrustumCuller kept.
+// hits is still indexed by sphere (box).
+void build_sphere_instances(const float* PV, float pixelScale, const SphereArrays &spheres, const uint32_t* visible, size_t count,
+	const uint8_t* hits, SphereLods &groups, DrawInstance* out);
+void build_box_instances(const BoxArrays &boxes, const uint32_t* visible, size_t count, const uint8_t* hits, DrawInstance* out);
+
+#endif // _DRAW_INSTANCES_H
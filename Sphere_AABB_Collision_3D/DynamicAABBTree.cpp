@@ -0,0 +1,387 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: DynamicAABBTree.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Insert, remove and balancing rotations of the dynamic AABB tree. See DynamicAABBTree.h.
+
+A new leaf walks down from the root towards the child whose box grows the least by taking it in,
+and stops as soon as making a new parent right here is cheaper than going deeper. Costs are surface areas,
+as in the SAH used by BoxBVH.cpp.
+*/
+
+#include "DynamicAABBTree.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#pragma region Box helpers
+static AABB combine(const AABB &a, const AABB &b)
+{
+	AABB c;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		c.min[axis] = std::min(a.min[axis], b.min[axis]);
+		c.max[axis] = std::max(a.max[axis], b.max[axis]);
+	}
+	return c;
+}
+
+static float surface_area(const AABB &b)
+{
+	float dx = b.max[0] - b.min[0], dy = b.max[1] - b.min[1], dz = b.max[2] - b.min[2];
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static bool contains(const AABB &outer, const AABB &inner)
+{
+	return outer.min[0] <= inner.min[0] && outer.min[1] <= inner.min[1] && outer.min[2] <= inner.min[2] &&
+		inner.max[0] <= outer.max[0] && inner.max[1] <= outer.max[1] && inner.max[2] <= outer.max[2];
+}
+#pragma endregion
+
+DynamicAABBTree::DynamicAABBTree(float margin)
+	: root(NULL_NODE), freeList(NULL_NODE), proxyCount(0), fatMargin(margin),
+	moveCount(0), reinsertCount(0), rotationCount(0)
+{
+}
+
+#pragma region Node pool
+uint32_t DynamicAABBTree::allocate_node()
+{
+	uint32_t index;
+	if (freeList != NULL_NODE)
+	{
+		index = freeList;
+		freeList = nodes[index].parent;
+	}
+	else
+	{
+		index = (uint32_t)nodes.size();
+		nodes.push_back(Node());
+	}
+
+	Node &node = nodes[index];
+	node.parent = NULL_NODE;
+	node.child1 = NULL_NODE;
+	node.child2 = NULL_NODE;
+	node.height = 0;
+	node.userId = 0;
+	return index;
+}
+
+void DynamicAABBTree::free_node(uint32_t index)
+{
+	nodes[index].parent = freeList;
+	nodes[index].height = -1;
+	freeList = index;
+}
+
+void DynamicAABBTree::clear()
+{
+	nodes.clear();
+	root = NULL_NODE;
+	freeList = NULL_NODE;
+	proxyCount = 0;
+	reset_counters();
+}
+#pragma endregion
+
+#pragma region Tree changes
+void DynamicAABBTree::refit(uint32_t index)
+{
+	Node &node = nodes[index];
+	const Node &a = nodes[node.child1];
+	const Node &b = nodes[node.child2];
+	node.height = 1 + std::max(a.height, b.height);
+	node.box = combine(a.box, b.box);
+}
+
+void DynamicAABBTree::insert_leaf(uint32_t leaf)
+{
+	if (root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[root].parent = NULL_NODE;
+		return;
+	}
+
+	// Find the best sibling for the new leaf.
+	AABB leafBox = nodes[leaf].box;
+	uint32_t index = root;
+	while (!nodes[index].is_leaf())
+	{
+		const Node &node = nodes[index];
+		float area = surface_area(node.box);
+		float combinedArea = surface_area(combine(node.box, leafBox));
+
+		// Cost of making a new parent for this node and the leaf.
+		float cost = 2.0f * combinedArea;
+
+		// Every node below here grows by at least this much if the leaf goes further down.
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCost[2];
+		uint32_t children[2] = { node.child1, node.child2 };
+		for (int c = 0; c < 2; c++)
+		{
+			const Node &child = nodes[children[c]];
+			float grown = surface_area(combine(child.box, leafBox));
+			childCost[c] = (child.is_leaf() ? grown : grown - surface_area(child.box)) + inheritanceCost;
+		}
+
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+
+		index = childCost[0] < childCost[1] ? node.child1 : node.child2;
+	}
+	uint32_t sibling = index;
+
+	// Put a new parent above the sibling and the leaf.
+	uint32_t oldParent = nodes[sibling].parent;
+	uint32_t newParent = allocate_node();
+	Node &parent = nodes[newParent];
+	parent.parent = oldParent;
+	parent.box = combine(leafBox, nodes[sibling].box);
+	parent.height = nodes[sibling].height + 1;
+	parent.child1 = sibling;
+	parent.child2 = leaf;
+
+	if (oldParent != NULL_NODE)
+	{
+		if (nodes[oldParent].child1 == sibling)
+			nodes[oldParent].child1 = newParent;
+		else
+			nodes[oldParent].child2 = newParent;
+	}
+	else
+		root = newParent;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	// Walk back up, balancing and fixing heights and boxes.
+	index = nodes[leaf].parent;
+	while (index != NULL_NODE)
+	{
+		index = balance(index);
+		refit(index);
+		index = nodes[index].parent;
+	}
+}
+
+void DynamicAABBTree::remove_leaf(uint32_t leaf)
+{
+	if (leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grandParent = nodes[parent].parent;
+	uint32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	// The sibling takes the parent's place.
+	if (grandParent != NULL_NODE)
+	{
+		if (nodes[grandParent].child1 == parent)
+			nodes[grandParent].child1 = sibling;
+		else
+			nodes[grandParent].child2 = sibling;
+		nodes[sibling].parent = grandParent;
+		free_node(parent);
+
+		uint32_t index = grandParent;
+		while (index != NULL_NODE)
+		{
+			index = balance(index);
+			refit(index);
+			index = nodes[index].parent;
+		}
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		free_node(parent);
+	}
+}
+
+// If one child of node a is more than one level deeper than the other, the deeper child (c) takes a's place,
+// a takes c's shallower child, and c keeps its deeper one. Returns the node now at a's position.
+/*
+        a                c
+       / \              / \
+      b   c     ->     a   f
+         / \          / \
+        f   g        b   g
+*/
+uint32_t DynamicAABBTree::balance(uint32_t ia)
+{
+	// a's own height may be stale here (it is refit after balancing), so only the children's are used.
+	Node &a = nodes[ia];
+	if (a.is_leaf())
+		return ia;
+
+	uint32_t ib = a.child1;
+	uint32_t ic = a.child2;
+	int difference = nodes[ic].height - nodes[ib].height;
+	if (difference >= -1 && difference <= 1)
+		return ia;
+
+	// Name the deeper child c and the other one b; deeperIsSecond says which slot of a held c.
+	bool deeperIsSecond = difference > 1;
+	if (!deeperIsSecond)
+		std::swap(ib, ic);
+	Node &b = nodes[ib];
+	Node &c = nodes[ic];
+
+	// c's deeper child (f) stays with c, the other one (g) moves to a.
+	uint32_t iff = c.child1;
+	uint32_t ig = c.child2;
+	if (nodes[iff].height < nodes[ig].height)
+		std::swap(iff, ig);
+
+	// c takes a's place under a's parent.
+	c.parent = a.parent;
+	if (c.parent != NULL_NODE)
+	{
+		if (nodes[c.parent].child1 == ia)
+			nodes[c.parent].child1 = ic;
+		else
+			nodes[c.parent].child2 = ic;
+	}
+	else
+		root = ic;
+
+	c.child1 = ia;
+	c.child2 = iff;
+	a.parent = ic;
+
+	if (deeperIsSecond)
+		a.child2 = ig;
+	else
+		a.child1 = ig;
+	nodes[ig].parent = ia;
+
+	a.box = combine(b.box, nodes[ig].box);
+	a.height = 1 + std::max(b.height, nodes[ig].height);
+	c.box = combine(a.box, nodes[iff].box);
+	c.height = 1 + std::max(a.height, nodes[iff].height);
+
+	rotationCount++;
+	return ic;
+}
+#pragma endregion
+
+#pragma region Proxies
+DynamicAABBTree::ProxyId DynamicAABBTree::create_proxy(const AABB &box, uint32_t userId)
+{
+	uint32_t proxy = allocate_node();
+	Node &node = nodes[proxy];
+	node.tight = box;
+	node.box = box;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		node.box.min[axis] -= fatMargin;
+		node.box.max[axis] += fatMargin;
+	}
+	node.userId = userId;
+
+	insert_leaf(proxy);
+	proxyCount++;
+	return proxy;
+}
+
+void DynamicAABBTree::destroy_proxy(ProxyId proxy)
+{
+	remove_leaf(proxy);
+	free_node(proxy);
+	proxyCount--;
+}
+
+bool DynamicAABBTree::move_proxy(ProxyId proxy, const AABB &box, const float* displacement)
+{
+	moveCount++;
+	nodes[proxy].tight = box;
+	if (contains(nodes[proxy].box, box))
+		return false;
+
+	remove_leaf(proxy);
+
+	AABB fat = box;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		fat.min[axis] -= fatMargin;
+		fat.max[axis] += fatMargin;
+
+		// Stretch ahead by two frames' worth of motion.
+		if (displacement)
+		{
+			float d = 2.0f * displacement[axis];
+			if (d < 0.0f)
+				fat.min[axis] += d;
+			else
+				fat.max[axis] += d;
+		}
+	}
+	nodes[proxy].box = fat;
+
+	insert_leaf(proxy);
+	reinsertCount++;
+	return true;
+}
+#pragma endregion
+
+DynamicTreeStats DynamicAABBTree::stats() const
+{
+	DynamicTreeStats s;
+	s.proxies = proxyCount;
+	s.nodes = 0;
+	s.moves = moveCount;
+	s.reinsertions = reinsertCount;
+	s.rotations = rotationCount;
+	s.reinsertionRate = moveCount ? (float)reinsertCount / (float)moveCount : 0.0f;
+	s.height = height();
+	s.maxImbalance = 0;
+	s.areaRatio = 0.0f;
+	s.fatness = 0.0f;
+
+	double interiorArea = 0.0, fatArea = 0.0, tightArea = 0.0;
+	for (const Node &node : nodes)
+	{
+		if (node.height < 0)
+			continue;
+
+		s.nodes++;
+		if (node.is_leaf())
+		{
+			fatArea += surface_area(node.box);
+			tightArea += surface_area(node.tight);
+		}
+		else
+		{
+			interiorArea += surface_area(node.box);
+			s.maxImbalance = std::max(s.maxImbalance, std::abs(nodes[node.child1].height - nodes[node.child2].height));
+		}
+	}
+
+	if (root != NULL_NODE && surface_area(nodes[root].box) > 0.0f)
+		s.areaRatio = (float)(interiorArea / surface_area(nodes[root].box));
+	if (tightArea > 0.0)
+		s.fatness = (float)(fatArea / tightArea);
+	return s;
+}
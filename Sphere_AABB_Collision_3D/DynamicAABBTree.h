@@ -0,0 +1,183 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: DynamicAABBTree.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A bounding volume tree for objects that move, like the demo's sphere that update() moves every frame.
+BoxBVH.h is built once for boxes that stay put; rebuilding it every frame would cost more than it saves.
+This tree is changed one object at a time instead.
+
+Each object (proxy) sits in a leaf whose box is the object's box grown by a margin on every side (the "fat" box).
+When the object moves but stays inside its fat box, nothing in the tree changes. Only when it leaves it
+is the leaf taken out and inserted again, at the place where it grows the tree's surface area the least.
+After every insert or remove the nodes on the way up are rotated when one side gets more than one level
+deeper than the other, so the tree stays close to balanced whatever order objects come and go in.
+
+A bigger margin means fewer reinsertions but looser boxes, so queries find more candidates.
+stats() reports both sides (reinsertion rate, and how much area the tree covers) to tune it.
+
+Nodes live in one array and point at each other by index; freed nodes are chained into a free list and reused.
+Queries test the fat boxes, so they report candidates. Run the exact test on them.
+*/
+
+#ifndef _DYNAMIC_AABB_TREE_H
+#define _DYNAMIC_AABB_TREE_H
+
+#include "CollisionTypes.h"
+#include "SphereAABBBatch.h"
+
+struct DynamicTreeStats
+{
+	size_t proxies;			// Objects in the tree.
+	size_t nodes;			// Nodes in use (2 x proxies - 1).
+	size_t moves;			// move_proxy calls since reset_counters.
+	size_t reinsertions;	// Moves that left the fat box and reinserted the leaf.
+	size_t rotations;		// Balancing rotations since reset_counters.
+	float reinsertionRate;	// reinsertions / moves.
+	int height;				// Levels below the root. A perfectly balanced tree has about log2(proxies).
+	int maxImbalance;		// Largest height difference between two siblings. Rotations keep it small.
+	float areaRatio;		// Sum of the interior nodes' surface areas over the root's: the expected number of
+							// interior nodes a query visits. Lower is better.
+	float fatness;			// Sum of the fat leaf areas over the sum of the tight areas: the price of the margin.
+};
+
+class DynamicAABBTree
+{
+public:
+	typedef uint32_t ProxyId;
+
+	static const uint32_t NULL_NODE = 0xFFFFFFFFu;
+
+	// The deepest tree a query can walk. Balancing keeps the height within a few levels of log2(proxies), far below this.
+	static const int MAX_QUERY_STACK = 256;
+
+	explicit DynamicAABBTree(float margin = 0.1f);
+
+	// userId is what queries report: typically the index into your sphere or box arrays.
+	ProxyId create_proxy(const AABB &box, uint32_t userId);
+	void destroy_proxy(ProxyId proxy);
+
+	// Updates an object's box. Returns true if it left its fat box and was reinserted.
+	// With a displacement (how far the object moved this frame), the new fat box is stretched
+	// that far ahead, so steadily moving objects are reinserted less often.
+	bool move_proxy(ProxyId proxy, const AABB &box, const float* displacement = nullptr);
+
+	const AABB &fat_aabb(ProxyId proxy) const { return nodes[proxy].box; }
+	uint32_t user_id(ProxyId proxy) const { return nodes[proxy].userId; }
+
+	// Calls report(userId) for every proxy whose fat box overlaps the box.
+	template <class Report>
+	void query_aabb(const AABB &box, Report &&report) const;
+
+	// Calls report(userId) for every proxy whose fat box the sphere touches.
+	template <class Report>
+	void query_sphere(float cx, float cy, float cz, float radius, Report &&report) const;
+
+	void clear();
+
+	size_t size() const { return proxyCount; }
+	int height() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+	float margin() const { return fatMargin; }
+
+	// Walks the whole tree, so call it when tuning, not every frame.
+	DynamicTreeStats stats() const;
+	void reset_counters() { moveCount = 0; reinsertCount = 0; rotationCount = 0; }
+
+private:
+	struct Node
+	{
+		AABB box;			// Leaf: the fat box. Interior: the box around both children.
+		AABB tight;			// Leaf: the box the object last reported (only used by stats).
+		uint32_t parent;	// In the free list: the next free node.
+		uint32_t child1, child2;
+		int height;			// Leaf: 0. Free: -1.
+		uint32_t userId;
+
+		bool is_leaf() const { return child1 == NULL_NODE; }
+	};
+
+	uint32_t allocate_node();
+	void free_node(uint32_t index);
+	void insert_leaf(uint32_t leaf);
+	void remove_leaf(uint32_t leaf);
+	uint32_t balance(uint32_t index);
+	void refit(uint32_t index);
+
+	std::vector<Node> nodes;
+	uint32_t root;
+	uint32_t freeList;
+	size_t proxyCount;
+	float fatMargin;
+
+	size_t moveCount, reinsertCount, rotationCount;
+};
+
+template <class Report>
+void DynamicAABBTree::query_aabb(const AABB &box, Report &&report) const
+{
+	if (root == NULL_NODE)
+		return;
+
+	uint32_t stack[MAX_QUERY_STACK];
+	int top = 0;
+	stack[top++] = root;
+
+	while (top > 0)
+	{
+		const Node &node = nodes[stack[--top]];
+		const AABB &b = node.box;
+		if (b.min[0] > box.max[0] || b.max[0] < box.min[0] ||
+			b.min[1] > box.max[1] || b.max[1] < box.min[1] ||
+			b.min[2] > box.max[2] || b.max[2] < box.min[2])
+			continue;
+
+		if (node.is_leaf())
+			report(node.userId);
+		else
+		{
+			stack[top++] = node.child2;
+			stack[top++] = node.child1;
+		}
+	}
+}
+
+template <class Report>
+void DynamicAABBTree::query_sphere(float cx, float cy, float cz, float radius, Report &&report) const
+{
+	if (root == NULL_NODE)
+		return;
+
+	uint32_t stack[MAX_QUERY_STACK];
+	int top = 0;
+	stack[top++] = root;
+
+	while (top > 0)
+	{
+		const Node &node = nodes[stack[--top]];
+		if (!sphere_aabb_overlap(cx, cy, cz, radius, node.box))
+			continue;
+
+		if (node.is_leaf())
+			report(node.userId);
+		else
+		{
+			stack[top++] = node.child2;
+			stack[top++] = node.child1;
+		}
+	}
+}
+
+#endif // _DYNAMIC_AABB_TREE_H
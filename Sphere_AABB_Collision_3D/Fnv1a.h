@@ -0,0 +1,44 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: Fnv1a.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The 64 bit FNV-1a hash, used for the checksums of scene files (SceneFile.h) and traces (SimulationTrace.h)
+and for the program cache key (ProgramCache.h). It is not meant to resist tampering, only to notice damage.
+*/
+
+#ifndef _FNV1A_H
+#define _FNV1A_H
+
+#include <cstddef>
+#include <cstdint>
+
+const uint64_t FNV_OFFSET = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+// FNV-1a over bytes, continuing from hash.
+inline uint64_t fnv1a(const void* bytes, size_t count, uint64_t hash = FNV_OFFSET)
+{
+	const unsigned char* p = (const unsigned char*)bytes;
+	for (size_t i = 0; i < count; i++)
+	{
+		hash ^= p[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+#endif // _FNV1A_H
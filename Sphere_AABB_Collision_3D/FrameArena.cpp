@@ -0,0 +1,94 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: FrameArena.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Blocks and bump allocation of the frame arena. See FrameArena.h.
+*/
+
+#include "FrameArena.h"
+
+FrameArena::FrameArena(size_t blockSize)
+	: current(0), offset(0), blockSize(blockSize > 0 ? blockSize : 1)
+{
+	counters = AllocatorStats();
+}
+
+FrameArena::~FrameArena()
+{
+	for (Block &b : blocks)
+		delete[] b.memory;
+}
+
+void FrameArena::add_block(size_t minimumSize)
+{
+	Block b;
+	b.size = minimumSize > blockSize ? minimumSize : blockSize;
+	b.memory = new char[b.size];
+	blocks.push_back(b);
+	counters.heapCalls++;
+	counters.capacity += b.size;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	counters.allocations++;
+
+	for (;;)
+	{
+		if (current < blocks.size())
+		{
+			Block &b = blocks[current];
+			uintptr_t start = (uintptr_t)(b.memory + offset);
+			uintptr_t aligned = (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+			size_t used = (size_t)(aligned - (uintptr_t)b.memory) + bytes;
+			if (used <= b.size)
+			{
+				counters.bytesUsed += used - offset;
+				if (counters.bytesUsed > counters.peakBytes)
+					counters.peakBytes = counters.bytesUsed;
+				offset = used;
+				return (void*)aligned;
+			}
+		}
+
+		// Doesn't fit (or there is no block yet): go on in the next block. The rest of the old one is left unused.
+		if (current < blocks.size())
+			current++;
+		if (current >= blocks.size())
+			add_block(bytes + alignment);
+		offset = 0;
+	}
+}
+
+void FrameArena::reset()
+{
+	// The frame spilled over into more blocks: replace them with one that holds all of it.
+	if (blocks.size() > 1)
+	{
+		size_t total = counters.capacity;
+		for (Block &b : blocks)
+			delete[] b.memory;
+		blocks.clear();
+		counters.capacity = 0;
+		add_block(total);
+	}
+
+	current = 0;
+	offset = 0;
+	counters.bytesUsed = 0;
+	counters.resets++;
+}
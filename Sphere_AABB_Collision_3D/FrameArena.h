@@ -0,0 +1,212 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: FrameArena.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Allocators for data that only lives for one frame: candidate pair lists, contacts, scratch arrays.
+setup() in main.cpp fills std::vectors with push_back and no reserve, so they reallocate as they grow.
+That is harmless once at startup, but a collision loop written the same way would call the heap
+many times every frame.
+
+FrameArena hands out memory by moving a pointer forward through a big block ("bump" or linear allocation).
+Nothing is freed one piece at a time; reset() at the end of a frame takes the pointer back to the start,
+which costs the same however much was allocated. If a frame needed more than one block, reset() swaps them
+for a single block big enough for that frame, so from then on a frame makes no heap calls at all.
+ArenaAllocator lets std::vector (and friends) allocate from an arena.
+
+ObjectPool hands out fixed size objects (contacts, say) from pages of slots, reuses freed slots through
+a free list, and can also be reset in one step. The benchmark's frame/ scenario times both, and
+Simulation::step() keeps each step's candidate pairs in a FrameArena.
+
+Both count what they do: peak bytes, how many allocations they served, and how many of those went to the heap.
+Only plain data (trivially destructible types) may live in them, since reset() runs no destructors.
+*/
+
+#ifndef _FRAME_ARENA_H
+#define _FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct AllocatorStats
+{
+	size_t bytesUsed;		// Handed out since the last reset.
+	size_t peakBytes;		// Most bytes handed out in any one frame.
+	size_t capacity;		// Bytes held from the heap.
+	size_t allocations;		// Allocations served, in total.
+	size_t heapCalls;		// Of those, how many had to get memory from the heap.
+	size_t resets;			// Frames.
+
+	// Allocations that would have been heap calls without the allocator.
+	size_t allocations_avoided() const { return allocations - heapCalls; }
+};
+
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t blockSize = 1 << 20);
+	~FrameArena();
+
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+
+	// Uninitialized memory, valid until the next reset(). alignment must be a power of two.
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialized array of count T's.
+	template <class T>
+	T* allocate_array(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "FrameArena never runs destructors");
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	// Makes all memory free again. Call it once per frame, after the frame's data is no longer used.
+	void reset();
+
+	const AllocatorStats &stats() const { return counters; }
+
+private:
+	struct Block
+	{
+		char* memory;
+		size_t size;
+	};
+
+	void add_block(size_t minimumSize);
+
+	std::vector<Block> blocks;
+	size_t current;			// Block being allocated from.
+	size_t offset;			// Next free byte in it.
+	size_t blockSize;
+	AllocatorStats counters;
+};
+
+// std::allocator replacement over a FrameArena, e.g. std::vector<CollisionPair, ArenaAllocator<CollisionPair>>.
+// deallocate does nothing: the memory comes back at the arena's reset(). Containers must be gone (or cleared
+// and never used again) before then.
+template <class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+	T* allocate(size_t count) { return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) {}
+
+	template <class U>
+	bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+	template <class U>
+	bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+
+	FrameArena* arena;
+};
+
+// Fixed size objects of one type, allocated from pages of pageSize slots. Addresses never move.
+template <class T>
+class ObjectPool
+{
+	static_assert(std::is_trivially_destructible<T>::value, "ObjectPool::reset never runs destructors");
+
+public:
+	explicit ObjectPool(size_t pageSize = 1024) : pageSize(pageSize > 0 ? pageSize : 1), next(0), freeList(nullptr), live(0)
+	{
+		counters = AllocatorStats();
+	}
+
+	ObjectPool(const ObjectPool &) = delete;
+	ObjectPool &operator=(const ObjectPool &) = delete;
+
+	template <class... Args>
+	T* create(Args &&... args)
+	{
+		counters.allocations++;
+		Slot* slot;
+		if (freeList)
+		{
+			slot = freeList;
+			freeList = slot->next;
+		}
+		else
+		{
+			if (next == pages.size() * pageSize)
+			{
+				pages.emplace_back(new Slot[pageSize]);
+				counters.heapCalls++;
+				counters.capacity += pageSize * sizeof(Slot);
+			}
+			slot = &pages[next / pageSize][next % pageSize];
+			next++;
+		}
+
+		live++;
+		counters.bytesUsed = live * sizeof(T);
+		if (counters.bytesUsed > counters.peakBytes)
+			counters.peakBytes = counters.bytesUsed;
+		return new (slot->storage()) T(std::forward<Args>(args)...);
+	}
+
+	void destroy(T* object)
+	{
+		Slot* slot = reinterpret_cast<Slot*>(object);
+		slot->next = freeList;
+		freeList = slot;
+		live--;
+		counters.bytesUsed = live * sizeof(T);
+	}
+
+	// Frees every object at once. The pages are kept.
+	void reset()
+	{
+		next = 0;
+		freeList = nullptr;
+		live = 0;
+		counters.bytesUsed = 0;
+		counters.resets++;
+	}
+
+	size_t size() const { return live; }
+	const AllocatorStats &stats() const { return counters; }
+
+private:
+	// A slot holds either an object or the link to the next free slot.
+	union Slot
+	{
+		Slot* next;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type object;
+
+		void* storage() { return &object; }
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> pages;
+	size_t pageSize;
+	size_t next;		// Slots below this have been handed out at least once since the last reset.
+	Slot* freeList;
+	size_t live;
+	AllocatorStats counters;
+};
+
+#endif // _FRAME_ARENA_H
@@ -0,0 +1,346 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: FrameProfiler.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Histograms, phase timers, hardware counters and the JSON / CSV output of the frame profiler. See FrameProfiler.h.
+*/
+
+#include "FrameProfiler.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* frame_phase_name(FramePhase phase)
+{
+	static const char* names[FRAME_PHASE_COUNT] = { "update", "render", "swap", "poll", "broadphase", "narrowphase", "cull" };
+	return names[(int)phase];
+}
+
+const char* frame_counter_name(FrameCounter counter)
+{
+	static const char* names[FRAME_COUNTER_COUNT] = { "pair_tests", "overlaps", "visible", "culled" };
+	return names[(int)counter];
+}
+
+#pragma region Histogram
+void Histogram::clear()
+{
+	for (int i = 0; i < BUCKETS; i++)
+		buckets[i] = 0;
+	sampleCount = 0;
+	sum = 0;
+	largest = 0;
+}
+
+int Histogram::bucket_of(uint64_t value)
+{
+	if (value < (uint64_t)SUB_BUCKETS)
+		return (int)value;
+
+	// The highest set bit picks the power of two, the next SUB_BUCKET_BITS bits the bucket within it.
+	int power = 63;
+	while (!(value >> power))
+		power--;
+	int sub = (int)((value >> (power - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+	return (power - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::bucket_top(int bucket)
+{
+	if (bucket < SUB_BUCKETS)
+		return (uint64_t)bucket;
+
+	int power = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+	int sub = bucket % SUB_BUCKETS;
+	int shift = power - SUB_BUCKET_BITS;
+	uint64_t bottom = (uint64_t)(SUB_BUCKETS + sub) << shift;
+	return bottom + (((uint64_t)1 << shift) - 1);
+}
+
+void Histogram::add(uint64_t value)
+{
+	buckets[bucket_of(value)]++;
+	sampleCount++;
+	sum += value;
+	if (value > largest)
+		largest = value;
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+	if (sampleCount == 0)
+		return 0;
+
+	// The rank of the sample wanted, from 1 to sampleCount.
+	uint64_t rank = (uint64_t)(p * sampleCount + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > sampleCount)
+		rank = sampleCount;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKETS; i++)
+	{
+		seen += buckets[i];
+		if (seen >= rank)
+		{
+			uint64_t top = bucket_top(i);
+			return top < largest ? top : largest;
+		}
+	}
+	return largest;
+}
+#pragma endregion
+
+#pragma region FrameProfiler
+FrameProfiler::FrameProfiler() : perfGroup(-1), perfBranches(-1)
+{
+	reset();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+#ifdef __linux__
+	if (perfBranches >= 0)
+		close(perfBranches);
+	if (perfGroup >= 0)
+		close(perfGroup);
+#endif
+}
+
+void FrameProfiler::reset()
+{
+	for (int p = 0; p < FRAME_PHASE_COUNT; p++)
+	{
+		phases[p].clear();
+		cacheMisses[p] = 0;
+		branchMisses[p] = 0;
+		startCounts[p][0] = startCounts[p][1] = 0;
+	}
+	for (int c = 0; c < FRAME_COUNTER_COUNT; c++)
+	{
+		counters[c].clear();
+		frameCounts[c] = 0;
+	}
+	frameCount = 0;
+}
+
+#ifdef __linux__
+static int open_counter(uint64_t config, int group)
+{
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.disabled = group < 0 ? 1 : 0;		// The group starts disabled, and is enabled once both are open.
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	// This thread, on whichever CPU it runs.
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+bool FrameProfiler::enable_hardware_counters(std::string &error)
+{
+#ifdef __linux__
+	if (perfGroup >= 0)
+		return true;
+
+	perfGroup = open_counter(PERF_COUNT_HW_CACHE_MISSES, -1);
+	if (perfGroup < 0)
+	{
+		error = std::string("perf_event_open: ") + std::strerror(errno);
+		return false;
+	}
+	perfBranches = open_counter(PERF_COUNT_HW_BRANCH_MISSES, perfGroup);
+	if (perfBranches < 0)
+	{
+		error = std::string("perf_event_open: ") + std::strerror(errno);
+		close(perfGroup);
+		perfGroup = -1;
+		return false;
+	}
+
+	ioctl(perfGroup, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perfGroup, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+#else
+	error = "hardware counters need Linux perf_event_open";
+	return false;
+#endif
+}
+
+bool FrameProfiler::read_hardware_counters(uint64_t* values) const
+{
+#ifdef __linux__
+	// PERF_FORMAT_GROUP: the number of counters, then each value in the order they were opened.
+	uint64_t data[3];
+	if (read(perfGroup, data, sizeof(data)) != (ssize_t)sizeof(data) || data[0] != 2)
+		return false;
+	values[0] = data[1];
+	values[1] = data[2];
+	return true;
+#else
+	(void)values;
+	return false;
+#endif
+}
+
+void FrameProfiler::begin(FramePhase phase)
+{
+	int p = (int)phase;
+	if (perfGroup >= 0)
+		read_hardware_counters(startCounts[p]);
+	// The clock is read last, so reading the counters isn't part of the time.
+	started[p] = std::chrono::steady_clock::now();
+}
+
+void FrameProfiler::end(FramePhase phase)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	int p = (int)phase;
+	phases[p].add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - started[p]).count());
+
+	uint64_t counts[2];
+	if (perfGroup >= 0 && read_hardware_counters(counts))
+	{
+		cacheMisses[p] += counts[0] - startCounts[p][0];
+		branchMisses[p] += counts[1] - startCounts[p][1];
+	}
+}
+
+void FrameProfiler::end_frame()
+{
+	for (int c = 0; c < FRAME_COUNTER_COUNT; c++)
+	{
+		counters[c].add(frameCounts[c]);
+		frameCounts[c] = 0;
+	}
+	frameCount++;
+}
+#pragma endregion
+
+#pragma region Output
+static double microseconds(uint64_t nanoseconds)
+{
+	return nanoseconds / 1000.0;
+}
+
+void FrameProfiler::write_json(FILE* out) const
+{
+	std::fprintf(out, "{\n  \"frames\": %llu,\n  \"hardware_counters\": %s,\n  \"phases\": [\n",
+		(unsigned long long)frameCount, hardware_counters() ? "true" : "false");
+	for (int p = 0; p < FRAME_PHASE_COUNT; p++)
+	{
+		const Histogram &h = phases[p];
+		std::fprintf(out, "    { \"name\": \"%s\", \"samples\": %llu, \"total_us\": %.3f, \"mean_us\": %.3f, "
+			"\"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f",
+			frame_phase_name((FramePhase)p), (unsigned long long)h.samples(), microseconds(h.total()), h.mean() / 1000.0,
+			microseconds(h.percentile(0.5)), microseconds(h.percentile(0.99)), microseconds(h.max()));
+		if (hardware_counters())
+			std::fprintf(out, ", \"cache_misses\": %llu, \"branch_misses\": %llu", (unsigned long long)cacheMisses[p], (unsigned long long)branchMisses[p]);
+		std::fprintf(out, " }%s\n", p + 1 < FRAME_PHASE_COUNT ? "," : "");
+	}
+	std::fprintf(out, "  ],\n  \"counters\": [\n");
+	for (int c = 0; c < FRAME_COUNTER_COUNT; c++)
+	{
+		const Histogram &h = counters[c];
+		std::fprintf(out, "    { \"name\": \"%s\", \"total\": %llu, \"mean_per_frame\": %.3f, \"p50_per_frame\": %llu, "
+			"\"p99_per_frame\": %llu, \"max_per_frame\": %llu }%s\n",
+			frame_counter_name((FrameCounter)c), (unsigned long long)h.total(), h.mean(), (unsigned long long)h.percentile(0.5),
+			(unsigned long long)h.percentile(0.99), (unsigned long long)h.max(), c + 1 < FRAME_COUNTER_COUNT ? "," : "");
+	}
+	std::fprintf(out, "  ]\n}\n");
+}
+
+void FrameProfiler::write_csv(FILE* out) const
+{
+	// One table for both: phases in microseconds, counters in counts per frame.
+	std::fprintf(out, "kind,name,samples,total,mean,p50,p99,max,cache_misses,branch_misses\n");
+	for (int p = 0; p < FRAME_PHASE_COUNT; p++)
+	{
+		const Histogram &h = phases[p];
+		std::fprintf(out, "phase_us,%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,", frame_phase_name((FramePhase)p), (unsigned long long)h.samples(),
+			microseconds(h.total()), h.mean() / 1000.0, microseconds(h.percentile(0.5)), microseconds(h.percentile(0.99)), microseconds(h.max()));
+		if (hardware_counters())
+			std::fprintf(out, "%llu,%llu\n", (unsigned long long)cacheMisses[p], (unsigned long long)branchMisses[p]);
+		else
+			std::fprintf(out, ",\n");
+	}
+	for (int c = 0; c < FRAME_COUNTER_COUNT; c++)
+	{
+		const Histogram &h = counters[c];
+		std::fprintf(out, "counter,%s,%llu,%llu,%.3f,%llu,%llu,%llu,,\n", frame_counter_name((FrameCounter)c), (unsigned long long)h.samples(),
+			(unsigned long long)h.total(), h.mean(), (unsigned long long)h.percentile(0.5), (unsigned long long)h.percentile(0.99),
+			(unsigned long long)h.max());
+	}
+}
+
+void FrameProfiler::write_table(FILE* out) const
+{
+	std::fprintf(out, "%llu frames\n", (unsigned long long)frameCount);
+	std::fprintf(out, "%-12s %10s %10s %10s %10s", "phase", "samples", "p50 us", "p99 us", "max us");
+	if (hardware_counters())
+		std::fprintf(out, " %14s %14s", "cache misses", "branch misses");
+	std::fprintf(out, "\n");
+	for (int p = 0; p < FRAME_PHASE_COUNT; p++)
+	{
+		const Histogram &h = phases[p];
+		if (h.samples() == 0)
+			continue;
+		std::fprintf(out, "%-12s %10llu %10.1f %10.1f %10.1f", frame_phase_name((FramePhase)p), (unsigned long long)h.samples(),
+			microseconds(h.percentile(0.5)), microseconds(h.percentile(0.99)), microseconds(h.max()));
+		if (hardware_counters())
+			std::fprintf(out, " %14llu %14llu", (unsigned long long)cacheMisses[p], (unsigned long long)branchMisses[p]);
+		std::fprintf(out, "\n");
+	}
+	for (int c = 0; c < FRAME_COUNTER_COUNT; c++)
+	{
+		const Histogram &h = counters[c];
+		std::fprintf(out, "%-12s %10llu total, %.1f per frame, max %llu\n", frame_counter_name((FrameCounter)c),
+			(unsigned long long)h.total(), h.mean(), (unsigned long long)h.max());
+	}
+}
+
+bool FrameProfiler::save(const std::string &path, std::string &error) const
+{
+	FILE* out = std::fopen(path.c_str(), "w");
+	if (!out)
+	{
+		error = "Can't write file: " + path;
+		return false;
+	}
+
+	bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+	if (csv)
+		write_csv(out);
+	else
+		write_json(out);
+	std::fclose(out);
+	return true;
+}
+#pragma endregion
@@ -0,0 +1,191 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: FrameProfiler.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Where a frame's time goes: how long each phase takes (update, render, swap, poll, broadphase, narrowphase, cull),
+as a histogram per phase, plus per-frame counters such as pair tests.
+
+The main loop times nothing, and with glfwSwapInterval(0) it spins as fast as it can, so an average FPS
+hides whether a slow frame came from the collision code, the draw calls or the driver. A ScopedPhase
+around a block of code reads the clock when it starts and when it ends, and adds the difference to that
+phase's histogram. The phases are a fixed enum, so a timer is two clock reads and an array index: no
+names looked up, no allocation.
+
+Histograms keep counts in buckets that are 1/16 of a power of two wide (about 6% apart), so p50 and p99
+are within a bucket of the exact value, the maximum is exact, and a histogram is a fixed 8 KB however
+many samples it holds.
+
+On Linux, enable_hardware_counters() also counts cache misses and branch misses per phase with
+perf_event_open. Those count the calling thread only (work handed to a thread pool is not in them), cost
+a system call at each end of a phase, and need permission (kernel.perf_event_paranoid): if they can't be
+opened, the profiler just goes on with times.
+
+The results can be saved as JSON or CSV, or printed as a table. A profiler is used from one thread.
+*/
+
+#ifndef _FRAME_PROFILER_H
+#define _FRAME_PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+enum class FramePhase : uint8_t
+{
+	Update,			// update(): input, collision, filling the instances.
+	Render,			// renderScene(): issuing the draws.
+	Swap,			// glfwSwapBuffers.
+	Poll,			// glfwPollEvents.
+	Broadphase,		// Finding candidate pairs (inside Update).
+	Narrowphase,	// Testing the candidates exactly (inside Update).
+	Cull,			// Frustum culling (inside Update).
+	Count
+};
+
+enum class FrameCounter : uint8_t
+{
+	PairTests,		// Sphere-box pairs tested exactly.
+	Overlaps,		// Pairs found touching.
+	Visible,		// Objects that passed frustum culling.
+	Culled,			// Objects frustum culling dropped.
+	Count
+};
+
+const int FRAME_PHASE_COUNT = (int)FramePhase::Count;
+const int FRAME_COUNTER_COUNT = (int)FrameCounter::Count;
+
+// "update", "pair_tests", ...: the names used in the saved files.
+const char* frame_phase_name(FramePhase phase);
+const char* frame_counter_name(FrameCounter counter);
+
+// Counts of values (nanoseconds, or a count per frame) in log-linear buckets.
+class Histogram
+{
+public:
+	Histogram() { clear(); }
+
+	void clear();
+	void add(uint64_t value);
+
+	uint64_t samples() const { return sampleCount; }
+	uint64_t total() const { return sum; }
+	uint64_t max() const { return largest; }
+	double mean() const { return sampleCount ? (double)sum / sampleCount : 0.0; }
+
+	// The value below which a fraction p (0 to 1) of the samples fall: the top of that bucket, but never above max().
+	uint64_t percentile(double p) const;
+
+private:
+	// Values below 16 have a bucket each. Above, each power of two is split in SUB_BUCKETS.
+	static const int SUB_BUCKET_BITS = 4;
+	static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	uint64_t buckets[BUCKETS];
+	uint64_t sampleCount;
+	uint64_t sum;
+	uint64_t largest;
+
+	static int bucket_of(uint64_t value);
+	static uint64_t bucket_top(int bucket);
+};
+
+class FrameProfiler
+{
+public:
+	FrameProfiler();
+	~FrameProfiler();
+
+	FrameProfiler(const FrameProfiler&) = delete;
+	FrameProfiler &operator=(const FrameProfiler&) = delete;
+
+	// Opens the cache miss and branch miss counters for the calling thread.
+	// False, with the reason in error, if the system doesn't allow it or isn't Linux.
+	bool enable_hardware_counters(std::string &error);
+	bool hardware_counters() const { return perfGroup >= 0; }
+
+	// ScopedPhase calls these. A phase can be inside another, but not inside itself.
+	void begin(FramePhase phase);
+	void end(FramePhase phase);
+
+	void count(FrameCounter counter, uint64_t n) { frameCounts[(int)counter] += n; }
+
+	// Call at the end of every frame: adds this frame's counts to the counter histograms.
+	void end_frame();
+
+	// Forgets everything measured so far.
+	void reset();
+
+	uint64_t frames() const { return frameCount; }
+	const Histogram &phase(FramePhase phase) const { return phases[(int)phase]; }
+	const Histogram &counter(FrameCounter counter) const { return counters[(int)counter]; }
+	uint64_t cache_misses(FramePhase phase) const { return cacheMisses[(int)phase]; }
+	uint64_t branch_misses(FramePhase phase) const { return branchMisses[(int)phase]; }
+
+	// Times are written in microseconds.
+	void write_json(FILE* out) const;
+	void write_csv(FILE* out) const;
+	void write_table(FILE* out) const;
+
+	// Writes CSV if path ends in ".csv", JSON otherwise.
+	bool save(const std::string &path, std::string &error) const;
+
+private:
+	Histogram phases[FRAME_PHASE_COUNT];
+	Histogram counters[FRAME_COUNTER_COUNT];
+	uint64_t frameCounts[FRAME_COUNTER_COUNT];
+	uint64_t frameCount;
+
+	std::chrono::steady_clock::time_point started[FRAME_PHASE_COUNT];
+
+	// perf_event_open descriptors: the group leader counts cache misses, the other branch misses.
+	int perfGroup;
+	int perfBranches;
+	uint64_t startCounts[FRAME_PHASE_COUNT][2];
+	uint64_t cacheMisses[FRAME_PHASE_COUNT];
+	uint64_t branchMisses[FRAME_PHASE_COUNT];
+
+	bool read_hardware_counters(uint64_t* values) const;
+};
+
+// Times the enclosing block as one phase. A null profiler times nothing, so code can be instrumented
+// and only measured when someone passes a profiler in.
+class ScopedPhase
+{
+public:
+	ScopedPhase(FrameProfiler* profiler, FramePhase phase) : profiler(profiler), phase(phase)
+	{
+		if (profiler)
+			profiler->begin(phase);
+	}
+
+	~ScopedPhase()
+	{
+		if (profiler)
+			profiler->end(phase);
+	}
+
+	ScopedPhase(const ScopedPhase&) = delete;
+	ScopedPhase &operator=(const ScopedPhase&) = delete;
+
+private:
+	FrameProfiler* profiler;
+	FramePhase phase;
+};
+
+#endif // _FRAME_PROFILER_H
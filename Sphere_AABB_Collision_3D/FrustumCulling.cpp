@@ -0,0 +1,597 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: FrustumCulling.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Frustum planes from PV, the batched sphere and box tests, and the threaded and hierarchical culls.
+See FrustumCulling.h.
+*/
+
+#include "FrustumCulling.h"
+#include "SimdSupport.h"
+#include "SphereAABBBatch.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const uint32_t ALL_PLANES = (1u << FRUSTUM_PLANE_COUNT) - 1;
+
+#pragma region Planes
+void extract_frustum_planes(const float* PV, Frustum &frustum)
+{
+	// Row r of a column major matrix is PV[r], PV[4 + r], PV[8 + r], PV[12 + r]. A point is inside when
+	// -w <= x, y, z <= w in clip space, and each of those six is row 3 plus or minus row 0, 1 or 2.
+	for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+	{
+		int row = p / 2;
+		float sign = p % 2 == 0 ? 1.0f : -1.0f;
+		float plane[4];
+		for (int column = 0; column < 4; column++)
+			plane[column] = PV[column * 4 + 3] + sign * PV[column * 4 + row];
+
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		for (int k = 0; k < 4; k++)
+			frustum.planes[p][k] = plane[k] * scale;
+	}
+}
+
+namespace
+{
+	// The planes still to be tested, with which corner of a box to test against each.
+	struct PlaneSet
+	{
+		int count;
+		float a[FRUSTUM_PLANE_COUNT], b[FRUSTUM_PLANE_COUNT], c[FRUSTUM_PLANE_COUNT], d[FRUSTUM_PLANE_COUNT];
+		bool maxX[FRUSTUM_PLANE_COUNT], maxY[FRUSTUM_PLANE_COUNT], maxZ[FRUSTUM_PLANE_COUNT];
+	};
+
+	PlaneSet select_planes(const Frustum &frustum, uint32_t planeMask)
+	{
+		PlaneSet set;
+		set.count = 0;
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			if (!(planeMask & (1u << p)))
+				continue;
+			const float* plane = frustum.planes[p];
+			int k = set.count++;
+			set.a[k] = plane[0]; set.b[k] = plane[1]; set.c[k] = plane[2]; set.d[k] = plane[3];
+			set.maxX[k] = plane[0] >= 0.0f;
+			set.maxY[k] = plane[1] >= 0.0f;
+			set.maxZ[k] = plane[2] >= 0.0f;
+		}
+		return set;
+	}
+
+	// Signed distance of (x, y, z) from a plane. Every path computes it in this order.
+	inline float plane_distance(float a, float b, float c, float d, float x, float y, float z)
+	{
+		return a * x + b * y + c * z + d;
+	}
+
+	// The corner of box i that is furthest along plane k's normal, the one it is enough to test.
+	inline float corner_distance(const PlaneSet &planes, int k, const BoxArrays &boxes, size_t i)
+	{
+		return plane_distance(planes.a[k], planes.b[k], planes.c[k], planes.d[k],
+			planes.maxX[k] ? boxes.maxX[i] : boxes.minX[i],
+			planes.maxY[k] ? boxes.maxY[i] : boxes.minY[i],
+			planes.maxZ[k] ? boxes.maxZ[i] : boxes.minZ[i]);
+	}
+
+	inline bool sphere_visible(const PlaneSet &planes, const SphereArrays &spheres, size_t i)
+	{
+		for (int k = 0; k < planes.count; k++)
+		{
+			if (plane_distance(planes.a[k], planes.b[k], planes.c[k], planes.d[k], spheres.x[i], spheres.y[i], spheres.z[i]) < -spheres.radius[i])
+				return false;
+		}
+		return true;
+	}
+
+	inline bool box_visible(const PlaneSet &planes, const BoxArrays &boxes, size_t i)
+	{
+		for (int k = 0; k < planes.count; k++)
+		{
+			if (corner_distance(planes, k, boxes, i) < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	// Culls [begin, end): Chunk tests LANES objects from i and returns a bit per visible one, and the
+	// objects left over at the end are tested one at a time.
+	template <int LANES, class Arrays, class Chunk, class Single>
+	FORCE_INLINE size_t cull_range(const PlaneSet &planes, const Arrays &arrays, size_t begin, size_t end, uint32_t* visible, Chunk chunk, Single single)
+	{
+		size_t n = 0;
+		size_t i = begin;
+		for (; i + LANES <= end; i += LANES)
+		{
+			uint32_t mask = chunk(planes, arrays, i);
+			while (mask)
+			{
+				uint32_t lane = 0;
+				while (!(mask & (1u << lane)))
+					lane++;
+				mask &= mask - 1;
+				visible[n++] = (uint32_t)(i + lane);
+			}
+		}
+		for (; i < end; i++)
+		{
+			if (single(planes, arrays, i))
+				visible[n++] = (uint32_t)i;
+		}
+		return n;
+	}
+
+	struct SphereSingle
+	{
+		bool operator()(const PlaneSet &planes, const SphereArrays &spheres, size_t i) const { return sphere_visible(planes, spheres, i); }
+	};
+
+	struct BoxSingle
+	{
+		bool operator()(const PlaneSet &planes, const BoxArrays &boxes, size_t i) const { return box_visible(planes, boxes, i); }
+	};
+
+	size_t cull_spheres_scalar(const PlaneSet &planes, const SphereArrays &spheres, size_t begin, size_t end, uint32_t* visible)
+	{
+		return cull_range<1>(planes, spheres, begin, end, visible, [](const PlaneSet &p, const SphereArrays &s, size_t i) {
+			return (uint32_t)sphere_visible(p, s, i);
+		}, SphereSingle());
+	}
+
+	size_t cull_boxes_scalar(const PlaneSet &planes, const BoxArrays &boxes, size_t begin, size_t end, uint32_t* visible)
+	{
+		return cull_range<1>(planes, boxes, begin, end, visible, [](const PlaneSet &p, const BoxArrays &b, size_t i) {
+			return (uint32_t)box_visible(p, b, i);
+		}, BoxSingle());
+	}
+
+#if COLLISION_X86
+#pragma region SSE
+	struct SphereSse
+	{
+		SIMD_TARGET("sse4.2")
+		uint32_t operator()(const PlaneSet &planes, const SphereArrays &spheres, size_t i) const
+		{
+			__m128 x = _mm_loadu_ps(spheres.x + i), y = _mm_loadu_ps(spheres.y + i), z = _mm_loadu_ps(spheres.z + i);
+			__m128 reach = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius + i));
+			__m128 outside = _mm_setzero_ps();
+			for (int k = 0; k < planes.count; k++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.a[k]), x), _mm_mul_ps(_mm_set1_ps(planes.b[k]), y)),
+					_mm_mul_ps(_mm_set1_ps(planes.c[k]), z)), _mm_set1_ps(planes.d[k]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, reach));
+			}
+			return (uint32_t)_mm_movemask_ps(outside) ^ 0xF;
+		}
+	};
+
+	struct BoxSse
+	{
+		SIMD_TARGET("sse4.2")
+		uint32_t operator()(const PlaneSet &planes, const BoxArrays &boxes, size_t i) const
+		{
+			__m128 outside = _mm_setzero_ps();
+			for (int k = 0; k < planes.count; k++)
+			{
+				__m128 x = _mm_loadu_ps((planes.maxX[k] ? boxes.maxX : boxes.minX) + i);
+				__m128 y = _mm_loadu_ps((planes.maxY[k] ? boxes.maxY : boxes.minY) + i);
+				__m128 z = _mm_loadu_ps((planes.maxZ[k] ? boxes.maxZ : boxes.minZ) + i);
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.a[k]), x), _mm_mul_ps(_mm_set1_ps(planes.b[k]), y)),
+					_mm_mul_ps(_mm_set1_ps(planes.c[k]), z)), _mm_set1_ps(planes.d[k]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+			}
+			return (uint32_t)_mm_movemask_ps(outside) ^ 0xF;
+		}
+	};
+
+	SIMD_TARGET("sse4.2")
+	size_t cull_spheres_sse(const PlaneSet &planes, const SphereArrays &spheres, size_t begin, size_t end, uint32_t* visible)
+	{
+		return cull_range<4>(planes, spheres, begin, end, visible, SphereSse(), SphereSingle());
+	}
+
+	SIMD_TARGET("sse4.2")
+	size_t cull_boxes_sse(const PlaneSet &planes, const BoxArrays &boxes, size_t begin, size_t end, uint32_t* visible)
+	{
+		return cull_range<4>(planes, boxes, begin, end, visible, BoxSse(), BoxSingle());
+	}
+#pragma endregion
+
+#pragma region AVX2
+	struct SphereAvx2
+	{
+		SIMD_TARGET("avx2")
+		uint32_t operator()(const PlaneSet &planes, const SphereArrays &spheres, size_t i) const
+		{
+			__m256 x = _mm256_loadu_ps(spheres.x + i), y = _mm256_loadu_ps(spheres.y + i), z = _mm256_loadu_ps(spheres.z + i);
+			__m256 reach = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.radius + i));
+			__m256 outside = _mm256_setzero_ps();
+			for (int k = 0; k < planes.count; k++)
+			{
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.a[k]), x), _mm256_mul_ps(_mm256_set1_ps(planes.b[k]), y)),
+					_mm256_mul_ps(_mm256_set1_ps(planes.c[k]), z)), _mm256_set1_ps(planes.d[k]));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, reach, _CMP_LT_OQ));
+			}
+			return (uint32_t)_mm256_movemask_ps(outside) ^ 0xFF;
+		}
+	};
+
+	struct BoxAvx2
+	{
+		SIMD_TARGET("avx2")
+		uint32_t operator()(const PlaneSet &planes, const BoxArrays &boxes, size_t i) const
+		{
+			__m256 outside = _mm256_setzero_ps();
+			for (int k = 0; k < planes.count; k++)
+			{
+				__m256 x = _mm256_loadu_ps((planes.maxX[k] ? boxes.maxX : boxes.minX) + i);
+				__m256 y = _mm256_loadu_ps((planes.maxY[k] ? boxes.maxY : boxes.minY) + i);
+				__m256 z = _mm256_loadu_ps((planes.maxZ[k] ? boxes.maxZ : boxes.minZ) + i);
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.a[k]), x), _mm256_mul_ps(_mm256_set1_ps(planes.b[k]), y)),
+					_mm256_mul_ps(_mm256_set1_ps(planes.c[k]), z)), _mm256_set1_ps(planes.d[k]));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+			return (uint32_t)_mm256_movemask_ps(outside) ^ 0xFF;
+		}
+	};
+
+	SIMD_TARGET("avx2")
+	size_t cull_spheres_avx2(const PlaneSet &planes, const SphereArrays &spheres, size_t begin, size_t end, uint32_t* visible)
+	{
+		return cull_range<8>(planes, spheres, begin, end, visible, SphereAvx2(), SphereSingle());
+	}
+
+	SIMD_TARGET("avx2")
+	size_t cull_boxes_avx2(const PlaneSet &planes, const BoxArrays &boxes, size_t begin, size_t end, uint32_t* visible)
+	{
+		return cull_range<8>(planes, boxes, begin, end, visible, BoxAvx2(), BoxSingle());
+	}
+#pragma endregion
+
+#if COLLISION_HAS_AVX512
+#pragma region AVX-512
+	struct SphereAvx512
+	{
+		SIMD_TARGET("avx512f")
+		uint32_t operator()(const PlaneSet &planes, const SphereArrays &spheres, size_t i) const
+		{
+			__m512 x = _mm512_loadu_ps(spheres.x + i), y = _mm512_loadu_ps(spheres.y + i), z = _mm512_loadu_ps(spheres.z + i);
+			__m512 reach = _mm512_sub_ps(_mm512_setzero_ps(), _mm512_loadu_ps(spheres.radius + i));
+			__mmask16 outside = 0;
+			for (int k = 0; k < planes.count; k++)
+			{
+				__m512 distance = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(planes.a[k]), x), _mm512_mul_ps(_mm512_set1_ps(planes.b[k]), y)),
+					_mm512_mul_ps(_mm512_set1_ps(planes.c[k]), z)), _mm512_set1_ps(planes.d[k]));
+				outside |= _mm512_cmp_ps_mask(distance, reach, _CMP_LT_OQ);
+			}
+			return (uint32_t)(uint16_t)~outside;
+		}
+	};
+
+	struct BoxAvx512
+	{
+		SIMD_TARGET("avx512f")
+		uint32_t operator()(const PlaneSet &planes, const BoxArrays &boxes, size_t i) const
+		{
+			__mmask16 outside = 0;
+			for (int k = 0; k < planes.count; k++)
+			{
+				__m512 x = _mm512_loadu_ps((planes.maxX[k] ? boxes.maxX : boxes.minX) + i);
+				__m512 y = _mm512_loadu_ps((planes.maxY[k] ? boxes.maxY : boxes.minY) + i);
+				__m512 z = _mm512_loadu_ps((planes.maxZ[k] ? boxes.maxZ : boxes.minZ) + i);
+				__m512 distance = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(planes.a[k]), x), _mm512_mul_ps(_mm512_set1_ps(planes.b[k]), y)),
+					_mm512_mul_ps(_mm512_set1_ps(planes.c[k]), z)), _mm512_set1_ps(planes.d[k]));
+				outside |= _mm512_cmp_ps_mask(distance, _mm512_setzero_ps(), _CMP_LT_OQ);
+			}
+			return (uint32_t)(uint16_t)~outside;
+		}
+	};
+
+	SIMD_TARGET("avx512f")
+	size_t cull_spheres_avx512(const PlaneSet &planes, const SphereArrays &spheres, size_t begin, size_t end, uint32_t* visible)
+	{
+		return cull_range<16>(planes, spheres, begin, end, visible, SphereAvx512(), SphereSingle());
+	}
+
+	SIMD_TARGET("avx512f")
+	size_t cull_boxes_avx512(const PlaneSet &planes, const BoxArrays &boxes, size_t begin, size_t end, uint32_t* visible)
+	{
+		return cull_range<16>(planes, boxes, begin, end, visible, BoxAvx512(), BoxSingle());
+	}
+#pragma endregion
+#endif // COLLISION_HAS_AVX512
+#endif // COLLISION_X86
+
+	size_t cull_sphere_range(const PlaneSet &planes, const SphereArrays &spheres, size_t begin, size_t end, uint32_t* visible)
+	{
+		switch (active_simd_level())
+		{
+#if COLLISION_X86
+#if COLLISION_HAS_AVX512
+		case SimdLevel::AVX512:	return cull_spheres_avx512(planes, spheres, begin, end, visible);
+#endif
+		case SimdLevel::AVX2:	return cull_spheres_avx2(planes, spheres, begin, end, visible);
+		case SimdLevel::SSE42:	return cull_spheres_sse(planes, spheres, begin, end, visible);
+#endif
+		default:				return cull_spheres_scalar(planes, spheres, begin, end, visible);
+		}
+	}
+
+	size_t cull_box_range(const PlaneSet &planes, const BoxArrays &boxes, size_t begin, size_t end, uint32_t* visible)
+	{
+		switch (active_simd_level())
+		{
+#if COLLISION_X86
+#if COLLISION_HAS_AVX512
+		case SimdLevel::AVX512:	return cull_boxes_avx512(planes, boxes, begin, end, visible);
+#endif
+		case SimdLevel::AVX2:	return cull_boxes_avx2(planes, boxes, begin, end, visible);
+		case SimdLevel::SSE42:	return cull_boxes_sse(planes, boxes, begin, end, visible);
+#endif
+		default:				return cull_boxes_scalar(planes, boxes, begin, end, visible);
+		}
+	}
+
+	// Where a node is against the planes in planeMask: Outside one of them, or Inside the planes it
+	// drops from planeMask (all of them: Inside), or neither.
+	enum class NodeSide { Outside, Inside, Crossing };
+
+	NodeSide classify_node(const Frustum &frustum, const BVHNode &node, uint32_t &planeMask)
+	{
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			if (!(planeMask & (1u << p)))
+				continue;
+			const float* plane = frustum.planes[p];
+			bool positiveX = plane[0] >= 0.0f, positiveY = plane[1] >= 0.0f, positiveZ = plane[2] >= 0.0f;
+
+			// The corner furthest along the normal: if that is behind the plane, every box in the node is.
+			float far = plane_distance(plane[0], plane[1], plane[2], plane[3],
+				positiveX ? node.max[0] : node.min[0], positiveY ? node.max[1] : node.min[1], positiveZ ? node.max[2] : node.min[2]);
+			if (far < 0.0f)
+				return NodeSide::Outside;
+
+			// The nearest corner: if even that is in front, every box in the node is in front of this plane.
+			float near = plane_distance(plane[0], plane[1], plane[2], plane[3],
+				positiveX ? node.min[0] : node.max[0], positiveY ? node.min[1] : node.max[1], positiveZ ? node.min[2] : node.max[2]);
+			if (near >= 0.0f)
+				planeMask &= ~(1u << p);
+		}
+		return planeMask == 0 ? NodeSide::Inside : NodeSide::Crossing;
+	}
+
+	// The leaf boxes [begin, end) under node: its leftmost leaf's first box to its rightmost leaf's last.
+	void subtree_range(const BoxBVHView &bvh, uint32_t node, size_t &begin, size_t &end)
+	{
+		uint32_t left = node, right = node;
+		while (!bvh.nodes[left].is_leaf())
+			left = left + 1;
+		while (!bvh.nodes[right].is_leaf())
+			right = bvh.nodes[right].rightOrFirst;
+		begin = bvh.nodes[left].rightOrFirst;
+		end = bvh.nodes[right].rightOrFirst + bvh.nodes[right].count;
+	}
+
+	// Walks the subtree under node, writing the leaf indices of its visible boxes to visible.
+	size_t cull_subtree(const Frustum &frustum, const BoxBVHView &bvh, uint32_t root, uint32_t rootMask, uint32_t* visible, size_t &tested, size_t &nodes)
+	{
+		struct Entry { uint32_t node; uint32_t planeMask; };
+		Entry stack[BVH_MAX_DEPTH];
+		int top = 0;
+		stack[top++] = Entry{ root, rootMask };
+		size_t n = 0;
+
+		while (top > 0)
+		{
+			Entry entry = stack[--top];
+			const BVHNode &node = bvh.nodes[entry.node];
+			uint32_t planeMask = entry.planeMask;
+			nodes++;
+
+			NodeSide side = classify_node(frustum, node, planeMask);
+			if (side == NodeSide::Outside)
+				continue;
+
+			size_t begin, end;
+			if (side == NodeSide::Inside)
+			{
+				subtree_range(bvh, entry.node, begin, end);
+				for (size_t k = begin; k < end; k++)
+					visible[n++] = (uint32_t)k;
+				continue;
+			}
+
+			if (node.is_leaf())
+			{
+				begin = node.rightOrFirst;
+				end = begin + node.count;
+				tested += end - begin;
+				n += cull_box_range(select_planes(frustum, planeMask), bvh.boxes, begin, end, visible + n);
+				continue;
+			}
+
+			// Right pushed first so the left subtree comes out first, keeping the output in leaf order.
+			stack[top++] = Entry{ node.rightOrFirst, planeMask };
+			stack[top++] = Entry{ entry.node + 1, planeMask };
+		}
+		return n;
+	}
+}
+
+bool sphere_in_frustum(const Frustum &frustum, float x, float y, float z, float radius)
+{
+	SphereArrays sphere = { &x, &y, &z, &radius };
+	return sphere_visible(select_planes(frustum, ALL_PLANES), sphere, 0);
+}
+
+bool box_in_frustum(const Frustum &frustum, float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+{
+	BoxArrays box = { &minX, &minY, &minZ, &maxX, &maxY, &maxZ };
+	return box_visible(select_planes(frustum, ALL_PLANES), box, 0);
+}
+
+size_t cull_spheres(const Frustum &frustum, const SphereArrays &spheres, size_t begin, size_t end, uint32_t* visible)
+{
+	return cull_sphere_range(select_planes(frustum, ALL_PLANES), spheres, begin, end, visible);
+}
+
+size_t cull_boxes(const Frustum &frustum, const BoxArrays &boxes, size_t begin, size_t end, uint32_t* visible)
+{
+	return cull_box_range(select_planes(frustum, ALL_PLANES), boxes, begin, end, visible);
+}
+#pragma endregion
+
+#pragma region FrustumCuller
+FrustumCuller::FrustumCuller(WorkStealingPool &pool, size_t chunkSize)
+	: pool(pool), chunkSize(chunkSize > 0 ? chunkSize : 1)
+{
+	lastStats = CullStats{ 0, 0, 0, 0 };
+}
+
+void FrustumCuller::cull_spheres(const Frustum &frustum, const SphereArrays &spheres, size_t count, std::vector<uint32_t> &visible)
+{
+	// Each chunk writes its visible spheres to its own part of scratch, then gather() packs them together in order.
+	tasks.clear();
+	for (size_t begin = 0; begin < count; begin += chunkSize)
+		tasks.push_back(Task{ begin, begin + chunkSize < count ? begin + chunkSize : count, NO_NODE, 0, 0, 0, 0 });
+	scratch.resize(count);
+
+	PlaneSet planes = select_planes(frustum, ALL_PLANES);
+	pool.parallel_for(tasks.size(), [&](size_t index, int) {
+		Task &task = tasks[index];
+		task.visible = cull_sphere_range(planes, spheres, task.begin, task.end, scratch.data() + task.begin);
+		task.tested = task.end - task.begin;
+	});
+	gather(visible);
+}
+
+void FrustumCuller::cull_boxes(const Frustum &frustum, const BoxArrays &boxes, size_t count, std::vector<uint32_t> &visible)
+{
+	tasks.clear();
+	for (size_t begin = 0; begin < count; begin += chunkSize)
+		tasks.push_back(Task{ begin, begin + chunkSize < count ? begin + chunkSize : count, NO_NODE, 0, 0, 0, 0 });
+	scratch.resize(count);
+
+	PlaneSet planes = select_planes(frustum, ALL_PLANES);
+	pool.parallel_for(tasks.size(), [&](size_t index, int) {
+		Task &task = tasks[index];
+		task.visible = cull_box_range(planes, boxes, task.begin, task.end, scratch.data() + task.begin);
+		task.tested = task.end - task.begin;
+	});
+	gather(visible);
+}
+
+void FrustumCuller::split_tree(const Frustum &frustum, const BoxBVHView &bvh, uint32_t node, uint32_t planeMask, int depth, int splitDepth)
+{
+	// The top of the tree is walked here, on one thread, to cut it into subtrees for the pool.
+	// Nodes wholly outside are dropped here and nodes wholly inside become ranges with nothing to test.
+	size_t begin, end;
+	subtree_range(bvh, node, begin, end);
+	const BVHNode &n = bvh.nodes[node];
+	if (depth == splitDepth || n.is_leaf())
+	{
+		tasks.push_back(Task{ begin, end, node, planeMask, 0, 0, 0 });
+		return;
+	}
+
+	lastStats.nodes++;
+	NodeSide side = classify_node(frustum, n, planeMask);
+	if (side == NodeSide::Outside)
+		return;
+	if (side == NodeSide::Inside)
+	{
+		tasks.push_back(Task{ begin, end, NO_NODE, 0, 0, 0, 0 });
+		return;
+	}
+	split_tree(frustum, bvh, node + 1, planeMask, depth + 1, splitDepth);
+	split_tree(frustum, bvh, n.rightOrFirst, planeMask, depth + 1, splitDepth);
+}
+
+void FrustumCuller::cull_boxes(const Frustum &frustum, const BoxBVHView &bvh, std::vector<uint32_t> &visible)
+{
+	tasks.clear();
+	lastStats = CullStats{ 0, 0, 0, 0 };
+	scratch.resize(bvh.boxCount);
+	if (bvh.nodeCount > 0)
+	{
+		// About 8 subtrees per thread to balance, each still big enough to be worth a task.
+		int splitDepth = 0;
+		while ((1 << splitDepth) < pool.thread_count() * 8 && ((size_t)chunkSize << splitDepth) < bvh.boxCount)
+			splitDepth++;
+		split_tree(frustum, bvh, 0, ALL_PLANES, 0, splitDepth);
+	}
+	size_t splitNodes = lastStats.nodes;
+
+	// A subtree's boxes are a contiguous range of the leaf boxes, so each task writes to that range of scratch.
+	pool.parallel_for(tasks.size(), [&](size_t index, int) {
+		Task &task = tasks[index];
+		uint32_t* out = scratch.data() + task.begin;
+		if (task.node == NO_NODE)
+		{
+			for (size_t k = task.begin; k < task.end; k++)
+				*out++ = (uint32_t)k;
+			task.visible = task.end - task.begin;
+		}
+		else
+			task.visible = cull_subtree(frustum, bvh, task.node, task.planeMask, out, task.tested, task.nodes);
+	});
+
+	// Leaf positions to box ids.
+	for (const Task &task : tasks)
+	{
+		uint32_t* ids = scratch.data() + task.begin;
+		for (size_t k = 0; k < task.visible; k++)
+			ids[k] = bvh.boxIds[ids[k]];
+	}
+
+	gather(visible);
+	lastStats.nodes += splitNodes;
+	lastStats.culled = bvh.boxCount - lastStats.visible;
+}
+
+void FrustumCuller::gather(std::vector<uint32_t> &visible)
+{
+	// Each task's visible objects are at the start of its range of scratch. Work out where each goes in the
+	// output from the tasks before it, then copy them there in parallel.
+	offsets.resize(tasks.size());
+	size_t total = 0, tested = 0, nodes = 0, covered = 0;
+	for (size_t t = 0; t < tasks.size(); t++)
+	{
+		offsets[t] = total;
+		total += tasks[t].visible;
+		tested += tasks[t].tested;
+		nodes += tasks[t].nodes;
+		covered += tasks[t].end - tasks[t].begin;
+	}
+
+	visible.resize(total);
+	pool.parallel_for(tasks.size(), [&](size_t index, int) {
+		const Task &task = tasks[index];
+		const uint32_t* from = scratch.data() + task.begin;
+		std::copy(from, from + task.visible, visible.data() + offsets[index]);
+	});
+
+	lastStats.tested = tested;
+	lastStats.visible = total;
+	lastStats.culled = covered - total;
+	lastStats.nodes = nodes;
+}
+#pragma endregion
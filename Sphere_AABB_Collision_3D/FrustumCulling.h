@@ -0,0 +1,123 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: FrustumCulling.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Finding which spheres and boxes the camera can see, so only those are drawn.
+
+renderScene() hands every object to the GPU, and the GPU clips away the ones off screen only after
+running the vertex shader on all of their vertices. The view volume of a perspective camera is a
+frustum: six planes, each with the inside on its positive side. PV holds them; extract_frustum_planes()
+reads them out of its rows (Gribb and Hartmann's method) and normalizes them, so a plane gives the
+signed distance of a point.
+
+The tests are the sphere-AABB test's cousins, with a plane in place of the box:
+ - a sphere is outside if its center is further than its radius behind any one plane,
+ - a box is outside if even its corner furthest along a plane's normal is behind that plane. Picking that
+   corner is the clamp of the sphere-AABB test pushed to the end: per axis, max if the normal's component
+   is positive, min if not. The choice is the same for every box, so it is made once per plane.
+Both are conservative: an object near a corner of the frustum can be outside it and still pass every
+plane. That costs a few objects drawn for nothing, never one missing.
+
+The batch functions test 4, 8 or 16 objects at a time (SSE4.2, AVX2 or AVX-512, the level chosen by
+SphereAABBBatch.h; every path gives the same result as the scalar one) and write the indices of the
+visible ones. FrustumCuller spreads a batch over a WorkStealingPool, and can walk a BoxBVH instead of
+the boxes: a node wholly outside the frustum drops all of its boxes at once, one wholly inside keeps
+them all without a test, and planes a node is wholly inside of aren't tested again below it. A box's
+corners are inside its node's, and rounding can't reorder the sums, so the tree finds exactly the boxes
+the flat cull does.
+*/
+
+#ifndef _FRUSTUM_CULLING_H
+#define _FRUSTUM_CULLING_H
+
+#include "BoxBVH.h"
+#include "CollisionTypes.h"
+#include "WorkStealingPool.h"
+
+#include <vector>
+
+const int FRUSTUM_PLANE_COUNT = 6;
+
+// Planes a x + b y + c z + d = 0 with (a, b, c) a unit vector pointing into the frustum:
+// left, right, bottom, top, near, far.
+struct Frustum
+{
+	float planes[FRUSTUM_PLANE_COUNT][4];
+};
+
+// The frustum that PV (4 x 4, column major, like glm::mat4) maps onto the -1 to 1 clip cube.
+void extract_frustum_planes(const float* PV, Frustum &frustum);
+
+bool sphere_in_frustum(const Frustum &frustum, float x, float y, float z, float radius);
+bool box_in_frustum(const Frustum &frustum, float minX, float minY, float minZ, float maxX, float maxY, float maxZ);
+
+// Write the indices in [begin, end) of the visible spheres (boxes) to visible, in order, and return how many.
+// visible must have room for end - begin.
+size_t cull_spheres(const Frustum &frustum, const SphereArrays &spheres, size_t begin, size_t end, uint32_t* visible);
+size_t cull_boxes(const Frustum &frustum, const BoxArrays &boxes, size_t begin, size_t end, uint32_t* visible);
+
+// What the last cull did.
+struct CullStats
+{
+	size_t tested;		// Objects tested one by one.
+	size_t visible;
+	size_t culled;
+	size_t nodes;		// BVH nodes tested, for the hierarchical cull.
+};
+
+class FrustumCuller
+{
+public:
+	// chunkSize: objects per task, as in ParallelNarrowphase.
+	explicit FrustumCuller(WorkStealingPool &pool, size_t chunkSize = 4096);
+
+	// Replace visible with the indices of the visible spheres (boxes) in [0, count), in order.
+	void cull_spheres(const Frustum &frustum, const SphereArrays &spheres, size_t count, std::vector<uint32_t> &visible);
+	void cull_boxes(const Frustum &frustum, const BoxArrays &boxes, size_t count, std::vector<uint32_t> &visible);
+
+	// Replaces visible with the ids of the tree's visible boxes: the same set as the flat cull_boxes, in the tree's leaf order.
+	void cull_boxes(const Frustum &frustum, const BoxBVHView &bvh, std::vector<uint32_t> &visible);
+
+	const CullStats &stats() const { return lastStats; }
+	WorkStealingPool &thread_pool() { return pool; }
+
+private:
+	// A range [begin, end) of objects, or of the tree's leaf boxes, and where its visible ones went in scratch.
+	struct Task
+	{
+		size_t begin, end;
+		uint32_t node;			// Hierarchical: the subtree to walk, or NO_NODE for a range that is wholly visible.
+		uint32_t planeMask;		// Hierarchical: planes the subtree may still be outside of.
+		size_t visible;
+		size_t tested;
+		size_t nodes;
+	};
+
+	static const uint32_t NO_NODE = 0xFFFFFFFFu;
+
+	void split_tree(const Frustum &frustum, const BoxBVHView &bvh, uint32_t node, uint32_t planeMask, int depth, int splitDepth);
+	void gather(std::vector<uint32_t> &visible);
+
+	WorkStealingPool &pool;
+	size_t chunkSize;
+	std::vector<Task> tasks;
+	std::vector<uint32_t> scratch;
+	std::vector<size_t> offsets;
+	CullStats lastStats;
+};
+
+#endif // _FRUSTUM_CULLING_H
@@ -44,18 +44,17 @@ AABB-2D by Brockton Roth
 #include <vector>
 #include <string>
 #include <algorithm>
-#include "gl\glew.h"
-#include "glfw\glfw3.h"
-#include "glm\glm.hpp"
-#include "glm\gtc\matrix_transform.hpp"
-#include "glm\gtc\type_ptr.hpp"
-#include "glm\gtc\quaternion.hpp"
-#include "glm\gtx\quaternion.hpp"
-#include "glm\gtx\rotate_vector.hpp"
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/gtx/quaternion.hpp"
+#include "glm/gtx/rotate_vector.hpp"
 
 
 #define PI 3.14159265
-#define DIVISIONS  40
 
 // We create a VertexFormat struct, which defines how the data passed into the shader code wil be formatted
 struct VertexFormat
@@ -78,4 +77,4 @@ struct VertexFormat
 	}
 };
 
-#endif _GL_INCLUDES_H
\ No newline at end of file
+#endif // _GL_INCLUDES_H
\ No newline at end of file
@@ -0,0 +1,192 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: InstanceRing.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A buffer of DrawInstances (DrawInstances.h) that stays mapped, written every frame without a copy or an upload call.
+
+Refilling a buffer with glBufferData every frame means building the data in CPU memory, then the driver
+copying it again, and possibly waiting for the GPU to let go of last frame's storage. Instead, the buffer
+is made once with glBufferStorage and mapped persistently and coherently: the CPU writes the instances
+straight into memory the GPU reads, and nothing needs to be flushed or unmapped before drawing.
+
+The catch is that the GPU may still be drawing a frame while the CPU writes the next one, so the buffer
+has three parts and each frame uses the next. After a frame's draws a fence goes into the command stream,
+and before a part is written again the CPU waits on that part's fence. With three parts the wait is
+normally already over: the GPU would have to be two whole frames behind.
+
+glBufferStorage needs OpenGL 4.4 or ARB_buffer_storage. Without it, the ring falls back to one buffer
+refilled with glBufferData, from CPU memory, each frame.
+
+This header uses OpenGL but doesn't include it: include it after GLIncludes.h in the demo, or after
+<GL/glcorearb.h> in tools/RenderCheck.cpp. It is not part of the collision library.
+*/
+
+#ifndef _INSTANCE_RING_H
+#define _INSTANCE_RING_H
+
+#include "DrawInstances.h"
+
+#include <chrono>
+#include <vector>
+
+class InstanceRing
+{
+public:
+	// Parts of the buffer, one per frame in flight.
+	static const int FRAMES = 3;
+
+	// persistent: glBufferStorage can be used. Otherwise every frame is uploaded with glBufferData.
+	void init(bool persistent)
+	{
+		persistentMapping = persistent;
+		glGenBuffers(1, &buffer);
+		for (int i = 0; i < FRAMES; i++)
+			fences[i] = 0;
+	}
+
+	// Memory for count instances in this frame's part of the buffer, waiting first if the GPU may still read it.
+	DrawInstance* begin_frame(size_t count)
+	{
+		if (!persistentMapping)
+		{
+			staging.resize(count);
+			return staging.data();
+		}
+
+		if (count > capacity)
+			grow(count);
+		if (!persistentMapping)
+			return begin_frame(count);
+		wait(part);
+		return mapped + part * capacity;
+	}
+
+	// Call once this frame's instances are written. Returns the index in instance_buffer() of this frame's first instance.
+	size_t end_writes()
+	{
+		if (!persistentMapping)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(DrawInstance) * staging.size(), staging.data(), GL_STREAM_DRAW);
+			return 0;
+		}
+
+		// The mapping is coherent, so the writes are already visible to the draws that follow.
+		return part * capacity;
+	}
+
+	// Call after this frame's draws: fences its part, and moves on to the next.
+	void end_frame()
+	{
+		if (!persistentMapping)
+			return;
+
+		fences[part] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		part = (part + 1) % FRAMES;
+	}
+
+	GLuint instance_buffer() const { return buffer; }
+	bool persistent() const { return persistentMapping; }
+
+	// Times begin_frame had to wait for the GPU, and how long in total.
+	size_t waits() const { return waitCount; }
+	double wait_seconds() const { return waitTime; }
+
+	void destroy()
+	{
+		for (int i = 0; i < FRAMES; i++)
+			wait(i);
+		release();
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+
+private:
+	bool persistentMapping = false;
+	GLuint buffer = 0;
+	DrawInstance* mapped = nullptr;
+	size_t capacity = 0;		// Instances per part.
+	size_t part = 0;			// The part this frame writes.
+	GLsync fences[FRAMES];
+	std::vector<DrawInstance> staging;		// This frame's instances, without glBufferStorage.
+
+	size_t waitCount = 0;
+	double waitTime = 0.0;
+
+	// Blocks until the GPU is done with part p.
+	void wait(size_t p)
+	{
+		if (!fences[p])
+			return;
+
+		GLenum result = glClientWaitSync(fences[p], 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+		{
+			waitCount++;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			// The first wait flushes, so the fence is sure to reach the GPU; then wait in steps of a millisecond.
+			GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			do
+			{
+				result = glClientWaitSync(fences[p], flags, 1000000);
+				flags = 0;
+			} while (result == GL_TIMEOUT_EXPIRED);
+			waitTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		glDeleteSync(fences[p]);
+		fences[p] = 0;
+	}
+
+	void release()
+	{
+		if (!mapped)
+			return;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		mapped = nullptr;
+	}
+
+	// Storage made with glBufferStorage can't be resized, so a bigger buffer replaces it, once the GPU is done with every part.
+	void grow(size_t count)
+	{
+		for (int i = 0; i < FRAMES; i++)
+			wait(i);
+		release();
+		glDeleteBuffers(1, &buffer);
+
+		capacity = count > capacity * 2 ? count : capacity * 2;
+		part = 0;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLsizeiptr bytes = (GLsizeiptr)(sizeof(DrawInstance) * capacity * FRAMES);
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+		mapped = (DrawInstance*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+
+		// If the driver won't map it after all, go on with glBufferData, on a buffer without immutable storage.
+		if (!mapped)
+		{
+			persistentMapping = false;
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+		}
+	}
+};
+
+#endif // _INSTANCE_RING_H
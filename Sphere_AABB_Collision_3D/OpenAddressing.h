@@ -0,0 +1,94 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: OpenAddressing.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The hash table code shared by SpatialHash's cells, SweepAndPrune's pair set and PairCache.
+Each keeps a std::vector of slots, a power of two long, keyed by a 64-bit key where one value
+means "empty". Collisions are resolved by linear probing, and erasing shifts the rest of the
+probe run back instead of leaving a tombstone, so lookups never have to skip dead slots.
+
+The slot type is up to the table; key_of(slot) returns its key.
+*/
+
+#ifndef _OPEN_ADDRESSING_H
+#define _OPEN_ADDRESSING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Home slot of key in a table of mask + 1 slots (Fibonacci hashing).
+inline size_t open_address_home(uint64_t key, size_t mask)
+{
+	return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+// Returns the slot holding key, or the empty slot where it would go.
+template <class Slot, class KeyOf>
+size_t open_address_find(const std::vector<Slot> &table, uint64_t key, uint64_t emptyKey, KeyOf key_of)
+{
+	size_t mask = table.size() - 1;
+	size_t slot = open_address_home(key, mask);
+	while (key_of(table[slot]) != key && key_of(table[slot]) != emptyKey)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+// Empties a slot without leaving a tombstone: later entries of the same probe run are shifted back.
+// empty is what an unused slot holds.
+template <class Slot, class KeyOf>
+void open_address_erase(std::vector<Slot> &table, size_t hole, const Slot &empty, KeyOf key_of)
+{
+	uint64_t emptyKey = key_of(empty);
+	size_t mask = table.size() - 1;
+	size_t next = hole;
+	for (;;)
+	{
+		next = (next + 1) & mask;
+		if (key_of(table[next]) == emptyKey)
+			break;
+
+		// An entry may move into the hole only if its home slot isn't between the hole and where it sits now.
+		size_t home = open_address_home(key_of(table[next]), mask);
+		bool stays = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+		if (stays)
+			continue;
+
+		table[hole] = table[next];
+		hole = next;
+	}
+
+	table[hole] = empty;
+}
+
+// Replaces table with one twice as long, holding the same entries.
+template <class Slot, class KeyOf>
+void open_address_grow(std::vector<Slot> &table, const Slot &empty, KeyOf key_of)
+{
+	uint64_t emptyKey = key_of(empty);
+	std::vector<Slot> old;
+	old.swap(table);
+	table.assign(old.size() * 2, empty);
+
+	for (const Slot &s : old)
+	{
+		if (key_of(s) != emptyKey)
+			table[open_address_find(table, key_of(s), emptyKey, key_of)] = s;
+	}
+}
+
+#endif // _OPEN_ADDRESSING_H
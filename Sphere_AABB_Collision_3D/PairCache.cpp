@@ -0,0 +1,180 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: PairCache.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The pair table and the enter/exit bookkeeping. See PairCache.h.
+*/
+
+#include "PairCache.h"
+#include "OpenAddressing.h"
+
+#include <algorithm>
+
+PairCache::PairCache()
+	: count(0), touchingCount(0)
+{
+	Slot empty = { EMPTY_KEY, 0, 0 };
+	table.assign(1024, empty);
+}
+
+#pragma region Table
+size_t PairCache::find(uint64_t key) const
+{
+	size_t slot = open_address_find(table, key, EMPTY_KEY, slot_key);
+	return table[slot].key == key ? slot : NOT_FOUND;
+}
+
+bool PairCache::add(const CollisionPair &pair)
+{
+	// At most half full, as in SweepAndPrune.
+	if ((count + 1) * 2 > table.size())
+		grow();
+
+	uint64_t key = key_of(pair);
+	size_t slot = open_address_find(table, key, EMPTY_KEY, slot_key);
+	if (table[slot].key == key)
+		return false;
+
+	Slot added = { key, 0, 0 };
+	table[slot] = added;
+	count++;
+
+	if (pair.sphere >= sphereBoxes.size())
+		sphereBoxes.resize(pair.sphere + 1);
+	sphereBoxes[pair.sphere].push_back(pair.box);
+	return true;
+}
+
+bool PairCache::remove(const CollisionPair &pair)
+{
+	size_t slot = find(key_of(pair));
+	if (slot == NOT_FOUND)
+		return false;
+
+	if (table[slot].touching)
+	{
+		touchingCount--;
+		record(pair, false);
+	}
+	erase_slot(slot);
+
+	// A sphere's list is as long as the boxes near it: a short search, and the last one takes the gap.
+	std::vector<uint32_t> &boxes = sphereBoxes[pair.sphere];
+	*std::find(boxes.begin(), boxes.end(), pair.box) = boxes.back();
+	boxes.pop_back();
+	return true;
+}
+
+void PairCache::erase_slot(size_t hole)
+{
+	Slot empty = { EMPTY_KEY, 0, 0 };
+	open_address_erase(table, hole, empty, slot_key);
+	count--;
+}
+
+void PairCache::grow()
+{
+	Slot empty = { EMPTY_KEY, 0, 0 };
+	open_address_grow(table, empty, slot_key);
+}
+#pragma endregion
+
+#pragma region State
+bool PairCache::set_touching(const CollisionPair &pair, bool touching)
+{
+	size_t slot = find(key_of(pair));
+	if (slot == NOT_FOUND)
+		return false;
+
+	Slot &s = table[slot];
+	if ((s.touching != 0) == touching)
+		return true;
+
+	s.touching = touching ? 1 : 0;
+	touchingCount += touching ? 1 : -1;
+	record(pair, touching);
+	return true;
+}
+
+bool PairCache::is_touching(const CollisionPair &pair) const
+{
+	size_t slot = find(key_of(pair));
+	return slot != NOT_FOUND && table[slot].touching != 0;
+}
+
+uint32_t* PairCache::user_data(const CollisionPair &pair)
+{
+	size_t slot = find(key_of(pair));
+	return slot == NOT_FOUND ? nullptr : &table[slot].user;
+}
+
+void PairCache::record(const CollisionPair &pair, bool begin)
+{
+	Change c = { pair, (uint32_t)changes.size(), begin };
+	changes.push_back(c);
+}
+#pragma endregion
+
+#pragma region Events
+size_t PairCache::flush(uint32_t frame, std::vector<CollisionEvent> &events)
+{
+	// By pair, and in the order recorded within a pair. Each change flips the state, so a pair that changed an
+	// odd number of times ends up flipped, the way its last change says; one that changed an even number is back where it was.
+	std::sort(changes.begin(), changes.end(), [](const Change &a, const Change &b)
+	{
+		return a.pair < b.pair || (a.pair == b.pair && a.order < b.order);
+	});
+
+	size_t first = events.size();
+	for (size_t i = 0; i < changes.size();)
+	{
+		size_t end = i + 1;
+		while (end < changes.size() && changes[end].pair == changes[i].pair)
+			end++;
+		if ((end - i) & 1)
+		{
+			CollisionEvent e = { frame, changes[end - 1].pair, changes[end - 1].begin };
+			events.push_back(e);
+		}
+		i = end;
+	}
+	changes.clear();
+
+	for (size_t i = first; i < events.size(); i++)
+	{
+		for (PairListener* listener : listeners)
+		{
+			if (events[i].begin)
+				listener->pair_entered(events[i]);
+			else
+				listener->pair_exited(events[i]);
+		}
+	}
+	return events.size() - first;
+}
+
+void PairCache::subscribe(PairListener* listener)
+{
+	if (std::find(listeners.begin(), listeners.end(), listener) == listeners.end())
+		listeners.push_back(listener);
+}
+
+void PairCache::unsubscribe(PairListener* listener)
+{
+	listeners.erase(std::remove(listeners.begin(), listeners.end(), listener), listeners.end());
+}
+#pragma endregion
@@ -0,0 +1,139 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: PairCache.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+What every sphere/box pair was doing last frame, kept from one frame to the next.
+
+The demo's update() used to work out the whole collision state again every frame and write it over
+the "blue" flag. Nothing remembered what touched before, so anything that only cares about changes
+(a sound when a sphere hits a box, a contact solver that starts from last frame's answer) had to
+compare whole lists to find them. This cache holds the pairs whose bounds overlap, keyed by
+(sphere, box) in an open addressing table like SweepAndPrune's pair set, and for each one whether it
+touches and a word of the caller's own data (an index into a contact array, say, for warm starting),
+kept for as long as the pair stays in the cache. Each sphere also has the list of its cached boxes, so the
+pairs of the spheres that moved are found without looking at anyone else's.
+
+The broadphase says which pairs to add and remove, the exact test says which touch, and only a change
+is recorded. flush() then hands the frame's enters and exits, sorted by pair, to the caller's event
+list and to every subscribed PairListener. A pair that enters and exits in the same frame is no event.
+A pair whose state didn't change costs nothing after the exact test: Simulation (Simulation.h) doesn't
+even test it again unless its sphere moved.
+*/
+
+#ifndef _PAIR_CACHE_H
+#define _PAIR_CACHE_H
+
+#include "CollisionTypes.h"
+
+#include <vector>
+
+// Told about every pair that starts or stops touching, from the thread that calls flush().
+class PairListener
+{
+public:
+	virtual ~PairListener() {}
+	virtual void pair_entered(const CollisionEvent &/*event*/) {}
+	virtual void pair_exited(const CollisionEvent &/*event*/) {}
+};
+
+class PairCache
+{
+public:
+	PairCache();
+
+	// The pair's bounds began overlapping: it is cached, not touching, with user data 0. False if it already was.
+	bool add(const CollisionPair &pair);
+
+	// The pair's bounds stopped overlapping: it leaves the cache, and exits if it was touching. False if it wasn't cached.
+	bool remove(const CollisionPair &pair);
+
+	// The exact test's answer for a cached pair. An enter or exit is recorded only if the answer changed.
+	// False if the pair isn't cached.
+	bool set_touching(const CollisionPair &pair, bool touching);
+
+	bool contains(const CollisionPair &pair) const { return find(key_of(pair)) != NOT_FOUND; }
+	bool is_touching(const CollisionPair &pair) const;
+
+	// The caller's word for a cached pair, or null. The pointer is good until the next add() or remove().
+	uint32_t* user_data(const CollisionPair &pair);
+
+	// Appends the enters and exits recorded since the last flush to events, sorted by pair, tells every
+	// listener in the same order, and returns how many there were.
+	size_t flush(uint32_t frame, std::vector<CollisionEvent> &events);
+
+	// Listeners are called in the order they subscribed. The cache doesn't own them.
+	void subscribe(PairListener* listener);
+	void unsubscribe(PairListener* listener);
+
+	// The boxes cached with sphere, in no particular order. Good until the next add() or remove().
+	const std::vector<uint32_t> &boxes_of(uint32_t sphere) const { return sphere < sphereBoxes.size() ? sphereBoxes[sphere] : noBoxes; }
+
+	// Calls visit(pair, touching) for every cached pair, in no particular order.
+	template <class Visit>
+	void for_each(Visit &&visit) const;
+
+	size_t size() const { return count; }
+	size_t touching_count() const { return touchingCount; }
+
+private:
+	struct Slot
+	{
+		uint64_t key;		// sphere << 32 | box, or EMPTY_KEY.
+		uint32_t user;
+		uint32_t touching;
+	};
+
+	// A change of state, in the order it was recorded. flush() cancels out pairs that changed an even number of times.
+	struct Change
+	{
+		CollisionPair pair;
+		uint32_t order;
+		bool begin;
+	};
+
+	static const uint64_t EMPTY_KEY = ~0ull;
+	static const size_t NOT_FOUND = ~(size_t)0;
+
+	static uint64_t key_of(const CollisionPair &pair) { return ((uint64_t)pair.sphere << 32) | pair.box; }
+	static CollisionPair pair_of(uint64_t key) { return CollisionPair{ (uint32_t)(key >> 32), (uint32_t)key }; }
+	static uint64_t slot_key(const Slot &slot) { return slot.key; }
+
+	size_t find(uint64_t key) const;
+	void erase_slot(size_t hole);
+	void grow();
+	void record(const CollisionPair &pair, bool begin);
+
+	std::vector<Slot> table;
+	std::vector<std::vector<uint32_t>> sphereBoxes;		// Indexed by sphere id, grown as ids show up.
+	std::vector<uint32_t> noBoxes;
+	size_t count;
+	size_t touchingCount;
+	std::vector<Change> changes;
+	std::vector<PairListener*> listeners;
+};
+
+template <class Visit>
+void PairCache::for_each(Visit &&visit) const
+{
+	for (const Slot &slot : table)
+	{
+		if (slot.key != EMPTY_KEY)
+			visit(pair_of(slot.key), slot.touching != 0);
+	}
+}
+
+#endif // _PAIR_CACHE_H
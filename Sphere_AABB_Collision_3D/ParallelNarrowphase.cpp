@@ -0,0 +1,99 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: ParallelNarrowphase.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Chunked, work stolen narrowphase with an ordered merge. See ParallelNarrowphase.h.
+*/
+
+#include "ParallelNarrowphase.h"
+
+#include <algorithm>
+
+ParallelNarrowphase::ParallelNarrowphase(WorkStealingPool &pool, size_t chunkSize)
+	: pool(pool), chunkSize(chunkSize > 0 ? chunkSize : 1)
+{
+	workers.resize(pool.thread_count());
+}
+
+// Copies every chunk's results from the thread buffer it was written to into out, in chunk order.
+template <class Item>
+void ParallelNarrowphase::merge(std::vector<Item> WorkerState::*buffer, std::vector<Item> &out)
+{
+	size_t chunkCount = chunks.size();
+	outputOffsets.resize(chunkCount + 1);
+	outputOffsets[0] = 0;
+	for (size_t c = 0; c < chunkCount; c++)
+		outputOffsets[c + 1] = outputOffsets[c] + chunks[c].count;
+
+	out.resize(outputOffsets[chunkCount]);
+	pool.parallel_for(chunkCount, [&](size_t c, int) {
+		const ChunkResult &chunk = chunks[c];
+		const std::vector<Item> &source = workers[chunk.worker].*buffer;
+		std::copy(source.begin() + chunk.offset, source.begin() + chunk.offset + chunk.count, out.begin() + outputOffsets[c]);
+	});
+}
+
+void ParallelNarrowphase::find_overlaps(const SphereArrays &spheres, const BoxArrays &boxes, const CollisionPair* candidates, size_t count,
+	std::vector<CollisionPair> &overlaps)
+{
+	chunks.resize((count + chunkSize - 1) / chunkSize);
+	for (WorkerState &w : workers)
+		w.overlaps.clear();
+
+	pool.parallel_for(chunks.size(), [&](size_t c, int worker) {
+		WorkerState &state = workers[worker];
+		size_t begin = c * chunkSize;
+		size_t n = std::min(chunkSize, count - begin);
+
+		size_t offset = state.overlaps.size();
+		collide_candidates(spheres, boxes, candidates + begin, n, state.overlaps, state.scratch);
+
+		ChunkResult result = { worker, offset, state.overlaps.size() - offset };
+		chunks[c] = result;
+	});
+
+	merge(&WorkerState::overlaps, overlaps);
+}
+
+void ParallelNarrowphase::generate_contacts(const SphereArrays &spheres, const BoxArrays &boxes, const CollisionPair* candidates, size_t count,
+	std::vector<Contact> &contacts)
+{
+	chunks.resize((count + chunkSize - 1) / chunkSize);
+	for (WorkerState &w : workers)
+		w.contacts.clear();
+
+	pool.parallel_for(chunks.size(), [&](size_t c, int worker) {
+		WorkerState &state = workers[worker];
+		size_t begin = c * chunkSize;
+		size_t n = std::min(chunkSize, count - begin);
+
+		// Room for every candidate to collide, then trimmed to what did.
+		size_t offset = state.contacts.size();
+		state.contacts.resize(offset + n);
+		size_t found = ::generate_contacts(spheres, boxes, candidates + begin, n, state.contacts.data() + offset, n);
+		state.contacts.resize(offset + found);
+
+		// Chunk-relative candidate indices to indices into the whole list.
+		for (size_t k = offset; k < offset + found; k++)
+			state.contacts[k].index += (uint32_t)begin;
+
+		ChunkResult result = { worker, offset, found };
+		chunks[c] = result;
+	});
+
+	merge(&WorkerState::contacts, contacts);
+}
@@ -0,0 +1,84 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: ParallelNarrowphase.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The exact test (or contact generation) for a broadphase's candidate pairs, spread over all cores.
+
+The candidates are cut into fixed size chunks, and the chunks are handed out by a WorkStealingPool.
+Each thread writes what it finds into its own buffer, so threads never share an output.
+Afterwards the chunks' results are copied into the output in chunk order, in parallel, each to a
+position worked out from the sizes of the chunks before it.
+
+So the output is always in candidate order: exactly what collide_candidates() / generate_contacts() give
+on one thread, at any thread count and whichever thread happened to run which chunk.
+That keeps replays and tests reproducible.
+All buffers are kept between calls, so after the first few frames nothing allocates.
+*/
+
+#ifndef _PARALLEL_NARROWPHASE_H
+#define _PARALLEL_NARROWPHASE_H
+
+#include "CollisionTypes.h"
+#include "SphereAABBBatch.h"
+#include "SphereAABBContacts.h"
+#include "WorkStealingPool.h"
+
+class ParallelNarrowphase
+{
+public:
+	// chunkSize: candidates per task. Big enough that taking a task costs nothing next to running it,
+	// small enough that there are many more tasks than threads to balance with.
+	explicit ParallelNarrowphase(WorkStealingPool &pool, size_t chunkSize = 4096);
+
+	// Replaces overlaps with the candidates that really overlap, in candidate order.
+	void find_overlaps(const SphereArrays &spheres, const BoxArrays &boxes, const CollisionPair* candidates, size_t count,
+		std::vector<CollisionPair> &overlaps);
+
+	// Replaces contacts with one contact per colliding candidate, in candidate order. Contact::index is the candidate's index.
+	void generate_contacts(const SphereArrays &spheres, const BoxArrays &boxes, const CollisionPair* candidates, size_t count,
+		std::vector<Contact> &contacts);
+
+	WorkStealingPool &thread_pool() { return pool; }
+
+private:
+	// Where one chunk's results ended up: which thread's buffer, where in it, and how many.
+	struct ChunkResult
+	{
+		int worker;
+		size_t offset;
+		size_t count;
+	};
+
+	// One thread's output buffers and scratch space. Each thread only touches its own.
+	struct WorkerState
+	{
+		std::vector<CollisionPair> overlaps;
+		std::vector<Contact> contacts;
+		CandidateScratch scratch;
+	};
+
+	template <class Item>
+	void merge(std::vector<Item> WorkerState::*buffer, std::vector<Item> &out);
+
+	WorkStealingPool &pool;
+	size_t chunkSize;
+	std::vector<ChunkResult> chunks;
+	std::vector<size_t> outputOffsets;
+	std::vector<WorkerState> workers;
+};
+
+#endif // _PARALLEL_NARROWPHASE_H
@@ -0,0 +1,193 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: ProgramCache.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A file that keeps the linked shader program between runs, so startup doesn't compile the shaders again.
+
+init() reads the shaders and compiles and links them on every launch. The driver's compiler is often
+the slowest part of starting up, and the result is the same every time unless the shaders or the
+driver changed. glGetProgramBinary hands back the linked program as the driver's own binary, and
+glProgramBinary loads it into a new program object without compiling anything.
+
+The binary is only good for the same sources on the same driver, so the file starts with a key: a
+64 bit FNV-1a hash of both shader sources and the GL_VENDOR, GL_RENDERER and GL_VERSION strings.
+If the file is missing, the key differs, or the driver rejects the binary (it may, after an update
+the strings don't show), load_cached_program returns 0 with the reason, and the caller compiles
+as before and saves the new program for next time.
+
+Program binaries need OpenGL 4.1 or ARB_get_program_binary, and a driver with at least one binary format.
+
+This header uses OpenGL but doesn't include it: include it after GLIncludes.h in the demo, or after
+<GL/glcorearb.h> in tools/RenderCheck.cpp. It is not part of the collision library.
+*/
+
+#ifndef _PROGRAM_CACHE_H
+#define _PROGRAM_CACHE_H
+
+#include "Fnv1a.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// "SPBC" and the layout version, at the start of the file.
+const uint32_t PROGRAM_CACHE_MAGIC = 0x43425053;
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;		// The binaryFormat glGetProgramBinary returned.
+	uint32_t length;		// Bytes of binary after the header.
+};
+
+// The key for these sources on the current context's driver. The length of each part goes in too,
+// so moving text from one shader to the other changes the key.
+inline uint64_t program_cache_key(const std::string &vertexSource, const std::string &fragmentSource)
+{
+	const GLenum names[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	std::string parts[5] = { vertexSource, fragmentSource };
+	for (int i = 0; i < 3; i++)
+	{
+		const GLubyte* name = glGetString(names[i]);
+		parts[2 + i] = name ? (const char*)name : "";
+	}
+
+	uint64_t hash = fnv1a(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+	for (const std::string &part : parts)
+	{
+		uint64_t length = part.size();
+		hash = fnv1a(&length, sizeof(length), hash);
+		hash = fnv1a(part.data(), part.size(), hash);
+	}
+	return hash;
+}
+
+// True if the driver can hand out program binaries at all.
+inline bool program_binaries_supported()
+{
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// A linked program made from the binary in path, or 0 with the reason in why.
+inline GLuint load_cached_program(const std::string &path, uint64_t key, std::string &why)
+{
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		why = "no cache file " + path;
+		return 0;
+	}
+
+	ProgramCacheHeader header;
+	std::vector<char> binary;
+	bool read = std::fread(&header, sizeof(header), 1, file) == 1;
+	if (read && header.magic == PROGRAM_CACHE_MAGIC && header.version == PROGRAM_CACHE_VERSION && header.key == key)
+	{
+		// The length comes from the file too: only believe it if the rest of the file is exactly that long,
+		// so a damaged one can't make us allocate gigabytes.
+		long end = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+		read = end >= (long)sizeof(header) && (unsigned long)end - sizeof(header) == header.length && header.length > 0 &&
+			std::fseek(file, (long)sizeof(header), SEEK_SET) == 0;
+		if (read)
+		{
+			binary.resize(header.length);
+			read = std::fread(binary.data(), 1, binary.size(), file) == binary.size();
+		}
+	}
+	std::fclose(file);
+
+	if (!read)
+	{
+		why = "cache file " + path + " is damaged";
+		return 0;
+	}
+	if (header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION || header.key != key)
+	{
+		why = "cache file " + path + " is for other shaders or another driver";
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, (GLenum)header.format, binary.data(), (GLsizei)binary.size());
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE)
+	{
+		glDeleteProgram(program);
+		why = "the driver rejected the binary in " + path;
+		return 0;
+	}
+	return program;
+}
+
+// Call before glLinkProgram on a program that will be saved: some drivers only keep a binary when asked to.
+inline void keep_program_binary(GLuint program)
+{
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+// Writes a linked program's binary to path under key. False, with the reason in error, if it couldn't.
+inline bool save_cached_program(const std::string &path, uint64_t key, GLuint program, std::string &error)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		error = "the driver gave no program binary";
+		return false;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+	{
+		error = "the driver gave no program binary";
+		return false;
+	}
+
+	ProgramCacheHeader header = { PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, (uint32_t)format, (uint32_t)written };
+
+	// Written to a temporary file and renamed, so a crash halfway never leaves a damaged cache behind.
+	std::string temporary = path + ".tmp";
+	FILE* file = std::fopen(temporary.c_str(), "wb");
+	if (!file)
+	{
+		error = "Can't write file: " + temporary;
+		return false;
+	}
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fwrite(binary.data(), 1, written, file) == (size_t)written;
+	ok = std::fclose(file) == 0 && ok;
+	std::remove(path.c_str());
+	if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporary.c_str());
+		error = "Can't write file: " + path;
+		return false;
+	}
+	return true;
+}
+
+#endif // _PROGRAM_CACHE_H
@@ -0,0 +1,379 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: QuantizedBoxBVH.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Conservative quantization of a BoxBVH's boxes, and queries that decode them on the fly. See QuantizedBoxBVH.h.
+The SIMD setup (target attributes, AVX-512 availability) comes from SimdSupport.h, and every path
+decodes with the same float operations in the same order as decode() below, so they all give the same bits.
+*/
+
+#include "QuantizedBoxBVH.h"
+#include "SimdSupport.h"
+#include "SphereAABBBatch.h"
+
+#include <cmath>
+
+namespace
+{
+	// Boxes stored past the last one, so the widest SIMD load at the last box stays inside the arrays.
+	const size_t PADDING = 16;
+
+	// The one way a quantized coordinate becomes a float, here and (lane by lane) in every SIMD path.
+	inline float decode(float origin, float step, uint32_t q)
+	{
+		return origin + (float)q * step;
+	}
+
+	// The smallest q whose coordinate is at or below value, so the box can only grow.
+	uint16_t quantize_down(float value, float origin, float step)
+	{
+		if (step == 0.0f)
+			return 0;
+		double q = std::floor(((double)value - origin) / step);
+		uint32_t result = q <= 0.0 ? 0 : q >= QuantizedBoxBVH::QUANTIZED_MAX ? QuantizedBoxBVH::QUANTIZED_MAX : (uint32_t)q;
+		while (result > 0 && decode(origin, step, result) > value)
+			result--;
+		return (uint16_t)result;
+	}
+
+	// The largest q whose coordinate is at or above value.
+	uint16_t quantize_up(float value, float origin, float step)
+	{
+		if (step == 0.0f)
+			return 0;
+		double q = std::ceil(((double)value - origin) / step);
+		uint32_t result = q <= 0.0 ? 0 : q >= QuantizedBoxBVH::QUANTIZED_MAX ? QuantizedBoxBVH::QUANTIZED_MAX : (uint32_t)q;
+		while (result < QuantizedBoxBVH::QUANTIZED_MAX && decode(origin, step, result) < value)
+			result++;
+		return (uint16_t)result;
+	}
+
+	// The step for an axis from origin to max: small enough to be precise, and just large enough that
+	// QUANTIZED_MAX decodes to max or beyond, so every box in the leaf can be rounded up.
+	float leaf_step(float origin, float max)
+	{
+		if (!(max > origin))
+			return 0.0f;
+		float step = (max - origin) / (float)QuantizedBoxBVH::QUANTIZED_MAX;
+		while (decode(origin, step, QuantizedBoxBVH::QUANTIZED_MAX) < max)
+			step = std::nextafter(step, INFINITY);
+		return step;
+	}
+
+	// Everything a query needs, in one place for the leaf tests.
+	struct QuantizedArrays
+	{
+		const BVHNode* nodes;
+		const QuantizedLeaf* leaves;
+		const uint16_t* minX; const uint16_t* minY; const uint16_t* minZ;
+		const uint16_t* maxX; const uint16_t* maxY; const uint16_t* maxZ;
+		const uint32_t* boxIds;
+	};
+
+	struct SphereQuery
+	{
+		float x, y, z, radius;
+	};
+
+	// Where the results of a query go: up to capacity ids into out, or every pair into pairs.
+	struct Sink
+	{
+		uint32_t* out;
+		size_t capacity;
+		size_t found;
+		std::vector<CollisionPair>* pairs;
+		uint32_t sphere;
+
+		void report(uint32_t id)
+		{
+			if (pairs)
+				pairs->push_back(CollisionPair{ sphere, id });
+			else if (found < capacity)
+				out[found] = id;
+			found++;
+		}
+	};
+
+	// Walks the tree like BoxBVHView::for_each_overlap. At each leaf, Chunk tests LANES boxes from box k
+	// and returns a bit per box; bits past the leaf's last box are dropped here.
+	template <int LANES, class Chunk>
+	FORCE_INLINE void traverse(const QuantizedArrays &q, size_t nodeCount, const SphereQuery &s, Sink &sink, Chunk chunk)
+	{
+		if (nodeCount == 0)
+			return;
+
+		uint32_t stack[BVH_MAX_DEPTH];
+		int top = 0;
+		uint32_t i = 0;
+
+		for (;;)
+		{
+			const BVHNode &node = q.nodes[i];
+			if (sphere_aabb_overlap(s.x, s.y, s.z, s.radius, node.min[0], node.min[1], node.min[2], node.max[0], node.max[1], node.max[2]))
+			{
+				if (!node.is_leaf())
+				{
+					stack[top++] = node.rightOrFirst;
+					i = i + 1;
+					continue;
+				}
+
+				const QuantizedLeaf &leaf = q.leaves[node.rightOrFirst];
+				uint32_t end = leaf.first + node.count;
+				for (uint32_t k = leaf.first; k < end; k += LANES)
+				{
+					uint64_t mask = chunk(q, s, node, leaf, k);
+					uint32_t valid = end - k;
+					if (valid < LANES)
+						mask &= (uint64_t(1) << valid) - 1;
+					while (mask)
+					{
+						uint32_t lane = 0;
+						while (!(mask & (uint64_t(1) << lane)))
+							lane++;
+						mask &= mask - 1;
+						sink.report(q.boxIds[k + lane]);
+					}
+				}
+			}
+
+			if (top == 0)
+				return;
+			i = stack[--top];
+		}
+	}
+
+	struct ChunkScalar
+	{
+		uint64_t operator()(const QuantizedArrays &q, const SphereQuery &s, const BVHNode &node, const QuantizedLeaf &leaf, uint32_t k) const
+		{
+			return sphere_aabb_overlap(s.x, s.y, s.z, s.radius,
+				decode(node.min[0], leaf.step[0], q.minX[k]), decode(node.min[1], leaf.step[1], q.minY[k]), decode(node.min[2], leaf.step[2], q.minZ[k]),
+				decode(node.min[0], leaf.step[0], q.maxX[k]), decode(node.min[1], leaf.step[1], q.maxY[k]), decode(node.min[2], leaf.step[2], q.maxZ[k])) ? 1 : 0;
+		}
+	};
+
+	void query_scalar(const QuantizedArrays &q, size_t nodeCount, const SphereQuery &s, Sink &sink)
+	{
+		traverse<1>(q, nodeCount, s, sink, ChunkScalar());
+	}
+
+#if COLLISION_X86
+	// 4 boxes: widen 4 uint16 to int32 (SSE4.1), convert, then origin + q * step.
+	struct ChunkSse
+	{
+		SIMD_TARGET("sse4.2")
+		static __m128 decode4(const uint16_t* q, float origin, float step)
+		{
+			__m128i wide = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)q));
+			return _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(_mm_cvtepi32_ps(wide), _mm_set1_ps(step)));
+		}
+
+		SIMD_TARGET("sse4.2")
+		uint64_t operator()(const QuantizedArrays &q, const SphereQuery &s, const BVHNode &node, const QuantizedLeaf &leaf, uint32_t k) const
+		{
+			__m128 cx = _mm_set1_ps(s.x), cy = _mm_set1_ps(s.y), cz = _mm_set1_ps(s.z);
+			__m128 dx = _mm_sub_ps(cx, _mm_min_ps(_mm_max_ps(cx, decode4(q.minX + k, node.min[0], leaf.step[0])), decode4(q.maxX + k, node.min[0], leaf.step[0])));
+			__m128 dy = _mm_sub_ps(cy, _mm_min_ps(_mm_max_ps(cy, decode4(q.minY + k, node.min[1], leaf.step[1])), decode4(q.maxY + k, node.min[1], leaf.step[1])));
+			__m128 dz = _mm_sub_ps(cz, _mm_min_ps(_mm_max_ps(cz, decode4(q.minZ + k, node.min[2], leaf.step[2])), decode4(q.maxZ + k, node.min[2], leaf.step[2])));
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			return (uint64_t)_mm_movemask_ps(_mm_cmple_ps(d2, _mm_set1_ps(s.radius * s.radius)));
+		}
+	};
+
+	SIMD_TARGET("sse4.2")
+	void query_sse(const QuantizedArrays &q, size_t nodeCount, const SphereQuery &s, Sink &sink)
+	{
+		traverse<4>(q, nodeCount, s, sink, ChunkSse());
+	}
+
+	// 8 boxes.
+	struct ChunkAvx2
+	{
+		SIMD_TARGET("avx2")
+		static __m256 decode8(const uint16_t* q, float origin, float step)
+		{
+			__m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)q));
+			return _mm256_add_ps(_mm256_set1_ps(origin), _mm256_mul_ps(_mm256_cvtepi32_ps(wide), _mm256_set1_ps(step)));
+		}
+
+		SIMD_TARGET("avx2")
+		uint64_t operator()(const QuantizedArrays &q, const SphereQuery &s, const BVHNode &node, const QuantizedLeaf &leaf, uint32_t k) const
+		{
+			__m256 cx = _mm256_set1_ps(s.x), cy = _mm256_set1_ps(s.y), cz = _mm256_set1_ps(s.z);
+			__m256 dx = _mm256_sub_ps(cx, _mm256_min_ps(_mm256_max_ps(cx, decode8(q.minX + k, node.min[0], leaf.step[0])), decode8(q.maxX + k, node.min[0], leaf.step[0])));
+			__m256 dy = _mm256_sub_ps(cy, _mm256_min_ps(_mm256_max_ps(cy, decode8(q.minY + k, node.min[1], leaf.step[1])), decode8(q.maxY + k, node.min[1], leaf.step[1])));
+			__m256 dz = _mm256_sub_ps(cz, _mm256_min_ps(_mm256_max_ps(cz, decode8(q.minZ + k, node.min[2], leaf.step[2])), decode8(q.maxZ + k, node.min[2], leaf.step[2])));
+			__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+			return (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_set1_ps(s.radius * s.radius), _CMP_LE_OQ));
+		}
+	};
+
+	SIMD_TARGET("avx2")
+	void query_avx2(const QuantizedArrays &q, size_t nodeCount, const SphereQuery &s, Sink &sink)
+	{
+		traverse<8>(q, nodeCount, s, sink, ChunkAvx2());
+	}
+
+#if COLLISION_HAS_AVX512
+	// 16 boxes: a whole default leaf at once.
+	struct ChunkAvx512
+	{
+		SIMD_TARGET("avx512f")
+		static __m512 decode16(const uint16_t* q, float origin, float step)
+		{
+			__m512i wide = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)q));
+			return _mm512_add_ps(_mm512_set1_ps(origin), _mm512_mul_ps(_mm512_cvtepi32_ps(wide), _mm512_set1_ps(step)));
+		}
+
+		SIMD_TARGET("avx512f")
+		uint64_t operator()(const QuantizedArrays &q, const SphereQuery &s, const BVHNode &node, const QuantizedLeaf &leaf, uint32_t k) const
+		{
+			__m512 cx = _mm512_set1_ps(s.x), cy = _mm512_set1_ps(s.y), cz = _mm512_set1_ps(s.z);
+			__m512 dx = _mm512_sub_ps(cx, _mm512_min_ps(_mm512_max_ps(cx, decode16(q.minX + k, node.min[0], leaf.step[0])), decode16(q.maxX + k, node.min[0], leaf.step[0])));
+			__m512 dy = _mm512_sub_ps(cy, _mm512_min_ps(_mm512_max_ps(cy, decode16(q.minY + k, node.min[1], leaf.step[1])), decode16(q.maxY + k, node.min[1], leaf.step[1])));
+			__m512 dz = _mm512_sub_ps(cz, _mm512_min_ps(_mm512_max_ps(cz, decode16(q.minZ + k, node.min[2], leaf.step[2])), decode16(q.maxZ + k, node.min[2], leaf.step[2])));
+			__m512 d2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+			return (uint64_t)_mm512_cmp_ps_mask(d2, _mm512_set1_ps(s.radius * s.radius), _CMP_LE_OQ);
+		}
+	};
+
+	SIMD_TARGET("avx512f")
+	void query_avx512(const QuantizedArrays &q, size_t nodeCount, const SphereQuery &s, Sink &sink)
+	{
+		traverse<16>(q, nodeCount, s, sink, ChunkAvx512());
+	}
+#endif // COLLISION_HAS_AVX512
+#endif // COLLISION_X86
+
+	typedef void (*QueryFunction)(const QuantizedArrays&, size_t, const SphereQuery&, Sink&);
+
+	QueryFunction query_function()
+	{
+		switch (active_simd_level())
+		{
+#if COLLISION_X86
+#if COLLISION_HAS_AVX512
+		case SimdLevel::AVX512:	return query_avx512;
+#endif
+		case SimdLevel::AVX2:	return query_avx2;
+		case SimdLevel::SSE42:	return query_sse;
+#endif
+		default:				return query_scalar;
+		}
+	}
+}
+
+#pragma region Building
+void QuantizedBoxBVH::build(const BoxArrays &boxes, size_t count, int leafSize)
+{
+	BoxBVH::BuildOptions options;
+	options.maxLeafSize = leafSize;
+	options.minLeafSize = leafSize;
+	BoxBVH bvh;
+	bvh.build(boxes, count, options);
+	build(bvh);
+}
+
+void QuantizedBoxBVH::build(const BoxBVH &bvh)
+{
+	tree = bvh.nodes();
+	leaves.clear();
+	boxIds = bvh.leaf_box_ids();
+
+	const BoxSet &boxes = bvh.leaf_boxes();
+	size_t count = boxes.size();
+	std::vector<uint16_t>* arrays[6] = { &qMinX, &qMinY, &qMinZ, &qMaxX, &qMaxY, &qMaxZ };
+	for (std::vector<uint16_t>* a : arrays)
+		a->assign(count + PADDING, 0);
+
+	for (BVHNode &node : tree)
+	{
+		if (!node.is_leaf())
+			continue;
+
+		QuantizedLeaf leaf;
+		leaf.first = node.rightOrFirst;
+		for (int axis = 0; axis < 3; axis++)
+			leaf.step[axis] = leaf_step(node.min[axis], node.max[axis]);
+
+		for (uint32_t k = leaf.first; k < leaf.first + node.count; k++)
+		{
+			qMinX[k] = quantize_down(boxes.minX[k], node.min[0], leaf.step[0]);
+			qMinY[k] = quantize_down(boxes.minY[k], node.min[1], leaf.step[1]);
+			qMinZ[k] = quantize_down(boxes.minZ[k], node.min[2], leaf.step[2]);
+			qMaxX[k] = quantize_up(boxes.maxX[k], node.min[0], leaf.step[0]);
+			qMaxY[k] = quantize_up(boxes.maxY[k], node.min[1], leaf.step[1]);
+			qMaxZ[k] = quantize_up(boxes.maxZ[k], node.min[2], leaf.step[2]);
+		}
+
+		node.rightOrFirst = (uint32_t)leaves.size();
+		leaves.push_back(leaf);
+	}
+}
+#pragma endregion
+
+#pragma region Queries
+size_t QuantizedBoxBVH::query_sphere(float cx, float cy, float cz, float radius, uint32_t* out, size_t capacity) const
+{
+	QuantizedArrays q = { tree.data(), leaves.data(), qMinX.data(), qMinY.data(), qMinZ.data(), qMaxX.data(), qMaxY.data(), qMaxZ.data(), boxIds.data() };
+	SphereQuery s = { cx, cy, cz, radius };
+	Sink sink = { out, capacity, 0, nullptr, 0 };
+	query_function()(q, tree.size(), s, sink);
+	return sink.found;
+}
+
+void QuantizedBoxBVH::find_overlaps(const SphereArrays &spheres, size_t count, std::vector<CollisionPair> &overlaps) const
+{
+	QuantizedArrays q = { tree.data(), leaves.data(), qMinX.data(), qMinY.data(), qMinZ.data(), qMaxX.data(), qMaxY.data(), qMaxZ.data(), boxIds.data() };
+	QueryFunction query = query_function();
+	Sink sink = { nullptr, 0, 0, &overlaps, 0 };
+	for (size_t i = 0; i < count; i++)
+	{
+		SphereQuery s = { spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i] };
+		sink.sphere = (uint32_t)i;
+		query(q, tree.size(), s, sink);
+	}
+}
+
+AABB QuantizedBoxBVH::decoded_box(size_t k) const
+{
+	// The leaf holding box k: the tree is small next to the boxes, and this is only for checking.
+	for (const BVHNode &node : tree)
+	{
+		if (!node.is_leaf())
+			continue;
+		const QuantizedLeaf &leaf = leaves[node.rightOrFirst];
+		if (k < leaf.first || k >= leaf.first + node.count)
+			continue;
+
+		AABB b = {
+			{ decode(node.min[0], leaf.step[0], qMinX[k]), decode(node.min[1], leaf.step[1], qMinY[k]), decode(node.min[2], leaf.step[2], qMinZ[k]) },
+			{ decode(node.min[0], leaf.step[0], qMaxX[k]), decode(node.min[1], leaf.step[1], qMaxY[k]), decode(node.min[2], leaf.step[2], qMaxZ[k]) }
+		};
+		return b;
+	}
+	AABB none = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+	return none;
+}
+
+size_t QuantizedBoxBVH::memory_bytes() const
+{
+	return tree.size() * sizeof(BVHNode) + leaves.size() * sizeof(QuantizedLeaf)
+		+ 6 * qMinX.size() * sizeof(uint16_t) + boxIds.size() * sizeof(uint32_t);
+}
+#pragma endregion
@@ -0,0 +1,494 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SceneFile.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Writing, mapping and checking binary scene files. See SceneFile.h.
+*/
+
+#include "SceneFile.h"
+#include "Fnv1a.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	uint64_t align_up(uint64_t offset)
+	{
+		return (offset + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+	}
+
+	// Bytes each section should have, from the counts in the header. 0 for BVH sections without a BVH.
+	uint64_t expected_bytes(const SceneFileHeader &h, int s)
+	{
+		if (s <= SPHERE_RADIUS)
+			return h.sphereCount * sizeof(float);
+		if (s <= BOX_MAX_Z)
+			return h.boxCount * sizeof(float);
+		if (!(h.flags & SCENE_FILE_HAS_BVH))
+			return 0;
+		if (s == BVH_NODES)
+			return h.nodeCount * sizeof(BVHNode);
+		if (s == BVH_BOX_IDS)
+			return h.boxCount * sizeof(uint32_t);
+		return h.boxCount * sizeof(float);
+	}
+
+	// Appends to the file and hashes what it writes, so the checksum needs no second pass.
+	struct HashingWriter
+	{
+		FILE* file;
+		uint64_t offset;
+		uint64_t hash;
+		bool ok;
+
+		void write(const void* bytes, size_t count)
+		{
+			if (count == 0)
+				return;
+			ok = ok && std::fwrite(bytes, 1, count, file) == count;
+			hash = fnv1a(bytes, count, hash);
+			offset += count;
+		}
+
+		void pad_to(uint64_t target)
+		{
+			static const unsigned char zeros[SCENE_FILE_ALIGNMENT] = {};
+			while (offset < target)
+				write(zeros, (size_t)std::min<uint64_t>(target - offset, SCENE_FILE_ALIGNMENT));
+		}
+	};
+}
+
+bool is_scene_file_path(const std::string &path)
+{
+	return path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+}
+
+#pragma region Writing
+bool write_scene_file(const std::string &path, const Scene &scene, const BoxBVH* bvh, std::string &error)
+{
+	if (scene.spheres.size() > UINT32_MAX || scene.boxes.size() > UINT32_MAX)
+	{
+		error = "Too many spheres or boxes for 32 bit ids";
+		return false;
+	}
+	if (bvh && bvh->size() != scene.boxes.size())
+	{
+		error = "The BVH wasn't built over this scene's boxes";
+		return false;
+	}
+
+	SceneFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_FILE_VERSION;
+	header.byteOrder = SCENE_FILE_BYTE_ORDER;
+	header.headerBytes = sizeof(SceneFileHeader);
+	header.flags = bvh ? SCENE_FILE_HAS_BVH : 0;
+	header.sphereCount = scene.spheres.size();
+	header.boxCount = scene.boxes.size();
+	header.nodeCount = bvh ? bvh->nodes().size() : 0;
+	header.bvhDepth = bvh ? (uint32_t)bvh->depth() : 0;
+
+	const void* arrays[SCENE_SECTION_COUNT] = {
+		scene.spheres.x.data(), scene.spheres.y.data(), scene.spheres.z.data(), scene.spheres.radius.data(),
+		scene.boxes.minX.data(), scene.boxes.minY.data(), scene.boxes.minZ.data(),
+		scene.boxes.maxX.data(), scene.boxes.maxY.data(), scene.boxes.maxZ.data(),
+	};
+	if (bvh)
+	{
+		const BoxSet &leaves = bvh->leaf_boxes();
+		arrays[BVH_NODES] = bvh->nodes().data();
+		arrays[BVH_BOX_MIN_X] = leaves.minX.data(); arrays[BVH_BOX_MIN_Y] = leaves.minY.data(); arrays[BVH_BOX_MIN_Z] = leaves.minZ.data();
+		arrays[BVH_BOX_MAX_X] = leaves.maxX.data(); arrays[BVH_BOX_MAX_Y] = leaves.maxY.data(); arrays[BVH_BOX_MAX_Z] = leaves.maxZ.data();
+		arrays[BVH_BOX_IDS] = bvh->leaf_box_ids().data();
+	}
+
+	// Lay the sections out one after another, each on the next aligned offset.
+	uint64_t offset = sizeof(SceneFileHeader);
+	int sectionCount = bvh ? SCENE_SECTION_COUNT : BVH_NODES;
+	for (int s = 0; s < sectionCount; s++)
+	{
+		offset = align_up(offset);
+		header.sections[s].offset = offset;
+		header.sections[s].bytes = expected_bytes(header, s);
+		offset += header.sections[s].bytes;
+	}
+	header.fileBytes = offset;
+
+	std::string temporary = path + ".tmp";
+	FILE* file = std::fopen(temporary.c_str(), "wb");
+	if (!file)
+	{
+		error = "Can't write file: " + temporary;
+		return false;
+	}
+
+	// The header goes in last, once the checksum is known; until then its space is left empty.
+	HashingWriter writer = { file, 0, FNV_OFFSET, true };
+	std::vector<unsigned char> blank(sizeof(SceneFileHeader), 0);
+	writer.ok = std::fwrite(blank.data(), 1, blank.size(), file) == blank.size();
+	writer.offset = blank.size();
+	for (int s = 0; s < sectionCount; s++)
+	{
+		writer.pad_to(header.sections[s].offset);
+		writer.write(arrays[s], (size_t)header.sections[s].bytes);
+	}
+	header.checksum = writer.hash;
+
+	bool ok = writer.ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = std::fclose(file) == 0 && ok;
+	std::remove(path.c_str());
+	if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporary.c_str());
+		error = "Can't write file: " + path;
+		return false;
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region Mapping
+MappedScene::MappedScene() : data(nullptr), bytes(0)
+#ifdef _WIN32
+	, file(nullptr), mapping(nullptr)
+#endif
+{
+}
+
+MappedScene::~MappedScene()
+{
+	close();
+}
+
+void MappedScene::close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if (data)
+		munmap((void*)data, bytes);
+#endif
+	data = nullptr;
+	bytes = 0;
+}
+
+bool MappedScene::open(const std::string &path, std::string &error)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		error = "Can't open file: " + path;
+		return false;
+	}
+	file = handle;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || (uint64_t)size.QuadPart < sizeof(SceneFileHeader))
+	{
+		close();
+		error = path + " is too short to be a scene file";
+		return false;
+	}
+
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	data = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!data)
+	{
+		close();
+		error = "Can't map file: " + path;
+		return false;
+	}
+	bytes = (size_t)size.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		error = "Can't open file: " + path;
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < sizeof(SceneFileHeader))
+	{
+		::close(fd);
+		error = path + " is too short to be a scene file";
+		return false;
+	}
+
+	// The mapping keeps the file alive by itself, so the descriptor can go right away.
+	void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		error = "Can't map file: " + path;
+		return false;
+	}
+	data = (const unsigned char*)mapped;
+	bytes = (size_t)info.st_size;
+#endif
+
+	// Only the header is looked at here; see SceneFile.h.
+	const SceneFileHeader &h = header();
+	const char* problem = nullptr;
+	if (std::memcmp(h.magic, SCENE_FILE_MAGIC, sizeof(h.magic)) != 0)
+		problem = "is not a scene file";
+	else if (h.byteOrder != SCENE_FILE_BYTE_ORDER)
+		problem = "was written with the other byte order";
+	else if (h.version != SCENE_FILE_VERSION || h.headerBytes != sizeof(SceneFileHeader))
+		problem = "is a scene file of another version";
+	else if (h.fileBytes != bytes)
+		problem = "is not the size its header says (cut short?)";
+	else if (h.sphereCount > UINT32_MAX || h.boxCount > UINT32_MAX || h.nodeCount > bytes / sizeof(BVHNode))
+		problem = "has impossible counts";
+	else if ((h.flags & SCENE_FILE_HAS_BVH) && (h.bvhDepth > (uint32_t)BVH_MAX_DEPTH || (h.nodeCount == 0) != (h.boxCount == 0)))
+		problem = "has a BVH that doesn't fit its boxes";
+
+	for (int s = 0; s < SCENE_SECTION_COUNT && !problem; s++)
+	{
+		const SceneFileSection &section = h.sections[s];
+		uint64_t want = expected_bytes(h, s);
+		bool present = s < BVH_NODES || (h.flags & SCENE_FILE_HAS_BVH);
+		if (section.bytes != want)
+			problem = "has an array of the wrong size";
+		else if (present && (section.offset < sizeof(SceneFileHeader) || section.offset % SCENE_FILE_ALIGNMENT != 0))
+			problem = "has a misplaced array";
+		else if (present && (section.offset > bytes || section.bytes > bytes - section.offset))
+			problem = "has an array past its end";
+	}
+
+	if (problem)
+	{
+		close();
+		error = path + " " + problem;
+		return false;
+	}
+	return true;
+}
+
+SphereArrays MappedScene::spheres() const
+{
+	SphereArrays a = { section<float>(SPHERE_X), section<float>(SPHERE_Y), section<float>(SPHERE_Z), section<float>(SPHERE_RADIUS) };
+	return a;
+}
+
+BoxArrays MappedScene::boxes() const
+{
+	BoxArrays a = {
+		section<float>(BOX_MIN_X), section<float>(BOX_MIN_Y), section<float>(BOX_MIN_Z),
+		section<float>(BOX_MAX_X), section<float>(BOX_MAX_Y), section<float>(BOX_MAX_Z)
+	};
+	return a;
+}
+
+BoxBVHView MappedScene::bvh() const
+{
+	BoxBVHView v = {
+		section<BVHNode>(BVH_NODES), (size_t)header().nodeCount,
+		{
+			section<float>(BVH_BOX_MIN_X), section<float>(BVH_BOX_MIN_Y), section<float>(BVH_BOX_MIN_Z),
+			section<float>(BVH_BOX_MAX_X), section<float>(BVH_BOX_MAX_Y), section<float>(BVH_BOX_MAX_Z)
+		},
+		section<uint32_t>(BVH_BOX_IDS), box_count()
+	};
+	return v;
+}
+
+void MappedScene::copy_to(Scene &scene) const
+{
+	size_t spheres = sphere_count();
+	size_t boxes = box_count();
+	SphereArrays s = this->spheres();
+	BoxArrays b = this->boxes();
+
+	scene.spheres.x.assign(s.x, s.x + spheres);
+	scene.spheres.y.assign(s.y, s.y + spheres);
+	scene.spheres.z.assign(s.z, s.z + spheres);
+	scene.spheres.radius.assign(s.radius, s.radius + spheres);
+	scene.boxes.minX.assign(b.minX, b.minX + boxes);
+	scene.boxes.minY.assign(b.minY, b.minY + boxes);
+	scene.boxes.minZ.assign(b.minZ, b.minZ + boxes);
+	scene.boxes.maxX.assign(b.maxX, b.maxX + boxes);
+	scene.boxes.maxY.assign(b.maxY, b.maxY + boxes);
+	scene.boxes.maxZ.assign(b.maxZ, b.maxZ + boxes);
+}
+#pragma endregion
+
+#pragma region Validation
+namespace
+{
+	bool inside(const BVHNode &outer, float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+	{
+		return minX >= outer.min[0] && minY >= outer.min[1] && minZ >= outer.min[2]
+			&& maxX <= outer.max[0] && maxY <= outer.max[1] && maxZ <= outer.max[2];
+	}
+
+	// Checks the tree's structure: every index in range, children after their parent (so there are no
+	// cycles), every node inside its parent, every box inside its leaf, each box in exactly one leaf as
+	// an exact copy of the scene's box with its id, and no deeper than a query can walk.
+	bool validate_bvh(const BoxBVHView &bvh, const BoxArrays &input, std::string &error)
+	{
+		if (bvh.nodeCount == 0)
+			return true;
+
+		std::vector<uint8_t> seen(bvh.boxCount, 0);
+		std::vector<uint8_t> seenIds(bvh.boxCount, 0);
+		size_t leafBoxes = 0;
+
+		struct Pending { uint32_t node; uint32_t depth; };
+		std::vector<Pending> stack(1, Pending{ 0, 1 });
+		while (!stack.empty())
+		{
+			Pending p = stack.back();
+			stack.pop_back();
+			if (p.depth > (uint32_t)BVH_MAX_DEPTH)
+			{
+				error = "the BVH is deeper than a query can walk";
+				return false;
+			}
+
+			const BVHNode &node = bvh.nodes[p.node];
+			if (!node.is_leaf())
+			{
+				uint32_t left = p.node + 1;
+				uint32_t right = node.rightOrFirst;
+				if (left >= bvh.nodeCount || right <= left || right >= bvh.nodeCount)
+				{
+					error = "a BVH node's child is out of range";
+					return false;
+				}
+				const BVHNode &l = bvh.nodes[left];
+				const BVHNode &r = bvh.nodes[right];
+				if (!inside(node, l.min[0], l.min[1], l.min[2], l.max[0], l.max[1], l.max[2])
+					|| !inside(node, r.min[0], r.min[1], r.min[2], r.max[0], r.max[1], r.max[2]))
+				{
+					error = "a BVH node is outside its parent";
+					return false;
+				}
+				stack.push_back(Pending{ right, p.depth + 1 });
+				stack.push_back(Pending{ left, p.depth + 1 });
+				continue;
+			}
+
+			if (node.rightOrFirst > bvh.boxCount || node.count > bvh.boxCount - node.rightOrFirst)
+			{
+				error = "a BVH leaf's boxes are out of range";
+				return false;
+			}
+			for (uint32_t k = node.rightOrFirst; k < node.rightOrFirst + node.count; k++)
+			{
+				const BoxArrays &b = bvh.boxes;
+				if (!inside(node, b.minX[k], b.minY[k], b.minZ[k], b.maxX[k], b.maxY[k], b.maxZ[k]))
+				{
+					error = "a box is outside its BVH leaf";
+					return false;
+				}
+				if (seen[k]++)
+				{
+					error = "a box is in two BVH leaves";
+					return false;
+				}
+				uint32_t id = bvh.boxIds[k];
+				if (id >= bvh.boxCount || seenIds[id]++)
+				{
+					error = "a BVH box id is out of range or repeated";
+					return false;
+				}
+				if (b.minX[k] != input.minX[id] || b.minY[k] != input.minY[id] || b.minZ[k] != input.minZ[id]
+					|| b.maxX[k] != input.maxX[id] || b.maxY[k] != input.maxY[id] || b.maxZ[k] != input.maxZ[id])
+				{
+					error = "a BVH box differs from the scene's box with its id";
+					return false;
+				}
+			}
+			leafBoxes += node.count;
+		}
+
+		if (leafBoxes != bvh.boxCount)
+		{
+			error = "some boxes are in no BVH leaf";
+			return false;
+		}
+		return true;
+	}
+}
+
+bool MappedScene::validate(std::string &error) const
+{
+	if (!data)
+	{
+		error = "no scene file is open";
+		return false;
+	}
+
+	if (fnv1a(data + sizeof(SceneFileHeader), bytes - sizeof(SceneFileHeader), FNV_OFFSET) != header().checksum)
+	{
+		error = "the checksum doesn't match: the file is damaged";
+		return false;
+	}
+
+	// Written as !(a <= b) so that NaNs fail too.
+	SphereArrays s = spheres();
+	for (size_t i = 0; i < sphere_count(); i++)
+	{
+		if (!(s.radius[i] >= 0.0f) || !(s.x[i] == s.x[i]) || !(s.y[i] == s.y[i]) || !(s.z[i] == s.z[i]))
+		{
+			error = "sphere " + std::to_string(i) + " has a negative or NaN radius or center";
+			return false;
+		}
+	}
+
+	BoxArrays b = boxes();
+	for (size_t i = 0; i < box_count(); i++)
+	{
+		if (!(b.minX[i] <= b.maxX[i]) || !(b.minY[i] <= b.maxY[i]) || !(b.minZ[i] <= b.maxZ[i]))
+		{
+			error = "box " + std::to_string(i) + " has a min corner past its max corner";
+			return false;
+		}
+	}
+
+	if (has_bvh() && !validate_bvh(bvh(), b, error))
+		return false;
+	return true;
+}
+#pragma endregion
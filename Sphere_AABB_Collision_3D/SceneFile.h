@@ -0,0 +1,161 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SceneFile.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A binary scene file that is used straight from memory, for worlds with millions of spheres and boxes.
+
+A scene script (SimulationScript.h) is read a line at a time and every number goes through strtof,
+into vectors that grow as they go. With millions of objects that takes seconds, and it happens again
+on every run. This file holds the same arrays the collision code works on (CollisionTypes.h), already
+laid out: MappedScene::open maps the file into memory and hands out pointers into it. Nothing is read,
+copied or converted; the operating system pages the arrays in as they are first touched.
+
+The file can also hold a BoxBVH built over the boxes (nodes, leaf-ordered boxes and their ids), which
+BoxBVHView queries where it lies, so a static world's tree is built once by the converter, not on every load.
+
+Layout, all little-endian:
+	SceneFileHeader (384 bytes): magic, version, counts, a checksum, and where each array is
+	then each array in turn, each starting on a 64 byte boundary (a cache line, and any SIMD load width)
+The arrays are sphere x, y, z and radius; box min x, y, z and max x, y, z; and with SCENE_FILE_HAS_BVH
+the BVHNode array, the leaf boxes (min x, y, z, max x, y, z) and the leaf box ids.
+A reader that finds another version refuses the file; any change to the layout bumps the version.
+
+open() checks only the header, in constant time: that it is this format and version, and that every
+array it names lies inside the file, aligned, with the size its count says. The contents are not looked
+at (that would touch every page). validate() goes through all of it: the checksum, radii and box
+corners, and that the tree's indices stay in range and it isn't deeper than a query can walk. Check a
+file from somewhere else with it (tools/SceneValidate.cpp) before trusting its BVH.
+
+tools/SceneConvert.cpp turns a scene script into this format.
+*/
+
+#ifndef _SCENE_FILE_H
+#define _SCENE_FILE_H
+
+#include "BoxBVH.h"
+#include "CollisionTypes.h"
+#include "SceneGenerator.h"
+
+#include <string>
+
+// "SABSCENE", and the layout version.
+const char SCENE_FILE_MAGIC[8] = { 'S', 'A', 'B', 'S', 'C', 'E', 'N', 'E' };
+const uint32_t SCENE_FILE_VERSION = 1;
+
+// Written as a number, read back as one: anything but this means the file's bytes are in the other order.
+const uint32_t SCENE_FILE_BYTE_ORDER = 0x01020304;
+
+// Every array starts on a multiple of this.
+const uint64_t SCENE_FILE_ALIGNMENT = 64;
+
+// Header flags.
+const uint32_t SCENE_FILE_HAS_BVH = 1;
+
+// The arrays, in the order they are stored.
+enum SceneSection
+{
+	SPHERE_X, SPHERE_Y, SPHERE_Z, SPHERE_RADIUS,
+	BOX_MIN_X, BOX_MIN_Y, BOX_MIN_Z, BOX_MAX_X, BOX_MAX_Y, BOX_MAX_Z,
+	BVH_NODES,
+	BVH_BOX_MIN_X, BVH_BOX_MIN_Y, BVH_BOX_MIN_Z, BVH_BOX_MAX_X, BVH_BOX_MAX_Y, BVH_BOX_MAX_Z,
+	BVH_BOX_IDS,
+	SCENE_SECTION_COUNT
+};
+
+struct SceneFileSection
+{
+	uint64_t offset;	// From the start of the file. 0 for an array that isn't there.
+	uint64_t bytes;
+};
+
+struct SceneFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t headerBytes;	// sizeof(SceneFileHeader)
+	uint32_t flags;
+	uint64_t sphereCount;
+	uint64_t boxCount;
+	uint64_t nodeCount;		// BVH nodes; 0 without a BVH.
+	uint64_t fileBytes;
+	uint64_t checksum;		// FNV-1a over every byte after the header.
+	uint32_t bvhDepth;
+	uint32_t padding;
+	SceneFileSection sections[SCENE_SECTION_COUNT];
+	unsigned char reserved[24];	// Zero.
+};
+
+static_assert(sizeof(SceneFileHeader) == 384, "SceneFileHeader must stay 384 bytes");
+static_assert(sizeof(SceneFileHeader) % SCENE_FILE_ALIGNMENT == 0, "the first array must start aligned");
+
+// Writes scene to path, with bvh's tree if bvh isn't null (it must have been built over scene.boxes).
+// The file is written under a temporary name and renamed, so a failed write never leaves half a file.
+// Returns false and describes the problem in error if it can't.
+bool write_scene_file(const std::string &path, const Scene &scene, const BoxBVH* bvh, std::string &error);
+
+// A scene file mapped into memory, read-only. All the pointers it gives out point into the mapping and
+// stay good until close(), or until the MappedScene is destroyed.
+class MappedScene
+{
+public:
+	MappedScene();
+	~MappedScene();
+
+	MappedScene(const MappedScene&) = delete;
+	MappedScene &operator=(const MappedScene&) = delete;
+
+	// Maps the file and checks its header. Returns false and describes the problem in error if it
+	// can't be opened or isn't a scene file this version can read.
+	bool open(const std::string &path, std::string &error);
+	void close();
+
+	bool is_open() const { return data != nullptr; }
+	const SceneFileHeader &header() const { return *(const SceneFileHeader*)data; }
+	size_t file_bytes() const { return bytes; }
+
+	size_t sphere_count() const { return (size_t)header().sphereCount; }
+	size_t box_count() const { return (size_t)header().boxCount; }
+	SphereArrays spheres() const;
+	BoxArrays boxes() const;
+
+	bool has_bvh() const { return (header().flags & SCENE_FILE_HAS_BVH) != 0; }
+	// The stored tree. Only call it if has_bvh().
+	BoxBVHView bvh() const;
+
+	// Reads the whole file: see the description at the top. Returns false with the first problem in error.
+	bool validate(std::string &error) const;
+
+	// Copies the spheres and boxes into scene, for code that needs its own (the Simulation moves spheres).
+	void copy_to(Scene &scene) const;
+
+private:
+	template <class T>
+	const T* section(SceneSection s) const { return (const T*)(data + header().sections[s].offset); }
+
+	const unsigned char* data;
+	size_t bytes;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+};
+
+// True if path ends in .bin, the extension the tools use for scene files.
+bool is_scene_file_path(const std::string &path);
+
+#endif // _SCENE_FILE_H
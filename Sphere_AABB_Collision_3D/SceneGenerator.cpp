@@ -0,0 +1,175 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SceneGenerator.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Random scene generation. See SceneGenerator.h.
+*/
+
+#include "SceneGenerator.h"
+
+#include <cmath>
+
+const char* scene_distribution_name(SceneDistribution distribution)
+{
+	switch (distribution)
+	{
+	case SceneDistribution::Clustered:	return "clustered";
+	case SceneDistribution::Degenerate:	return "degenerate";
+	default:							return "uniform";
+	}
+}
+
+// A roughly bell shaped value in [-1.5, 1.5): the sum of three uniform values.
+static float bell(SceneRandom &rng)
+{
+	return rng.unit() + rng.unit() + rng.unit() - 1.5f;
+}
+
+// Picks a position for one object, according to the distribution.
+static void place(SceneRandom &rng, const SceneParams &params, const std::vector<float> &clusters, float* p)
+{
+	float half = params.worldSize / 2.0f;
+
+	if (params.distribution == SceneDistribution::Clustered && !clusters.empty())
+	{
+		size_t c = (size_t)(rng.next() % (clusters.size() / 3));
+		for (int a = 0; a < 3; a++)
+		{
+			float v = clusters[c * 3 + a] + bell(rng) * params.clusterSpread * params.worldSize;
+			p[a] = v < -half ? -half : (v > half ? half : v);
+		}
+	}
+	else
+	{
+		for (int a = 0; a < 3; a++)
+			p[a] = rng.range(-half, half);
+	}
+}
+
+// Random box extents. For degenerate scenes one, two or all three axes are squashed to zero.
+static void extents(SceneRandom &rng, SceneDistribution distribution, float minExtent, float maxExtent, float* e)
+{
+	for (int a = 0; a < 3; a++)
+		e[a] = rng.range(minExtent, maxExtent);
+
+	if (distribution == SceneDistribution::Degenerate)
+	{
+		int flat = 1 + (int)(rng.next() % 7);	// Non-empty subset of {x, y, z}
+		for (int a = 0; a < 3; a++)
+		{
+			if (flat & (1 << a))
+				e[a] = 0.0f;
+		}
+	}
+}
+
+void generate_scene(const SceneParams &params, Scene &scene)
+{
+	SceneRandom rng(params.seed);
+
+	scene.spheres.clear();
+	scene.boxes.clear();
+	scene.spheres.reserve(params.sphereCount);
+	scene.boxes.reserve(params.boxCount);
+
+	// Cluster centers stay away from the world's edge so clusters aren't cut in half.
+	std::vector<float> clusters;
+	if (params.distribution == SceneDistribution::Clustered)
+	{
+		for (int c = 0; c < params.clusterCount * 3; c++)
+			clusters.push_back(rng.range(-0.4f, 0.4f) * params.worldSize);
+	}
+
+	float p[3], e[3];
+	for (size_t i = 0; i < params.sphereCount; i++)
+	{
+		place(rng, params, clusters, p);
+		scene.spheres.add(p[0], p[1], p[2], rng.range(params.minRadius, params.maxRadius));
+	}
+
+	for (size_t i = 0; i < params.boxCount; i++)
+	{
+		place(rng, params, clusters, p);
+		extents(rng, params.distribution, params.minExtent, params.maxExtent, e);
+		scene.boxes.add(make_aabb(p[0], p[1], p[2], e[0], e[1], e[2]));
+	}
+}
+
+void generate_pairs(uint64_t seed, size_t count, float overlapRatio, SceneDistribution distribution, Scene &scene)
+{
+	SceneParams params;
+	params.seed = seed;
+	params.distribution = distribution;
+
+	SceneRandom rng(seed);
+
+	scene.spheres.clear();
+	scene.boxes.clear();
+	scene.spheres.reserve(count);
+	scene.boxes.reserve(count);
+
+	std::vector<float> clusters;
+	if (distribution == SceneDistribution::Clustered)
+	{
+		for (int c = 0; c < params.clusterCount * 3; c++)
+			clusters.push_back(rng.range(-0.4f, 0.4f) * params.worldSize);
+	}
+
+	float p[3], e[3];
+	for (size_t i = 0; i < count; i++)
+	{
+		place(rng, params, clusters, p);
+		extents(rng, distribution, params.minExtent, params.maxExtent, e);
+		AABB box = make_aabb(p[0], p[1], p[2], e[0], e[1], e[2]);
+		scene.boxes.add(box);
+
+		float radius = rng.range(params.minRadius, params.maxRadius);
+
+		// Distance from the sphere's center to the box. The 5% margins keep float rounding from flipping the answer.
+		bool hit = rng.unit() < overlapRatio;
+		float distance = hit ? rng.range(0.0f, 0.95f) * radius : rng.range(1.05f, 3.0f) * radius;
+
+		// Pick which axes the center sits outside of the box on; on the other axes it is within the box's range.
+		// The offset along the outside axes has length `distance`, so that is exactly the distance to the closest point.
+		int outside = 1 + (int)(rng.next() % 7);
+		float offset[3] = { 0.0f, 0.0f, 0.0f };
+		float length = 0.0f;
+		for (int a = 0; a < 3; a++)
+		{
+			if (outside & (1 << a))
+			{
+				offset[a] = rng.range(0.05f, 1.0f);
+				length += offset[a] * offset[a];
+			}
+		}
+		length = std::sqrt(length);
+
+		float c[3];
+		for (int a = 0; a < 3; a++)
+		{
+			if (outside & (1 << a))
+			{
+				float o = offset[a] / length * distance;
+				c[a] = (rng.next() & 1) ? box.max[a] + o : box.min[a] - o;
+			}
+			else
+				c[a] = rng.range(box.min[a], box.max[a]);
+		}
+
+		scene.spheres.add(c[0], c[1], c[2], radius);
+	}
+}
@@ -0,0 +1,110 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SceneGenerator.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Random scenes of spheres and boxes for benchmarking and testing the collision code.
+The same seed always gives the same scene, on every platform. (std::mt19937 is portable, but the
+std distributions are not, so we use our own small generator and do the float conversion ourselves.)
+*/
+
+#ifndef _SCENE_GENERATOR_H
+#define _SCENE_GENERATOR_H
+
+#include "CollisionTypes.h"
+
+// A small, fast, seedable random number generator (splitmix64).
+struct SceneRandom
+{
+	uint64_t state;
+
+	explicit SceneRandom(uint64_t seed) : state(seed) {}
+
+	uint64_t next()
+	{
+		uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// Uniform float in [0, 1). Uses the top 24 bits so every value is exactly representable.
+	float unit()
+	{
+		return (float)(next() >> 40) * (1.0f / 16777216.0f);
+	}
+
+	// Uniform float in [lo, hi).
+	float range(float lo, float hi)
+	{
+		return lo + (hi - lo) * unit();
+	}
+};
+
+// How objects are spread over the world.
+enum class SceneDistribution
+{
+	Uniform,	// Evenly over the whole world.
+	Clustered,	// Around a few random cluster centers, the way objects bunch up in real levels.
+	Degenerate	// Uniform, but every box has zero extent along one or more axes (flat walls, lines, points).
+};
+
+const char* scene_distribution_name(SceneDistribution distribution);
+
+// Parameters for a world of N spheres and M boxes.
+struct SceneParams
+{
+	uint64_t seed;
+	size_t sphereCount;
+	size_t boxCount;
+	float worldSize;		// Objects are placed in [-worldSize/2, worldSize/2] on each axis.
+	float minRadius, maxRadius;
+	float minExtent, maxExtent;	// Full box size along each axis, like Cuboid's breadth/length/depth.
+	SceneDistribution distribution;
+	int clusterCount;
+	float clusterSpread;	// Standard-ish spread of a cluster, as a fraction of worldSize.
+
+	SceneParams()
+	{
+		seed = 1;
+		sphereCount = 1000;
+		boxCount = 1000;
+		worldSize = 100.0f;
+		minRadius = 0.25f;
+		maxRadius = 1.0f;
+		minExtent = 0.5f;
+		maxExtent = 2.0f;
+		distribution = SceneDistribution::Uniform;
+		clusterCount = 8;
+		clusterSpread = 0.1f;
+	}
+};
+
+struct Scene
+{
+	SphereSet spheres;
+	BoxSet boxes;
+};
+
+// Fills the scene with params.sphereCount spheres and params.boxCount boxes.
+void generate_scene(const SceneParams &params, Scene &scene);
+
+// Fills the scene with count spheres and count boxes meant to be tested pair by pair (sphere i against box i).
+// About overlapRatio of the pairs overlap: those spheres are placed so their center is closer to the box
+// than their radius, the rest farther away. Boxes follow the given distribution.
+void generate_pairs(uint64_t seed, size_t count, float overlapRatio, SceneDistribution distribution, Scene &scene);
+
+#endif // _SCENE_GENERATOR_H
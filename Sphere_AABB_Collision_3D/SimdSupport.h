@@ -0,0 +1,66 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SimdSupport.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The compiler and target setup shared by the files with hand-written SIMD paths (SphereAABBBatch.cpp,
+QuantizedBoxBVH.cpp, BoxCast.cpp, FrustumCulling.cpp). Internal: include it from .cpp files only, as
+the macros aren't prefixed for use in headers that others include.
+
+COLLISION_X86			1 when building for x86 or x86-64, with the intrinsics headers included
+SIMD_TARGET(isa)		lets one function use an instruction set the rest of the file isn't compiled for
+FORCE_INLINE			for loops written once and inlined into each ISA's function, so they take its instruction set
+COLLISION_HAS_AVX512	1 if the compiler has the AVX-512 intrinsics
+Which path runs is chosen at run time (active_simd_level() in SphereAABBBatch.h).
+*/
+
+#ifndef _SIMD_SUPPORT_H
+#define _SIMD_SUPPORT_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COLLISION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define COLLISION_X86 0
+#endif
+
+// GCC and Clang need to be told which instruction set a function may use. MSVC does not.
+#if COLLISION_X86 && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa)
+#endif
+
+// Inlined into a SIMD_TARGET function, a FORCE_INLINE function is compiled for that function's instruction set.
+#if defined(__GNUC__) || defined(__clang__)
+#define FORCE_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline
+#endif
+
+// Visual Studio 2015 has no AVX-512 intrinsics.
+#if COLLISION_X86 && !(defined(_MSC_VER) && _MSC_VER < 1910)
+#define COLLISION_HAS_AVX512 1
+#else
+#define COLLISION_HAS_AVX512 0
+#endif
+
+#endif // _SIMD_SUPPORT_H
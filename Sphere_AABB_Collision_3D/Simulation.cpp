@@ -0,0 +1,201 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: Simulation.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Input, motion and collision events of the headless simulation. See Simulation.h.
+*/
+
+#include "Simulation.h"
+
+#include <algorithm>
+
+Simulation::Simulation(const Scene &scene)
+	: sphereSet(scene.spheres), boxSet(scene.boxes), parallelNarrowphase(nullptr), parallelPairs(SIMULATION_PARALLEL_PAIRS), currentFrame(0), exactTests(0), frameProfiler(nullptr)
+{
+	size_t n = sphereSet.size();
+	for (int axis = 0; axis < 3; axis++)
+		velocity[axis].assign(n, 0.0f);
+	dirty.assign(n, 0);
+
+	handles.reserve(n + boxSet.size());
+	for (size_t i = 0; i < n; i++)
+		handles.push_back(broadphase.add_sphere((uint32_t)i, sphereSet.x[i], sphereSet.y[i], sphereSet.z[i], sphereSet.radius[i]));
+	for (size_t i = 0; i < boxSet.size(); i++)
+		handles.push_back(broadphase.add_box((uint32_t)i, boxSet.get(i)));
+
+	// The pairs overlapping in the starting positions are left as broadphase events, so the first step caches
+	// and tests them, and the ones touching begin in the first frame.
+}
+
+void Simulation::mark_moved(uint32_t sphere)
+{
+	if (!dirty[sphere])
+	{
+		dirty[sphere] = 1;
+		dirtyList.push_back(sphere);
+	}
+}
+
+void Simulation::apply(const InputCommand &command)
+{
+	uint32_t s = command.sphere;
+	if (s >= sphereSet.size())
+		return;
+
+	switch (command.kind)
+	{
+	case InputKind::Cursor:
+		// The mapping update() used to do itself: pixels to [-1, 1], with y flipped since the window's origin is at the top.
+		sphereSet.x[s] = ((command.value[0] / SIMULATION_WINDOW_SIZE) * 2.0f) - 1.0f;
+		sphereSet.y[s] = -(((command.value[1] / SIMULATION_WINDOW_SIZE) * 2.0f) - 1.0f);
+		break;
+	case InputKind::KeyW:
+		sphereSet.z[s] -= SIMULATION_KEY_MOVE;
+		break;
+	case InputKind::KeyS:
+		sphereSet.z[s] += SIMULATION_KEY_MOVE;
+		break;
+	case InputKind::Place:
+		sphereSet.x[s] = command.value[0];
+		sphereSet.y[s] = command.value[1];
+		sphereSet.z[s] = command.value[2];
+		break;
+	case InputKind::Velocity:
+	{
+		bool wasMoving = velocity[0][s] != 0.0f || velocity[1][s] != 0.0f || velocity[2][s] != 0.0f;
+		for (int axis = 0; axis < 3; axis++)
+			velocity[axis][s] = command.value[axis];
+		bool isMoving = velocity[0][s] != 0.0f || velocity[1][s] != 0.0f || velocity[2][s] != 0.0f;
+
+		if (isMoving && !wasMoving)
+			moving.push_back(s);
+		else if (!isMoving && wasMoving)
+			moving.erase(std::find(moving.begin(), moving.end(), s));
+		return;
+	}
+	}
+	mark_moved(s);
+}
+
+void Simulation::step(const InputCommand* commands, size_t count, std::vector<CollisionEvent> &events)
+{
+	for (size_t i = 0; i < count; i++)
+		apply(commands[i]);
+
+	for (uint32_t s : moving)
+	{
+		sphereSet.x[s] += velocity[0][s];
+		sphereSet.y[s] += velocity[1][s];
+		sphereSet.z[s] += velocity[2][s];
+		mark_moved(s);
+	}
+
+	// This step's candidate pairs live in frameArena. It gets everything back at once when they are gone, so once it
+	// has grown to fit a step, a step costs no heap calls for them.
+	size_t tested;
+	{
+		std::vector<CollisionPair, ArenaAllocator<CollisionPair>> candidates{ ArenaAllocator<CollisionPair>(frameArena) };
+
+		{
+			ScopedPhase timer(frameProfiler, FramePhase::Broadphase);
+
+			// Only the spheres that moved touch the broadphase.
+			for (uint32_t s : dirtyList)
+				broadphase.move_sphere(handles[s], sphereSet.x[s], sphereSet.y[s], sphereSet.z[s], sphereSet.radius[s]);
+
+			// Pairs whose bounds parted leave the cache (exiting if they touched). Of the rest, only a pair whose
+			// sphere moved can have changed; new pairs are tested after them.
+			broadphase.take_events(broadphaseEvents);
+			for (const PairEvent &e : broadphaseEvents)
+			{
+				if (!e.begin)
+					pairs.remove(e.pair);
+			}
+
+			for (uint32_t s : dirtyList)
+			{
+				for (uint32_t box : pairs.boxes_of(s))
+					candidates.push_back(CollisionPair{ s, box });
+			}
+			for (const PairEvent &e : broadphaseEvents)
+			{
+				if (e.begin && pairs.add(e.pair))
+					candidates.push_back(e.pair);
+			}
+			broadphaseEvents.clear();
+
+			for (uint32_t s : dirtyList)
+				dirty[s] = 0;
+			movedSpheres.swap(dirtyList);
+			dirtyList.clear();
+		}
+
+		{
+			ScopedPhase timer(frameProfiler, FramePhase::Narrowphase);
+			// Either way, overlaps comes out in candidate order.
+			if (parallelNarrowphase && candidates.size() >= parallelPairs)
+				parallelNarrowphase->find_overlaps(sphereSet.arrays(), boxSet.arrays(), candidates.data(), candidates.size(), overlaps);
+			else
+			{
+				overlaps.clear();
+				collide_candidates(sphereSet.arrays(), boxSet.arrays(), candidates.data(), candidates.size(), overlaps, scratch);
+			}
+
+			// overlaps is the touching subset of candidates, in the same order.
+			size_t o = 0;
+			for (const CollisionPair &pair : candidates)
+			{
+				bool touching = o < overlaps.size() && overlaps[o] == pair;
+				if (touching)
+					o++;
+				pairs.set_touching(pair, touching);
+			}
+		}
+
+		tested = candidates.size();
+	}
+	frameArena.reset();
+	exactTests += tested;
+
+	// The cache sorts the changes by pair. Folding them into the sorted touching list keeps touching() in order
+	// without sorting it, and a frame without changes leaves it alone.
+	size_t first = events.size();
+	if (pairs.flush(currentFrame, events) > 0)
+	{
+		nextTouching.clear();
+		size_t a = 0;
+		for (size_t i = first; i < events.size(); i++)
+		{
+			const CollisionEvent &e = events[i];
+			while (a < touchingPairs.size() && touchingPairs[a] < e.pair)
+				nextTouching.push_back(touchingPairs[a++]);
+			if (e.begin)
+				nextTouching.push_back(e.pair);
+			else
+				a++;
+		}
+		nextTouching.insert(nextTouching.end(), touchingPairs.begin() + a, touchingPairs.end());
+		touchingPairs.swap(nextTouching);
+	}
+	if (frameProfiler)
+	{
+		frameProfiler->count(FrameCounter::PairTests, tested);
+		frameProfiler->count(FrameCounter::Overlaps, touchingPairs.size());
+	}
+
+	currentFrame++;
+}
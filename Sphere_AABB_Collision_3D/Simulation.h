@@ -0,0 +1,149 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: Simulation.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The demo's game logic without the window: spheres that move, boxes that don't, and the collision
+test between them, stepped one frame at a time.
+
+In main.cpp, update() used to read the sphere's position from glfwGetCursorPos every frame and key_callback
+moved it along z when w or s was pressed. Here the same input comes in as InputCommands, which can be
+read from a script (SimulationScript.h), recorded, or generated. Nothing waits for vsync or a timer,
+so a headless run steps as fast as the collision code allows. The demo itself now runs a Simulation on a
+thread of its own (SimulationThread.h), and sends it the cursor and keys as InputCommands.
+
+Instead of one "blue" flag, step() reports every sphere/box pair that started or stopped touching
+(CollisionEvent). The broadphase is the incremental sweep and prune (SweepAndPrune.h), since only a few
+objects move each frame. Its active pairs live in a PairCache (PairCache.h) with whether they touch, and
+only the ones that are new or whose sphere moved get the exact test from is_colliding() again: boxes
+don't move, so nothing else can have changed. The cache hands the enters and exits to subscribed
+PairListeners as well as to step()'s event list. Given a ParallelNarrowphase (ParallelNarrowphase.h), a frame
+with enough pairs to test spreads them over its thread pool; the results are the same, in the same order.
+*/
+
+#ifndef _SIMULATION_H
+#define _SIMULATION_H
+
+#include "CollisionTypes.h"
+#include "FrameArena.h"
+#include "FrameProfiler.h"
+#include "PairCache.h"
+#include "ParallelNarrowphase.h"
+#include "SceneGenerator.h"
+#include "SphereAABBBatch.h"
+#include "SweepAndPrune.h"
+
+// The demo's window is 800 x 800 pixels, and the cursor is mapped from that to [-1, 1].
+const float SIMULATION_WINDOW_SIZE = 800.0f;
+// How far one press of w or s moves the sphere along z (moverate in key_callback).
+const float SIMULATION_KEY_MOVE = 0.25f;
+// Fewest pairs to test in a frame before set_narrowphase()'s pool is used. Below this, handing out the work costs
+// more than it saves.
+const size_t SIMULATION_PARALLEL_PAIRS = 16384;
+
+enum class InputKind : uint8_t
+{
+	Cursor,		// Cursor moved to pixel (value[0], value[1]); the sphere follows it in x and y.
+	KeyW,		// w pressed: the sphere moves away from the camera (z - 0.25).
+	KeyS,		// s pressed: the sphere moves toward the camera (z + 0.25).
+	Place,		// The sphere jumps to (value[0], value[1], value[2]).
+	Velocity	// From this frame on, the sphere moves by (value[0], value[1], value[2]) every frame.
+};
+
+// One input, applied at the start of the given frame to one sphere.
+// The demo only has one movable sphere, so cursor and key input normally go to sphere 0.
+struct InputCommand
+{
+	uint32_t frame;
+	InputKind kind;
+	uint32_t sphere;
+	float value[3];
+};
+
+class Simulation
+{
+public:
+	// Takes a copy of the scene. Sphere and box ids in commands and events are indices into it.
+	explicit Simulation(const Scene &scene);
+
+	// Runs one frame: applies the commands for this frame (they must all have frame == frame()),
+	// moves the spheres that have a velocity, and appends the pairs that began or ended touching to events.
+	// Commands for spheres that don't exist are ignored.
+	void step(const InputCommand* commands, size_t count, std::vector<CollisionEvent> &events);
+
+	// Number of frames stepped so far; also the frame the next step() runs.
+	uint32_t frame() const { return currentFrame; }
+
+	// The pairs touching right now, sorted.
+	const std::vector<CollisionPair> &touching() const { return touchingPairs; }
+
+	const SphereSet &spheres() const { return sphereSet; }
+
+	// The spheres the last step() moved, each once, in no particular order. Every other sphere is where it was.
+	const std::vector<uint32_t> &moved() const { return movedSpheres; }
+	const BoxSet &boxes() const { return boxSet; }
+
+	// Pairs tested exactly over all frames: the broadphase's new pairs and the active pairs of spheres that moved.
+	uint64_t tests() const { return exactTests; }
+
+	// The broadphase's active pairs and whether they touch. Subscribe a PairListener to hear of every enter and
+	// exit as step() finds them, on the thread that calls step().
+	PairCache &pair_cache() { return pairs; }
+	const PairCache &pair_cache() const { return pairs; }
+
+	// Times the broadphase and narrowphase of each step, and counts its pair tests and overlaps, in profiler.
+	// Null (the default) measures nothing. The caller times the whole step and calls end_frame().
+	void set_profiler(FrameProfiler* profiler) { frameProfiler = profiler; }
+
+	// Frames with at least minPairs pairs to test run the exact test on narrowphase's pool. Null (the default) keeps
+	// it on the calling thread. The narrowphase must outlive the simulation's use of it, and not be used elsewhere meanwhile.
+	void set_narrowphase(ParallelNarrowphase* narrowphase, size_t minPairs = SIMULATION_PARALLEL_PAIRS)
+	{
+		parallelNarrowphase = narrowphase;
+		parallelPairs = minPairs;
+	}
+
+private:
+	void apply(const InputCommand &command);
+	void mark_moved(uint32_t sphere);
+
+	SphereSet sphereSet;
+	BoxSet boxSet;
+	std::vector<float> velocity[3];
+	std::vector<uint32_t> moving;		// Spheres with a non-zero velocity.
+	std::vector<uint8_t> dirty;			// Spheres moved this frame; their pairs are tested again.
+	std::vector<uint32_t> dirtyList;
+	std::vector<uint32_t> movedSpheres;
+
+	SweepAndPrune broadphase;
+	std::vector<SweepAndPrune::Handle> handles;
+	std::vector<PairEvent> broadphaseEvents;
+
+	PairCache pairs;
+	FrameArena frameArena;		// The candidate list of the step in progress.
+	std::vector<CollisionPair> overlaps;
+	std::vector<CollisionPair> touchingPairs;
+	std::vector<CollisionPair> nextTouching;
+	CandidateScratch scratch;
+	ParallelNarrowphase* parallelNarrowphase;
+	size_t parallelPairs;
+
+	uint32_t currentFrame;
+	uint64_t exactTests;
+	FrameProfiler* frameProfiler;
+};
+
+#endif // _SIMULATION_H
@@ -0,0 +1,290 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SimulationScript.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Readers for the scene and motion scripts. See SimulationScript.h.
+*/
+
+#include "SimulationScript.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+void demo_scene(Scene &scene)
+{
+	scene.spheres.clear();
+	scene.boxes.clear();
+	scene.spheres.add(0.0f, 0.0f, 0.0f, 0.25f);
+	scene.boxes.add(make_aabb(0.0f, 0.0f, 0.0f, 1.0f, 0.5f, 0.5f));
+}
+
+static bool read_file(const std::string &path, std::string &text, std::string &error)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (!file.good())
+	{
+		error = "Can't read file: " + path;
+		return false;
+	}
+
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	text = contents.str();
+	return true;
+}
+
+// Calls parse_line(words, message) for every line that isn't empty or a comment.
+// parse_line returns false and fills message for a bad line; the line number is added here.
+template <class ParseLine>
+static bool for_each_line(const std::string &text, std::string &error, ParseLine parse_line)
+{
+	std::istringstream lines(text);
+	std::string line;
+	int number = 0;
+	while (std::getline(lines, line))
+	{
+		number++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream words(line);
+		std::string first;
+		if (!(words >> first))
+			continue;
+
+		std::string message;
+		words.clear();
+		words.seekg(0);
+		if (!parse_line(words, message))
+		{
+			error = "line " + std::to_string(number) + ": " + message;
+			return false;
+		}
+	}
+	return true;
+}
+
+// True if there is nothing but whitespace left.
+static bool at_end(std::istringstream &words)
+{
+	std::string rest;
+	return !(words >> rest);
+}
+
+// Reads the optional sphere id at the end of a cursor or key line. Sphere 0 if there is none.
+static bool optional_sphere(std::istringstream &words, uint32_t &sphere)
+{
+	std::string word;
+	sphere = 0;
+	if (!(words >> word))
+		return true;
+
+	std::istringstream number(word);
+	return (number >> sphere) && at_end(number) && at_end(words);
+}
+
+bool parse_scene_script(const std::string &text, Scene &scene, std::string &error)
+{
+	scene.spheres.clear();
+	scene.boxes.clear();
+
+	return for_each_line(text, error, [&](std::istringstream &words, std::string &message) {
+		std::string command;
+		words >> command;
+
+		if (command == "sphere")
+		{
+			float x, y, z, radius;
+			if (!(words >> x >> y >> z >> radius) || !at_end(words) || !(radius >= 0.0f))
+			{
+				message = "expected: sphere X Y Z RADIUS";
+				return false;
+			}
+			scene.spheres.add(x, y, z, radius);
+		}
+		else if (command == "box")
+		{
+			float x, y, z, breadth, length, depth;
+			if (!(words >> x >> y >> z >> breadth >> length >> depth) || !at_end(words) ||
+				!(breadth >= 0.0f && length >= 0.0f && depth >= 0.0f))
+			{
+				message = "expected: box X Y Z BREADTH LENGTH DEPTH";
+				return false;
+			}
+			scene.boxes.add(make_aabb(x, y, z, breadth, length, depth));
+		}
+		else if (command == "random")
+		{
+			SceneParams params;
+			if (!(words >> params.seed >> params.sphereCount >> params.boxCount))
+			{
+				message = "expected: random SEED SPHERES BOXES [WORLD_SIZE] [uniform|clustered|degenerate]";
+				return false;
+			}
+
+			std::string word;
+			while (words >> word)
+			{
+				if (word == "uniform" || word == "clustered" || word == "degenerate")
+					params.distribution = word == "uniform" ? SceneDistribution::Uniform :
+						word == "clustered" ? SceneDistribution::Clustered : SceneDistribution::Degenerate;
+				else if (!(std::istringstream(word) >> params.worldSize) || !(params.worldSize > 0.0f))
+				{
+					message = "bad world size or distribution: " + word;
+					return false;
+				}
+			}
+
+			// Appended after whatever the script added before, so ids keep counting up.
+			Scene generated;
+			generate_scene(params, generated);
+			const SphereSet &s = generated.spheres;
+			for (size_t i = 0; i < s.size(); i++)
+				scene.spheres.add(s.x[i], s.y[i], s.z[i], s.radius[i]);
+			for (size_t i = 0; i < generated.boxes.size(); i++)
+				scene.boxes.add(generated.boxes.get(i));
+		}
+		else
+		{
+			message = "unknown command: " + command;
+			return false;
+		}
+		return true;
+	});
+}
+
+bool parse_motion_script(const std::string &text, MotionScript &script, std::string &error)
+{
+	script.frames = 0;
+	script.commands.clear();
+	bool hasFrames = false;
+
+	bool ok = for_each_line(text, error, [&](std::istringstream &words, std::string &message) {
+		std::string first;
+		words >> first;
+
+		if (first == "frames")
+		{
+			long long frames;
+			if (!(words >> frames) || !at_end(words) || frames < 0 || frames > 0xFFFFFFFFll)
+			{
+				message = "expected: frames COUNT";
+				return false;
+			}
+			script.frames = (uint32_t)frames;
+			hasFrames = true;
+			return true;
+		}
+
+		InputCommand c = {};
+		long long frame;
+		std::string command;
+		// One short of the largest frames COUNT, so that the last command's frame + 1 still fits.
+		if (!(std::istringstream(first) >> frame) || frame < 0 || frame >= 0xFFFFFFFFll || !(words >> command))
+		{
+			message = "expected: FRAME COMMAND ... or frames COUNT";
+			return false;
+		}
+		c.frame = (uint32_t)frame;
+
+		if (command == "cursor")
+		{
+			c.kind = InputKind::Cursor;
+			if (!(words >> c.value[0] >> c.value[1]) || !optional_sphere(words, c.sphere))
+			{
+				message = "expected: FRAME cursor X Y [SPHERE]";
+				return false;
+			}
+		}
+		else if (command == "key")
+		{
+			std::string key;
+			if (!(words >> key) || (key != "w" && key != "s"))
+			{
+				message = "expected: FRAME key w|s [SPHERE]";
+				return false;
+			}
+			c.kind = key == "w" ? InputKind::KeyW : InputKind::KeyS;
+			if (!optional_sphere(words, c.sphere))
+			{
+				message = "expected: FRAME key w|s [SPHERE]";
+				return false;
+			}
+		}
+		else if (command == "place" || command == "velocity")
+		{
+			c.kind = command == "place" ? InputKind::Place : InputKind::Velocity;
+			if (!(words >> c.sphere >> c.value[0] >> c.value[1] >> c.value[2]) || !at_end(words))
+			{
+				message = "expected: FRAME " + command + " SPHERE X Y Z";
+				return false;
+			}
+		}
+		else
+		{
+			message = "unknown command: " + command;
+			return false;
+		}
+
+		script.commands.push_back(c);
+		return true;
+	});
+
+	std::stable_sort(script.commands.begin(), script.commands.end(),
+		[](const InputCommand &a, const InputCommand &b) { return a.frame < b.frame; });
+	if (!ok || script.commands.empty())
+		return ok;
+
+	// Without a frames line, run until the last command has happened.
+	uint32_t last = script.commands.back().frame;
+	if (!hasFrames)
+		script.frames = last + 1;
+	else if (last >= script.frames)
+	{
+		error = "a command at frame " + std::to_string(last) + " is past the end (frames " + std::to_string(script.frames) + ")";
+		return false;
+	}
+	return true;
+}
+
+bool load_scene_script(const std::string &path, Scene &scene, std::string &error)
+{
+	std::string text;
+	if (!read_file(path, text, error))
+		return false;
+	if (!parse_scene_script(text, scene, error))
+	{
+		error = path + ": " + error;
+		return false;
+	}
+	return true;
+}
+
+bool load_motion_script(const std::string &path, MotionScript &script, std::string &error)
+{
+	std::string text;
+	if (!read_file(path, text, error))
+		return false;
+	if (!parse_motion_script(text, script, error))
+	{
+		error = path + ": " + error;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,67 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SimulationScript.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Text scripts for the headless simulation (Simulation.h): a scene script says what is in the world,
+a motion script says what the mouse and keyboard do, frame by frame.
+Both are plain text, one command per line. Anything after a # is a comment.
+
+Scene script:
+	sphere X Y Z RADIUS
+	box X Y Z BREADTH LENGTH DEPTH			(center and full extents, like the demo's Cuboid)
+	random SEED SPHERES BOXES [WORLD_SIZE] [uniform|clustered|degenerate]	(generate_scene)
+Spheres and boxes get ids in the order they are added, starting at 0.
+
+Motion script:
+	frames COUNT							(how many frames to run; without it, up to the last command)
+	FRAME cursor X Y [SPHERE]				(cursor at pixel X, Y of the 800 x 800 window)
+	FRAME key w|s [SPHERE]					(w or s pressed)
+	FRAME place SPHERE X Y Z
+	FRAME velocity SPHERE DX DY DZ			(moves by DX, DY, DZ every frame from then on)
+Cursor and key input goes to sphere 0 unless another sphere is given.
+Commands may be written in any order; they are sorted by frame (keeping the order within a frame).
+With a frames line, a command at frame COUNT or later is an error.
+*/
+
+#ifndef _SIMULATION_SCRIPT_H
+#define _SIMULATION_SCRIPT_H
+
+#include "SceneGenerator.h"
+#include "Simulation.h"
+
+#include <string>
+
+struct MotionScript
+{
+	uint32_t frames;
+	std::vector<InputCommand> commands;		// Sorted by frame.
+
+	MotionScript() : frames(0) {}
+};
+
+// The scene from setup() in main.cpp: a sphere of radius 0.25 and a 1 x 0.5 x 0.5 box, both at the origin.
+void demo_scene(Scene &scene);
+
+// Each returns false and describes the problem (with the line number) in error if the file can't be read or has a bad line.
+bool load_scene_script(const std::string &path, Scene &scene, std::string &error);
+bool load_motion_script(const std::string &path, MotionScript &script, std::string &error);
+
+// The same, from text already in memory.
+bool parse_scene_script(const std::string &text, Scene &scene, std::string &error);
+bool parse_motion_script(const std::string &text, MotionScript &script, std::string &error);
+
+#endif // _SIMULATION_SCRIPT_H
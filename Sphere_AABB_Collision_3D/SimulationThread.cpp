@@ -0,0 +1,279 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SimulationThread.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The fixed tick loop, snapshots and interpolation of the simulation thread. See SimulationThread.h.
+*/
+
+#include "SimulationThread.h"
+
+#include <algorithm>
+
+void interpolate_spheres(const SimulationSnapshot &snapshot, float alpha, SphereSet &out)
+{
+	size_t count = snapshot.x.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		out.x[i] = snapshot.previousX[i] + (snapshot.x[i] - snapshot.previousX[i]) * alpha;
+		out.y[i] = snapshot.previousY[i] + (snapshot.y[i] - snapshot.previousY[i]) * alpha;
+		out.z[i] = snapshot.previousZ[i] + (snapshot.z[i] - snapshot.previousZ[i]) * alpha;
+	}
+}
+
+void interpolate_spheres(const SimulationSnapshot &snapshot, float alpha, const uint32_t* spheres, size_t count, SphereSet &out)
+{
+	for (size_t k = 0; k < count; k++)
+	{
+		uint32_t i = spheres[k];
+		out.x[i] = snapshot.previousX[i] + (snapshot.x[i] - snapshot.previousX[i]) * alpha;
+		out.y[i] = snapshot.previousY[i] + (snapshot.y[i] - snapshot.previousY[i]) * alpha;
+		out.z[i] = snapshot.previousZ[i] + (snapshot.z[i] - snapshot.previousZ[i]) * alpha;
+	}
+}
+
+// run() takes it by reference (duration * int), so before C++17 it needs a definition as well as its value.
+const int SimulationThread::MAX_TICKS_BEHIND;
+
+SimulationThread::SimulationThread()
+	: inputs(1024), running(false), tickSeconds(1.0 / 60.0), traceRecorder(nullptr), dirtyStart(0), tickTime(0.0), tickCount(0), changeTick(0), skippedTicks(0), droppedInputs(0)
+{
+}
+
+SimulationThread::~SimulationThread()
+{
+	stop();
+}
+
+void SimulationThread::start(const Scene &scene, double tickRate, TraceRecorder* recorder)
+{
+	stop();
+
+	simulation.reset(new Simulation(scene));
+	hitCounter.touches.assign(scene.spheres.size(), 0);
+	hitCounter.hits.assign(scene.spheres.size(), 0);
+	hitCounter.changed.clear();
+	simulation->pair_cache().subscribe(&hitCounter);
+	traceRecorder = recorder;
+	tickSeconds = 1.0 / tickRate;
+	tickTime = 0.0;
+	tickCount = 0;
+	changeTick = 0;
+	skippedTicks = 0;
+	tickProfiler.reset();
+
+	const SphereSet &spheres = simulation->spheres();
+	lastX = spheres.x;
+	lastY = spheres.y;
+	lastZ = spheres.z;
+	dirtyLog.clear();
+	dirtyStart = 0;
+
+	// All three snapshots get their full size now, so publishing never allocates.
+	for (int i = 0; i < 3; i++)
+	{
+		SimulationSnapshot &s = snapshots.slot(i);
+		s.tick = 0;
+		s.time = 0.0;
+		s.x = s.previousX = spheres.x;
+		s.y = s.previousY = spheres.y;
+		s.z = s.previousZ = spheres.z;
+		s.hits.assign(spheres.size(), 0);
+		s.moved.clear();
+		s.moved.reserve(spheres.size());
+		s.changeTick = 0;
+		s.touching = 0;
+	}
+
+	startTime = std::chrono::steady_clock::now();
+	running.store(true, std::memory_order_release);
+	thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop()
+{
+	if (!thread.joinable())
+		return;
+	running.store(false, std::memory_order_release);
+	thread.join();
+}
+
+bool SimulationThread::push_input(const InputCommand &command)
+{
+	if (inputs.push(command))
+		return true;
+	droppedInputs++;
+	return false;
+}
+
+const SimulationSnapshot &SimulationThread::latest()
+{
+	return snapshots.read();
+}
+
+float SimulationThread::interpolation(const SimulationSnapshot &snapshot) const
+{
+	double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	double alpha = (now - snapshot.time) / tickSeconds;
+	if (alpha < 0.0)
+		return 0.0f;
+	if (alpha > 1.0)
+		return 1.0f;
+	return (float)alpha;
+}
+
+void SimulationThread::HitCounter::pair_entered(const CollisionEvent &event)
+{
+	if (touches[event.pair.sphere]++ == 0)
+	{
+		hits[event.pair.sphere] = 1;
+		changed.push_back(event.pair.sphere);
+	}
+}
+
+void SimulationThread::HitCounter::pair_exited(const CollisionEvent &event)
+{
+	if (--touches[event.pair.sphere] == 0)
+	{
+		hits[event.pair.sphere] = 0;
+		changed.push_back(event.pair.sphere);
+	}
+}
+
+void SimulationThread::publish()
+{
+	SimulationSnapshot &s = snapshots.write_buffer();
+	const SphereSet &spheres = simulation->spheres();
+	const std::vector<uint32_t> &moved = simulation->moved();
+	size_t n = spheres.size();
+
+	for (uint32_t i : moved)
+		dirtyLog.push_back(DirtySphere{ tickCount, i });
+	for (uint32_t i : hitCounter.changed)
+		dirtyLog.push_back(DirtySphere{ tickCount, i });
+	if (!moved.empty() || !hitCounter.changed.empty())
+		changeTick = tickCount;
+	hitCounter.changed.clear();
+
+	// Nothing older than the oldest copy is needed again. The copies' ticks are only written on this thread.
+	uint64_t oldest = snapshots.slot(0).tick;
+	for (int i = 1; i < 3; i++)
+		oldest = std::min(oldest, snapshots.slot(i).tick);
+	if (oldest > dirtyStart)
+	{
+		size_t keep = 0;
+		while (keep < dirtyLog.size() && dirtyLog[keep].tick < oldest)
+			keep++;
+		dirtyLog.erase(dirtyLog.begin(), dirtyLog.begin() + keep);
+		dirtyStart = oldest;
+	}
+	// A log longer than the spheres is no cheaper than copying them all: keep just this tick's entries.
+	if (dirtyLog.size() > n)
+	{
+		size_t keep = 0;
+		while (keep < dirtyLog.size() && dirtyLog[keep].tick < tickCount)
+			keep++;
+		dirtyLog.erase(dirtyLog.begin(), dirtyLog.begin() + keep);
+		dirtyStart = tickCount;
+	}
+
+	// Bring the copy up to date from the tick it was filled for. Spheres that didn't change since then already have
+	// their center in both x and previousX, and their hit flag. Previous and current only differ for this tick's moves.
+	if (s.tick >= dirtyStart)
+	{
+		size_t first = dirtyLog.size();
+		while (first > 0 && dirtyLog[first - 1].tick >= s.tick)
+			first--;
+		for (size_t k = first; k < dirtyLog.size(); k++)
+		{
+			uint32_t i = dirtyLog[k].sphere;
+			s.x[i] = s.previousX[i] = spheres.x[i];
+			s.y[i] = s.previousY[i] = spheres.y[i];
+			s.z[i] = s.previousZ[i] = spheres.z[i];
+			s.hits[i] = hitCounter.hits[i];
+		}
+	}
+	else
+	{
+		s.x = s.previousX = spheres.x;
+		s.y = s.previousY = spheres.y;
+		s.z = s.previousZ = spheres.z;
+		s.hits = hitCounter.hits;
+	}
+	for (uint32_t i : moved)
+	{
+		s.previousX[i] = lastX[i];
+		s.previousY[i] = lastY[i];
+		s.previousZ[i] = lastZ[i];
+	}
+
+	s.tick = tickCount;
+	s.time = tickTime;
+	s.moved = moved;
+	s.changeTick = changeTick;
+	s.touching = simulation->touching().size();
+
+	snapshots.publish();
+
+	for (uint32_t i : moved)
+	{
+		lastX[i] = spheres.x[i];
+		lastY[i] = spheres.y[i];
+		lastZ[i] = spheres.z[i];
+	}
+}
+
+void SimulationThread::run()
+{
+	simulation->set_profiler(&tickProfiler);
+	std::chrono::duration<double> tick(tickSeconds);
+
+	while (running.load(std::memory_order_acquire))
+	{
+		// Everything the main thread sent since the last tick happens at this tick.
+		commands.clear();
+		InputCommand command;
+		while (inputs.pop(command))
+		{
+			command.frame = simulation->frame();
+			commands.push_back(command);
+		}
+
+		{
+			ScopedPhase timer(&tickProfiler, FramePhase::Update);
+			events.clear();
+			simulation->step(commands.data(), commands.size(), events);
+		}
+		if (traceRecorder)
+			traceRecorder->record(*simulation, commands.data(), commands.size(), events.data(), events.size());
+		tickProfiler.end_frame();
+		tickCount++;
+		publish();
+
+		// The next tick is due one tick after this one was. If that time has long passed, skip to now.
+		tickTime += tickSeconds;
+		std::chrono::steady_clock::time_point due = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(tickTime));
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - due > tick * MAX_TICKS_BEHIND)
+		{
+			uint64_t behind = (uint64_t)(std::chrono::duration<double>(now - due).count() / tickSeconds);
+			skippedTicks += behind;
+			tickTime += behind * tickSeconds;
+		}
+		else
+			std::this_thread::sleep_until(due);
+	}
+}
@@ -0,0 +1,166 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SimulationThread.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Runs the Simulation (Simulation.h) on a thread of its own, at a fixed number of ticks per second.
+
+main() used to call update() and renderScene() one after the other, so a slow glfwSwapBuffers held up
+the collision code, and a heavy collision frame held up the picture. Here the two only meet through
+two lock-free structures, and neither ever waits for the other:
+- Input goes from the main thread to the simulation as InputCommands, through an SpscRing (SpscRing.h).
+  Each tick applies everything that arrived since the last one.
+- After each tick the simulation publishes a SimulationSnapshot (sphere centers, before and after the tick,
+  and which spheres touch a box) through a TripleBuffer (TripleBuffer.h). The render thread takes the newest.
+  The snapshot also says which spheres the tick moved and when anything last changed, so the renderer can
+  leave the spheres that stood still alone, and skip the frame altogether when nothing did.
+  Publishing works the same way: a copy only gets the spheres that moved or changed their hit flag since the
+  tick it was last filled for, so a tick where nothing happened copies nothing.
+
+Ticks are on a fixed schedule, tick k at k / tickRate seconds after start(), so the simulation steps the same
+way however fast the screen is drawn. The renderer draws between the last two ticks: interpolation() says
+how far along, from 0 when the snapshot is published to 1 one tick later, when the next one is due.
+That is one tick of delay in exchange for motion that doesn't stutter when frames and ticks don't line up.
+
+If the simulation falls more than a few ticks behind its schedule, it skips ahead instead of running
+ticks back to back to catch up, and counts the ticks it skipped.
+*/
+
+#ifndef _SIMULATION_THREAD_H
+#define _SIMULATION_THREAD_H
+
+#include "CollisionTypes.h"
+#include "FrameProfiler.h"
+#include "Simulation.h"
+#include "SimulationTrace.h"
+#include "SpscRing.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct SimulationSnapshot
+{
+	uint64_t tick;			// Ticks run when this was published.
+	double time;			// When this tick was due, in seconds after start().
+	std::vector<float> x, y, z;							// Sphere centers after the tick.
+	std::vector<float> previousX, previousY, previousZ;	// And before it.
+	std::vector<uint8_t> hits;		// 1 for each sphere touching a box after the tick.
+	std::vector<uint32_t> moved;	// Spheres the tick moved: the only ones whose previous and current centers may differ.
+	uint64_t changeTick;			// The last tick that moved a sphere or changed a hit; 0 for the starting scene.
+	size_t touching;				// Sphere-box pairs touching.
+};
+
+// Centers a fraction alpha (0 to 1) of the way from before the snapshot's tick to after it, written to out's x, y and z.
+// out must have the snapshot's spheres; their radii are left alone.
+void interpolate_spheres(const SimulationSnapshot &snapshot, float alpha, SphereSet &out);
+
+// The same for the count spheres listed in spheres only.
+void interpolate_spheres(const SimulationSnapshot &snapshot, float alpha, const uint32_t* spheres, size_t count, SphereSet &out);
+
+class SimulationThread
+{
+public:
+	// Most ticks the simulation may be behind before it skips ahead.
+	static const int MAX_TICKS_BEHIND = 5;
+
+	SimulationThread();
+	~SimulationThread();
+
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread &operator=(const SimulationThread&) = delete;
+
+	// Starts simulating a copy of scene, tickRate ticks per second. Until the first tick is published, latest()
+	// returns the scene as it was given, with no hits. recorder, if given and open, records every tick; it must
+	// stay alive, and not be used by anyone else, until stop().
+	void start(const Scene &scene, double tickRate, TraceRecorder* recorder = nullptr);
+
+	// Stops the thread, after the tick it is on. The counters and profiler can be read after this.
+	void stop();
+
+	// From one thread only (the main thread). The command applies at the next tick; its frame is ignored.
+	// False if the queue is full, which means the simulation hasn't run for a long while.
+	bool push_input(const InputCommand &command);
+
+	// From one thread only (the render thread): the newest snapshot. It stays valid until the next call.
+	const SimulationSnapshot &latest();
+
+	// How far from snapshot's tick toward the next, by the clock: 0 to 1.
+	float interpolation(const SimulationSnapshot &snapshot) const;
+
+	double tick_seconds() const { return tickSeconds; }
+	uint64_t dropped_inputs() const { return droppedInputs; }
+
+	// Read these only after stop().
+	uint64_t ticks() const { return tickCount; }
+	uint64_t skipped_ticks() const { return skippedTicks; }
+	const FrameProfiler &profiler() const { return tickProfiler; }
+
+private:
+	void run();
+	void publish();
+
+	// Keeps each sphere's hit flag from the simulation's enters and exits, so pairs that didn't change cost a tick nothing.
+	struct HitCounter : PairListener
+	{
+		std::vector<uint32_t> touches;	// Boxes each sphere is touching.
+		std::vector<uint8_t> hits;		// touches != 0, in the snapshot's form.
+		std::vector<uint32_t> changed;	// Spheres whose hit flag changed since the last publish.
+
+		void pair_entered(const CollisionEvent &event) override;
+		void pair_exited(const CollisionEvent &event) override;
+	};
+
+	std::unique_ptr<Simulation> simulation;
+	SpscRing<InputCommand> inputs;
+	TripleBuffer<SimulationSnapshot> snapshots;
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::chrono::steady_clock::time_point startTime;
+	double tickSeconds;
+
+	// Only touched by the simulation thread while it runs.
+	std::vector<InputCommand> commands;
+	std::vector<CollisionEvent> events;
+	TraceRecorder* traceRecorder;
+	HitCounter hitCounter;
+	std::vector<float> lastX, lastY, lastZ;
+
+	// A sphere that moved, or whose hit flag changed, at a tick.
+	struct DirtySphere
+	{
+		uint64_t tick;
+		uint32_t sphere;
+	};
+	// Every change from tick dirtyStart on, in tick order: what a copy filled at tick t lacks is the entries from t on.
+	// Entries older than every copy are dropped, and so is the whole log once it names more spheres than there are.
+	std::vector<DirtySphere> dirtyLog;
+	uint64_t dirtyStart;
+	double tickTime;
+	uint64_t tickCount;
+	uint64_t changeTick;
+	uint64_t skippedTicks;
+	FrameProfiler tickProfiler;
+
+	// Only touched by the thread that pushes input.
+	uint64_t droppedInputs;
+};
+
+#endif // _SIMULATION_THREAD_H
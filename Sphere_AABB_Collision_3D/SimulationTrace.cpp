@@ -0,0 +1,388 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SimulationTrace.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Writing, reading and replaying simulation traces. See SimulationTrace.h.
+*/
+
+#include "SimulationTrace.h"
+#include "Fnv1a.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+	// FNV-1a a 32 bit word at a time: the state hash runs every frame over every sphere, and this is 4 times fewer steps.
+	uint64_t hash_words(const uint32_t* words, size_t count, uint64_t hash)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			hash ^= words[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	const size_t COMMAND_BYTES = 1 + 4 + 3 * 4;
+	const size_t EVENT_BYTES = 4 + 4 + 1;
+	const size_t FRAME_BYTES = 4 + 4 + 8;
+
+	// Reads the frame stream of a loaded file, refusing to read past its end.
+	struct Reader
+	{
+		const unsigned char* data;
+		size_t size;
+		size_t offset;
+		bool ok;
+
+		void read(void* out, size_t count)
+		{
+			if (!ok || size - offset < count)
+			{
+				ok = false;
+				std::memset(out, 0, count);
+				return;
+			}
+			std::memcpy(out, data + offset, count);
+			offset += count;
+		}
+
+		template <class T>
+		T next()
+		{
+			T value;
+			read(&value, sizeof(value));
+			return value;
+		}
+	};
+}
+
+uint64_t simulation_state_hash(const Simulation &simulation)
+{
+	const SphereSet &spheres = simulation.spheres();
+	const std::vector<CollisionPair> &touching = simulation.touching();
+	static_assert(sizeof(float) == sizeof(uint32_t) && sizeof(CollisionPair) == 2 * sizeof(uint32_t), "hashed as 32 bit words");
+
+	uint64_t hash = FNV_OFFSET;
+	hash = hash_words((const uint32_t*)spheres.x.data(), spheres.size(), hash);
+	hash = hash_words((const uint32_t*)spheres.y.data(), spheres.size(), hash);
+	hash = hash_words((const uint32_t*)spheres.z.data(), spheres.size(), hash);
+	hash = hash_words((const uint32_t*)touching.data(), touching.size() * 2, hash);
+	return hash;
+}
+
+#pragma region Recording
+TraceRecorder::TraceRecorder() : file(nullptr), ok(false)
+{
+	std::memset(&header, 0, sizeof(header));
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	std::string error;
+	close(error);
+}
+
+bool TraceRecorder::open(const std::string &tracePath, const Scene &scene, std::string &error)
+{
+	close(error);
+
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_FILE_VERSION;
+	header.byteOrder = TRACE_FILE_BYTE_ORDER;
+	header.headerBytes = sizeof(TraceFileHeader);
+	header.sphereCount = scene.spheres.size();
+	header.boxCount = scene.boxes.size();
+	header.fileBytes = sizeof(TraceFileHeader);
+	header.checksum = FNV_OFFSET;
+
+	path = tracePath;
+	std::string temporary = path + ".tmp";
+	file = std::fopen(temporary.c_str(), "wb");
+	if (!file)
+	{
+		error = "Can't write file: " + temporary;
+		return false;
+	}
+
+	// The header goes in last, once the counts and checksum are known; until then its space is left empty.
+	TraceFileHeader blank;
+	std::memset(&blank, 0, sizeof(blank));
+	ok = std::fwrite(&blank, sizeof(blank), 1, file) == 1;
+
+	const std::vector<float>* arrays[] = {
+		&scene.spheres.x, &scene.spheres.y, &scene.spheres.z, &scene.spheres.radius,
+		&scene.boxes.minX, &scene.boxes.minY, &scene.boxes.minZ, &scene.boxes.maxX, &scene.boxes.maxY, &scene.boxes.maxZ,
+	};
+	for (const std::vector<float>* array : arrays)
+		write(array->data(), array->size() * sizeof(float));
+	flush();
+	return true;
+}
+
+void TraceRecorder::write(const void* bytes, size_t count)
+{
+	const unsigned char* p = (const unsigned char*)bytes;
+	buffer.insert(buffer.end(), p, p + count);
+	if (buffer.size() >= (1 << 16))
+		flush();
+}
+
+void TraceRecorder::flush()
+{
+	if (buffer.empty())
+		return;
+	ok = ok && std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+	header.checksum = fnv1a(buffer.data(), buffer.size(), header.checksum);
+	header.fileBytes += buffer.size();
+	buffer.clear();
+}
+
+void TraceRecorder::record(const Simulation &simulation, const InputCommand* commands, size_t count, const CollisionEvent* events, size_t eventCount)
+{
+	if (!file)
+		return;
+
+	uint32_t counts[2] = { (uint32_t)count, (uint32_t)eventCount };
+	uint64_t hash = simulation_state_hash(simulation);
+	write(counts, sizeof(counts));
+	write(&hash, sizeof(hash));
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const InputCommand &c = commands[i];
+		uint8_t kind = (uint8_t)c.kind;
+		write(&kind, 1);
+		write(&c.sphere, 4);
+		write(c.value, 12);
+	}
+	for (size_t i = 0; i < eventCount; i++)
+	{
+		const CollisionEvent &e = events[i];
+		uint8_t begin = e.begin ? 1 : 0;
+		write(&e.pair.sphere, 4);
+		write(&e.pair.box, 4);
+		write(&begin, 1);
+	}
+
+	header.frameCount++;
+	header.commandCount += count;
+	header.eventCount += eventCount;
+}
+
+bool TraceRecorder::close(std::string &error)
+{
+	if (!file)
+		return true;
+
+	flush();
+	bool written = ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+	written = std::fclose(file) == 0 && written;
+	file = nullptr;
+
+	std::string temporary = path + ".tmp";
+	std::remove(path.c_str());
+	if (!written || std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporary.c_str());
+		error = "Can't write file: " + path;
+		return false;
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region Loading
+bool load_trace(const std::string &path, SimulationTrace &trace, std::string &error)
+{
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		error = "Can't read file: " + path;
+		return false;
+	}
+	std::vector<unsigned char> data;
+	unsigned char block[1 << 16];
+	size_t got;
+	while ((got = std::fread(block, 1, sizeof(block), file)) > 0)
+		data.insert(data.end(), block, block + got);
+	std::fclose(file);
+
+	TraceFileHeader header;
+	if (data.size() < sizeof(header))
+	{
+		error = path + ": too small to be a trace";
+		return false;
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (std::memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) != 0)
+	{
+		error = path + ": not a trace file";
+		return false;
+	}
+	if (header.byteOrder != TRACE_FILE_BYTE_ORDER)
+	{
+		error = path + ": written on a machine with the other byte order";
+		return false;
+	}
+	if (header.version != TRACE_FILE_VERSION || header.headerBytes != sizeof(TraceFileHeader))
+	{
+		error = path + ": trace version " + std::to_string(header.version) + ", this program reads version " + std::to_string(TRACE_FILE_VERSION);
+		return false;
+	}
+	if (header.fileBytes != data.size())
+	{
+		error = path + ": the file is " + std::to_string(data.size()) + " bytes, its header says " + std::to_string(header.fileBytes);
+		return false;
+	}
+	if (fnv1a(data.data() + sizeof(header), data.size() - sizeof(header), FNV_OFFSET) != header.checksum)
+	{
+		error = path + ": checksum mismatch";
+		return false;
+	}
+
+	Reader reader = { data.data(), data.size(), sizeof(header), true };
+	uint64_t sceneFloats = header.sphereCount * 4 + header.boxCount * 6;
+	if (sceneFloats > (data.size() - sizeof(header)) / sizeof(float))
+	{
+		error = path + ": the scene is bigger than the file";
+		return false;
+	}
+
+	Scene &scene = trace.scene;
+	std::vector<float>* arrays[] = {
+		&scene.spheres.x, &scene.spheres.y, &scene.spheres.z, &scene.spheres.radius,
+		&scene.boxes.minX, &scene.boxes.minY, &scene.boxes.minZ, &scene.boxes.maxX, &scene.boxes.maxY, &scene.boxes.maxZ,
+	};
+	for (int a = 0; a < 10; a++)
+	{
+		arrays[a]->resize(a < 4 ? (size_t)header.sphereCount : (size_t)header.boxCount);
+		reader.read(arrays[a]->data(), arrays[a]->size() * sizeof(float));
+	}
+
+	// Counts come from the file: check them against what is left of it before reserving anything.
+	uint64_t left = data.size() - reader.offset;
+	if (header.frameCount > left / FRAME_BYTES || header.commandCount > left / COMMAND_BYTES || header.eventCount > left / EVENT_BYTES)
+	{
+		error = path + ": the header's counts don't fit in the file";
+		return false;
+	}
+	trace.frames.clear();
+	trace.commands.clear();
+	trace.events.clear();
+	trace.frames.reserve((size_t)header.frameCount);
+	trace.commands.reserve((size_t)header.commandCount);
+	trace.events.reserve((size_t)header.eventCount);
+
+	for (uint64_t f = 0; f < header.frameCount && reader.ok; f++)
+	{
+		TraceFrame frame;
+		frame.commandCount = reader.next<uint32_t>();
+		frame.eventCount = reader.next<uint32_t>();
+		frame.stateHash = reader.next<uint64_t>();
+		frame.firstCommand = trace.commands.size();
+		frame.firstEvent = trace.events.size();
+
+		for (size_t i = 0; i < frame.commandCount && reader.ok; i++)
+		{
+			InputCommand c;
+			c.frame = (uint32_t)f;
+			uint8_t kind = reader.next<uint8_t>();
+			if (kind > (uint8_t)InputKind::Velocity)
+				reader.ok = false;
+			c.kind = (InputKind)kind;
+			c.sphere = reader.next<uint32_t>();
+			reader.read(c.value, sizeof(c.value));
+			trace.commands.push_back(c);
+		}
+		for (size_t i = 0; i < frame.eventCount && reader.ok; i++)
+		{
+			CollisionEvent e;
+			e.frame = (uint32_t)f;
+			e.pair.sphere = reader.next<uint32_t>();
+			e.pair.box = reader.next<uint32_t>();
+			e.begin = reader.next<uint8_t>() != 0;
+			trace.events.push_back(e);
+		}
+		trace.frames.push_back(frame);
+	}
+
+	if (!reader.ok || reader.offset != data.size() || trace.commands.size() != header.commandCount || trace.events.size() != header.eventCount)
+	{
+		error = path + ": the frames don't match the header";
+		return false;
+	}
+	return true;
+}
+#pragma endregion
+
+#pragma region Replay
+void replay_trace(const SimulationTrace &trace, ReplayResult &result, FrameProfiler* profiler, ParallelNarrowphase* narrowphase)
+{
+	result.frames = 0;
+	result.events = 0;
+	result.matched = true;
+	result.mismatchFrame = 0;
+	result.mismatch.clear();
+	result.seconds = 0.0;
+
+	Simulation simulation(trace.scene);
+	simulation.set_profiler(profiler);
+	simulation.set_narrowphase(narrowphase);
+	std::vector<CollisionEvent> events;
+
+	for (size_t f = 0; f < trace.frames.size(); f++)
+	{
+		const TraceFrame &frame = trace.frames[f];
+		events.clear();
+
+		// Only the step is timed: the comparisons below are the replay's own cost, not the simulation's.
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			ScopedPhase timer(profiler, FramePhase::Update);
+			simulation.step(trace.commands.data() + frame.firstCommand, frame.commandCount, events);
+		}
+		result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (profiler)
+			profiler->end_frame();
+		result.frames++;
+		result.events += events.size();
+
+		const CollisionEvent* recorded = trace.events.data() + frame.firstEvent;
+		bool sameEvents = events.size() == frame.eventCount;
+		for (size_t i = 0; sameEvents && i < events.size(); i++)
+			sameEvents = events[i].pair == recorded[i].pair && events[i].begin == recorded[i].begin;
+
+		if (!sameEvents)
+		{
+			result.mismatch = std::to_string(events.size()) + " events, the trace has " + std::to_string(frame.eventCount) + " (or different ones)";
+		}
+		else if (simulation_state_hash(simulation) != frame.stateHash)
+		{
+			result.mismatch = "the same events, but sphere positions or touching pairs differ";
+		}
+		if (!result.mismatch.empty())
+		{
+			result.matched = false;
+			result.mismatchFrame = (uint32_t)f;
+			return;
+		}
+	}
+}
+#pragma endregion
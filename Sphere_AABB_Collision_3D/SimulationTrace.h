@@ -0,0 +1,151 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SimulationTrace.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Recording a simulation's input and results to a file, and replaying it later to check nothing changed.
+
+What the demo does depends on where the mouse was and when w or s was pressed, so a run can't be
+repeated, and a slow frame seen once can't be measured again. A Simulation (Simulation.h) is
+deterministic, though: the same scene and the same InputCommands in the same frames give the same
+results, to the bit. So a trace holds the scene it started from and, for every frame, the commands it
+got, the collisions that began or ended, and a hash of the state after the frame (every sphere's
+center and the touching pairs). That is enough to run the session again without a window, as fast as
+the collision code goes, and to say at which frame, if any, the results first differ.
+
+Record with TraceRecorder, either from the demo ("--record FILE") or from HeadlessSimulation
+("--record FILE"), and replay with replay_trace() or "HeadlessSimulation --replay FILE", which prints the
+time and fails on the first mismatch. A trace of a real session is then a regression test and a
+benchmark in one.
+
+Layout, all little-endian, like the scene file (SceneFile.h):
+	TraceFileHeader (128 bytes): magic, version, counts, a checksum of everything after it
+	the scene: sphere x, y, z, radius, box min x, y, z, max x, y, z, each count floats
+	then per frame: command count, event count (uint32 each), the state hash (uint64),
+	the commands (kind: uint8, sphere: uint32, value: 3 floats) and the events (sphere, box: uint32, begin: uint8)
+Frames are numbered by their position, so neither commands nor events store one. At 120 ticks a second
+a quiet frame is 16 bytes: about 7 MB an hour.
+*/
+
+#ifndef _SIMULATION_TRACE_H
+#define _SIMULATION_TRACE_H
+
+#include "CollisionTypes.h"
+#include "FrameProfiler.h"
+#include "SceneGenerator.h"
+#include "Simulation.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// "SABTRACE", and the layout version.
+const char TRACE_FILE_MAGIC[8] = { 'S', 'A', 'B', 'T', 'R', 'A', 'C', 'E' };
+const uint32_t TRACE_FILE_VERSION = 1;
+const uint32_t TRACE_FILE_BYTE_ORDER = 0x01020304;
+
+struct TraceFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t headerBytes;	// sizeof(TraceFileHeader).
+	uint32_t reserved0;
+	uint64_t sphereCount;
+	uint64_t boxCount;
+	uint64_t frameCount;
+	uint64_t commandCount;
+	uint64_t eventCount;
+	uint64_t fileBytes;
+	uint64_t checksum;		// FNV-1a of every byte after the header.
+	uint64_t reserved[6];
+};
+
+static_assert(sizeof(TraceFileHeader) == 128, "TraceFileHeader must stay 128 bytes");
+
+// A hash of everything a frame's results depend on: every sphere's center, bit for bit, and the touching pairs.
+uint64_t simulation_state_hash(const Simulation &simulation);
+
+// Writes a trace while a Simulation runs. Call record() after every step(), from the thread that steps.
+class TraceRecorder
+{
+public:
+	TraceRecorder();
+	~TraceRecorder();
+
+	TraceRecorder(const TraceRecorder&) = delete;
+	TraceRecorder &operator=(const TraceRecorder&) = delete;
+
+	// Starts a trace of a Simulation created from scene. The file is written as FILE.tmp and renamed by close().
+	bool open(const std::string &path, const Scene &scene, std::string &error);
+
+	// The frame simulation just stepped: the commands it was given and the events it appended.
+	void record(const Simulation &simulation, const InputCommand* commands, size_t count, const CollisionEvent* events, size_t eventCount);
+
+	// Writes the header and finishes the file. False, with the reason in error, if anything failed to write.
+	bool close(std::string &error);
+
+	bool is_open() const { return file != nullptr; }
+	uint64_t frames() const { return header.frameCount; }
+	uint64_t bytes() const { return header.fileBytes; }
+
+private:
+	void write(const void* bytes, size_t count);
+	void flush();
+
+	FILE* file;
+	std::string path;
+	TraceFileHeader header;
+	std::vector<unsigned char> buffer;	// Frames are gathered here and written in big blocks.
+	bool ok;
+};
+
+// One frame of a loaded trace: its commands and events are [first, first + count) of the trace's arrays.
+struct TraceFrame
+{
+	size_t firstCommand, commandCount;
+	size_t firstEvent, eventCount;
+	uint64_t stateHash;
+};
+
+struct SimulationTrace
+{
+	Scene scene;
+	std::vector<TraceFrame> frames;
+	std::vector<InputCommand> commands;		// With their frame numbers filled in.
+	std::vector<CollisionEvent> events;
+};
+
+// Reads a whole trace. False, with the reason in error, if it can't be read, is another format or version,
+// or fails its checksum.
+bool load_trace(const std::string &path, SimulationTrace &trace, std::string &error);
+
+struct ReplayResult
+{
+	uint32_t frames;			// Frames stepped.
+	size_t events;				// Events produced.
+	bool matched;				// Every frame gave the recorded events and state.
+	uint32_t mismatchFrame;		// If not, the first frame that didn't.
+	std::string mismatch;		// And what differed.
+	double seconds;				// Time spent stepping, without the comparisons.
+};
+
+// Steps a new Simulation through the trace as fast as it can, and compares each frame's events and state
+// with the recording. Stops at the first mismatch. profiler, if given, times each step as in HeadlessSimulation,
+// and narrowphase, if given, is handed to the Simulation (Simulation::set_narrowphase).
+void replay_trace(const SimulationTrace &trace, ReplayResult &result, FrameProfiler* profiler = nullptr, ParallelNarrowphase* narrowphase = nullptr);
+
+#endif // _SIMULATION_TRACE_H
@@ -0,0 +1,403 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SpatialHash.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Uniform grid / spatial hash broadphase. See SpatialHash.h.
+*/
+
+#include "SpatialHash.h"
+#include "OpenAddressing.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Cell coordinates are packed into 21 bits each, so a key fits in 63 bits and ~0 can mean "empty".
+static const int CELL_LIMIT = (1 << 20) - 1;
+static const uint64_t EMPTY_KEY = ~0ull;
+
+static int to_cell(float v, float inverseCellSize)
+{
+	float c = std::floor(v * inverseCellSize);
+	if (!(c > (float)-CELL_LIMIT))	// Also catches NaN.
+		return -CELL_LIMIT;
+	if (c > (float)CELL_LIMIT)
+		return CELL_LIMIT;
+	return (int)c;
+}
+
+static uint64_t cell_key(int x, int y, int z)
+{
+	const int bias = 1 << 20;
+	return ((uint64_t)(x + bias) << 42) | ((uint64_t)(y + bias) << 21) | (uint64_t)(z + bias);
+}
+
+SpatialHash::SpatialHash(float cellSize, int maxCellsPerBox)
+	: cellSize(cellSize), inverseCellSize(1.0f / cellSize), maxCellsPerBox(maxCellsPerBox),
+	freeEntry(INVALID), usedCells(0), liveBoxes(0), liveEntries(0)
+{
+	Cell empty = { EMPTY_KEY, INVALID };
+	table.assign(1024, empty);
+}
+
+float SpatialHash::cell_size_for(const SphereArrays &spheres, size_t count)
+{
+	if (count == 0)
+		return 1.0f;
+
+	std::vector<float> radii(spheres.radius, spheres.radius + count);
+	size_t k = (count * 9) / 10;
+	std::nth_element(radii.begin(), radii.begin() + k, radii.end());
+
+	float size = 2.0f * radii[k];
+	return size > 0.0f ? size : 1.0f;
+}
+
+void SpatialHash::set_cell_size(float size)
+{
+	for (BoxId id = 0; id < records.size(); id++)
+	{
+		if (records[id].alive)
+			unbin(id);
+	}
+
+	cellSize = size;
+	inverseCellSize = 1.0f / size;
+
+	for (BoxId id = 0; id < records.size(); id++)
+	{
+		if (records[id].alive)
+			bin(id);
+	}
+}
+
+#pragma region Cell table
+// Linear probing: returns the slot holding key, or the empty slot where it would go.
+size_t SpatialHash::find_slot(uint64_t key) const
+{
+	return open_address_find(table, key, EMPTY_KEY, slot_key);
+}
+
+// Returns the list head of a cell, creating the cell if needed.
+uint32_t* SpatialHash::cell_head(uint64_t key)
+{
+	size_t slot = find_slot(key);
+	if (table[slot].key == key)
+		return &table[slot].head;
+
+	// Keep the table at most half full so probe sequences stay short.
+	if ((usedCells + 1) * 2 > table.size())
+	{
+		grow_table();
+		slot = find_slot(key);
+	}
+
+	table[slot].key = key;
+	table[slot].head = INVALID;
+	usedCells++;
+	return &table[slot].head;
+}
+
+// Removes a cell without leaving a tombstone (open_address_erase).
+void SpatialHash::erase_cell(size_t slot)
+{
+	Cell empty = { EMPTY_KEY, INVALID };
+	open_address_erase(table, slot, empty, slot_key);
+	usedCells--;
+}
+
+void SpatialHash::grow_table()
+{
+	Cell empty = { EMPTY_KEY, INVALID };
+	open_address_grow(table, empty, slot_key);
+}
+#pragma endregion
+
+#pragma region Boxes
+void SpatialHash::cell_range(const AABB &box, int* lo, int* hi) const
+{
+	for (int a = 0; a < 3; a++)
+	{
+		lo[a] = to_cell(box.min[a], inverseCellSize);
+		hi[a] = to_cell(box.max[a], inverseCellSize);
+	}
+}
+
+void SpatialHash::sphere_range(float cx, float cy, float cz, float radius, int* lo, int* hi) const
+{
+	lo[0] = to_cell(cx - radius, inverseCellSize);
+	lo[1] = to_cell(cy - radius, inverseCellSize);
+	lo[2] = to_cell(cz - radius, inverseCellSize);
+	hi[0] = to_cell(cx + radius, inverseCellSize);
+	hi[1] = to_cell(cy + radius, inverseCellSize);
+	hi[2] = to_cell(cz + radius, inverseCellSize);
+}
+
+template <class Visit>
+void SpatialHash::visit_range(const int* lo, const int* hi, Visit &&visit) const
+{
+	for (int x = lo[0]; x <= hi[0]; x++)
+		for (int y = lo[1]; y <= hi[1]; y++)
+			for (int z = lo[2]; z <= hi[2]; z++)
+				visit(x, y, z);
+}
+
+uint32_t SpatialHash::allocate_entry()
+{
+	liveEntries++;
+	if (freeEntry != INVALID)
+	{
+		uint32_t e = freeEntry;
+		freeEntry = entries[e].next;
+		return e;
+	}
+	entries.push_back(Entry());
+	return (uint32_t)(entries.size() - 1);
+}
+
+// Writes the box into the cells it covers (or into the large box list).
+void SpatialHash::bin(BoxId id)
+{
+	BoxRecord &rec = records[id];
+	cell_range(bounds.get(id), rec.lo, rec.hi);
+	rec.firstEntry = INVALID;
+	rec.largeIndex = INVALID;
+
+	long long cells = 1;
+	for (int a = 0; a < 3; a++)
+		cells *= (long long)(rec.hi[a] - rec.lo[a] + 1);
+
+	if (cells > maxCellsPerBox)
+	{
+		rec.largeIndex = (uint32_t)largeBoxes.size();
+		largeBoxes.push_back(id);
+		return;
+	}
+
+	visit_range(rec.lo, rec.hi, [&](int x, int y, int z) {
+		uint64_t key = cell_key(x, y, z);
+		uint32_t e = allocate_entry();
+		uint32_t* head = cell_head(key);
+
+		Entry &entry = entries[e];
+		entry.cellKey = key;
+		entry.box = id;
+		entry.prev = INVALID;
+		entry.next = *head;
+		entry.boxNext = records[id].firstEntry;
+		if (*head != INVALID)
+			entries[*head].prev = e;
+		*head = e;
+		records[id].firstEntry = e;
+	});
+}
+
+// Takes the box out of every cell it is in.
+void SpatialHash::unbin(BoxId id)
+{
+	BoxRecord &rec = records[id];
+
+	if (rec.largeIndex != INVALID)
+	{
+		BoxId last = largeBoxes.back();
+		largeBoxes[rec.largeIndex] = last;
+		records[last].largeIndex = rec.largeIndex;
+		largeBoxes.pop_back();
+		rec.largeIndex = INVALID;
+		return;
+	}
+
+	uint32_t e = rec.firstEntry;
+	while (e != INVALID)
+	{
+		Entry &entry = entries[e];
+		uint32_t boxNext = entry.boxNext;
+
+		if (entry.prev != INVALID)
+			entries[entry.prev].next = entry.next;
+		else
+		{
+			size_t slot = find_slot(entry.cellKey);
+			table[slot].head = entry.next;
+			if (entry.next == INVALID)
+				erase_cell(slot);
+		}
+		if (entry.next != INVALID)
+			entries[entry.next].prev = entry.prev;
+
+		entry.next = freeEntry;
+		freeEntry = e;
+		liveEntries--;
+
+		e = boxNext;
+	}
+	rec.firstEntry = INVALID;
+}
+
+SpatialHash::BoxId SpatialHash::insert(const AABB &box)
+{
+	BoxId id;
+	if (!freeBoxes.empty())
+	{
+		id = freeBoxes.back();
+		freeBoxes.pop_back();
+
+		bounds.minX[id] = box.min[0]; bounds.minY[id] = box.min[1]; bounds.minZ[id] = box.min[2];
+		bounds.maxX[id] = box.max[0]; bounds.maxY[id] = box.max[1]; bounds.maxZ[id] = box.max[2];
+	}
+	else
+	{
+		id = (BoxId)records.size();
+		records.push_back(BoxRecord());
+		bounds.add(box);
+	}
+
+	records[id].alive = true;
+	bin(id);
+	liveBoxes++;
+	return id;
+}
+
+void SpatialHash::remove(BoxId id)
+{
+	if (id >= records.size() || !records[id].alive)
+		return;
+
+	unbin(id);
+	records[id].alive = false;
+	freeBoxes.push_back(id);
+	liveBoxes--;
+}
+
+void SpatialHash::move(BoxId id, const AABB &box)
+{
+	if (id >= records.size() || !records[id].alive)
+		return;
+
+	bounds.minX[id] = box.min[0]; bounds.minY[id] = box.min[1]; bounds.minZ[id] = box.min[2];
+	bounds.maxX[id] = box.max[0]; bounds.maxY[id] = box.max[1]; bounds.maxZ[id] = box.max[2];
+
+	// Most frames an object moves less than a cell: same cells, nothing to relink.
+	int lo[3], hi[3];
+	cell_range(box, lo, hi);
+	BoxRecord &rec = records[id];
+	if (lo[0] == rec.lo[0] && lo[1] == rec.lo[1] && lo[2] == rec.lo[2] &&
+		hi[0] == rec.hi[0] && hi[1] == rec.hi[1] && hi[2] == rec.hi[2])
+		return;
+
+	unbin(id);
+	bin(id);
+}
+
+void SpatialHash::clear()
+{
+	bounds.clear();
+	records.clear();
+	freeBoxes.clear();
+	largeBoxes.clear();
+	entries.clear();
+	freeEntry = INVALID;
+
+	Cell empty = { EMPTY_KEY, INVALID };
+	std::fill(table.begin(), table.end(), empty);
+	usedCells = 0;
+	liveBoxes = 0;
+	liveEntries = 0;
+}
+#pragma endregion
+
+#pragma region Queries
+// A box that spans several of the sphere's cells is found in each of them.
+// We only report it from the first cell (lowest coordinates) the two ranges share, so no set is needed to remove duplicates.
+template <class Report>
+void SpatialHash::for_each_candidate(float cx, float cy, float cz, float radius, Report &&report) const
+{
+	int lo[3], hi[3];
+	sphere_range(cx, cy, cz, radius, lo, hi);
+
+	// A cheap bounds check against the sphere's cube keeps obvious misses out of the candidate list.
+	BoxArrays b = bounds.arrays();
+	auto touchesCube = [&](BoxId id) {
+		return b.minX[id] <= cx + radius && b.maxX[id] >= cx - radius &&
+			b.minY[id] <= cy + radius && b.maxY[id] >= cy - radius &&
+			b.minZ[id] <= cz + radius && b.maxZ[id] >= cz - radius;
+	};
+
+	// A sphere much bigger than a cell would look up (2r / cellSize)^3 cells. Like a large box, it skips the cells then,
+	// as long as checking every box is the shorter job. Large boxes are among the records, so they are covered too.
+	long long cells = 1;
+	for (int a = 0; a < 3; a++)
+		cells *= (long long)(hi[a] - lo[a] + 1);
+
+	if (cells > maxCellsPerBox && cells > (long long)records.size())
+	{
+		for (BoxId id = 0; id < records.size(); id++)
+		{
+			if (records[id].alive && touchesCube(id))
+				report(id);
+		}
+		return;
+	}
+
+	visit_range(lo, hi, [&](int x, int y, int z) {
+		size_t slot = find_slot(cell_key(x, y, z));
+		if (table[slot].key == EMPTY_KEY)
+			return;
+
+		for (uint32_t e = table[slot].head; e != INVALID; e = entries[e].next)
+		{
+			BoxId id = entries[e].box;
+			const BoxRecord &rec = records[id];
+			if (std::max(lo[0], rec.lo[0]) == x && std::max(lo[1], rec.lo[1]) == y && std::max(lo[2], rec.lo[2]) == z &&
+				touchesCube(id))
+				report(id);
+		}
+	});
+
+	// Large boxes skip the cells.
+	for (BoxId id : largeBoxes)
+	{
+		if (touchesCube(id))
+			report(id);
+	}
+}
+
+void SpatialHash::query_sphere(float cx, float cy, float cz, float radius, std::vector<BoxId> &out) const
+{
+	for_each_candidate(cx, cy, cz, radius, [&](BoxId id) {
+		out.push_back(id);
+	});
+}
+
+void SpatialHash::collect_candidates(const SphereArrays &spheres, size_t count, std::vector<CollisionPair> &out) const
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		for_each_candidate(spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i], [&](BoxId id) {
+			CollisionPair pair = { (uint32_t)i, id };
+			out.push_back(pair);
+		});
+	}
+}
+
+void SpatialHash::find_overlaps(const SphereArrays &spheres, size_t count, std::vector<CollisionPair> &overlaps,
+	std::vector<CollisionPair> &candidates, CandidateScratch &scratch) const
+{
+	candidates.clear();
+	collect_candidates(spheres, count, candidates);
+	collide_candidates(spheres, bounds.arrays(), candidates.data(), candidates.size(), overlaps, scratch);
+}
+#pragma endregion
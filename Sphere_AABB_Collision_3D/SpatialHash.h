@@ -0,0 +1,150 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SpatialHash.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A uniform grid broadphase for N spheres against M boxes.
+Testing every sphere against every box costs N x M tests. Instead, space is cut into cubic cells and
+each box is written into the cells its extents (origin +/- breadth/length/depth halves) touch.
+A sphere then only has to look at the cells its own bounding cube touches, and only the boxes
+found there become candidate pairs for the exact test in SphereAABBBatch.h.
+
+Only the cells that hold something are stored, in a hash table keyed by the cell's integer coordinates,
+so the grid has no bounds and costs nothing for empty space.
+Each (box, cell) entry sits in a doubly linked list, so insert, remove and move are O(1) for boxes
+that cover a bounded number of cells. Boxes that would cover more than maxCellsPerBox cells are
+kept in a separate list and handed to every query instead. In the same way, a sphere whose cube covers
+more than maxCellsPerBox cells, and more cells than there are boxes, checks every box instead of the cells.
+*/
+
+#ifndef _SPATIAL_HASH_H
+#define _SPATIAL_HASH_H
+
+#include "CollisionTypes.h"
+#include "SphereAABBBatch.h"
+
+class SpatialHash
+{
+public:
+	// Handle used to move or remove a box. Handles are reused after a box is removed.
+	typedef uint32_t BoxId;
+
+	static const uint32_t INVALID = 0xFFFFFFFFu;
+
+	explicit SpatialHash(float cellSize = 1.0f, int maxCellsPerBox = 64);
+
+	// A good cell size for a set of spheres: about the diameter of the larger spheres (90th percentile),
+	// so most spheres touch at most 2 cells along each axis.
+	static float cell_size_for(const SphereArrays &spheres, size_t count);
+
+	// Changing the cell size rebins every box.
+	void set_cell_size(float cellSize);
+	float cell_size() const { return cellSize; }
+
+	BoxId insert(const AABB &box);
+	void remove(BoxId id);
+
+	// Updates a box's bounds. If it still covers the same cells, only the stored bounds change.
+	void move(BoxId id, const AABB &box);
+
+	void clear();
+
+	// Number of boxes currently in the grid.
+	size_t size() const { return liveBoxes; }
+
+	// Number of non-empty cells, and of (box, cell) entries. Useful for tuning the cell size.
+	size_t cell_count() const { return usedCells; }
+	size_t entry_count() const { return liveEntries; }
+
+	// The stored box bounds, indexed by BoxId. Slots of removed boxes hold stale data.
+	BoxArrays boxes() const { return bounds.arrays(); }
+	size_t box_capacity() const { return bounds.size(); }
+
+	// Appends the id of every box that overlaps the sphere's bounding cube. Each box is reported once.
+	void query_sphere(float cx, float cy, float cz, float radius, std::vector<BoxId> &out) const;
+
+	// Appends a candidate pair (sphere index, box id) for every sphere in the set.
+	void collect_candidates(const SphereArrays &spheres, size_t count, std::vector<CollisionPair> &out) const;
+
+	// collect_candidates followed by the exact sphere-AABB test. Appends only the pairs that really overlap.
+	// Candidates and scratch are caller owned so a steady-state frame doesn't allocate.
+	void find_overlaps(const SphereArrays &spheres, size_t count, std::vector<CollisionPair> &overlaps,
+		std::vector<CollisionPair> &candidates, CandidateScratch &scratch) const;
+
+private:
+	// One box written into one cell.
+	struct Entry
+	{
+		uint64_t cellKey;
+		BoxId box;
+		uint32_t prev, next;	// Neighbours in the cell's list.
+		uint32_t boxNext;		// Next entry of the same box.
+	};
+
+	// A non-empty cell in the open addressing table.
+	struct Cell
+	{
+		uint64_t key;
+		uint32_t head;
+	};
+
+	static uint64_t slot_key(const Cell &cell) { return cell.key; }
+
+	// Per box bookkeeping.
+	struct BoxRecord
+	{
+		int lo[3], hi[3];		// Cell range the box covers.
+		uint32_t firstEntry;	// INVALID for large boxes.
+		uint32_t largeIndex;	// Position in largeBoxes, or INVALID.
+		bool alive;
+	};
+
+	void cell_range(const AABB &box, int* lo, int* hi) const;
+	void sphere_range(float cx, float cy, float cz, float radius, int* lo, int* hi) const;
+	void bin(BoxId id);
+	void unbin(BoxId id);
+	uint32_t allocate_entry();
+
+	size_t find_slot(uint64_t key) const;
+	uint32_t* cell_head(uint64_t key);
+	void erase_cell(size_t slot);
+	void grow_table();
+
+	template <class Visit>
+	void visit_range(const int* lo, const int* hi, Visit &&visit) const;
+
+	template <class Report>
+	void for_each_candidate(float cx, float cy, float cz, float radius, Report &&report) const;
+
+	float cellSize;
+	float inverseCellSize;
+	int maxCellsPerBox;
+
+	BoxSet bounds;
+	std::vector<BoxRecord> records;
+	std::vector<BoxId> freeBoxes;
+	std::vector<BoxId> largeBoxes;
+
+	std::vector<Entry> entries;
+	uint32_t freeEntry;
+
+	std::vector<Cell> table;
+	size_t usedCells;
+	size_t liveBoxes;
+	size_t liveEntries;
+};
+
+#endif // _SPATIAL_HASH_H
@@ -0,0 +1,397 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereAABBBatch.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Scalar, SSE4.2, AVX2 and AVX-512 versions of the batched sphere-AABB test, and the code that picks one at runtime.
+Each SIMD function is compiled for its own instruction set (with a target attribute on GCC/Clang; MSVC allows
+intrinsics anywhere), so the rest of the program still runs on CPUs that don't have it.
+All paths use the same operation order as sphere_aabb_overlap(): max, min, subtract, multiply, add, add, compare.
+The build disables floating point contraction (fused multiply-add) so the compiler can't change that order on us.
+*/
+
+#include "SphereAABBBatch.h"
+#include "SimdSupport.h"
+
+#include <atomic>
+#include <cstring>
+
+#pragma region Scalar
+// Sets bit i of the hit mask. The mask has been cleared before.
+static inline void set_hit(uint64_t* hits, size_t i)
+{
+	hits[i >> 6] |= uint64_t(1) << (i & 63);
+}
+
+// Stores `lanes` bits of a SIMD compare result starting at pair i.
+// i is always a multiple of the lane count, and the lane count divides 64, so the bits never straddle two words.
+static inline void set_hits(uint64_t* hits, size_t i, uint64_t bits)
+{
+	hits[i >> 6] |= bits << (i & 63);
+}
+
+static void pairs_scalar(const SphereArrays &s, const BoxArrays &b, size_t begin, size_t end, uint64_t* hits)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		if (sphere_aabb_overlap(s.x[i], s.y[i], s.z[i], s.radius[i],
+			b.minX[i], b.minY[i], b.minZ[i], b.maxX[i], b.maxY[i], b.maxZ[i]))
+			set_hit(hits, i);
+	}
+}
+
+static void sphere_boxes_scalar(float cx, float cy, float cz, float r, const BoxArrays &b, size_t begin, size_t end, uint64_t* hits)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		if (sphere_aabb_overlap(cx, cy, cz, r,
+			b.minX[i], b.minY[i], b.minZ[i], b.maxX[i], b.maxY[i], b.maxZ[i]))
+			set_hit(hits, i);
+	}
+}
+
+static void pairs_scalar_all(const SphereArrays &s, const BoxArrays &b, size_t count, uint64_t* hits)
+{
+	pairs_scalar(s, b, 0, count, hits);
+}
+
+static void sphere_boxes_scalar_all(float cx, float cy, float cz, float r, const BoxArrays &b, size_t count, uint64_t* hits)
+{
+	sphere_boxes_scalar(cx, cy, cz, r, b, 0, count, hits);
+}
+#pragma endregion
+
+#if COLLISION_X86
+#pragma region SSE
+// 4 pairs per iteration.
+SIMD_TARGET("sse4.2")
+static inline __m128 distance_squared_sse(__m128 cx, __m128 cy, __m128 cz, const BoxArrays &b, size_t i)
+{
+	// closest point = min(max(center, boxMin), boxMax), then the offset from the center to it.
+	__m128 dx = _mm_sub_ps(cx, _mm_min_ps(_mm_max_ps(cx, _mm_loadu_ps(b.minX + i)), _mm_loadu_ps(b.maxX + i)));
+	__m128 dy = _mm_sub_ps(cy, _mm_min_ps(_mm_max_ps(cy, _mm_loadu_ps(b.minY + i)), _mm_loadu_ps(b.maxY + i)));
+	__m128 dz = _mm_sub_ps(cz, _mm_min_ps(_mm_max_ps(cz, _mm_loadu_ps(b.minZ + i)), _mm_loadu_ps(b.maxZ + i)));
+
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+}
+
+SIMD_TARGET("sse4.2")
+static void pairs_sse(const SphereArrays &s, const BoxArrays &b, size_t count, uint64_t* hits)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 r = _mm_loadu_ps(s.radius + i);
+		__m128 d2 = distance_squared_sse(_mm_loadu_ps(s.x + i), _mm_loadu_ps(s.y + i), _mm_loadu_ps(s.z + i), b, i);
+		set_hits(hits, i, (uint64_t)_mm_movemask_ps(_mm_cmple_ps(d2, _mm_mul_ps(r, r))));
+	}
+	pairs_scalar(s, b, i, count, hits);
+}
+
+SIMD_TARGET("sse4.2")
+static void sphere_boxes_sse(float x, float y, float z, float radius, const BoxArrays &b, size_t count, uint64_t* hits)
+{
+	__m128 cx = _mm_set1_ps(x), cy = _mm_set1_ps(y), cz = _mm_set1_ps(z);
+	__m128 r2 = _mm_set1_ps(radius * radius);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 d2 = distance_squared_sse(cx, cy, cz, b, i);
+		set_hits(hits, i, (uint64_t)_mm_movemask_ps(_mm_cmple_ps(d2, r2)));
+	}
+	sphere_boxes_scalar(x, y, z, radius, b, i, count, hits);
+}
+#pragma endregion
+
+#pragma region AVX2
+// 8 pairs per iteration.
+SIMD_TARGET("avx2")
+static inline __m256 distance_squared_avx2(__m256 cx, __m256 cy, __m256 cz, const BoxArrays &b, size_t i)
+{
+	__m256 dx = _mm256_sub_ps(cx, _mm256_min_ps(_mm256_max_ps(cx, _mm256_loadu_ps(b.minX + i)), _mm256_loadu_ps(b.maxX + i)));
+	__m256 dy = _mm256_sub_ps(cy, _mm256_min_ps(_mm256_max_ps(cy, _mm256_loadu_ps(b.minY + i)), _mm256_loadu_ps(b.maxY + i)));
+	__m256 dz = _mm256_sub_ps(cz, _mm256_min_ps(_mm256_max_ps(cz, _mm256_loadu_ps(b.minZ + i)), _mm256_loadu_ps(b.maxZ + i)));
+
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+}
+
+SIMD_TARGET("avx2")
+static void pairs_avx2(const SphereArrays &s, const BoxArrays &b, size_t count, uint64_t* hits)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 r = _mm256_loadu_ps(s.radius + i);
+		__m256 d2 = distance_squared_avx2(_mm256_loadu_ps(s.x + i), _mm256_loadu_ps(s.y + i), _mm256_loadu_ps(s.z + i), b, i);
+		set_hits(hits, i, (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(r, r), _CMP_LE_OQ)));
+	}
+	pairs_scalar(s, b, i, count, hits);
+}
+
+SIMD_TARGET("avx2")
+static void sphere_boxes_avx2(float x, float y, float z, float radius, const BoxArrays &b, size_t count, uint64_t* hits)
+{
+	__m256 cx = _mm256_set1_ps(x), cy = _mm256_set1_ps(y), cz = _mm256_set1_ps(z);
+	__m256 r2 = _mm256_set1_ps(radius * radius);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 d2 = distance_squared_avx2(cx, cy, cz, b, i);
+		set_hits(hits, i, (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ)));
+	}
+	sphere_boxes_scalar(x, y, z, radius, b, i, count, hits);
+}
+#pragma endregion
+
+#if COLLISION_HAS_AVX512
+#pragma region AVX512
+// 16 pairs per iteration. The compare writes straight into a 16 bit mask register.
+SIMD_TARGET("avx512f")
+static inline __m512 distance_squared_avx512(__m512 cx, __m512 cy, __m512 cz, const BoxArrays &b, size_t i)
+{
+	__m512 dx = _mm512_sub_ps(cx, _mm512_min_ps(_mm512_max_ps(cx, _mm512_loadu_ps(b.minX + i)), _mm512_loadu_ps(b.maxX + i)));
+	__m512 dy = _mm512_sub_ps(cy, _mm512_min_ps(_mm512_max_ps(cy, _mm512_loadu_ps(b.minY + i)), _mm512_loadu_ps(b.maxY + i)));
+	__m512 dz = _mm512_sub_ps(cz, _mm512_min_ps(_mm512_max_ps(cz, _mm512_loadu_ps(b.minZ + i)), _mm512_loadu_ps(b.maxZ + i)));
+
+	return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+}
+
+SIMD_TARGET("avx512f")
+static void pairs_avx512(const SphereArrays &s, const BoxArrays &b, size_t count, uint64_t* hits)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512 r = _mm512_loadu_ps(s.radius + i);
+		__m512 d2 = distance_squared_avx512(_mm512_loadu_ps(s.x + i), _mm512_loadu_ps(s.y + i), _mm512_loadu_ps(s.z + i), b, i);
+		set_hits(hits, i, (uint64_t)_mm512_cmp_ps_mask(d2, _mm512_mul_ps(r, r), _CMP_LE_OQ));
+	}
+	pairs_scalar(s, b, i, count, hits);
+}
+
+SIMD_TARGET("avx512f")
+static void sphere_boxes_avx512(float x, float y, float z, float radius, const BoxArrays &b, size_t count, uint64_t* hits)
+{
+	__m512 cx = _mm512_set1_ps(x), cy = _mm512_set1_ps(y), cz = _mm512_set1_ps(z);
+	__m512 r2 = _mm512_set1_ps(radius * radius);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512 d2 = distance_squared_avx512(cx, cy, cz, b, i);
+		set_hits(hits, i, (uint64_t)_mm512_cmp_ps_mask(d2, r2, _CMP_LE_OQ));
+	}
+	sphere_boxes_scalar(x, y, z, radius, b, i, count, hits);
+}
+#pragma endregion
+#endif // COLLISION_HAS_AVX512
+#endif // COLLISION_X86
+
+#pragma region Dispatch
+#if COLLISION_X86 && defined(_MSC_VER)
+// Checks that the OS saves the given register state (bits of XCR0) on context switches.
+static bool os_saves(unsigned long long mask)
+{
+	return (_xgetbv(0) & mask) == mask;
+}
+#endif
+
+SimdLevel detect_simd_level()
+{
+#if COLLISION_X86 && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+#if COLLISION_HAS_AVX512
+	if (__builtin_cpu_supports("avx512f"))
+		return SimdLevel::AVX512;
+#endif
+	if (__builtin_cpu_supports("avx2"))
+		return SimdLevel::AVX2;
+	if (__builtin_cpu_supports("sse4.2"))
+		return SimdLevel::SSE42;
+	return SimdLevel::Scalar;
+#elif COLLISION_X86 && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse42 = (info[2] & (1 << 20)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	bool avx2 = false, avx512 = false;
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+		avx512 = (info[1] & (1 << 16)) != 0;
+	}
+
+	// xmm/ymm state is bits 1-2 of XCR0, opmask/zmm state is bits 5-7.
+	if (osxsave && avx && avx512 && COLLISION_HAS_AVX512 && os_saves(0xE6))
+		return SimdLevel::AVX512;
+	if (osxsave && avx && avx2 && os_saves(0x6))
+		return SimdLevel::AVX2;
+	if (sse42)
+		return SimdLevel::SSE42;
+	return SimdLevel::Scalar;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+// The detected level is computed once, the first time anyone asks.
+static SimdLevel supported_level()
+{
+	static const SimdLevel level = detect_simd_level();
+	return level;
+}
+
+static SimdLevel clamp_level(SimdLevel level)
+{
+	SimdLevel max = supported_level();
+	return (int)level > (int)max ? max : level;
+}
+
+static std::atomic<int> activeLevel(-1);
+
+SimdLevel active_simd_level()
+{
+	int level = activeLevel.load(std::memory_order_relaxed);
+	if (level < 0)
+	{
+		level = (int)supported_level();
+		activeLevel.store(level, std::memory_order_relaxed);
+	}
+	return (SimdLevel)level;
+}
+
+SimdLevel set_simd_level(SimdLevel level)
+{
+	level = clamp_level(level);
+	activeLevel.store((int)level, std::memory_order_relaxed);
+	return level;
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::SSE42:	return "sse4.2";
+	case SimdLevel::AVX2:	return "avx2";
+	case SimdLevel::AVX512:	return "avx512";
+	default:				return "scalar";
+	}
+}
+
+void collide_pairs_with(SimdLevel level, const SphereArrays &spheres, const BoxArrays &boxes, size_t count, uint64_t* hits)
+{
+	std::memset(hits, 0, hit_mask_words(count) * sizeof(uint64_t));
+
+	switch (clamp_level(level))
+	{
+#if COLLISION_X86
+#if COLLISION_HAS_AVX512
+	case SimdLevel::AVX512:	pairs_avx512(spheres, boxes, count, hits); return;
+#endif
+	case SimdLevel::AVX2:	pairs_avx2(spheres, boxes, count, hits); return;
+	case SimdLevel::SSE42:	pairs_sse(spheres, boxes, count, hits); return;
+#endif
+	default:				pairs_scalar_all(spheres, boxes, count, hits); return;
+	}
+}
+
+void collide_sphere_boxes_with(SimdLevel level, float cx, float cy, float cz, float radius, const BoxArrays &boxes, size_t count, uint64_t* hits)
+{
+	std::memset(hits, 0, hit_mask_words(count) * sizeof(uint64_t));
+
+	switch (clamp_level(level))
+	{
+#if COLLISION_X86
+#if COLLISION_HAS_AVX512
+	case SimdLevel::AVX512:	sphere_boxes_avx512(cx, cy, cz, radius, boxes, count, hits); return;
+#endif
+	case SimdLevel::AVX2:	sphere_boxes_avx2(cx, cy, cz, radius, boxes, count, hits); return;
+	case SimdLevel::SSE42:	sphere_boxes_sse(cx, cy, cz, radius, boxes, count, hits); return;
+#endif
+	default:				sphere_boxes_scalar_all(cx, cy, cz, radius, boxes, count, hits); return;
+	}
+}
+
+void collide_pairs(const SphereArrays &spheres, const BoxArrays &boxes, size_t count, uint64_t* hits)
+{
+	collide_pairs_with(active_simd_level(), spheres, boxes, count, hits);
+}
+
+void collide_sphere_boxes(float cx, float cy, float cz, float radius, const BoxArrays &boxes, size_t count, uint64_t* hits)
+{
+	collide_sphere_boxes_with(active_simd_level(), cx, cy, cz, radius, boxes, count, hits);
+}
+
+void collide_candidates(const SphereArrays &spheres, const BoxArrays &boxes, const CollisionPair* candidates, size_t count,
+	std::vector<CollisionPair> &overlaps, CandidateScratch &scratch)
+{
+	// Small enough that a chunk's gathered data stays in the L1 cache while collide_pairs reads it.
+	const size_t chunk = 512;
+
+	scratch.hits.resize(hit_mask_words(chunk));
+
+	for (size_t begin = 0; begin < count; begin += chunk)
+	{
+		size_t n = count - begin < chunk ? count - begin : chunk;
+
+		scratch.spheres.clear();
+		scratch.boxes.clear();
+		for (size_t k = 0; k < n; k++)
+		{
+			const CollisionPair &p = candidates[begin + k];
+			scratch.spheres.add(spheres.x[p.sphere], spheres.y[p.sphere], spheres.z[p.sphere], spheres.radius[p.sphere]);
+			scratch.boxes.minX.push_back(boxes.minX[p.box]);
+			scratch.boxes.minY.push_back(boxes.minY[p.box]);
+			scratch.boxes.minZ.push_back(boxes.minZ[p.box]);
+			scratch.boxes.maxX.push_back(boxes.maxX[p.box]);
+			scratch.boxes.maxY.push_back(boxes.maxY[p.box]);
+			scratch.boxes.maxZ.push_back(boxes.maxZ[p.box]);
+		}
+
+		collide_pairs(scratch.spheres.arrays(), scratch.boxes.arrays(), n, scratch.hits.data());
+
+		for (size_t k = 0; k < n; k++)
+		{
+			if (hit_mask_test(scratch.hits.data(), k))
+				overlaps.push_back(candidates[begin + k]);
+		}
+	}
+}
+
+size_t hit_mask_count(const uint64_t* hits, size_t count)
+{
+	size_t total = 0;
+	size_t words = hit_mask_words(count);
+	for (size_t w = 0; w < words; w++)
+	{
+		// Portable popcount; the mask is small compared to the work that produced it.
+		uint64_t v = hits[w];
+		v = v - ((v >> 1) & 0x5555555555555555ull);
+		v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+		v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		total += (size_t)((v * 0x0101010101010101ull) >> 56);
+	}
+	return total;
+}
+#pragma endregion
@@ -0,0 +1,119 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereAABBBatch.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Batched version of is_colliding() from main.cpp.
+The test is the same one: clamp the sphere's center onto the box to get the closest point,
+then check whether that point lies on/inside the sphere. Two things change:
+ - we compare squared distances, so there is no square root. That needs radius >= 0: is_colliding()
+   never hits with a negative radius, but its square would. Scene scripts reject one and
+   MappedScene::validate() reports one in a scene file; the kernels don't check again,
+ - clamping is done with min/max instead of if statements, so there are no branches.
+With no branches, the same instructions can run on 4 (SSE), 8 (AVX2) or 16 (AVX-512) pairs at once.
+The widest path the CPU supports is picked at runtime. Every path produces exactly the same bits as
+the scalar fallback, because they all do the same float operations in the same order.
+
+Results are written as a bit mask: bit i of the mask (word i / 64, bit i % 64) is set when pair i collides.
+*/
+
+#ifndef _SPHERE_AABB_BATCH_H
+#define _SPHERE_AABB_BATCH_H
+
+#include "CollisionTypes.h"
+#include "SphereAABBKernel.h"
+
+// The instruction sets the batch kernels can run on, from narrowest to widest.
+enum class SimdLevel
+{
+	Scalar = 0,
+	SSE42 = 1,
+	AVX2 = 2,
+	AVX512 = 3
+};
+
+// The widest instruction set this CPU (and OS) supports.
+SimdLevel detect_simd_level();
+
+// The instruction set the batch functions currently use. Starts out as detect_simd_level().
+SimdLevel active_simd_level();
+
+// Forces the batch functions onto a narrower path (for benchmarking or comparing results).
+// Asking for a wider path than the CPU supports falls back to the widest supported one.
+// Returns the level that is now active.
+SimdLevel set_simd_level(SimdLevel level);
+
+// Readable name of a level, e.g. "avx2".
+const char* simd_level_name(SimdLevel level);
+
+// Clamps x onto [min, max] without branches.
+// The operand order matches what maxps/minps do, so the scalar code and the SIMD code agree bit for bit, even for NaN.
+inline float clamp_branchless(float x, float min, float max)
+{
+	float v = x > min ? x : min;
+	return v < max ? v : max;
+}
+
+// The single pair test every other piece of collision code builds on.
+// It is the test from is_colliding(): closest point on the box (clamp_on_rectangle), then distance to the center,
+// compared squared so we don't need the square root. The 3D float case of sphere_box_overlap (SphereAABBKernel.h).
+// radius must be >= 0 (see above).
+inline bool sphere_aabb_overlap(float cx, float cy, float cz, float radius,
+	float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+{
+	SphereN<3, float> sphere = { { cx, cy, cz }, radius };
+	BoxN<3, float> box = { { minX, minY, minZ }, { maxX, maxY, maxZ } };
+	return sphere_box_overlap(sphere, box);
+}
+
+inline bool sphere_aabb_overlap(float cx, float cy, float cz, float radius, const AABB &b)
+{
+	return sphere_aabb_overlap(cx, cy, cz, radius, b.min[0], b.min[1], b.min[2], b.max[0], b.max[1], b.max[2]);
+}
+
+// Tests sphere i against box i for every i in [0, count), and writes bit i of hits.
+// hits must hold hit_mask_words(count) words; all of them are overwritten.
+void collide_pairs(const SphereArrays &spheres, const BoxArrays &boxes, size_t count, uint64_t* hits);
+
+// Tests one sphere against boxes [0, count), and writes bit i of hits for box i.
+// hits must hold hit_mask_words(count) words; all of them are overwritten.
+void collide_sphere_boxes(float cx, float cy, float cz, float radius, const BoxArrays &boxes, size_t count, uint64_t* hits);
+
+// Same as collide_pairs, but always uses the given level (clamped to what the CPU supports).
+// Used by the benchmark to compare paths side by side without touching the global setting.
+void collide_pairs_with(SimdLevel level, const SphereArrays &spheres, const BoxArrays &boxes, size_t count, uint64_t* hits);
+
+// Same as collide_sphere_boxes, but always uses the given level (clamped to what the CPU supports).
+void collide_sphere_boxes_with(SimdLevel level, float cx, float cy, float cz, float radius, const BoxArrays &boxes, size_t count, uint64_t* hits);
+
+// Scratch space for collide_candidates. Keep one around between calls so a steady-state frame doesn't allocate.
+struct CandidateScratch
+{
+	SphereSet spheres;
+	BoxSet boxes;
+	std::vector<uint64_t> hits;
+};
+
+// The exact test for the candidate pairs a broadphase produced.
+// Candidates are gathered into structure-of-arrays form in small chunks, run through collide_pairs,
+// and the ones that really overlap are appended to overlaps (in the same order as candidates).
+void collide_candidates(const SphereArrays &spheres, const BoxArrays &boxes, const CollisionPair* candidates, size_t count,
+	std::vector<CollisionPair> &overlaps, CandidateScratch &scratch);
+
+// Counts the set bits of a hit mask holding count pairs.
+size_t hit_mask_count(const uint64_t* hits, size_t count);
+
+#endif // _SPHERE_AABB_BATCH_H
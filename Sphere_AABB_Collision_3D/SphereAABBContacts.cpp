@@ -0,0 +1,200 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereAABBContacts.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Contact math and the chunked contact pipeline. See SphereAABBContacts.h.
+*/
+
+#include "SphereAABBContacts.h"
+#include "SphereAABBBatch.h"
+
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Pairs per chunk. The gathered candidate data (10 floats per pair) and the hit mask stay on the stack and in L1.
+static const size_t CHUNK = 256;
+
+// Index of the lowest set bit. v must not be 0.
+static inline unsigned lowest_bit(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, v);
+	return (unsigned)index;
+#else
+	unsigned index = 0;
+	while (!(v & 1))
+	{
+		v >>= 1;
+		index++;
+	}
+	return index;
+#endif
+}
+
+// Fills in the contact of a pair that is known to collide.
+static void fill_contact(float cx, float cy, float cz, float radius,
+	float minX, float minY, float minZ, float maxX, float maxY, float maxZ, Contact &contact)
+{
+	// Closest point on the box, exactly as in the overlap test.
+	float px = clamp_branchless(cx, minX, maxX);
+	float py = clamp_branchless(cy, minY, maxY);
+	float pz = clamp_branchless(cz, minZ, maxZ);
+
+	float dx = cx - px;
+	float dy = cy - py;
+	float dz = cz - pz;
+	float distanceSquared = dx * dx + dy * dy + dz * dz;
+
+	if (distanceSquared > 0.0f)
+	{
+		// Center outside the box.
+		float distance = std::sqrt(distanceSquared);
+		float inverse = 1.0f / distance;
+		contact.point[0] = px; contact.point[1] = py; contact.point[2] = pz;
+		contact.normal[0] = dx * inverse; contact.normal[1] = dy * inverse; contact.normal[2] = dz * inverse;
+
+		// The squared test passed, but the square root can round a hair past the radius.
+		float depth = radius - distance;
+		contact.depth = depth > 0.0f ? depth : 0.0f;
+		return;
+	}
+
+	// Center inside the box (or exactly on its surface): leave through the nearest face.
+	// Faces are checked in the order -x, +x, -y, +y, -z, +z, and the first of equally near faces wins.
+	const float center[3] = { cx, cy, cz };
+	const float lo[3] = { minX, minY, minZ };
+	const float hi[3] = { maxX, maxY, maxZ };
+
+	int axis = 0;
+	float sign = -1.0f;
+	float nearest = cx - minX;
+	for (int a = 0; a < 3; a++)
+	{
+		float toMin = center[a] - lo[a];
+		float toMax = hi[a] - center[a];
+		if (toMin < nearest)
+		{
+			nearest = toMin;
+			axis = a;
+			sign = -1.0f;
+		}
+		if (toMax < nearest)
+		{
+			nearest = toMax;
+			axis = a;
+			sign = 1.0f;
+		}
+	}
+
+	for (int a = 0; a < 3; a++)
+	{
+		contact.point[a] = center[a];
+		contact.normal[a] = 0.0f;
+	}
+	contact.point[axis] = sign < 0.0f ? lo[axis] : hi[axis];
+	contact.normal[axis] = sign;
+	contact.depth = radius + nearest;
+}
+
+bool sphere_aabb_contact(float cx, float cy, float cz, float radius, const AABB &box, Contact &contact)
+{
+	if (!sphere_aabb_overlap(cx, cy, cz, radius, box))
+		return false;
+
+	fill_contact(cx, cy, cz, radius, box.min[0], box.min[1], box.min[2], box.max[0], box.max[1], box.max[2], contact);
+	return true;
+}
+
+size_t generate_contacts(const SphereArrays &spheres, const BoxArrays &boxes, size_t count, Contact* contacts, size_t capacity)
+{
+	uint64_t hits[CHUNK / 64];
+	size_t found = 0;
+
+	for (size_t begin = 0; begin < count; begin += CHUNK)
+	{
+		size_t n = count - begin < CHUNK ? count - begin : CHUNK;
+
+		SphereArrays s = { spheres.x + begin, spheres.y + begin, spheres.z + begin, spheres.radius + begin };
+		BoxArrays b = { boxes.minX + begin, boxes.minY + begin, boxes.minZ + begin,
+			boxes.maxX + begin, boxes.maxY + begin, boxes.maxZ + begin };
+		collide_pairs(s, b, n, hits);
+
+		for (size_t w = 0; w < hit_mask_words(n); w++)
+		{
+			for (uint64_t word = hits[w]; word != 0; word &= word - 1)
+			{
+				size_t k = w * 64 + lowest_bit(word);
+				if (found < capacity)
+				{
+					Contact &c = contacts[found];
+					fill_contact(s.x[k], s.y[k], s.z[k], s.radius[k], b.minX[k], b.minY[k], b.minZ[k], b.maxX[k], b.maxY[k], b.maxZ[k], c);
+					c.index = (uint32_t)(begin + k);
+				}
+				found++;
+			}
+		}
+	}
+	return found;
+}
+
+size_t generate_contacts(const SphereArrays &spheres, const BoxArrays &boxes, const CollisionPair* candidates, size_t count,
+	Contact* contacts, size_t capacity)
+{
+	// Gathered chunk, structure-of-arrays, on the stack.
+	float x[CHUNK], y[CHUNK], z[CHUNK], radius[CHUNK];
+	float minX[CHUNK], minY[CHUNK], minZ[CHUNK], maxX[CHUNK], maxY[CHUNK], maxZ[CHUNK];
+	const SphereArrays s = { x, y, z, radius };
+	const BoxArrays b = { minX, minY, minZ, maxX, maxY, maxZ };
+	uint64_t hits[CHUNK / 64];
+	size_t found = 0;
+
+	for (size_t begin = 0; begin < count; begin += CHUNK)
+	{
+		size_t n = count - begin < CHUNK ? count - begin : CHUNK;
+
+		for (size_t k = 0; k < n; k++)
+		{
+			const CollisionPair &p = candidates[begin + k];
+			x[k] = spheres.x[p.sphere]; y[k] = spheres.y[p.sphere]; z[k] = spheres.z[p.sphere]; radius[k] = spheres.radius[p.sphere];
+			minX[k] = boxes.minX[p.box]; minY[k] = boxes.minY[p.box]; minZ[k] = boxes.minZ[p.box];
+			maxX[k] = boxes.maxX[p.box]; maxY[k] = boxes.maxY[p.box]; maxZ[k] = boxes.maxZ[p.box];
+		}
+		collide_pairs(s, b, n, hits);
+
+		for (size_t w = 0; w < hit_mask_words(n); w++)
+		{
+			for (uint64_t word = hits[w]; word != 0; word &= word - 1)
+			{
+				size_t k = w * 64 + lowest_bit(word);
+				if (found < capacity)
+				{
+					Contact &c = contacts[found];
+					fill_contact(x[k], y[k], z[k], radius[k], minX[k], minY[k], minZ[k], maxX[k], maxY[k], maxZ[k], c);
+					c.index = (uint32_t)(begin + k);
+				}
+				found++;
+			}
+		}
+	}
+	return found;
+}
@@ -0,0 +1,60 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereAABBContacts.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Contact generation: not just "do they collide?" but where, in which direction, and how deep.
+That is what a physics response needs to push the sphere back out of the box.
+
+If the sphere's center is outside the box, the clamp from is_colliding() gives the closest point on the box.
+The normal points from that point to the center, and the depth is the radius minus the distance.
+If the center is inside the box, the clamp gives back the center itself: the vector between them has length 0
+and no direction. Then the sphere is pushed out through the nearest face instead: the normal is that face's
+direction, the point is the center moved onto the face, and the depth is the radius plus the distance to the face.
+
+Pairs are handled in chunks: the branch-free SIMD test from SphereAABBBatch.h finds the hits first,
+and only the hits go through the (scalar) contact math. Most pairs miss, so the extra work stays small.
+Contacts are written into a buffer the caller owns and reuses; nothing here allocates.
+*/
+
+#ifndef _SPHERE_AABB_CONTACTS_H
+#define _SPHERE_AABB_CONTACTS_H
+
+#include "CollisionTypes.h"
+
+// One contact, 32 bytes.
+struct Contact
+{
+	float point[3];		// Contact point on the box's surface.
+	float normal[3];	// Unit vector from the box towards the sphere: move the sphere along it to separate them.
+	float depth;		// How far to move the sphere along the normal so they only touch. 0 when they just touch.
+	uint32_t index;		// Which input pair this contact is for (its index in the pairs or candidate list).
+};
+
+static_assert(sizeof(Contact) == 32, "Contact must stay 32 bytes");
+
+// Computes the contact between one sphere and one box. Returns false (and leaves contact alone) if they don't touch.
+bool sphere_aabb_contact(float cx, float cy, float cz, float radius, const AABB &box, Contact &contact);
+
+// Sphere i against box i for every i in [0, count). Writes one contact per colliding pair, in pair order,
+// and returns the number of colliding pairs. If that is more than capacity, only the first capacity were written.
+size_t generate_contacts(const SphereArrays &spheres, const BoxArrays &boxes, size_t count, Contact* contacts, size_t capacity);
+
+// The same for the candidate pairs a broadphase produced. Contact::index is the candidate's position in the list.
+size_t generate_contacts(const SphereArrays &spheres, const BoxArrays &boxes, const CollisionPair* candidates, size_t count,
+	Contact* contacts, size_t capacity);
+
+#endif // _SPHERE_AABB_CONTACTS_H
@@ -0,0 +1,207 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereAABBKernel.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+clamp_on_rectangle() and is_colliding() from main.cpp as templates, for any number of dimensions
+and any number type. The 2D version of this project (circle against rectangle) is the same test with
+one axis fewer, and some uses need more than float gives:
+ - double, for large worlds, where a float's 24 bits of precision run out far from the origin,
+ - Fixed32 (below), for lockstep networking, where every machine must get exactly the same answer
+   whatever its compiler or CPU does with floats. Integer arithmetic is the same everywhere.
+Code that is fine with float pays nothing for the others: each combination is its own function.
+
+The test is the same as sphere_aabb_overlap (SphereAABBBatch.h), which now calls the 3D float version:
+clamp each coordinate of the center onto the box, then compare the squared distance to the squared
+radius. The axes are walked by template recursion, not a loop, so every variant is straight-line code
+whatever the optimizer decides about unrolling, and the clamps are conditional moves, not branches.
+The squared distances are added in axis order (x, then y, then z), so the float version gives the same
+bits as the batch kernels.
+
+Everything is constexpr, so a test with constant inputs can be worked out by the compiler.
+*/
+
+#ifndef _SPHERE_AABB_KERNEL_H
+#define _SPHERE_AABB_KERNEL_H
+
+#include <cstdint>
+
+#pragma region Fixed point
+// A signed 16.16 fixed-point number: raw / 65536.
+// The squared distance is kept in 64 bits (see ScalarTraits<Fixed32>), which holds the sum of three squared
+// differences only while every coordinate and radius stays under 2^14 = 16384 in size. Keep worlds inside that.
+struct Fixed32
+{
+	static const int FRACTION_BITS = 16;
+	static const int32_t ONE = 1 << FRACTION_BITS;
+
+	int32_t raw;
+
+	static constexpr Fixed32 from_raw(int32_t raw) { return Fixed32{ raw }; }
+	static constexpr Fixed32 from_int(int32_t value) { return Fixed32{ value * ONE }; }
+
+	// Rounds to the nearest step of 1/65536.
+	static constexpr Fixed32 from_float(double value)
+	{
+		return Fixed32{ (int32_t)(value * ONE + (value >= 0.0 ? 0.5 : -0.5)) };
+	}
+
+	constexpr double to_double() const { return (double)raw / ONE; }
+};
+
+constexpr bool operator<(Fixed32 a, Fixed32 b) { return a.raw < b.raw; }
+constexpr bool operator>(Fixed32 a, Fixed32 b) { return a.raw > b.raw; }
+constexpr bool operator==(Fixed32 a, Fixed32 b) { return a.raw == b.raw; }
+#pragma endregion
+
+#pragma region Scalar traits
+// How each number type squares a difference. Square is the type squared distances are summed in.
+template <class T>
+struct ScalarTraits;
+
+template <>
+struct ScalarTraits<float>
+{
+	typedef float Square;
+	static constexpr Square square_difference(float a, float b) { return (a - b) * (a - b); }
+	static constexpr Square square(float a) { return a * a; }
+};
+
+template <>
+struct ScalarTraits<double>
+{
+	typedef double Square;
+	static constexpr Square square_difference(double a, double b) { return (a - b) * (a - b); }
+	static constexpr Square square(double a) { return a * a; }
+};
+
+// Differences are taken in 64 bits so they can't overflow, and squared unsigned: a square is never negative,
+// and unsigned has the extra bit that three squares of differences up to 2^31 raw need.
+template <>
+struct ScalarTraits<Fixed32>
+{
+	typedef uint64_t Square;
+
+	static constexpr uint64_t magnitude(int64_t d) { return (uint64_t)(d < 0 ? -d : d); }
+	static constexpr Square square_difference(Fixed32 a, Fixed32 b)
+	{
+		return magnitude((int64_t)a.raw - b.raw) * magnitude((int64_t)a.raw - b.raw);
+	}
+	static constexpr Square square(Fixed32 a) { return magnitude(a.raw) * magnitude(a.raw); }
+};
+#pragma endregion
+
+#pragma region Shapes
+// A sphere (a circle in 2D) and a box (a rectangle) in D dimensions. Plain aggregates, so they can be constexpr.
+template <int D, class T>
+struct SphereN
+{
+	T center[D];
+	T radius;
+};
+
+template <int D, class T>
+struct BoxN
+{
+	T min[D];
+	T max[D];
+};
+
+template <int D, class T>
+struct PointN
+{
+	T v[D];
+};
+#pragma endregion
+
+#pragma region Kernels
+// Clamps x onto [min, max]. The same operand order as clamp_branchless (SphereAABBBatch.h), so NaNs behave the same.
+template <class T>
+constexpr T clamp_to_range(T x, T min, T max)
+{
+	T v = x > min ? x : min;
+	return v < max ? v : max;
+}
+
+namespace kernel_detail
+{
+	// Axis A onward, added to sum. Recursion stops at D.
+	template <int A, int D, class T>
+	struct Axes
+	{
+		typedef typename ScalarTraits<T>::Square Square;
+
+		static constexpr Square distance_squared(Square sum, const T* center, const T* min, const T* max)
+		{
+			return Axes<A + 1, D, T>::distance_squared(
+				sum + ScalarTraits<T>::square_difference(center[A], clamp_to_range(center[A], min[A], max[A])), center, min, max);
+		}
+	};
+
+	template <int D, class T>
+	struct Axes<D, D, T>
+	{
+		typedef typename ScalarTraits<T>::Square Square;
+
+		static constexpr Square distance_squared(Square sum, const T*, const T*, const T*) { return sum; }
+	};
+
+	template <int A, int D, class T>
+	struct ClampAxes
+	{
+		static constexpr void clamp(const T* p, const T* min, const T* max, T* out)
+		{
+			out[A] = clamp_to_range(p[A], min[A], max[A]);
+			ClampAxes<A + 1, D, T>::clamp(p, min, max, out);
+		}
+	};
+
+	template <int D, class T>
+	struct ClampAxes<D, D, T>
+	{
+		static constexpr void clamp(const T*, const T*, const T*, T*) {}
+	};
+}
+
+// The point of the box closest to p: clamp_on_rectangle() from main.cpp.
+template <int D, class T>
+constexpr PointN<D, T> closest_point_on_box(const T (&p)[D], const BoxN<D, T> &box)
+{
+	static_assert(D == 2 || D == 3, "boxes are 2D or 3D");
+	PointN<D, T> closest = {};
+	kernel_detail::ClampAxes<0, D, T>::clamp(p, box.min, box.max, closest.v);
+	return closest;
+}
+
+// Squared distance from p to the nearest point of the box; 0 if p is inside.
+template <int D, class T>
+constexpr typename ScalarTraits<T>::Square distance_squared_to_box(const T (&p)[D], const BoxN<D, T> &box)
+{
+	static_assert(D == 2 || D == 3, "boxes are 2D or 3D");
+	return kernel_detail::Axes<1, D, T>::distance_squared(
+		ScalarTraits<T>::square_difference(p[0], clamp_to_range(p[0], box.min[0], box.max[0])), p, box.min, box.max);
+}
+
+// is_colliding() from main.cpp: true if the sphere touches or overlaps the box. The radius must be >= 0, since only
+// its square is compared.
+template <int D, class T>
+constexpr bool sphere_box_overlap(const SphereN<D, T> &sphere, const BoxN<D, T> &box)
+{
+	return distance_squared_to_box<D, T>(sphere.center, box) <= ScalarTraits<T>::square(sphere.radius);
+}
+#pragma endregion
+
+#endif // _SPHERE_AABB_KERNEL_H
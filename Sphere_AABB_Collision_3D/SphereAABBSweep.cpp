@@ -0,0 +1,270 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereAABBSweep.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Ray against rounded box, and the chunked batch versions. See SphereAABBSweep.h.
+*/
+
+#include "SphereAABBSweep.h"
+#include "SphereAABBBatch.h"
+#include "SphereAABBContacts.h"
+
+#include <cmath>
+
+// Pairs per chunk for the batch versions.
+static const size_t CHUNK = 256;
+
+#pragma region Ray tests
+// Earliest t in [0, 1] at which the point c + t d is within radius of the point s.
+static float ray_sphere(const float* c, const float* d, const float* s, float radius)
+{
+	float m[3] = { c[0] - s[0], c[1] - s[1], c[2] - s[2] };
+	float a = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+	float b = m[0] * d[0] + m[1] * d[1] + m[2] * d[2];
+	float k = m[0] * m[0] + m[1] * m[1] + m[2] * m[2] - radius * radius;
+
+	// Starting outside and moving away.
+	if (a == 0.0f || (k > 0.0f && b > 0.0f))
+		return SWEEP_MISS;
+
+	float discriminant = b * b - a * k;
+	if (discriminant < 0.0f)
+		return SWEEP_MISS;
+
+	float t = (-b - std::sqrt(discriminant)) / a;
+	if (t < 0.0f)
+		t = 0.0f;
+	return t <= 1.0f ? t : SWEEP_MISS;
+}
+
+// Earliest t at which c + t d is within radius of the edge running along `axis` from lo to hi,
+// through the point `corner` (whose coordinate on `axis` is ignored): a capsule.
+static float ray_edge(const float* c, const float* d, float radius, int axis, const float* corner, float lo, float hi)
+{
+	int u = (axis + 1) % 3;
+	int v = (axis + 2) % 3;
+	float best = SWEEP_MISS;
+
+	// The side of the capsule: a cylinder, solved in the plane across the edge.
+	float mu = c[u] - corner[u];
+	float mv = c[v] - corner[v];
+	float a = d[u] * d[u] + d[v] * d[v];
+	float b = mu * d[u] + mv * d[v];
+	float k = mu * mu + mv * mv - radius * radius;
+	float discriminant = b * b - a * k;
+	if (a > 0.0f && discriminant >= 0.0f)
+	{
+		float t = (-b - std::sqrt(discriminant)) / a;
+		float along = c[axis] + t * d[axis];
+		if (t >= 0.0f && t <= 1.0f && along >= lo && along <= hi)
+			best = t;
+	}
+
+	// The two ends: spheres at the edge's corners.
+	float end[3] = { corner[0], corner[1], corner[2] };
+	end[axis] = lo;
+	float t = ray_sphere(c, d, end, radius);
+	if (t < best)
+		best = t;
+	end[axis] = hi;
+	t = ray_sphere(c, d, end, radius);
+	if (t < best)
+		best = t;
+
+	return best;
+}
+#pragma endregion
+
+float sphere_aabb_sweep_time(float cx, float cy, float cz, float radius, float dx, float dy, float dz,
+	float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+{
+	if (sphere_aabb_overlap(cx, cy, cz, radius, minX, minY, minZ, maxX, maxY, maxZ))
+		return 0.0f;
+
+	const float c[3] = { cx, cy, cz };
+	const float d[3] = { dx, dy, dz };
+	const float lo[3] = { minX, minY, minZ };
+	const float hi[3] = { maxX, maxY, maxZ };
+
+	// The ray against the box grown by radius.
+	float enter = 0.0f, leave = 1.0f;
+	for (int a = 0; a < 3; a++)
+		clip_slab(c[a], d[a], lo[a] - radius, hi[a] + radius, enter, leave);
+	if (enter > leave)
+		return SWEEP_MISS;
+
+	// Which sides of the real box is the entry point beyond?
+	float p[3];
+	int outside = 0;
+	float corner[3];
+	int inside = -1;
+	for (int a = 0; a < 3; a++)
+	{
+		p[a] = c[a] + enter * d[a];
+		if (p[a] < lo[a])
+		{
+			outside++;
+			corner[a] = lo[a];
+		}
+		else if (p[a] > hi[a])
+		{
+			outside++;
+			corner[a] = hi[a];
+		}
+		else
+		{
+			corner[a] = p[a];
+			inside = a;
+		}
+	}
+
+	// Beside a face: the grown box and the rounded box are the same there.
+	// A ray (radius 0) enters the box itself, so the slabs' answer is exact wherever it enters.
+	if (outside <= 1 || radius == 0.0f)
+		return enter;
+
+	// Beside an edge: only that edge's capsule can be hit.
+	if (outside == 2)
+		return ray_edge(c, d, radius, inside, corner, lo[inside], hi[inside]);
+
+	// Beside a corner: the first hit is on one of the three edges that meet there.
+	float best = SWEEP_MISS;
+	for (int a = 0; a < 3; a++)
+	{
+		float t = ray_edge(c, d, radius, a, corner, lo[a], hi[a]);
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+bool sphere_aabb_sweep(float cx, float cy, float cz, float radius, float dx, float dy, float dz, const AABB &box, SweepHit &hit)
+{
+	float t = sphere_aabb_sweep_time(cx, cy, cz, radius, dx, dy, dz,
+		box.min[0], box.min[1], box.min[2], box.max[0], box.max[1], box.max[2]);
+	if (t == SWEEP_MISS)
+		return false;
+
+	// The normal is the contact normal where the sphere is at the time of impact.
+	float qx = cx + t * dx, qy = cy + t * dy, qz = cz + t * dz;
+	float nx = qx - clamp_branchless(qx, box.min[0], box.max[0]);
+	float ny = qy - clamp_branchless(qy, box.min[1], box.max[1]);
+	float nz = qz - clamp_branchless(qz, box.min[2], box.max[2]);
+	float lengthSquared = nx * nx + ny * ny + nz * nz;
+
+	hit.time = t;
+	if (lengthSquared > 0.0f)
+	{
+		float inverse = 1.0f / std::sqrt(lengthSquared);
+		hit.normal[0] = nx * inverse;
+		hit.normal[1] = ny * inverse;
+		hit.normal[2] = nz * inverse;
+	}
+	else
+	{
+		// Center inside the box (it started there): the nearest face decides, as in contact generation.
+		Contact contact;
+		sphere_aabb_contact(qx, qy, qz, radius, box, contact);
+		for (int a = 0; a < 3; a++)
+			hit.normal[a] = contact.normal[a];
+	}
+	return true;
+}
+
+#pragma region Batches
+// Slab test against the box grown by radius for pairs [0, n). Sets keep[k] when the exact test is needed.
+// It is the first step of the exact test, so it never throws out a pair the exact test would accept.
+static void sweep_filter(const float* x, const float* y, const float* z, const float* radius,
+	const float* dx, const float* dy, const float* dz,
+	const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ,
+	size_t n, bool* keep)
+{
+	for (size_t k = 0; k < n; k++)
+	{
+		float r = radius[k];
+		float enter = 0.0f, leave = 1.0f;
+		clip_slab(x[k], dx[k], minX[k] - r, maxX[k] + r, enter, leave);
+		clip_slab(y[k], dy[k], minY[k] - r, maxY[k] + r, enter, leave);
+		clip_slab(z[k], dz[k], minZ[k] - r, maxZ[k] + r, enter, leave);
+		keep[k] = !(enter > leave);
+	}
+}
+
+void sweep_pairs(const SphereArrays &spheres, const MotionArrays &motion, const BoxArrays &boxes, size_t count, float* times)
+{
+	bool keep[CHUNK];
+
+	for (size_t begin = 0; begin < count; begin += CHUNK)
+	{
+		size_t n = count - begin < CHUNK ? count - begin : CHUNK;
+		sweep_filter(spheres.x + begin, spheres.y + begin, spheres.z + begin, spheres.radius + begin,
+			motion.dx + begin, motion.dy + begin, motion.dz + begin,
+			boxes.minX + begin, boxes.minY + begin, boxes.minZ + begin, boxes.maxX + begin, boxes.maxY + begin, boxes.maxZ + begin,
+			n, keep);
+
+		for (size_t k = 0; k < n; k++)
+		{
+			size_t i = begin + k;
+			times[i] = keep[k] ? sphere_aabb_sweep_time(spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i],
+				motion.dx[i], motion.dy[i], motion.dz[i],
+				boxes.minX[i], boxes.minY[i], boxes.minZ[i], boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]) : SWEEP_MISS;
+		}
+	}
+}
+
+size_t sweep_sphere_boxes(float cx, float cy, float cz, float radius, float dx, float dy, float dz,
+	const BoxArrays &boxes, size_t count, float &time)
+{
+	// The sphere is the same for every box: broadcast it once into chunk sized arrays.
+	float x[CHUNK], y[CHUNK], z[CHUNK], r[CHUNK], mx[CHUNK], my[CHUNK], mz[CHUNK];
+	for (size_t k = 0; k < CHUNK; k++)
+	{
+		x[k] = cx; y[k] = cy; z[k] = cz; r[k] = radius;
+		mx[k] = dx; my[k] = dy; mz[k] = dz;
+	}
+
+	bool keep[CHUNK];
+	size_t first = count;
+	time = SWEEP_MISS;
+
+	for (size_t begin = 0; begin < count; begin += CHUNK)
+	{
+		size_t n = count - begin < CHUNK ? count - begin : CHUNK;
+		sweep_filter(x, y, z, r, mx, my, mz,
+			boxes.minX + begin, boxes.minY + begin, boxes.minZ + begin, boxes.maxX + begin, boxes.maxY + begin, boxes.maxZ + begin,
+			n, keep);
+
+		for (size_t k = 0; k < n; k++)
+		{
+			if (!keep[k])
+				continue;
+
+			size_t i = begin + k;
+			float t = sphere_aabb_sweep_time(cx, cy, cz, radius, dx, dy, dz,
+				boxes.minX[i], boxes.minY[i], boxes.minZ[i], boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]);
+
+			// Strictly earlier, so of two boxes hit at the same time the lower index wins.
+			if (t < time)
+			{
+				time = t;
+				first = i;
+			}
+		}
+	}
+	return first;
+}
+#pragma endregion
@@ -0,0 +1,98 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereAABBSweep.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Continuous (swept) sphere-AABB test.
+In the demo the sphere jumps: key_callback moves it 0.25 units per key press and update() puts it wherever
+the cursor is. Testing only where it lands lets a fast sphere jump straight through a thin box.
+Instead we test the whole motion, from the center c to c + d, and find the earliest time t in [0, 1]
+at which the sphere touches the box: the time of impact.
+
+A sphere of radius r touches the box exactly when its center is inside the box "rounded" by r:
+the box grown by r on every side, with the edges and corners rounded off. So the sweep is a ray
+(from c along d) against that rounded box:
+ - first the ray is tested against the box grown by r (three slabs). A miss there is a miss.
+ - if the entry point is beside a face of the real box, that entry point is the answer.
+ - if it is beside an edge or a corner, the ray is tested against the round parts there instead:
+   a cylinder around each edge and a sphere at each corner.
+*/
+
+#ifndef _SPHERE_AABB_SWEEP_H
+#define _SPHERE_AABB_SWEEP_H
+
+#include "CollisionTypes.h"
+
+#include <limits>
+
+// Time reported for pairs that don't touch during the motion.
+static const float SWEEP_MISS = std::numeric_limits<float>::infinity();
+
+// Read-only view of per-sphere motion (structure-of-arrays): sphere i moves by (dx[i], dy[i], dz[i]).
+struct MotionArrays
+{
+	const float* dx;
+	const float* dy;
+	const float* dz;
+};
+
+struct SweepHit
+{
+	float time;			// Fraction of the motion at first touch, in [0, 1]. 0 if they already overlap at the start.
+	float normal[3];	// Unit vector from the box to the sphere at the time of impact.
+};
+
+// Narrows [enter, leave] to the times the ray c + t d is inside one slab, [lo, hi] on one axis.
+// Selects instead of branches, so loops over it vectorize. A ray parallel to the slab is inside it for all
+// time or for none. inverse is 1 / d, for callers that test one ray against many slabs.
+inline void clip_slab(float c, float d, float inverse, float lo, float hi, float &enter, float &leave)
+{
+	float t1 = (lo - c) * inverse;
+	float t2 = (hi - c) * inverse;
+	float near = t1 < t2 ? t1 : t2;
+	float far = t1 < t2 ? t2 : t1;
+
+	bool parallel = d == 0.0f;
+	bool within = c >= lo && c <= hi;
+	near = parallel ? (within ? 0.0f : 2.0f) : near;
+	far = parallel ? (within ? 1.0f : -1.0f) : far;
+
+	enter = near > enter ? near : enter;
+	leave = far < leave ? far : leave;
+}
+
+inline void clip_slab(float c, float d, float lo, float hi, float &enter, float &leave)
+{
+	clip_slab(c, d, 1.0f / d, lo, hi, enter, leave);
+}
+
+// Sweeps a sphere with center (cx, cy, cz) along (dx, dy, dz). Returns false if it never touches the box.
+bool sphere_aabb_sweep(float cx, float cy, float cz, float radius, float dx, float dy, float dz, const AABB &box, SweepHit &hit);
+
+// Same test, time only.
+float sphere_aabb_sweep_time(float cx, float cy, float cz, float radius, float dx, float dy, float dz,
+	float minX, float minY, float minZ, float maxX, float maxY, float maxZ);
+
+// Sweeps sphere i along motion i against box i for every i in [0, count) and writes the time of impact
+// (or SWEEP_MISS) to times[i]. A cheap slab test over a whole chunk throws out most misses before the exact test.
+void sweep_pairs(const SphereArrays &spheres, const MotionArrays &motion, const BoxArrays &boxes, size_t count, float* times);
+
+// Sweeps one sphere against boxes [0, count). Returns the index of the box it hits first (or count if none),
+// and writes the time of that hit to time (or SWEEP_MISS).
+size_t sweep_sphere_boxes(float cx, float cy, float cz, float radius, float dx, float dy, float dz,
+	const BoxArrays &boxes, size_t count, float &time);
+
+#endif // _SPHERE_AABB_SWEEP_H
@@ -0,0 +1,146 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereMesh.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Trig tables, shared vertices and index lists of the sphere meshes. See SphereMesh.h.
+*/
+
+#include "SphereMesh.h"
+
+#include <cmath>
+
+static const double MESH_PI = 3.14159265358979323846;
+
+// Divisions of each level: stacks (pole to pole), slices (around).
+static const int LOD_DIVISIONS[SPHERE_LOD_COUNT][2] = { { 6, 12 }, { 10, 20 }, { 20, 40 }, { 40, 80 } };
+
+// Longest triangle edge, in pixels, that sphere_lod_for_size accepts.
+static const float LOD_EDGE_PIXELS = 24.0f;
+
+void build_sphere_mesh(int stacks, int slices, SphereMesh &mesh)
+{
+	if (stacks < 2)
+		stacks = 2;
+	if (slices < 3)
+		slices = 3;
+	// Two poles plus a ring of slices vertices for each stack boundary in between.
+	while (2 + (stacks - 1) * slices > 65536)
+	{
+		stacks = stacks * 3 / 4;
+		slices = slices * 3 / 4;
+	}
+	mesh.stacks = stacks;
+	mesh.slices = slices;
+
+	// Every vertex uses one pitch and one yaw from these tables.
+	std::vector<float> sinPitch(stacks + 1), cosPitch(stacks + 1), sinYaw(slices), cosYaw(slices);
+	for (int i = 0; i <= stacks; i++)
+	{
+		double pitch = MESH_PI * i / stacks;
+		sinPitch[i] = (float)std::sin(pitch);
+		cosPitch[i] = (float)std::cos(pitch);
+	}
+	for (int j = 0; j < slices; j++)
+	{
+		double yaw = 2.0 * MESH_PI * j / slices;
+		sinYaw[j] = (float)std::sin(yaw);
+		cosYaw[j] = (float)std::cos(yaw);
+	}
+
+	size_t vertexCount = 2 + (size_t)(stacks - 1) * slices;
+	mesh.positions.clear();
+	mesh.positions.reserve(vertexCount * 3);
+
+	// The poles are one vertex each, not a ring of slices copies of the same point.
+	const float north[3] = { 0.0f, 0.0f, 1.0f };
+	mesh.positions.insert(mesh.positions.end(), north, north + 3);
+	for (int i = 1; i < stacks; i++)
+	{
+		for (int j = 0; j < slices; j++)
+		{
+			mesh.positions.push_back(sinPitch[i] * cosYaw[j]);
+			mesh.positions.push_back(sinPitch[i] * sinYaw[j]);
+			mesh.positions.push_back(cosPitch[i]);
+		}
+	}
+	const float south[3] = { 0.0f, 0.0f, -1.0f };
+	mesh.positions.insert(mesh.positions.end(), south, south + 3);
+
+	// Vertex j of ring i (1 to stacks - 1). Slices wrap around, so the seam shares its vertices too.
+	auto ring = [slices](int i, int j) { return (uint16_t)(1 + (i - 1) * slices + (j % slices)); };
+	uint16_t southPole = (uint16_t)(vertexCount - 1);
+
+	mesh.indices.clear();
+	mesh.indices.reserve((size_t)slices * (stacks - 1) * 6);
+	for (int j = 0; j < slices; j++)
+	{
+		const uint16_t cap[3] = { 0, ring(1, j), ring(1, j + 1) };
+		mesh.indices.insert(mesh.indices.end(), cap, cap + 3);
+	}
+	for (int i = 1; i < stacks - 1; i++)
+	{
+		for (int j = 0; j < slices; j++)
+		{
+			// The quad between ring i (nearer the north pole) and ring i + 1, as two triangles.
+			const uint16_t quad[6] = { ring(i, j), ring(i + 1, j), ring(i + 1, j + 1), ring(i, j), ring(i + 1, j + 1), ring(i, j + 1) };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	for (int j = 0; j < slices; j++)
+	{
+		const uint16_t cap[3] = { ring(stacks - 1, j), southPole, ring(stacks - 1, j + 1) };
+		mesh.indices.insert(mesh.indices.end(), cap, cap + 3);
+	}
+}
+
+void build_sphere_lods(SphereMesh (&levels)[SPHERE_LOD_COUNT])
+{
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+		build_sphere_mesh(LOD_DIVISIONS[lod][0], LOD_DIVISIONS[lod][1], levels[lod]);
+}
+
+// All levels, built together the first time one is needed.
+struct SphereMeshLods
+{
+	SphereMesh levels[SPHERE_LOD_COUNT];
+
+	SphereMeshLods() { build_sphere_lods(levels); }
+};
+
+const SphereMesh &sphere_mesh_lod(int lod)
+{
+	// A function-local static is built once, on the first call, even with several threads calling.
+	static const SphereMeshLods cache;
+
+	if (lod < 0)
+		lod = 0;
+	if (lod >= SPHERE_LOD_COUNT)
+		lod = SPHERE_LOD_COUNT - 1;
+	return cache.levels[lod];
+}
+
+int sphere_lod_for_size(float radiusPixels)
+{
+	// The equator of a level is cut into slices edges.
+	float circumference = 2.0f * (float)MESH_PI * radiusPixels;
+	for (int lod = 0; lod < SPHERE_LOD_COUNT - 1; lod++)
+	{
+		if (circumference / LOD_DIVISIONS[lod][1] <= LOD_EDGE_PIXELS)
+			return lod;
+	}
+	return SPHERE_LOD_COUNT - 1;
+}
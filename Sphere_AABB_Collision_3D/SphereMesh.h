@@ -0,0 +1,72 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SphereMesh.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Indexed triangle meshes of a sphere, at several levels of detail.
+
+setup() used to build the sphere as separate triangles: 6 VertexFormats per quad, where each corner is
+shared by 4 quads, so every point was computed (4 sin/cos calls in double) and stored 6 times.
+Pitch also went all the way round (360 degrees) instead of pole to pole (180), so the whole surface
+was built twice.
+
+Here each point on the sphere is stored once and the triangles refer to it by a 16 bit index.
+The angles only take stacks + 1 and slices values, so their sines and cosines are worked out once,
+into two small tables, and each vertex is just a few multiplies. The sphere has radius 1 around the
+origin: a sphere of any size is drawn by scaling it in its model matrix, so all spheres share one mesh.
+
+The levels are built the first time they are asked for and kept, so startup costs the same however
+many spheres there are. The vertex layout is the same as the old mesh's: z = cos(pitch) from the
++z pole, x and y going round with yaw.
+*/
+
+#ifndef _SPHERE_MESH_H
+#define _SPHERE_MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SphereMesh
+{
+	int stacks;		// Divisions from pole to pole.
+	int slices;		// Divisions around the z axis.
+	std::vector<float> positions;		// x, y, z per vertex, on the unit sphere.
+	std::vector<uint16_t> indices;		// Three per triangle, counter-clockwise seen from outside.
+
+	size_t vertex_count() const { return positions.size() / 3; }
+	size_t triangle_count() const { return indices.size() / 3; }
+	size_t bytes() const { return positions.size() * sizeof(float) + indices.size() * sizeof(uint16_t); }
+};
+
+// Levels of detail, from coarsest (0) to finest. Level 2 has the density of the old DIVISIONS 40 mesh.
+const int SPHERE_LOD_COUNT = 4;
+
+// Builds a sphere of radius 1 with the given divisions into mesh.
+// stacks is at least 2 and slices at least 3; both are reduced if the vertices wouldn't fit 16 bit indices.
+void build_sphere_mesh(int stacks, int slices, SphereMesh &mesh);
+
+// Builds every level of detail into levels, as sphere_mesh_lod() does on its first call.
+void build_sphere_lods(SphereMesh (&levels)[SPHERE_LOD_COUNT]);
+
+// Level of detail lod (clamped to [0, SPHERE_LOD_COUNT)), built on the first call.
+const SphereMesh &sphere_mesh_lod(int lod);
+
+// The coarsest level whose triangle edges are at most about 24 pixels long on screen,
+// for a sphere whose radius covers radiusPixels pixels.
+int sphere_lod_for_size(float radiusPixels);
+
+#endif // _SPHERE_MESH_H
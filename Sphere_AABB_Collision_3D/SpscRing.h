@@ -0,0 +1,95 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SpscRing.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A fixed size queue from exactly one producer thread to exactly one consumer thread, without locks.
+
+The demo's input (key_callback and the cursor) happens on the main thread, and the simulation that
+uses it runs on its own thread (SimulationThread.h). A mutex around a std::deque would work, but the
+main thread could then block behind a simulation tick, which is what moving the simulation off the
+main thread is meant to stop.
+
+Here the producer only ever writes tail and the consumer only ever writes head. Each reads the other's
+index to see how much room or data there is: the release store of an index and the acquire load on the
+other side make sure the slot's contents are seen before the index that says they are there.
+Neither side ever waits; push fails when the ring is full and pop when it is empty.
+
+The indices only grow (64 bits will not wrap) and a slot is index & (capacity - 1), so the capacity is
+a power of two. They are kept on separate cache lines so the two threads don't keep taking the same
+line from each other.
+*/
+
+#ifndef _SPSC_RING_H
+#define _SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template <class T>
+class SpscRing
+{
+public:
+	// capacity is rounded up to a power of two.
+	explicit SpscRing(size_t capacity = 1024) : head(0), tail(0)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size *= 2;
+		slots.resize(size);
+		mask = size - 1;
+	}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing &operator=(const SpscRing&) = delete;
+
+	// Producer thread only. False if the ring is full.
+	bool push(const T &value)
+	{
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask)
+			return false;
+
+		slots[t & mask] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer thread only. False if the ring is empty.
+	bool pop(T &value)
+	{
+		uint64_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+
+		value = slots[h & mask];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t capacity() const { return mask + 1; }
+
+private:
+	std::vector<T> slots;
+	size_t mask;
+
+	alignas(64) std::atomic<uint64_t> head;		// Next slot to pop. Written by the consumer.
+	alignas(64) std::atomic<uint64_t> tail;		// Next slot to push. Written by the producer.
+};
+
+#endif // _SPSC_RING_H
@@ -0,0 +1,341 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SweepAndPrune.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Endpoint lists, insertion sort and the pair set of the sweep and prune broadphase. See SweepAndPrune.h.
+
+When two endpoints have the same value the min endpoint is kept first, so boxes that only touch
+count as overlapping, like the <= in the exact test.
+*/
+
+#include "SweepAndPrune.h"
+#include "OpenAddressing.h"
+
+#include <algorithm>
+
+static const uint64_t EMPTY_KEY = ~0ull;
+
+// The pair set's slots are the keys themselves.
+static uint64_t key_of(uint64_t key)
+{
+	return key;
+}
+
+SweepAndPrune::SweepAndPrune()
+	: liveObjects(0), pairCount(0), swaps(0)
+{
+	pairTable.assign(1024, EMPTY_KEY);
+}
+
+#pragma region Pair set
+bool SweepAndPrune::pair_insert(uint64_t key)
+{
+	// Keep the table at most half full so probe sequences stay short.
+	if ((pairCount + 1) * 2 > pairTable.size())
+		pair_grow();
+
+	size_t slot = open_address_find(pairTable, key, EMPTY_KEY, key_of);
+	if (pairTable[slot] == key)
+		return false;
+
+	pairTable[slot] = key;
+	pairCount++;
+	return true;
+}
+
+bool SweepAndPrune::pair_erase(uint64_t key)
+{
+	size_t slot = open_address_find(pairTable, key, EMPTY_KEY, key_of);
+	if (pairTable[slot] != key)
+		return false;
+
+	open_address_erase(pairTable, slot, EMPTY_KEY, key_of);
+	pairCount--;
+	return true;
+}
+
+void SweepAndPrune::pair_grow()
+{
+	open_address_grow(pairTable, EMPTY_KEY, key_of);
+}
+
+void SweepAndPrune::begin_pair(Handle a, Handle b)
+{
+	if (objects[a].kind == objects[b].kind || !pair_insert(pair_key(a, b)))
+		return;
+
+	const Object &oa = objects[a];
+	const Object &ob = objects[b];
+	RawEvent e;
+	e.pair = oa.kind == SPHERE ? CollisionPair{ oa.userId, ob.userId } : CollisionPair{ ob.userId, oa.userId };
+	e.order = (uint32_t)rawEvents.size();
+	e.begin = true;
+	rawEvents.push_back(e);
+}
+
+void SweepAndPrune::end_pair(Handle a, Handle b)
+{
+	if (objects[a].kind == objects[b].kind || !pair_erase(pair_key(a, b)))
+		return;
+
+	const Object &oa = objects[a];
+	const Object &ob = objects[b];
+	RawEvent e;
+	e.pair = oa.kind == SPHERE ? CollisionPair{ oa.userId, ob.userId } : CollisionPair{ ob.userId, oa.userId };
+	e.order = (uint32_t)rawEvents.size();
+	e.begin = false;
+	rawEvents.push_back(e);
+}
+#pragma endregion
+
+#pragma region Insertion sort
+// Endpoint order: by value, and min before max when the values are equal.
+static inline bool goes_before(float value, bool isMax, float otherValue, bool otherIsMax)
+{
+	return value < otherValue || (value == otherValue && !isMax && otherIsMax);
+}
+
+// Positions are compared instead of values, so ties are resolved the same way as in the lists.
+bool SweepAndPrune::overlaps_on_other_axes(Handle a, Handle b, int axis) const
+{
+	const Object &oa = objects[a];
+	const Object &ob = objects[b];
+	for (int k = 1; k < 3; k++)
+	{
+		int other = (axis + k) % 3;
+		if (oa.minIndex[other] > ob.maxIndex[other] || ob.minIndex[other] > oa.maxIndex[other])
+			return false;
+	}
+	return true;
+}
+
+// Moves the endpoint at index to the left until the list is sorted again.
+void SweepAndPrune::sort_down(int axis, uint32_t index)
+{
+	std::vector<Endpoint> &list = axes[axis];
+	Endpoint moving = list[index];
+	Handle self = moving.handle();
+
+	while (index > 0)
+	{
+		Endpoint prev = list[index - 1];
+		if (!goes_before(moving.value, moving.is_max(), prev.value, prev.is_max()))
+			break;
+
+		Handle other = prev.handle();
+		if (!moving.is_max() && prev.is_max())
+		{
+			// Our min passes their max: the intervals start overlapping on this axis.
+			if (overlaps_on_other_axes(self, other, axis))
+				begin_pair(self, other);
+		}
+		else if (moving.is_max() && !prev.is_max())
+		{
+			// Our max passes their min: the intervals stop overlapping.
+			end_pair(self, other);
+		}
+
+		list[index] = prev;
+		if (prev.is_max())
+			objects[other].maxIndex[axis] = index;
+		else
+			objects[other].minIndex[axis] = index;
+		index--;
+		swaps++;
+	}
+
+	list[index] = moving;
+	if (moving.is_max())
+		objects[self].maxIndex[axis] = index;
+	else
+		objects[self].minIndex[axis] = index;
+}
+
+// Moves the endpoint at index to the right until the list is sorted again, or all the way to the end.
+void SweepAndPrune::sort_up(int axis, uint32_t index, bool toEnd)
+{
+	std::vector<Endpoint> &list = axes[axis];
+	Endpoint moving = list[index];
+	Handle self = moving.handle();
+	uint32_t last = (uint32_t)list.size() - 1;
+
+	while (index < last)
+	{
+		Endpoint next = list[index + 1];
+		if (!toEnd && !goes_before(next.value, next.is_max(), moving.value, moving.is_max()))
+			break;
+
+		Handle other = next.handle();
+		if (moving.is_max() && !next.is_max())
+		{
+			// Our max passes their min: the intervals start overlapping on this axis.
+			if (overlaps_on_other_axes(self, other, axis))
+				begin_pair(self, other);
+		}
+		else if (!moving.is_max() && next.is_max())
+		{
+			// Our min passes their max: the intervals stop overlapping.
+			end_pair(self, other);
+		}
+
+		list[index] = next;
+		if (next.is_max())
+			objects[other].maxIndex[axis] = index;
+		else
+			objects[other].minIndex[axis] = index;
+		index++;
+		swaps++;
+	}
+
+	list[index] = moving;
+	if (moving.is_max())
+		objects[self].maxIndex[axis] = index;
+	else
+		objects[self].minIndex[axis] = index;
+}
+
+void SweepAndPrune::set_bounds(Handle handle, const float* lo, const float* hi)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Object &obj = objects[handle];
+		axes[axis][obj.minIndex[axis]].value = lo[axis];
+		axes[axis][obj.maxIndex[axis]].value = hi[axis];
+
+		// Grow first, then shrink, so the min endpoint never has to pass the object's own max.
+		sort_down(axis, obj.minIndex[axis]);
+		sort_up(axis, obj.maxIndex[axis], false);
+		sort_up(axis, obj.minIndex[axis], false);
+		sort_down(axis, obj.maxIndex[axis]);
+	}
+}
+#pragma endregion
+
+#pragma region Objects
+SweepAndPrune::Handle SweepAndPrune::add(uint32_t userId, Kind kind, const float* lo, const float* hi)
+{
+	Handle handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else
+	{
+		handle = (Handle)objects.size();
+		objects.push_back(Object());
+	}
+
+	Object &obj = objects[handle];
+	obj.userId = userId;
+	obj.kind = kind;
+	obj.alive = true;
+	liveObjects++;
+
+	// Append the endpoints on every axis first. While one axis is sorted, the others still sit at the end
+	// of their lists and overlap nothing, so pairs only begin once the last axis is in place.
+	for (int axis = 0; axis < 3; axis++)
+	{
+		std::vector<Endpoint> &list = axes[axis];
+		obj.minIndex[axis] = (uint32_t)list.size();
+		Endpoint minPoint = { lo[axis], handle << 1 };
+		list.push_back(minPoint);
+		obj.maxIndex[axis] = (uint32_t)list.size();
+		Endpoint maxPoint = { hi[axis], (handle << 1) | 1 };
+		list.push_back(maxPoint);
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		sort_down(axis, objects[handle].minIndex[axis]);
+		sort_down(axis, objects[handle].maxIndex[axis]);
+	}
+	return handle;
+}
+
+SweepAndPrune::Handle SweepAndPrune::add_sphere(uint32_t userId, float cx, float cy, float cz, float radius)
+{
+	float lo[3] = { cx - radius, cy - radius, cz - radius };
+	float hi[3] = { cx + radius, cy + radius, cz + radius };
+	return add(userId, SPHERE, lo, hi);
+}
+
+SweepAndPrune::Handle SweepAndPrune::add_box(uint32_t userId, const AABB &box)
+{
+	return add(userId, BOX, box.min, box.max);
+}
+
+void SweepAndPrune::remove(Handle handle)
+{
+	if (handle >= objects.size() || !objects[handle].alive)
+		return;
+
+	// Push the endpoints past everything else, which ends every pair on the first axis, then drop them.
+	for (int axis = 0; axis < 3; axis++)
+	{
+		sort_up(axis, objects[handle].maxIndex[axis], true);
+		sort_up(axis, objects[handle].minIndex[axis], true);
+		axes[axis].pop_back();
+		axes[axis].pop_back();
+	}
+
+	objects[handle].alive = false;
+	freeHandles.push_back(handle);
+	liveObjects--;
+}
+
+void SweepAndPrune::move_sphere(Handle handle, float cx, float cy, float cz, float radius)
+{
+	float lo[3] = { cx - radius, cy - radius, cz - radius };
+	float hi[3] = { cx + radius, cy + radius, cz + radius };
+	set_bounds(handle, lo, hi);
+}
+
+void SweepAndPrune::move_box(Handle handle, const AABB &box)
+{
+	set_bounds(handle, box.min, box.max);
+}
+#pragma endregion
+
+void SweepAndPrune::take_events(std::vector<PairEvent> &out)
+{
+	// A pair can change more than once in a batch (an object added far away slides past others on its way in).
+	// Only the net change is reported: the state after the last change against the state before the first.
+	std::sort(rawEvents.begin(), rawEvents.end(), [](const RawEvent &a, const RawEvent &b) {
+		if (!(a.pair == b.pair))
+			return a.pair < b.pair;
+		return a.order < b.order;
+	});
+
+	for (size_t i = 0; i < rawEvents.size();)
+	{
+		size_t j = i + 1;
+		while (j < rawEvents.size() && rawEvents[j].pair == rawEvents[i].pair)
+			j++;
+
+		// Changes alternate, so the first and last agree exactly when the pair's state changed.
+		if (rawEvents[i].begin == rawEvents[j - 1].begin)
+		{
+			PairEvent e = { rawEvents[i].pair, rawEvents[i].begin };
+			out.push_back(e);
+		}
+		i = j;
+	}
+
+	rawEvents.clear();
+	swaps = 0;
+}
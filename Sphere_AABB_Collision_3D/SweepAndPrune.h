@@ -0,0 +1,152 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SweepAndPrune.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Incremental sweep and prune broadphase.
+Two boxes overlap only if their intervals overlap on the x, y and z axis. For each axis we keep the
+start (min) and end (max) points of every object in one sorted list. The lists are kept between frames.
+In the demo, update() moves the sphere only a little each frame (it follows the cursor), so the lists
+are almost sorted already, and insertion sort fixes them with a few swaps.
+
+Every swap is a change in overlap: a min passing a max means two intervals start or stop overlapping
+on that axis. When that happens and the other two axes overlap too, a pair begins or ends.
+So the work per frame is one step per moved object plus one step per change, and what comes out
+is only the pairs that started or stopped overlapping (begin/end events), not the full pair list.
+
+Only sphere/box pairs are tracked. A sphere is tracked by its bounding cube; run the exact test
+(SphereAABBBatch.h) on the active pairs to find the ones that really touch.
+*/
+
+#ifndef _SWEEP_AND_PRUNE_H
+#define _SWEEP_AND_PRUNE_H
+
+#include "CollisionTypes.h"
+
+// A pair of objects that started (begin = true) or stopped (begin = false) overlapping.
+// The pair holds the ids given to add_sphere/add_box.
+struct PairEvent
+{
+	CollisionPair pair;
+	bool begin;
+};
+
+class SweepAndPrune
+{
+public:
+	typedef uint32_t Handle;
+
+	static const uint32_t INVALID = 0xFFFFFFFFu;
+
+	SweepAndPrune();
+
+	// userId is what shows up in the events: typically the index into your sphere or box arrays.
+	Handle add_sphere(uint32_t userId, float cx, float cy, float cz, float radius);
+	Handle add_box(uint32_t userId, const AABB &box);
+
+	// Ends all of the object's pairs and frees the handle.
+	void remove(Handle handle);
+
+	// Moves an object and repairs the sorted lists with insertion sort.
+	void move_sphere(Handle handle, float cx, float cy, float cz, float radius);
+	void move_box(Handle handle, const AABB &box);
+
+	// Hands over the events since the last call (appended to out) and starts a new batch.
+	// A pair that began and ended again (or the other way round) within one batch produces no event.
+	void take_events(std::vector<PairEvent> &out);
+
+	// Number of sphere/box pairs whose bounds overlap right now.
+	size_t pair_count() const { return pairCount; }
+
+	// Calls visit(pair) for every sphere/box pair whose bounds overlap right now.
+	template <class Visit>
+	void for_each_pair(Visit &&visit) const;
+
+	// Endpoint swaps done since the last take_events. With coherent motion this stays close to the number of events.
+	size_t swap_count() const { return swaps; }
+
+	size_t size() const { return liveObjects; }
+
+private:
+	enum Kind : uint8_t { SPHERE, BOX };
+
+	struct Object
+	{
+		uint32_t userId;
+		uint32_t minIndex[3], maxIndex[3];	// Positions of this object's endpoints in each axis list.
+		Kind kind;
+		bool alive;
+	};
+
+	// One end of an object's interval on one axis.
+	struct Endpoint
+	{
+		float value;
+		uint32_t data;	// Handle << 1, low bit set for a max endpoint.
+
+		Handle handle() const { return data >> 1; }
+		bool is_max() const { return (data & 1) != 0; }
+	};
+
+	// A pair's two handles packed into one key, smaller handle first.
+	static uint64_t pair_key(Handle a, Handle b)
+	{
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+
+	Handle add(uint32_t userId, Kind kind, const float* lo, const float* hi);
+	void set_bounds(Handle handle, const float* lo, const float* hi);
+	void sort_down(int axis, uint32_t index);
+	void sort_up(int axis, uint32_t index, bool toEnd);
+	bool overlaps_on_other_axes(Handle a, Handle b, int axis) const;
+	void begin_pair(Handle a, Handle b);
+	void end_pair(Handle a, Handle b);
+
+	// Open addressing set of active pair keys.
+	bool pair_insert(uint64_t key);
+	bool pair_erase(uint64_t key);
+	void pair_grow();
+
+	std::vector<Object> objects;
+	std::vector<Handle> freeHandles;
+	std::vector<Endpoint> axes[3];
+	size_t liveObjects;
+
+	std::vector<uint64_t> pairTable;
+	size_t pairCount;
+
+	// Every change in this batch, in the order it happened; coalesced by take_events.
+	struct RawEvent { CollisionPair pair; uint32_t order; bool begin; };
+	std::vector<RawEvent> rawEvents;
+	size_t swaps;
+};
+
+template <class Visit>
+void SweepAndPrune::for_each_pair(Visit &&visit) const
+{
+	for (uint64_t key : pairTable)
+	{
+		if (key == ~0ull)
+			continue;
+
+		const Object &a = objects[(Handle)(key >> 32)];
+		const Object &b = objects[(Handle)(key & 0xFFFFFFFFu)];
+		CollisionPair pair = a.kind == SPHERE ? CollisionPair{ a.userId, b.userId } : CollisionPair{ b.userId, a.userId };
+		visit(pair);
+	}
+}
+
+#endif // _SWEEP_AND_PRUNE_H
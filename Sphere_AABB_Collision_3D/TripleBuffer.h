@@ -0,0 +1,85 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: TripleBuffer.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Hands the newest version of some state from one writer thread to one reader thread. Neither ever waits.
+
+The simulation thread (SimulationThread.h) produces a new state every tick and the render thread wants
+the latest one every frame, at a different rate. With one copy and a lock, whichever thread is slow
+holds up the other; with two, the writer has to wait for the reader to let go of the older copy.
+
+With three copies there is always one for each side plus one in the middle. The writer fills its own
+copy ("back") and then swaps it with the middle one, marking the middle as new. The reader, if the middle
+is new, swaps it with its own ("front"). Each swap is one atomic exchange of a small index, so both
+sides finish in a fixed number of steps whatever the other is doing (wait-free). States the reader
+never picked up are simply overwritten: it always sees the newest.
+
+The three copies are made once, so if T holds vectors, they keep their memory from publish to publish.
+*/
+
+#ifndef _TRIPLE_BUFFER_H
+#define _TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+template <class T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : middle(1), back(0), front(2) {}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer &operator=(const TripleBuffer&) = delete;
+
+	// Writer only: the copy to fill. It belongs to the writer until publish().
+	T &write_buffer() { return slots[back]; }
+
+	// Writer only: makes the filled copy the newest, and takes the middle one to fill next.
+	// The release half of the exchange makes the writes to the copy visible before the index that hands it over.
+	void publish()
+	{
+		uint8_t old = middle.exchange((uint8_t)(back | NEW), std::memory_order_acq_rel);
+		back = old & INDEX;
+	}
+
+	// Reader only: the newest published copy, or the one it already had if nothing new was published.
+	// It stays the reader's until the next call to read().
+	const T &read()
+	{
+		if (middle.load(std::memory_order_relaxed) & NEW)
+		{
+			uint8_t old = middle.exchange(front, std::memory_order_acq_rel);
+			front = old & INDEX;
+		}
+		return slots[front];
+	}
+
+	// Copy i of the three, for setting them all up before the threads start.
+	T &slot(int i) { return slots[i]; }
+
+private:
+	static const uint8_t INDEX = 3;		// The copy's index, in the low bits.
+	static const uint8_t NEW = 4;		// Set when the middle copy hasn't been read yet.
+
+	T slots[3];
+	std::atomic<uint8_t> middle;
+	uint8_t back;		// Only touched by the writer.
+	uint8_t front;		// Only touched by the reader.
+};
+
+#endif // _TRIPLE_BUFFER_H
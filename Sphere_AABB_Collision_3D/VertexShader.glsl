@@ -41,14 +41,18 @@ AABB-2D by Brockton Roth
 layout(location = 0) in vec3 in_position;	// Get in a vec3 for position
 layout(location = 1) in vec4 in_color;		// Get in a vec4 for color
 
-out vec4 color; // Our vec4 color variable containing r, g, b, a
+// Per-instance attributes (see DrawInstances.h). They advance once per instance instead of once per vertex,
+// so one draw call can draw every sphere (or every box), each with its own position, size and collision flag.
+layout(location = 2) in vec3 instance_position;	// Center of the object in world space.
+layout(location = 3) in vec3 instance_scale;	// Size of the object: the mesh is a unit sphere or a unit cube.
+layout(location = 4) in float instance_blue;	// 1 if the object collides, like the old "blue" uniform.
 
-uniform mat4 MVP; // Our uniform MVP matrix to modify our position values
+uniform mat4 PV;	// Projection * view, the same for every object. The model matrix is just the scale and the position.
 
-uniform	float blue;
+out vec4 color; // Our vec4 color variable containing r, g, b, a
 
 void main(void)
 {
-	color = in_color + vec4(0.0f,0.0f,blue,0.0f);	// Pass the color through
-	gl_Position = MVP * vec4(in_position, 1.0); //w is 1.0, also notice cast to a vec4
+	color = in_color + vec4(0.0f,0.0f,instance_blue,0.0f);	// Pass the color through
+	gl_Position = PV * vec4(in_position * instance_scale + instance_position, 1.0); //w is 1.0, also notice cast to a vec4
 }
@@ -0,0 +1,164 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: WorkStealingPool.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Threads, ranges and stealing of the work stealing pool. See WorkStealingPool.h.
+*/
+
+#include "WorkStealingPool.h"
+
+WorkStealingPool::WorkStealingPool(int threads)
+	: function(nullptr), context(nullptr), remaining(0), steals(0), generation(0), active(0), stopping(false)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	threadCount = threads > 0 ? threads : 1;
+
+	ranges.reset(new Range[threadCount]);
+	for (int w = 0; w < threadCount; w++)
+	{
+		ranges[w].begin = 0;
+		ranges[w].end = 0;
+	}
+
+	for (int w = 1; w < threadCount; w++)
+		this->threads.emplace_back(&WorkStealingPool::thread_main, this, w);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(wakeLock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread &t : threads)
+		t.join();
+}
+
+void WorkStealingPool::run(size_t count, TaskFunction task, void* taskContext)
+{
+	if (count == 0)
+		return;
+
+	// The task is published before any index is, and reading an index takes the range's lock,
+	// so a thread that gets an index also sees the task it belongs to.
+	function = task;
+	context = taskContext;
+	remaining.store(count);
+
+	for (int w = 0; w < threadCount; w++)
+	{
+		std::lock_guard<std::mutex> guard(ranges[w].lock);
+		ranges[w].begin = count * w / threadCount;
+		ranges[w].end = count * (w + 1) / threadCount;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(wakeLock);
+		generation++;
+	}
+	wake.notify_all();
+
+	work(0);
+
+	// Wait for the last index to finish, and for every thread to have left work() so the next loop can reuse the ranges.
+	std::unique_lock<std::mutex> lock(wakeLock);
+	done.wait(lock, [this]() { return remaining.load() == 0 && active == 0; });
+}
+
+void WorkStealingPool::thread_main(int worker)
+{
+	uint64_t seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(wakeLock);
+			wake.wait(lock, [&]() { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+			active++;
+		}
+
+		work(worker);
+
+		{
+			std::lock_guard<std::mutex> guard(wakeLock);
+			active--;
+		}
+		done.notify_all();
+	}
+}
+
+void WorkStealingPool::work(int worker)
+{
+	size_t index;
+	while (take(worker, index))
+	{
+		function(context, index, worker);
+
+		if (remaining.fetch_sub(1) == 1)
+		{
+			// Take the lock so the notify can't slip in between run()'s check and its wait.
+			std::lock_guard<std::mutex> guard(wakeLock);
+			done.notify_all();
+		}
+	}
+}
+
+bool WorkStealingPool::take(int worker, size_t &index)
+{
+	Range &own = ranges[worker];
+	{
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (own.begin < own.end)
+		{
+			index = own.begin++;
+			return true;
+		}
+	}
+
+	// Out of work: steal the back half of someone else's range, starting with the next thread.
+	for (int k = 1; k < threadCount; k++)
+	{
+		Range &victim = ranges[(worker + k) % threadCount];
+		size_t begin, end;
+		{
+			std::lock_guard<std::mutex> guard(victim.lock);
+			size_t left = victim.end - victim.begin;
+			if (left == 0)
+				continue;
+
+			begin = victim.end - (left + 1) / 2;
+			end = victim.end;
+			victim.end = begin;
+		}
+
+		// Our own range is empty, and thieves only take from non-empty ranges, so nobody else is touching it.
+		{
+			std::lock_guard<std::mutex> guard(own.lock);
+			own.begin = begin + 1;
+			own.end = end;
+		}
+		steals++;
+		index = begin;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,100 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: WorkStealingPool.h
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+A small thread pool for loops whose iterations take different amounts of time (chunks of collision pairs:
+some chunks are all misses, some all hits).
+
+parallel_for(count, task) runs task(index, worker) for every index in [0, count).
+The indices are first split into one equal range per thread. Each thread works through its own range from
+the front. A thread that runs out steals the back half of the next thread's range that still has work, so
+threads that got cheap work help the ones that got expensive work, and nobody waits at the end.
+Each range has its own lock, which is only contended while stealing.
+
+The calling thread works too (as worker 0), so a pool of N threads starts N - 1 extra threads.
+Threads sleep between loops. Tasks must not call parallel_for on the same pool.
+*/
+
+#ifndef _WORK_STEALING_POOL_H
+#define _WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+	// threads = 0 means one per hardware thread.
+	explicit WorkStealingPool(int threads = 0);
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool &) = delete;
+	WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+	// Number of threads working on a loop, including the caller. Worker ids are [0, thread_count()).
+	int thread_count() const { return threadCount; }
+
+	// Runs task(index, worker) for index in [0, count) and returns when all of them are done.
+	template <class Task>
+	void parallel_for(size_t count, Task &&task)
+	{
+		run(count, [](void* context, size_t index, int worker) { (*(typename std::remove_reference<Task>::type*)context)(index, worker); }, &task);
+	}
+
+	// Ranges stolen since the pool was created. Useful to see how uneven the work was.
+	size_t steal_count() const { return steals.load(); }
+
+private:
+	typedef void (*TaskFunction)(void* context, size_t index, int worker);
+
+	// One thread's range of indices. Padded to a cache line so two threads' ranges don't share one.
+	struct Range
+	{
+		std::mutex lock;
+		size_t begin, end;
+		char padding[64];
+	};
+
+	void run(size_t count, TaskFunction function, void* context);
+	void work(int worker);
+	bool take(int worker, size_t &index);
+	void thread_main(int worker);
+
+	int threadCount;
+	std::unique_ptr<Range[]> ranges;
+	std::vector<std::thread> threads;
+
+	TaskFunction function;
+	void* context;
+	std::atomic<size_t> remaining;
+	std::atomic<size_t> steals;
+
+	std::mutex wakeLock;
+	std::condition_variable wake, done;
+	uint64_t generation;
+	int active;
+	bool stopping;
+};
+
+#endif // _WORK_STEALING_POOL_H
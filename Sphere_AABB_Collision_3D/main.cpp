@@ -36,9 +36,26 @@ AABB-2D by Brockton Roth
 
 
 #include "GLIncludes.h"
-
-// We change this variable upon detecting collision
-float blue = 0.0f;
+#include "SphereMesh.h"
+#include "DrawInstances.h"
+#include "InstanceRing.h"
+#include "FrameProfiler.h"
+#include "FrustumCulling.h"
+#include "ProgramCache.h"
+#include "SceneGenerator.h"
+#include "SimulationThread.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
 //This struct consists of the basic stuff needed for getting the shape on the screen.
 struct stuff_for_drawing{
@@ -49,10 +66,16 @@ struct stuff_for_drawing{
 	//This will be used to tell the GPU, how many vertices will be needed to draw during drawcall.
 	int numberOfVertices;
 
+	//Indexed meshes also have a buffer of indices into the vertices, and are drawn with glDrawElements. ibo is 0 for the others.
+	GLuint ibo;
+	int numberOfIndices;
+
 	//This function gets the number of vertices and all the vertex values and stores them in the buffer.
 	void initBuffer(int numVertices, VertexFormat* vertices)
 	{
 		numberOfVertices = numVertices;
+		ibo = 0;
+		numberOfIndices = 0;
 
 		// This generates buffer object names
 		// The first parameter is the number of buffer objects, and the second parameter is a pointer to an array of buffer objects (yes, before this call, vbo was an empty variable)
@@ -94,19 +117,29 @@ struct stuff_for_drawing{
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)0);
 	}
+
+	//The same, plus the indices. Each vertex is stored once, and every triangle that uses it refers to it by index.
+	void initIndexedBuffer(int numVertices, VertexFormat* vertices, int numIndices, const uint16_t* indices)
+	{
+		initBuffer(numVertices, vertices);
+		numberOfIndices = numIndices;
+
+		//// GL_ELEMENT_ARRAY_BUFFER is the binding point for index buffers. glDrawElements reads its indices from the buffer bound there.
+		glGenBuffers(1, &ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * numIndices, indices, GL_STATIC_DRAW);
+	}
 };
 
-// The basic structure for a Circle. We need a center, a radius, and VBO and total number of vertices.
+// The basic structure for a Circle. We need a center, a radius, and the buffers of each level of detail (see SphereMesh.h).
 struct Sphere{
-	glm::mat4 MVP;
 	glm::vec3 origin;
 	float radius;
-	stuff_for_drawing base;
+	stuff_for_drawing lods[SPHERE_LOD_COUNT];
 }sphere;
 
 // the basic structure for a rectangle. We need a center, a length, a breadth and total number of vertices (36, 6 triangles, 2 for eachside).
 struct Cuboid{
-	glm::mat4 MVP;
 	glm::vec3 origin;
 	float length;
 	float breadth;
@@ -114,6 +147,18 @@ struct Cuboid{
 	stuff_for_drawing base;
 }cuboid;
 
+// Extra spheres and boxes that stand still around the demo's pair, to see how drawing scales.
+// Run the demo as "Sphere_AABB_Collision_3D SPHERES BOXES" to get them.
+size_t crowdSpheres = 0;
+size_t crowdBoxes = 0;
+Scene crowd;
+
+// The collision logic runs on its own thread, SIMULATION_TICK_RATE times a second (see SimulationThread.h).
+// The main loop sends it the cursor and the keys, and draws the newest state it has published.
+const double SIMULATION_TICK_RATE = 120.0;
+SimulationThread simulationThread;
+TraceRecorder traceRecorder;	// Open with --record FILE: every simulation tick goes into a trace (SimulationTrace.h).
+
 // This function return the value between min and mx with the least distance value to x. This is called clamping.
 float clamp_on_range(float x, float min, float max)
 {
@@ -145,6 +190,8 @@ glm::vec3 clamp_on_rectangle(glm::vec3 p, Cuboid &r)
 }
 
 //Convert the circle's position from world coordinate system to the box's model cordinate system.
+// The simulation thread runs the batched version of this test (SphereAABBBatch.h). This one still runs in update(), on every
+// new tick drawn, as a check on it for the movable sphere and the cuboid.
 bool is_colliding(Sphere &s, Cuboid &c)
 {
 	//Gets the closest point on the box to the circle's center.
@@ -165,8 +212,6 @@ bool is_colliding(Sphere &s, Cuboid &c)
 void setup()
 {
 	//Create a sphere. 
-	// yaw is the rotation along y axis.
-	// pitch is the rotation along x axis.
 	sphere.origin = glm::vec3(0.0f, 0.0f, 0.0f);
 	
 	std::vector<VertexFormat> vertexSet, vertices2;
@@ -175,67 +220,23 @@ void setup()
 	
 	sphere.radius = radius;
 
-	float pitch, yaw;
-	yaw = 0.0f;
-	pitch = 0.0f;
-	int i, j;
-	float pitchDelta = 360 / DIVISIONS;
-	float yawDelta = 360 / DIVISIONS;
-
-	VertexFormat p1, p2, p3, p4;
-
-	for (i = 0; i < DIVISIONS; i++)
+	// The sphere meshes have radius 1 and are shared by all spheres: the radius is a scale in the sphere's MVP (see update()).
+	// Each level is built once (sphere_mesh_lod keeps them) and uploaded once, as shared vertices and 16 bit indices.
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
 	{
-		for (j = 0; j < DIVISIONS; j++)
-		{
+		const SphereMesh &mesh = sphere_mesh_lod(lod);
 
-			p1.position.x = radius * sin((pitch)* PI / 180.0) * cos((yaw)* PI / 180.0);
-			p1.position.y = radius * sin((pitch)* PI / 180.0) * sin((yaw)* PI / 180.0);;
-			p1.position.z = radius * cos((pitch)* PI / 180.0);
-			p1.color.r = 0.7f;
-			p1.color.g = 0.2f;
-			p1.color.b = 0;
-			p1.color.a = 1;
-
-			p2.position.x = radius * sin((pitch)* PI / 180.0) * cos((yaw + yawDelta)* PI / 180.0);
-			p2.position.y = radius * sin((pitch)* PI / 180.0) * sin((yaw + yawDelta)* PI / 180.0);;
-			p2.position.z = radius * cos((pitch)* PI / 180.0);
-			p2.color.r = 0.7f;
-			p2.color.g = 0.2f;
-			p2.color.b = 0;
-			p2.color.a = 1;
-
-			p3.position.x = radius * sin((pitch + pitchDelta)* PI / 180.0) * cos((yaw + yawDelta)* PI / 180.0);
-			p3.position.y = radius * sin((pitch + pitchDelta)* PI / 180.0) * sin((yaw + yawDelta)* PI / 180.0);;
-			p3.position.z = radius * cos((pitch + pitchDelta)* PI / 180.0);
-			p3.color.r = 0.7f;
-			p3.color.g = 0.2f;
-			p3.color.b = 0;
-			p3.color.a = 1;
-
-			p4.position.x = radius * sin((pitch + pitchDelta)* PI / 180.0) * cos((yaw)* PI / 180.0);
-			p4.position.y = radius * sin((pitch + pitchDelta)* PI / 180.0) * sin((yaw)* PI / 180.0);;
-			p4.position.z = radius * cos((pitch + pitchDelta)* PI / 180.0);
-			p4.color.r = 0.7f;
-			p4.color.g = 0.2f;
-			p4.color.b = 0;
-			p4.color.a = 1;
-
-			vertexSet.push_back(p1);
-			vertexSet.push_back(p2);
-			vertexSet.push_back(p3);
-			vertexSet.push_back(p1);
-			vertexSet.push_back(p3);
-			vertexSet.push_back(p4);
-
-			yaw = yaw + yawDelta;
+		vertexSet.clear();
+		vertexSet.reserve(mesh.vertex_count());
+		for (size_t v = 0; v < mesh.vertex_count(); v++)
+		{
+			const float* p = &mesh.positions[v * 3];
+			vertexSet.push_back(VertexFormat(glm::vec3(p[0], p[1], p[2]), glm::vec4(0.7f, 0.2f, 0.0f, 1.0f)));
 		}
 
-		pitch += pitchDelta;
+		sphere.lods[lod].initIndexedBuffer(vertexSet.size(), &vertexSet[0], mesh.indices.size(), &mesh.indices[0]);
 	}
 
-	sphere.base.initBuffer(vertexSet.size(), &vertexSet[0]);
-
 	cuboid.breadth = 1.0f;
 	cuboid.length = 0.5f;
 	cuboid.depth = 0.5f;
@@ -243,54 +244,57 @@ void setup()
 	//Rectangle Vertex generation
 	cuboid.origin = glm::vec3(0.0f, 0.0f, 0.0f);
 
+	// The mesh is a unit cube around the origin. Each box's size and position go into its instance transform
+	// (see DrawInstances.h), so every box, whatever its size, is drawn from this one mesh.
+
 	VertexFormat A = VertexFormat(
-		glm::vec3(cuboid.origin.x - (cuboid.breadth / 2.0f),
-		cuboid.origin.y - (cuboid.length / 2.0f),
-		cuboid.origin.z + cuboid.depth / 2.0f),
+		glm::vec3(-0.5f,
+		-0.5f,
+		0.5f),
 		glm::vec4(0.7f, 0.20f, 0.0f, 1.0f));
 
 
 	VertexFormat B = VertexFormat(
-		glm::vec3(cuboid.origin.x + (cuboid.breadth / 2.0f),
-		cuboid.origin.y - (cuboid.length / 2.0f),
-		cuboid.origin.z + cuboid.depth / 2.0f),
+		glm::vec3(0.5f,
+		-0.5f,
+		0.5f),
 		glm::vec4(0.7f, 0.20f, 0.0f, 1.0f));
 
 	VertexFormat C = VertexFormat(
-		glm::vec3(cuboid.origin.x + (cuboid.breadth / 2.0f),
-		cuboid.origin.y + (cuboid.length / 2.0f),
-		cuboid.origin.z + cuboid.depth / 2.0f),
+		glm::vec3(0.5f,
+		0.5f,
+		0.5f),
 		glm::vec4(0.7f, 0.20f, 0.0f, 1.0f));
 
 	VertexFormat D = VertexFormat(
-		glm::vec3(cuboid.origin.x - (cuboid.breadth / 2.0f),
-		cuboid.origin.y + (cuboid.length / 2.0f),
-		cuboid.origin.z + cuboid.depth / 2.0f),
+		glm::vec3(-0.5f,
+		0.5f,
+		0.5f),
 		glm::vec4(0.7f, 0.20f, 0.0f, 1.0f));
 
 	VertexFormat A2 = VertexFormat(
-		glm::vec3(cuboid.origin.x - (cuboid.breadth / 2.0f),
-		cuboid.origin.y - (cuboid.length / 2.0f),
-		cuboid.origin.z - cuboid.depth / 2.0f),
+		glm::vec3(-0.5f,
+		-0.5f,
+		-0.5f),
 		glm::vec4(0.7f, 0.20f, 0.0f, 1.0f));
 
 
 	VertexFormat B2 = VertexFormat(
-		glm::vec3(cuboid.origin.x + (cuboid.breadth / 2.0f),
-		cuboid.origin.y - (cuboid.length / 2.0f),
-		cuboid.origin.z - cuboid.depth / 2.0f),
+		glm::vec3(0.5f,
+		-0.5f,
+		-0.5f),
 		glm::vec4(0.7f, 0.20f, 0.0f, 1.0f));
 
 	VertexFormat C2 = VertexFormat(
-		glm::vec3(cuboid.origin.x + (cuboid.breadth / 2.0f),
-		cuboid.origin.y + (cuboid.length / 2.0f),
-		cuboid.origin.z - cuboid.depth / 2.0f),
+		glm::vec3(0.5f,
+		0.5f,
+		-0.5f),
 		glm::vec4(0.7f, 0.20f, 0.0f, 1.0f));
 
 	VertexFormat D2 = VertexFormat(
-		glm::vec3(cuboid.origin.x - (cuboid.breadth / 2.0f),
-		cuboid.origin.y + (cuboid.length / 2.0f),
-		cuboid.origin.z - cuboid.depth / 2.0f),
+		glm::vec3(-0.5f,
+		0.5f,
+		-0.5f),
 		glm::vec4(0.7f, 0.20f, 0.0f, 1.0f));
 
 	/*
@@ -360,6 +364,17 @@ void setup()
 
 	//Push all the data to the buffer on the GPU
 	cuboid.base.initBuffer(36 , &vertices2[0]);
+
+	// The crowd: small spheres and boxes spread over the cube from -1 to 1, with a fixed seed so every run looks the same.
+	SceneParams params;
+	params.sphereCount = crowdSpheres;
+	params.boxCount = crowdBoxes;
+	params.worldSize = 2.0f;
+	params.minRadius = 0.01f;
+	params.maxRadius = 0.04f;
+	params.minExtent = 0.02f;
+	params.maxExtent = 0.1f;
+	generate_scene(params, crowd);
 }
 
 
@@ -374,9 +389,27 @@ GLuint program;
 GLuint vertex_shader;
 GLuint fragment_shader;
 
-// This is a reference to your uniform MVP matrix in your vertex shader
-GLuint uniMVP;
-GLuint color;
+// Everything that gets drawn: the movable sphere followed by the crowd's spheres, and the cuboid followed by the crowd's boxes.
+// This is also the scene the simulation thread runs. Their positions, sizes and collision flags are written each frame into
+// the instance ring (see DrawInstances.h and InstanceRing.h): the spheres sorted by level of detail, then the boxes.
+SphereSet drawnSpheres;
+BoxSet drawnBoxes;
+SphereLods sphereLods;
+InstanceRing instanceRing;
+
+// Only what the camera can see is drawn (see FrustumCulling.h): the visible spheres and boxes are found each frame, on all
+// cores, and only they go into the instance ring. The boxes never move, so a BoxBVH over them is built once and the boxes
+// are culled a subtree at a time. Press h to cull them one by one instead, to compare; the frame profile has the time.
+WorkStealingPool cullPool;
+FrustumCuller culler(cullPool);
+Frustum frustum;
+BoxBVH drawnBoxTree;
+bool hierarchicalCulling = true;
+std::vector<uint32_t> visibleSpheres;
+std::vector<uint32_t> visibleBoxes;
+
+// The location of the PV uniform in the vertex shader, which turns every instance's world position into clip space.
+GLuint uniPV;
 
 glm::mat4 view;
 glm::mat4 proj;
@@ -384,6 +417,59 @@ glm::mat4 PV;
 
 // Reference to the window object being created by GLFW.
 GLFWwindow* window;
+
+// Times of each part of the frame (see FrameProfiler.h). Press p to save them; they are also saved when the program ends.
+FrameProfiler profiler;
+const char* PROFILE_JSON = "frame_profile.json";
+const char* PROFILE_CSV = "frame_profile.csv";
+
+// With --wait (or after pressing i) the loop only draws a frame when it would look different from the last one: the
+// simulation published a tick that moved a sphere or changed a hit, a sphere is still on its way between two ticks,
+// or the window needs painting again. Otherwise it sleeps in glfwWaitEventsTimeout until there is input, or until the
+// next tick is due, instead of drawing the same picture again as fast as it can. Without it every frame is drawn, as before.
+bool waitForEvents = false;
+bool redrawNeeded = true;				// Something the snapshot doesn't know about changed: the window, the h key.
+
+// What the last frame drew. Only the spheres that moved since get their centers worked out again.
+uint64_t drawnTick = 0;
+uint64_t drawnChangeTick = 0;
+float drawnAlpha = 0.0f;
+std::vector<uint32_t> drawnMoved;		// The spheres that frame's snapshot moved, maybe drawn part way there.
+
+// How often is_colliding() was checked against the simulation's flag for the movable sphere, and disagreed with it.
+uint64_t referenceChecks = 0;
+uint64_t referenceMismatches = 0;
+
+uint64_t framesDrawn = 0;
+uint64_t framesSkipped = 0;
+double drawnSeconds = 0.0;				// Main thread time spent on drawn frames.
+double waitedSeconds = 0.0;				// Time spent asleep waiting for events.
+double drawnCpuSeconds = 0.0;			// Main thread CPU time spent on drawn frames,
+double waitedCpuSeconds = 0.0;			// and on skipped ones: checking for changes, and waking up.
+
+// CPU time the calling thread has used. Unlike the steady clock, it doesn't run while the thread sleeps.
+double threadCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+		return 0.0;
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (double)(k.QuadPart + u.QuadPart) * 1e-7;		// 100 ns units.
+#else
+	timespec t;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) != 0)
+		return 0.0;
+	return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+// The linked shader program from the last run (see ProgramCache.h), next to the executable's working directory like the profile.
+const char* PROGRAM_CACHE = "program_cache.bin";
 #pragma endregion			  
 
 // Functions called only once every time the program is executed.
@@ -479,18 +565,51 @@ void init()
 	std::string vertShader = readShader("../VertexShader.glsl");
 	std::string fragShader = readShader("../FragmentShader.glsl");
 
-	// createShader consolidates all of the shader compilation code
-	vertex_shader = createShader(vertShader, GL_VERTEX_SHADER);
-	fragment_shader = createShader(fragShader, GL_FRAGMENT_SHADER);
+	// The program linked on an earlier run, if the shaders and the driver are still the same. Loading it skips
+	// the compiler entirely; if there is none, or it doesn't fit, the shaders are compiled below as always.
+	std::chrono::steady_clock::time_point shaderStart = std::chrono::steady_clock::now();
+	bool binaries = (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) && program_binaries_supported();
+	uint64_t programKey = 0;
+	std::string cacheMiss = "program binaries not supported";
+	program = 0;
+	if (binaries)
+	{
+		programKey = program_cache_key(vertShader, fragShader);
+		program = load_cached_program(PROGRAM_CACHE, programKey, cacheMiss);
+	}
+	bool fromCache = program != 0;
 
-	// A shader is a program that runs on your GPU instead of your CPU. In this sense, OpenGL refers to your groups of shaders as "programs".
-	// Using glCreateProgram creates a shader program and returns a GLuint reference to it.
-	program = glCreateProgram();
-	glAttachShader(program, vertex_shader);		// This attaches our vertex shader to our program.
-	glAttachShader(program, fragment_shader);	// This attaches our fragment shader to our program.
+	if (!fromCache)
+	{
+		// createShader consolidates all of the shader compilation code
+		vertex_shader = createShader(vertShader, GL_VERTEX_SHADER);
+		fragment_shader = createShader(fragShader, GL_FRAGMENT_SHADER);
+
+		// A shader is a program that runs on your GPU instead of your CPU. In this sense, OpenGL refers to your groups of shaders as "programs".
+		// Using glCreateProgram creates a shader program and returns a GLuint reference to it.
+		program = glCreateProgram();
+		glAttachShader(program, vertex_shader);		// This attaches our vertex shader to our program.
+		glAttachShader(program, fragment_shader);	// This attaches our fragment shader to our program.
+
+		// Ask the driver to keep the binary, so it can be saved for next time.
+		if (binaries)
+			keep_program_binary(program);
+
+		// This links the program, using the vertex and fragment shaders to create executables to run on the GPU.
+		glLinkProgram(program);
+
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		std::string saveError;
+		if (binaries && linked == GL_TRUE && !save_cached_program(PROGRAM_CACHE, programKey, program, saveError))
+			std::cout << saveError << std::endl;
+	}
 
-	// This links the program, using the vertex and fragment shaders to create executables to run on the GPU.
-	glLinkProgram(program);
+	double shaderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count();
+	if (fromCache)
+		std::cout << "Shader program loaded from " << PROGRAM_CACHE << " in " << shaderMs << " ms" << std::endl;
+	else
+		std::cout << "Shaders compiled in " << shaderMs << " ms (" << cacheMiss << ")" << std::endl;
 	// End of shader and program creation
 
 	// Creates the view matrix using glm::lookAt.
@@ -502,12 +621,20 @@ void init()
 	proj = glm::perspective(45.0f, 800.0f / 800.0f, 0.1f, 100.0f);
 
 	PV = proj * view;
+	extract_frustum_planes(glm::value_ptr(PV), frustum);
 
-	// This gets us a reference to the uniform variable in the vertex shader, which is called "color".
-	// We're using this variable to change color during runtime, without changing the buffer values.
-	// Only 2 parameters required: A reference to the shader program and the name of the uniform variable within the shader code.
-	uniMVP = glGetUniformLocation(program, "MVP");
-	color = glGetUniformLocation(program, "blue");
+	// Each object's MVP and collision flag used to be uniforms, set before every draw. Now they are per-instance vertex attributes,
+	// read from a buffer of DrawInstances, and only PV is a uniform. glVertexAttribDivisor(location, 1) makes an attribute advance
+	// once per instance instead of once per vertex.
+	uniPV = glGetUniformLocation(program, "PV");
+
+	// The instances are written straight into a persistently mapped buffer when the driver has glBufferStorage.
+	instanceRing.init(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+	for (int location = INSTANCE_POSITION_LOCATION; location <= INSTANCE_BLUE_LOCATION; location++)
+	{
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
 
 	// This is not necessary, but I prefer to handle my vertices in the clockwise order. glFrontFace defines which face of the triangles you're drawing is the front.
 	// Essentially, if you draw your vertices in counter-clockwise order, by default (in OpenGL) the front face will be facing you/the screen. If you draw them clockwise, the front face 
@@ -527,40 +654,137 @@ void init()
 	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 }
 
+// Gathers everything that gets drawn once the scene is set up. Only the movable sphere changes after this, on the simulation thread.
+void setupInstances()
+{
+	drawnBoxes.clear();
+	drawnBoxes.add(make_aabb(cuboid.origin.x, cuboid.origin.y, cuboid.origin.z, cuboid.breadth, cuboid.length, cuboid.depth));
+	for (size_t i = 0; i < crowd.boxes.size(); i++)
+		drawnBoxes.add(crowd.boxes.get(i));
+	drawnBoxTree.build(drawnBoxes.arrays(), drawnBoxes.size());
+
+	drawnSpheres.clear();
+	drawnSpheres.add(sphere.origin.x, sphere.origin.y, sphere.origin.z, sphere.radius);
+	const SphereSet &s = crowd.spheres;
+	for (size_t i = 0; i < s.size(); i++)
+		drawnSpheres.add(s.x[i], s.y[i], s.z[i], s.radius[i]);
+}
+
+// Points the instance attributes at a buffer of DrawInstances, starting at instance first.
+void bindInstances(GLuint buffer, size_t first)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	size_t start = first * sizeof(DrawInstance);
+	glVertexAttribPointer(INSTANCE_POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(start + offsetof(DrawInstance, position)));
+	glVertexAttribPointer(INSTANCE_SCALE_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(start + offsetof(DrawInstance, scale)));
+	glVertexAttribPointer(INSTANCE_BLUE_LOCATION, 1, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(start + offsetof(DrawInstance, blue)));
+}
+
 #pragma endregion
 
 // Functions called between every frame. game logic
 #pragma region util_functions
-// This runs once every physics timestep.
-void update()
+// Sends the cursor to the simulation when it moves. This runs every time round the loop, whether a frame is drawn or not.
+void sendInput()
 {
-	if (is_colliding(sphere, cuboid))
-	{
-		blue = 1.0f;
-	}
-	else
-		blue = 0.0f;
-
 	// Get the cursor position with respect ot hte window.
 	double x, y;
 	glfwGetCursorPos(window, &x, &y);
 
-	//Since the cursor posiiton is represented in pixel values, 
-	//dividing it by the window specs will reduce the position to 0-1 range.
-	//multiplying it with 2 and then subtracting it with 1 wil bring the 
-	//mouse position to -1 ot 1.
-	
-	sphere.origin.x = ((x / 800.0f)*2.0f) - 1.0f;
-	sphere.origin.y = -(((y / 800.0f)*2.0f) - 1.0f);
+	// The simulation thread moves the sphere to follow the cursor, mapping it from pixels to -1 to 1 (see Simulation.cpp).
+	// It only needs to hear about the cursor when it moves.
+	static double lastX = -1.0, lastY = -1.0;
+	if (x != lastX || y != lastY)
+	{
+		InputCommand command = { 0, InputKind::Cursor, 0, { (float)x, (float)y, 0.0f } };
+		if (simulationThread.push_input(command))
+		{
+			lastX = x;
+			lastY = y;
+		}
+	}
+}
 
-	//create the translation matrix. Later when the object is scaled and rotated, thet would also be in this matrix
-	glm::mat4 translation;
+// Whether a frame of state, alpha of the way between its last two ticks, would look any different from the last one drawn.
+bool frameChanged(const SimulationSnapshot &state, float alpha)
+{
+	if (redrawNeeded || state.changeTick != drawnChangeTick)
+		return true;
+	// A later tick that changed nothing still has to put the spheres the last frame drew part way at their ends.
+	if (state.tick != drawnTick)
+		return !drawnMoved.empty();
+	return !state.moved.empty() && alpha != drawnAlpha;
+}
+
+// Waits until there is input, or seconds have passed.
+void waitEvents(double seconds)
+{
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 2)
+	glfwWaitEventsTimeout(seconds);
+#else
+	// glfwWaitEventsTimeout came with GLFW 3.2, and glfwWaitEvents could sleep through a whole tick of the simulation's, since
+	// publishing a snapshot isn't an event. Handle what has come in, then sleep: input waits up to one tick, as it would anyway.
+	glfwPollEvents();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+#endif
+}
+
+// Draws the newest state the simulation has published, alpha of the way between its last two ticks so the motion is smooth
+// however the frames and the ticks line up.
+void update(const SimulationSnapshot &state, float alpha)
+{
+	// Only the spheres whose drawn centers can be out of date: the ones this snapshot moved and, if it is the tick after the
+	// last one drawn, the ones that one moved. If ticks were missed in between, any sphere may have moved: all of them.
+	if (state.tick == drawnTick)
+		interpolate_spheres(state, alpha, state.moved.data(), state.moved.size(), drawnSpheres);
+	else if (state.tick == drawnTick + 1)
+	{
+		interpolate_spheres(state, alpha, drawnMoved.data(), drawnMoved.size(), drawnSpheres);
+		interpolate_spheres(state, alpha, state.moved.data(), state.moved.size(), drawnSpheres);
+	}
+	else
+		interpolate_spheres(state, alpha, drawnSpheres);
 
-	translation = glm::translate(sphere.origin);
-	sphere.MVP = PV * translation;					// multiply the translation matrix with the projection and view matrix. This makes the objects look 3D, (perspective view)
+	// The demo's own test, on each new tick at the sphere's center after it (not the interpolated one), must agree with the
+	// simulation. With a crowd the sphere may be touching another box, so then only a hit has to show up in the flag.
+	if (state.tick != drawnTick)
+	{
+		sphere.origin = glm::vec3(state.x[0], state.y[0], state.z[0]);
+		bool reference = is_colliding(sphere, cuboid);
+		if (reference != (state.hits[0] != 0) && (reference || crowd.boxes.size() == 0))
+			referenceMismatches++;
+		referenceChecks++;
+	}
+
+	drawnTick = state.tick;
+	drawnChangeTick = state.changeTick;
+	drawnAlpha = alpha;
+	drawnMoved = state.moved;
+	redrawNeeded = false;
 
-	translation = glm::translate(cuboid.origin);
-	cuboid.MVP = PV * translation;					// Since the screen's origin is on the top, we need to negate the y values.	
+	// Leave out everything outside the view.
+	size_t culled = 0;
+	{
+		ScopedPhase timer(&profiler, FramePhase::Cull);
+		culler.cull_spheres(frustum, drawnSpheres.arrays(), drawnSpheres.size(), visibleSpheres);
+		culled += culler.stats().culled;
+		if (hierarchicalCulling)
+			culler.cull_boxes(frustum, drawnBoxTree.view(), visibleBoxes);
+		else
+			culler.cull_boxes(frustum, drawnBoxes.arrays(), drawnBoxes.size(), visibleBoxes);
+		culled += culler.stats().culled;
+	}
+	profiler.count(FrameCounter::Visible, visibleSpheres.size() + visibleBoxes.size());
+	profiler.count(FrameCounter::Culled, culled);
+
+	// Every visible sphere's and box's position, size and flag, written straight into this frame's part of the instance ring.
+	// No matrices here: the shader multiplies by PV. PV is only used to pick each sphere's level of detail, where
+	// proj[1][1] times half the window's height turns radius / distance into the sphere's radius on screen in pixels.
+	DrawInstance* instances = instanceRing.begin_frame(visibleSpheres.size() + visibleBoxes.size());
+	build_sphere_instances(glm::value_ptr(PV), proj[1][1] * 400.0f, drawnSpheres.arrays(), visibleSpheres.data(), visibleSpheres.size(),
+		state.hits.data(), sphereLods, instances);
+	// Boxes keep their color, as the cuboid always has.
+	build_box_instances(drawnBoxes.arrays(), visibleBoxes.data(), visibleBoxes.size(), nullptr, instances + visibleSpheres.size());
 }
 
 // This function runs every frame
@@ -575,28 +799,41 @@ void renderScene()
 	// Tell OpenGL to use the shader program you've created.
 	glUseProgram(program);
 
-	//Draw the Sphere
-	
-	glUniformMatrix4fv(uniMVP, 1, GL_FALSE, glm::value_ptr(sphere.MVP));
-	glUniform1f(color, blue);
-	glBindBuffer(GL_ARRAY_BUFFER, sphere.base.vbo);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)16);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)0);
-	glDrawArrays(GL_TRIANGLES, 0, sphere.base.numberOfVertices);
+	// The one matrix every object shares.
+	glUniformMatrix4fv(uniPV, 1, GL_FALSE, glm::value_ptr(PV));
 
-	/*
-	we are using a vec3 to store 2 variables. The first 2 are used to store the x and y transformation.
-	the last float is used to store the blue  color component. We are doing this so, there are less calls to be made to the GPU
-	*/
+	// update() has written this frame's instances; base is where they start in the ring.
+	size_t base = instanceRing.end_writes();
+	GLuint instanceBuffer = instanceRing.instance_buffer();
+
+	//Draw the Spheres
+	// Each level of detail is one instanced draw of its mesh, with the instance attributes pointing at that level's spheres.
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+	{
+		size_t first = sphereLods.first[lod];
+		size_t count = sphereLods.first[lod + 1] - first;
+		if (count == 0)
+			continue;
+
+		stuff_for_drawing &sphereMesh = sphere.lods[lod];
+		glBindBuffer(GL_ARRAY_BUFFER, sphereMesh.vbo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)16);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)0);
+		bindInstances(instanceBuffer, base + first);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereMesh.ibo);
+		glDrawElementsInstanced(GL_TRIANGLES, sphereMesh.numberOfIndices, GL_UNSIGNED_SHORT, (void*)0, (GLsizei)count);
+	}
 
 	// Draw the cube/Box
-	// Set the uniform matrix in our shader to our MVP matrix for the Box.
-	glUniformMatrix4fv(uniMVP, 1, GL_FALSE, glm::value_ptr(cuboid.MVP));
-	glUniform1f(color, 0.0f);
+	// The cuboid and every visible crowd box in one draw of the unit cube.
 	glBindBuffer(GL_ARRAY_BUFFER, cuboid.base.vbo);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)16);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)0);
-	glDrawArrays(GL_TRIANGLES, 0, cuboid.base.numberOfVertices);
+	bindInstances(instanceBuffer, base + visibleSpheres.size());
+	glDrawArraysInstanced(GL_TRIANGLES, 0, cuboid.base.numberOfVertices, (GLsizei)visibleBoxes.size());
+
+	// Fence this frame's part of the ring, so it isn't overwritten before the GPU has drawn it.
+	instanceRing.end_frame();
 
 }
 
@@ -605,21 +842,86 @@ void renderScene()
 // It is a callback funciton. i.e. glfw takes the pointer to this function (via function pointer) and calls this function every time a key is pressed in the during event polling.
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-	float moverate = 0.25f;
-
 	////This set of controls are used to move one point (point1) of the line.
+	// The sphere moves by SIMULATION_KEY_MOVE on the simulation thread, at its next tick.
 	if (key == GLFW_KEY_W && action == GLFW_PRESS)
-		sphere.origin.z -= moverate;
+	{
+		InputCommand command = { 0, InputKind::KeyW, 0, { 0.0f, 0.0f, 0.0f } };
+		simulationThread.push_input(command);
+	}
 	if (key == GLFW_KEY_S && action == GLFW_PRESS)
-		sphere.origin.z += moverate;
+	{
+		InputCommand command = { 0, InputKind::KeyS, 0, { 0.0f, 0.0f, 0.0f } };
+		simulationThread.push_input(command);
+	}
+
+	// Cull the boxes through their tree, or one by one.
+	if (key == GLFW_KEY_H && action == GLFW_PRESS)
+	{
+		hierarchicalCulling = !hierarchicalCulling;
+		redrawNeeded = true;
+		std::cout << "\nBoxes culled " << (hierarchicalCulling ? "through the BVH" : "one by one") << std::endl;
+	}
+
+	// Draw only the frames that changed, sleeping in between, or every frame.
+	if (key == GLFW_KEY_I && action == GLFW_PRESS)
+	{
+		waitForEvents = !waitForEvents;
+		redrawNeeded = true;
+		std::cout << "\nFrames drawn " << (waitForEvents ? "only when something changes" : "as fast as possible") << std::endl;
+	}
+
+	// Save the frame times so far.
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+	{
+		std::string error;
+		if (profiler.save(PROFILE_JSON, error) && profiler.save(PROFILE_CSV, error))
+			std::cout << "\nFrame profile saved to " << PROFILE_JSON << " and " << PROFILE_CSV << std::endl;
+		else
+			std::cout << "\n" << error << std::endl;
+	}
 	
 }
 
+// The window was uncovered or resized, and its contents are gone: draw them again even if nothing moved.
+void refresh_callback(GLFWwindow* window)
+{
+	redrawNeeded = true;
+}
+
 #pragma endregion
 
 
-void main()
+int main(int argc, char** argv)
 {
+	// Launch to first frame is on the critical path, so it is measured and printed before the loop starts.
+	std::chrono::steady_clock::time_point launch = std::chrono::steady_clock::now();
+
+	// Optional crowd size, hardware counters in the frame profile, and a trace of the session:
+	// Sphere_AABB_Collision_3D [SPHERES BOXES] [--perf] [--record FILE] [--wait]
+	std::vector<const char*> counts;
+	std::string recordPath;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--record" && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (std::string(argv[i]) == "--wait")
+			waitForEvents = true;
+		else if (std::string(argv[i]) == "--perf")
+		{
+			std::string error;
+			if (!profiler.enable_hardware_counters(error))
+				std::cout << "No hardware counters (" << error << "): times only" << std::endl;
+		}
+		else
+			counts.push_back(argv[i]);
+	}
+	if (counts.size() >= 2)
+	{
+		crowdSpheres = (size_t)atol(counts[0]);
+		crowdBoxes = (size_t)atol(counts[1]);
+	}
+
 	glfwInit();
 
 	// Creates a window given (width, height, title, monitorPtr, windowPtr).
@@ -643,33 +945,121 @@ void main()
 
 	// Sends the funtion as a funtion pointer along with the window to which it should be applied to.
 	glfwSetKeyCallback(window, key_callback);
+	glfwSetWindowRefreshCallback(window, refresh_callback);
 
 	setup();
+	setupInstances();
+
+	Scene simulated;
+	simulated.spheres = drawnSpheres;
+	simulated.boxes = drawnBoxes;
+	if (!recordPath.empty())
+	{
+		std::string error;
+		if (!traceRecorder.open(recordPath, simulated, error))
+			std::cout << error << std::endl;
+	}
+	simulationThread.start(simulated, SIMULATION_TICK_RATE, traceRecorder.is_open() ? &traceRecorder : nullptr);
+
+	std::cout << "\nStartup took " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launch).count() << " ms" << std::endl;
 
 	// Enter the main loop.
 	while (!glfwWindowShouldClose(window))
 	{
+		double cpuStart = threadCpuSeconds();
+		sendInput();
+		const SimulationSnapshot &state = simulationThread.latest();
+		float alpha = simulationThread.interpolation(state);
+
+		// Nothing to show that isn't on the screen already: sleep until there is input or the next tick is due.
+		if (waitForEvents && !frameChanged(state, alpha))
+		{
+			std::chrono::steady_clock::time_point asleep = std::chrono::steady_clock::now();
+			waitEvents(simulationThread.tick_seconds());
+			waitedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - asleep).count();
+			waitedCpuSeconds += threadCpuSeconds() - cpuStart;
+			framesSkipped++;
+			continue;
+		}
+		std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+
 		// Call to update() which will update the gameobjects.
-		update();
+		{
+			ScopedPhase timer(&profiler, FramePhase::Update);
+			update(state, alpha);
+		}
 
 		// Call the render function.
-		renderScene();
+		{
+			ScopedPhase timer(&profiler, FramePhase::Render);
+			renderScene();
+		}
 
 		// Swaps the back buffer to the front buffer
 		// Remember, you're rendering to the back buffer, then once rendering is complete, you're moving the back buffer to the front so it can be displayed.
-		glfwSwapBuffers(window);
+		{
+			ScopedPhase timer(&profiler, FramePhase::Swap);
+			glfwSwapBuffers(window);
+		}
 
 		// Checks to see if any events are pending and then processes them.
-		glfwPollEvents();
+		{
+			ScopedPhase timer(&profiler, FramePhase::Poll);
+			glfwPollEvents();
+		}
+		profiler.end_frame();
+		drawnSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+		drawnCpuSeconds += threadCpuSeconds() - cpuStart;
+		framesDrawn++;
+	}
+
+	simulationThread.stop();
+
+	// Where the frames' time went, on the main thread and on the simulation thread.
+	std::cout << std::endl;
+	std::fflush(stdout);
+	profiler.write_table(stdout);
+	std::printf("\nSimulation thread: %llu ticks at %.0f per second, %llu skipped, %llu inputs dropped\n",
+		(unsigned long long)simulationThread.ticks(), SIMULATION_TICK_RATE, (unsigned long long)simulationThread.skipped_ticks(),
+		(unsigned long long)simulationThread.dropped_inputs());
+	simulationThread.profiler().write_table(stdout);
+	std::printf("\nis_colliding() checked the simulation on %llu ticks: %llu disagreements\n",
+		(unsigned long long)referenceChecks, (unsigned long long)referenceMismatches);
+	// What waiting for events saved. The CPU times are measured; what the skipped frames would have cost is not, so the
+	// saving is an estimate: as much CPU per skipped frame as a drawn one took, less what the waiting itself cost.
+	if (framesSkipped > 0)
+	{
+		double perFrame = framesDrawn > 0 ? drawnSeconds / framesDrawn : 0.0;
+		double cpuPerFrame = framesDrawn > 0 ? drawnCpuSeconds / framesDrawn : 0.0;
+		std::printf("\nFrames: %llu drawn, %llu skipped as unchanged, %.1f s asleep waiting for events\n",
+			(unsigned long long)framesDrawn, (unsigned long long)framesSkipped, waitedSeconds);
+		std::printf("Main thread CPU time: %.0f ms drawing (%.3f ms per frame, %.3f ms wall), %.0f ms checking and waiting\n",
+			drawnCpuSeconds * 1e3, cpuPerFrame * 1e3, perFrame * 1e3, waitedCpuSeconds * 1e3);
+		std::printf("Skipping saved an estimated %.0f ms of main thread CPU time\n", (framesSkipped * cpuPerFrame - waitedCpuSeconds) * 1e3);
+	}
+	if (traceRecorder.is_open())
+	{
+		uint64_t recorded = traceRecorder.frames();
+		std::string error;
+		if (traceRecorder.close(error))
+			std::printf("Recorded %llu ticks to %s, %llu bytes: replay with HeadlessSimulation --replay %s\n",
+				(unsigned long long)recorded, recordPath.c_str(), (unsigned long long)traceRecorder.bytes(), recordPath.c_str());
+		else
+			std::cout << error << std::endl;
 	}
+	std::string profileError;
+	if (!profiler.save(PROFILE_JSON, profileError) || !profiler.save(PROFILE_CSV, profileError))
+		std::cout << profileError << std::endl;
 
 	// After the program is over, cleanup your data!
 	glDeleteShader(vertex_shader);
 	glDeleteShader(fragment_shader);
 	glDeleteProgram(program);
+	instanceRing.destroy();
 	// Note: If at any point you stop using a "program" or shaders, you should free the data up then and there.
 
 
 	// Frees up GLFW memory
 	glfwTerminate();
+	return 0;
 }
\ No newline at end of file
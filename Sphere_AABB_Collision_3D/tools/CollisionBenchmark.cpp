@@ -0,0 +1,1491 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: CollisionBenchmark.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Headless benchmark for the collision code. No window, no OpenGL, just numbers.
+It generates seeded random scenes (uniform, clustered and degenerate zero-extent boxes, at several
+sizes and overlap ratios) and times every narrowphase and broadphase variant on them. The motion scenarios move every
+sphere a little each frame, the case the incremental broadphases are built for.
+For each run it prints pairs per second, nanoseconds per pair and the hit rate. Variants that
+should agree are checked against each other, so a kernel that gets faster by getting wrong is caught.
+
+Usage: CollisionBenchmark [--seed N] [--min-time SECONDS] [--scale FACTOR] [--filter TEXT] [--csv]
+*/
+
+#include "../CollisionTypes.h"
+#include "../SphereAABBBatch.h"
+#include "../SphereAABBContacts.h"
+#include "../SphereAABBKernel.h"
+#include "../SphereAABBSweep.h"
+#include "../SceneGenerator.h"
+#include "../SpatialHash.h"
+#include "../BoxBVH.h"
+#include "../QuantizedBoxBVH.h"
+#include "../BoxCast.h"
+#include "../FrustumCulling.h"
+#include "../SweepAndPrune.h"
+#include "../DynamicAABBTree.h"
+#include "../ParallelNarrowphase.h"
+#include "../FrameArena.h"
+#include "../SphereMesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma region Options
+struct Options
+{
+	uint64_t seed = 1;
+	double minTime = 0.1;	// Each variant runs for at least this many seconds.
+	double scale = 1.0;		// Multiplies every object count, e.g. 0.1 for a quick run.
+	std::string filter;		// Only runs whose "scenario variant" name contains this text.
+	bool csv = false;
+} options;
+
+static bool parse_options(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--seed" && hasValue)
+			options.seed = strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--min-time" && hasValue)
+			options.minTime = atof(argv[++i]);
+		else if (arg == "--scale" && hasValue)
+			options.scale = atof(argv[++i]);
+		else if (arg == "--filter" && hasValue)
+			options.filter = argv[++i];
+		else if (arg == "--csv")
+			options.csv = true;
+		else
+		{
+			std::printf("Usage: %s [--seed N] [--min-time SECONDS] [--scale FACTOR] [--filter TEXT] [--csv]\n", argv[0]);
+			return false;
+		}
+	}
+	return true;
+}
+
+static size_t scaled(size_t count)
+{
+	size_t n = (size_t)(count * options.scale);
+	return n < 1 ? 1 : n;
+}
+#pragma endregion
+
+#pragma region Heap call counting
+// Every operator new in the program goes through here, so a benchmark can check how many heap calls a frame makes.
+static std::atomic<size_t> heapCalls(0);
+
+void* operator new(size_t size)
+{
+	heapCalls++;
+	void* p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	std::free(p);
+}
+#pragma endregion
+
+#pragma region Timing and reporting
+typedef std::chrono::steady_clock Clock;
+
+// Anything a variant computes is folded in here, so the compiler can't throw the work away.
+static volatile size_t sink;
+
+// Runs the variant once to warm up, then repeatedly until minTime has passed.
+// Returns the average seconds per run. The variant returns its hit count.
+template <class Variant>
+static double time_variant(Variant &&variant, size_t &hits)
+{
+	hits = variant();
+
+	int iterations = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed = 0.0;
+	do
+	{
+		sink = sink + variant();
+		iterations++;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < options.minTime);
+
+	return elapsed / iterations;
+}
+
+static bool selected(const std::string &scenario, const char* variant)
+{
+	return options.filter.empty() || (scenario + " " + variant).find(options.filter) != std::string::npos;
+}
+
+static void print_header()
+{
+	if (options.csv)
+		std::printf("scenario,variant,pairs,hits,hit_rate,pairs_per_second,ns_per_pair\n");
+	else
+		std::printf("%-48s %-18s %12s %8s %12s %9s\n", "scenario", "variant", "pairs", "hit %", "Mpairs/s", "ns/pair");
+}
+
+static void report(const std::string &scenario, const char* variant, size_t pairs, size_t hits, double seconds)
+{
+	double hitRate = pairs ? (double)hits / (double)pairs : 0.0;
+	double pairsPerSecond = seconds > 0.0 ? pairs / seconds : 0.0;
+	double nsPerPair = pairs ? seconds * 1e9 / pairs : 0.0;
+
+	if (options.csv)
+		std::printf("%s,%s,%zu,%zu,%.6f,%.1f,%.4f\n", scenario.c_str(), variant, pairs, hits, hitRate, pairsPerSecond, nsPerPair);
+	else
+		std::printf("%-48s %-18s %12zu %8.2f %12.1f %9.3f\n", scenario.c_str(), variant, pairs, hitRate * 100.0, pairsPerSecond / 1e6, nsPerPair);
+	std::fflush(stdout);
+}
+
+// Variants of the same scenario must agree on how many pairs collide.
+static int mismatches = 0;
+
+static void check(const std::string &scenario, const char* variant, size_t hits, size_t expected)
+{
+	if (hits != expected)
+	{
+		std::fprintf(stderr, "MISMATCH: %s %s found %zu hits, expected %zu\n", scenario.c_str(), variant, hits, expected);
+		mismatches++;
+	}
+}
+#pragma endregion
+
+#pragma region Narrowphase
+// is_colliding() from main.cpp, as it was written: if-based clamp and a square root per pair.
+// Kept here as the baseline every other variant is compared against.
+static float clamp_on_range(float x, float min, float max)
+{
+	if (x < min)
+		return min;
+	if (x > max)
+		return max;
+
+	return x;
+}
+
+static bool legacy_is_colliding(float cx, float cy, float cz, float radius, const AABB &b)
+{
+	float dx = cx - clamp_on_range(cx, b.min[0], b.max[0]);
+	float dy = cy - clamp_on_range(cy, b.min[1], b.max[1]);
+	float dz = cz - clamp_on_range(cz, b.min[2], b.max[2]);
+
+	float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+	return distance <= radius;
+}
+
+// The kernel templates are constexpr, so the compiler can check them here, in 2D and 3D and every number type.
+static_assert(sphere_box_overlap(SphereN<2, float>{ { 1.5f, 0.0f }, 0.5f }, BoxN<2, float>{ { -1.0f, -1.0f }, { 1.0f, 1.0f } }), "circle touching a side");
+static_assert(!sphere_box_overlap(SphereN<2, double>{ { 1.5, 1.5 }, 0.5 }, BoxN<2, double>{ { -1.0, -1.0 }, { 1.0, 1.0 } }), "circle off a corner");
+static_assert(sphere_box_overlap(SphereN<3, Fixed32>{ { Fixed32::from_float(1.25), Fixed32::from_int(0), Fixed32::from_int(0) }, Fixed32::from_float(0.25) },
+	BoxN<3, Fixed32>{ { Fixed32::from_int(-1), Fixed32::from_int(-1), Fixed32::from_int(-1) }, { Fixed32::from_int(1), Fixed32::from_int(1), Fixed32::from_int(1) } }), "fixed point, exactly touching");
+static_assert(distance_squared_to_box<3, float>({ 3.0f, 0.0f, 4.0f }, BoxN<3, float>{ { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } }) == 25.0f, "3-4-5");
+
+// The scene's pairs converted to another number type for the kernel templates, before timing.
+template <class T>
+struct KernelPairs
+{
+	std::vector<SphereN<3, T>> spheres;
+	std::vector<BoxN<3, T>> boxes;
+
+	template <class Convert>
+	void fill(const Scene &scene, size_t count, Convert convert)
+	{
+		spheres.resize(count);
+		boxes.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			spheres[i] = SphereN<3, T>{ { convert(scene.spheres.x[i]), convert(scene.spheres.y[i]), convert(scene.spheres.z[i]) }, convert(scene.spheres.radius[i]) };
+			boxes[i] = BoxN<3, T>{
+				{ convert(scene.boxes.minX[i]), convert(scene.boxes.minY[i]), convert(scene.boxes.minZ[i]) },
+				{ convert(scene.boxes.maxX[i]), convert(scene.boxes.maxY[i]), convert(scene.boxes.maxZ[i]) } };
+		}
+	}
+
+	size_t count_overlaps() const
+	{
+		size_t n = 0;
+		for (size_t i = 0; i < spheres.size(); i++)
+			n += sphere_box_overlap(spheres[i], boxes[i]);
+		return n;
+	}
+};
+
+static void bench_narrowphase()
+{
+	const size_t counts[] = { 1024, 65536, 1048576 };
+	const float overlaps[] = { 0.1f, 0.5f, 0.9f };
+	const SceneDistribution distributions[] = { SceneDistribution::Uniform, SceneDistribution::Clustered, SceneDistribution::Degenerate };
+
+	Scene scene;
+	std::vector<uint64_t> hits;
+	std::vector<Contact> contacts;
+	KernelPairs<float> floatPairs;
+	KernelPairs<double> doublePairs;
+	KernelPairs<Fixed32> fixedPairs;
+
+	for (SceneDistribution distribution : distributions)
+	{
+		for (size_t baseCount : counts)
+		{
+			for (float overlap : overlaps)
+			{
+				size_t count = scaled(baseCount);
+				char name[128];
+				std::snprintf(name, sizeof(name), "narrow/%s/n=%zu/overlap=%.1f", scene_distribution_name(distribution), count, overlap);
+				std::string scenario = name;
+
+				generate_pairs(options.seed, count, overlap, distribution, scene);
+				SphereArrays s = scene.spheres.arrays();
+				BoxArrays b = scene.boxes.arrays();
+				hits.assign(hit_mask_words(count), 0);
+
+				// The scalar batch path is the reference: every SIMD path must give exactly the same bits,
+				// and the original is_colliding() must agree on the number of hits.
+				collide_pairs_with(SimdLevel::Scalar, s, b, count, hits.data());
+				std::vector<uint64_t> reference = hits;
+				size_t expected = hit_mask_count(reference.data(), count);
+				size_t found = 0;
+				double seconds;
+
+				if (selected(scenario, "legacy"))
+				{
+					seconds = time_variant([&]() {
+						size_t n = 0;
+						for (size_t i = 0; i < count; i++)
+							n += legacy_is_colliding(s.x[i], s.y[i], s.z[i], s.radius[i], scene.boxes.get(i));
+						return n;
+					}, found);
+					check(scenario, "legacy", found, expected);
+					report(scenario, "legacy", count, found, seconds);
+				}
+
+				for (int level = 0; level <= (int)detect_simd_level(); level++)
+				{
+					const char* variant = simd_level_name((SimdLevel)level);
+					if (!selected(scenario, variant))
+						continue;
+
+					seconds = time_variant([&]() {
+						collide_pairs_with((SimdLevel)level, s, b, count, hits.data());
+						return (size_t)(hits[0] & 1);
+					}, found);
+					if (hits != reference)
+					{
+						std::fprintf(stderr, "MISMATCH: %s %s hit mask differs from scalar\n", scenario.c_str(), variant);
+						mismatches++;
+					}
+					report(scenario, variant, count, hit_mask_count(hits.data(), count), seconds);
+				}
+
+				// The kernel templates, one pair at a time. float is the same test as the batch kernels and must
+				// agree exactly. double and fixed point round differently, so pairs that only just touch may
+				// come out the other way: those are reported, not checked.
+				if (selected(scenario, "kernel-float"))
+				{
+					floatPairs.fill(scene, count, [](float v) { return v; });
+					seconds = time_variant([&]() { return floatPairs.count_overlaps(); }, found);
+					check(scenario, "kernel-float", found, expected);
+					report(scenario, "kernel-float", count, found, seconds);
+				}
+				if (selected(scenario, "kernel-double"))
+				{
+					doublePairs.fill(scene, count, [](float v) { return (double)v; });
+					seconds = time_variant([&]() { return doublePairs.count_overlaps(); }, found);
+					report(scenario, "kernel-double", count, found, seconds);
+				}
+				if (selected(scenario, "kernel-fixed"))
+				{
+					fixedPairs.fill(scene, count, [](float v) { return Fixed32::from_float(v); });
+					seconds = time_variant([&]() { return fixedPairs.count_overlaps(); }, found);
+					report(scenario, "kernel-fixed", count, found, seconds);
+				}
+
+				// Contact generation on top of the boolean test: point, normal and depth for every hit.
+				if (selected(scenario, "contacts"))
+				{
+					contacts.resize(count);
+					seconds = time_variant([&]() {
+						return generate_contacts(s, b, count, contacts.data(), contacts.size());
+					}, found);
+					check(scenario, "contacts", found, expected);
+					report(scenario, "contacts", count, found, seconds);
+				}
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Sweep
+// Every sphere moves a random distance of up to 4 units (several box sizes) in a random direction.
+// "endpoint" is the discrete test at the end of the motion, for comparison: it misses every pair that tunnels through.
+static void bench_sweep()
+{
+	const size_t counts[] = { 65536 };
+	const SceneDistribution distributions[] = { SceneDistribution::Uniform, SceneDistribution::Degenerate };
+
+	Scene scene;
+	SphereSet moved;
+	std::vector<float> dx, dy, dz, times;
+	std::vector<uint64_t> hits;
+
+	for (SceneDistribution distribution : distributions)
+	{
+		for (size_t baseCount : counts)
+		{
+			size_t count = scaled(baseCount);
+			char name[128];
+			std::snprintf(name, sizeof(name), "sweep/%s/n=%zu", scene_distribution_name(distribution), count);
+			std::string scenario = name;
+
+			generate_pairs(options.seed, count, 0.1f, distribution, scene);
+			SphereArrays s = scene.spheres.arrays();
+			BoxArrays b = scene.boxes.arrays();
+
+			SceneRandom random(options.seed + 1);
+			dx.resize(count); dy.resize(count); dz.resize(count); times.resize(count);
+			moved.clear();
+			for (size_t i = 0; i < count; i++)
+			{
+				dx[i] = random.range(-4.0f, 4.0f);
+				dy[i] = random.range(-4.0f, 4.0f);
+				dz[i] = random.range(-4.0f, 4.0f);
+				moved.add(s.x[i] + dx[i], s.y[i] + dy[i], s.z[i] + dz[i], s.radius[i]);
+			}
+			MotionArrays motion = { dx.data(), dy.data(), dz.data() };
+
+			size_t found = 0, expected = 0;
+			double seconds;
+
+			auto single = [&]() {
+				size_t n = 0;
+				for (size_t i = 0; i < count; i++)
+					n += sphere_aabb_sweep_time(s.x[i], s.y[i], s.z[i], s.radius[i], dx[i], dy[i], dz[i],
+						b.minX[i], b.minY[i], b.minZ[i], b.maxX[i], b.maxY[i], b.maxZ[i]) != SWEEP_MISS;
+				return n;
+			};
+			expected = single();
+
+			if (selected(scenario, "endpoint"))
+			{
+				hits.assign(hit_mask_words(count), 0);
+				seconds = time_variant([&]() {
+					collide_pairs(moved.arrays(), b, count, hits.data());
+					return hit_mask_count(hits.data(), count);
+				}, found);
+				report(scenario, "endpoint", count, found, seconds);
+			}
+
+			if (selected(scenario, "sweep"))
+			{
+				seconds = time_variant(single, found);
+				report(scenario, "sweep", count, found, seconds);
+			}
+
+			if (selected(scenario, "sweep-batch"))
+			{
+				seconds = time_variant([&]() {
+					sweep_pairs(s, motion, b, count, times.data());
+					size_t n = 0;
+					for (size_t i = 0; i < count; i++)
+						n += times[i] != SWEEP_MISS;
+					return n;
+				}, found);
+				check(scenario, "sweep-batch", found, expected);
+				report(scenario, "sweep-batch", count, found, seconds);
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Parallel
+// The exact test over a long candidate list on 1, 2, 4, ... threads. Every thread count must give
+// exactly the serial result, in the same order.
+static void bench_parallel()
+{
+	const SceneDistribution distributions[] = { SceneDistribution::Uniform, SceneDistribution::Clustered };
+
+	Scene scene;
+	std::vector<CollisionPair> candidates, expected, overlaps;
+	std::vector<Contact> expectedContacts, contacts;
+	CandidateScratch scratch;
+
+	std::vector<int> threadCounts;
+	int hardware = (int)std::thread::hardware_concurrency();
+	for (int t = 1; t < hardware; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(hardware > 0 ? hardware : 1);
+
+	for (SceneDistribution distribution : distributions)
+	{
+		size_t count = scaled(4194304);
+		char name[128];
+		std::snprintf(name, sizeof(name), "parallel/%s/n=%zu", scene_distribution_name(distribution), count);
+		std::string scenario = name;
+
+		// Pairs generated with half of them overlapping, fed in as candidates (sphere i, box i).
+		generate_pairs(options.seed, count, 0.5f, distribution, scene);
+		SphereArrays s = scene.spheres.arrays();
+		BoxArrays b = scene.boxes.arrays();
+		candidates.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			CollisionPair pair = { (uint32_t)i, (uint32_t)i };
+			candidates[i] = pair;
+		}
+
+		expected.clear();
+		collide_candidates(s, b, candidates.data(), count, expected, scratch);
+		expectedContacts.resize(count);
+		expectedContacts.resize(generate_contacts(s, b, candidates.data(), count, expectedContacts.data(), count));
+
+		size_t found = 0;
+		double seconds;
+
+		if (selected(scenario, "serial"))
+		{
+			seconds = time_variant([&]() {
+				overlaps.clear();
+				collide_candidates(s, b, candidates.data(), count, overlaps, scratch);
+				return overlaps.size();
+			}, found);
+			report(scenario, "serial", count, found, seconds);
+		}
+
+		for (int threads : threadCounts)
+		{
+			char variant[64];
+			std::snprintf(variant, sizeof(variant), "threads=%d", threads);
+			char contactVariant[64];
+			std::snprintf(contactVariant, sizeof(contactVariant), "contacts/t=%d", threads);
+			if (!selected(scenario, variant) && !selected(scenario, contactVariant))
+				continue;
+
+			WorkStealingPool pool(threads);
+			ParallelNarrowphase narrowphase(pool);
+
+			if (selected(scenario, variant))
+			{
+				seconds = time_variant([&]() {
+					narrowphase.find_overlaps(s, b, candidates.data(), count, overlaps);
+					return overlaps.size();
+				}, found);
+				if (overlaps != expected)
+				{
+					std::fprintf(stderr, "MISMATCH: %s %s differs from the serial result\n", scenario.c_str(), variant);
+					mismatches++;
+				}
+				report(scenario, variant, count, found, seconds);
+			}
+
+			if (selected(scenario, contactVariant))
+			{
+				seconds = time_variant([&]() {
+					narrowphase.generate_contacts(s, b, candidates.data(), count, contacts);
+					return contacts.size();
+				}, found);
+				if (contacts.size() != expectedContacts.size() ||
+					std::memcmp(contacts.data(), expectedContacts.data(), contacts.size() * sizeof(Contact)) != 0)
+				{
+					std::fprintf(stderr, "MISMATCH: %s %s differs from the serial result\n", scenario.c_str(), contactVariant);
+					mismatches++;
+				}
+				report(scenario, contactVariant, count, found, seconds);
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Broadphase
+// Every broadphase variant answers the same question: how many of the N x M sphere/box pairs overlap.
+// Brute force is the reference, it tests every pair with the batch kernel.
+static void bench_broadphase()
+{
+	struct Size { size_t spheres, boxes; float worldSize; };
+	const Size sizes[] = { { 1000, 1000, 25.0f }, { 4000, 4000, 40.0f }, { 10000, 10000, 55.0f } };
+	const SceneDistribution distributions[] = { SceneDistribution::Uniform, SceneDistribution::Clustered, SceneDistribution::Degenerate };
+
+	Scene scene;
+	std::vector<uint64_t> hits;
+
+	for (SceneDistribution distribution : distributions)
+	{
+		for (const Size &size : sizes)
+		{
+			SceneParams params;
+			params.seed = options.seed;
+			params.sphereCount = scaled(size.spheres);
+			params.boxCount = scaled(size.boxes);
+			params.worldSize = size.worldSize;
+			params.distribution = distribution;
+			generate_scene(params, scene);
+
+			char name[128];
+			std::snprintf(name, sizeof(name), "broad/%s/%zux%zu/world=%.0f", scene_distribution_name(distribution),
+				params.sphereCount, params.boxCount, params.worldSize);
+			std::string scenario = name;
+
+			size_t n = scene.spheres.size();
+			size_t m = scene.boxes.size();
+			size_t pairs = n * m;
+			SphereArrays s = scene.spheres.arrays();
+			BoxArrays b = scene.boxes.arrays();
+			hits.assign(hit_mask_words(m), 0);
+
+			auto bruteForce = [&]() {
+				size_t total = 0;
+				for (size_t i = 0; i < n; i++)
+				{
+					collide_sphere_boxes(s.x[i], s.y[i], s.z[i], s.radius[i], b, m, hits.data());
+					total += hit_mask_count(hits.data(), m);
+				}
+				return total;
+			};
+
+			// Brute force gives the reference answer even when its timing is filtered out.
+			size_t expected = bruteForce();
+			size_t found = 0;
+			double seconds;
+
+			if (selected(scenario, "brute-force"))
+			{
+				seconds = time_variant(bruteForce, found);
+				report(scenario, "brute-force", pairs, found, seconds);
+			}
+
+			std::vector<CollisionPair> candidates, overlaps;
+			CandidateScratch scratch;
+
+			// Boxes binned once (static level geometry); each run queries every sphere and runs the exact test.
+			SpatialHash grid(SpatialHash::cell_size_for(s, n));
+			for (size_t j = 0; j < m; j++)
+				grid.insert(scene.boxes.get(j));
+
+			if (selected(scenario, "spatial-hash"))
+			{
+				seconds = time_variant([&]() {
+					overlaps.clear();
+					grid.find_overlaps(s, n, overlaps, candidates, scratch);
+					return overlaps.size();
+				}, found);
+				check(scenario, "spatial-hash", found, expected);
+				report(scenario, "spatial-hash", pairs, found, seconds);
+			}
+
+			// Every box moved (here: back to where it was) each run, as if the whole scene were dynamic.
+			if (selected(scenario, "spatial-hash-move"))
+			{
+				seconds = time_variant([&]() {
+					for (size_t j = 0; j < m; j++)
+						grid.move((SpatialHash::BoxId)j, scene.boxes.get(j));
+					overlaps.clear();
+					grid.find_overlaps(s, n, overlaps, candidates, scratch);
+					return overlaps.size();
+				}, found);
+				check(scenario, "spatial-hash-move", found, expected);
+				report(scenario, "spatial-hash-move", pairs, found, seconds);
+			}
+
+			// Static boxes in a SAH BVH. The build is reported on its own line, with boxes in the "pairs" column.
+			BoxBVH bvh;
+			if (selected(scenario, "bvh-build"))
+			{
+				seconds = time_variant([&]() {
+					bvh.build(b, m);
+					return bvh.size();
+				}, found);
+				report(scenario, "bvh-build", m, 0, seconds);
+			}
+			else
+				bvh.build(b, m);
+
+			if (selected(scenario, "bvh"))
+			{
+				seconds = time_variant([&]() {
+					overlaps.clear();
+					bvh.find_overlaps(s, n, overlaps);
+					return overlaps.size();
+				}, found);
+				check(scenario, "bvh", found, expected);
+				report(scenario, "bvh", pairs, found, seconds);
+			}
+		}
+	}
+}
+
+// Spheres drift a small distance every frame (like the demo's cursor-driven sphere), boxes stay put.
+// Each run of a variant is one frame.
+static void bench_motion()
+{
+	struct Size { size_t spheres, boxes; float worldSize; };
+	const Size sizes[] = { { 4000, 4000, 40.0f }, { 10000, 10000, 55.0f } };
+	const SceneDistribution distributions[] = { SceneDistribution::Uniform, SceneDistribution::Clustered };
+
+	Scene scene;
+	SphereSet moved;
+	std::vector<float> phase;
+	std::vector<uint64_t> hits;
+	std::vector<CollisionPair> candidates, overlaps;
+	CandidateScratch scratch;
+
+	for (SceneDistribution distribution : distributions)
+	{
+		for (const Size &size : sizes)
+		{
+			SceneParams params;
+			params.seed = options.seed;
+			params.sphereCount = scaled(size.spheres);
+			params.boxCount = scaled(size.boxes);
+			params.worldSize = size.worldSize;
+			params.distribution = distribution;
+			generate_scene(params, scene);
+
+			char name[128];
+			std::snprintf(name, sizeof(name), "motion/%s/%zux%zu/world=%.0f", scene_distribution_name(distribution),
+				params.sphereCount, params.boxCount, params.worldSize);
+			std::string scenario = name;
+
+			size_t n = scene.spheres.size();
+			size_t m = scene.boxes.size();
+			size_t pairs = n * m;
+			BoxArrays b = scene.boxes.arrays();
+			hits.assign(hit_mask_words(m), 0);
+
+			SceneRandom random(options.seed);
+			phase.resize(n);
+			for (size_t i = 0; i < n; i++)
+				phase[i] = random.range(0.0f, 6.2831853f);
+
+			// Every sphere circles its start position with a radius of 0.5, a few hundredths of a unit per frame.
+			auto move_spheres = [&](int frame) {
+				moved.clear();
+				for (size_t i = 0; i < n; i++)
+				{
+					float t = 0.05f * frame + phase[i];
+					moved.add(scene.spheres.x[i] + 0.5f * std::cos(t), scene.spheres.y[i] + 0.5f * std::sin(t),
+						scene.spheres.z[i], scene.spheres.radius[i]);
+				}
+			};
+
+			auto bruteForce = [&]() {
+				SphereArrays s = moved.arrays();
+				size_t total = 0;
+				for (size_t i = 0; i < n; i++)
+				{
+					collide_sphere_boxes(s.x[i], s.y[i], s.z[i], s.radius[i], b, m, hits.data());
+					total += hit_mask_count(hits.data(), m);
+				}
+				return total;
+			};
+
+			SpatialHash grid(SpatialHash::cell_size_for(scene.spheres.arrays(), n));
+			for (size_t j = 0; j < m; j++)
+				grid.insert(scene.boxes.get(j));
+
+			SweepAndPrune sap;
+			std::vector<SweepAndPrune::Handle> sapHandles(n);
+			std::vector<PairEvent> events;
+			for (size_t j = 0; j < m; j++)
+				sap.add_box((uint32_t)j, scene.boxes.get(j));
+			for (size_t i = 0; i < n; i++)
+				sapHandles[i] = sap.add_sphere((uint32_t)i, scene.spheres.x[i], scene.spheres.y[i], scene.spheres.z[i], scene.spheres.radius[i]);
+
+			// One sweep and prune frame: move the spheres, collect the begin/end events, exact test the active pairs.
+			auto sapFrame = [&]() {
+				for (size_t i = 0; i < n; i++)
+					sap.move_sphere(sapHandles[i], moved.x[i], moved.y[i], moved.z[i], moved.radius[i]);
+				events.clear();
+				sap.take_events(events);
+
+				candidates.clear();
+				sap.for_each_pair([&](const CollisionPair &pair) { candidates.push_back(pair); });
+				overlaps.clear();
+				collide_candidates(moved.arrays(), b, candidates.data(), candidates.size(), overlaps, scratch);
+				return overlaps.size();
+			};
+
+			// The pair set is only right if every frame's events were right, so check a run of frames, not one.
+			if (selected(scenario, "sweep-and-prune"))
+			{
+				for (int frame = 1; frame <= 30; frame++)
+				{
+					move_spheres(frame);
+					check(scenario, "sweep-and-prune", sapFrame(), bruteForce());
+				}
+			}
+
+			int frame = 0;
+			size_t found = 0;
+			double seconds;
+
+			if (selected(scenario, "brute-force"))
+			{
+				seconds = time_variant([&]() {
+					move_spheres(++frame);
+					return bruteForce();
+				}, found);
+				report(scenario, "brute-force", pairs, found, seconds);
+			}
+
+			if (selected(scenario, "spatial-hash"))
+			{
+				seconds = time_variant([&]() {
+					move_spheres(++frame);
+					overlaps.clear();
+					grid.find_overlaps(moved.arrays(), n, overlaps, candidates, scratch);
+					return overlaps.size();
+				}, found);
+				report(scenario, "spatial-hash", pairs, found, seconds);
+			}
+
+			if (selected(scenario, "sweep-and-prune"))
+			{
+				seconds = time_variant([&]() {
+					move_spheres(++frame);
+					return sapFrame();
+				}, found);
+				report(scenario, "sweep-and-prune", pairs, found, seconds);
+			}
+
+			// The spheres go into a dynamic AABB tree (boxes could, just the same), and every box queries it.
+			// Two margins (the number after the name) show the trade between reinsertions and looser boxes.
+			const float margins[] = { 0.05f, 0.25f };
+			for (float margin : margins)
+			{
+				char variant[64];
+				std::snprintf(variant, sizeof(variant), "dynamic-tree/%.2f", margin);
+				if (!selected(scenario, variant))
+					continue;
+
+				DynamicAABBTree tree(margin);
+				std::vector<DynamicAABBTree::ProxyId> proxies(n);
+				for (size_t i = 0; i < n; i++)
+				{
+					const float r = scene.spheres.radius[i];
+					proxies[i] = tree.create_proxy(make_aabb(scene.spheres.x[i], scene.spheres.y[i], scene.spheres.z[i], 2.0f * r, 2.0f * r, 2.0f * r), (uint32_t)i);
+				}
+
+				auto treeFrame = [&]() {
+					for (size_t i = 0; i < n; i++)
+					{
+						const float r = moved.radius[i];
+						tree.move_proxy(proxies[i], make_aabb(moved.x[i], moved.y[i], moved.z[i], 2.0f * r, 2.0f * r, 2.0f * r));
+					}
+
+					candidates.clear();
+					for (size_t j = 0; j < m; j++)
+					{
+						tree.query_aabb(scene.boxes.get(j), [&](uint32_t sphere) {
+							CollisionPair pair = { sphere, (uint32_t)j };
+							candidates.push_back(pair);
+						});
+					}
+					overlaps.clear();
+					collide_candidates(moved.arrays(), b, candidates.data(), candidates.size(), overlaps, scratch);
+					return overlaps.size();
+				};
+
+				for (int checkFrame = 1; checkFrame <= 30; checkFrame++)
+				{
+					move_spheres(checkFrame);
+					check(scenario, variant, treeFrame(), bruteForce());
+				}
+
+				tree.reset_counters();
+				seconds = time_variant([&]() {
+					move_spheres(++frame);
+					return treeFrame();
+				}, found);
+				report(scenario, variant, pairs, found, seconds);
+
+				DynamicTreeStats stats = tree.stats();
+				if (!options.csv)
+					std::printf("    reinserted %.1f%% of moves, height %d (log2 n = %.1f), area ratio %.1f, fat/tight area %.2f, candidates %zu\n",
+						100.0f * stats.reinsertionRate, stats.height, std::log2((double)n), stats.areaRatio, stats.fatness, candidates.size());
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Quantized boxes
+// Big static box sets, where memory bandwidth decides the speed: one query per sphere through a float BoxBVH
+// (with the default options, and with leaves of up to 16 boxes like the quantized tree) and through a QuantizedBoxBVH.
+// Here the "pairs" column counts queries, so Mpairs/s is millions of queries per second.
+// The quantized tree rounds boxes outward, so it must find every pair the float tree finds, and may find a few more.
+static void bench_quantized()
+{
+	const size_t boxCounts[] = { 1000000, 4000000 };
+
+	Scene scene;
+	std::vector<CollisionPair> expected, overlaps;
+
+	for (size_t baseCount : boxCounts)
+	{
+		SceneParams params;
+		params.seed = options.seed;
+		params.sphereCount = scaled(100000);
+		params.boxCount = scaled(baseCount);
+		// The same density as the largest broadphase scene.
+		params.worldSize = 55.0f * (float)std::cbrt(params.boxCount / 10000.0);
+		params.distribution = SceneDistribution::Uniform;
+		generate_scene(params, scene);
+
+		char name[128];
+		std::snprintf(name, sizeof(name), "quantized/uniform/%zux%zu/world=%.0f", params.sphereCount, params.boxCount, params.worldSize);
+		std::string scenario = name;
+		if (!selected(scenario, "bvh-float") && !selected(scenario, "bvh-float-16") && !selected(scenario, "bvh-quantized"))
+			continue;
+
+		size_t n = scene.spheres.size();
+		size_t m = scene.boxes.size();
+		SphereArrays s = scene.spheres.arrays();
+		size_t found = 0;
+		double seconds;
+
+		BoxBVH bvh;
+		bvh.build(scene.boxes.arrays(), m);
+		expected.clear();
+		bvh.find_overlaps(s, n, expected);
+		std::sort(expected.begin(), expected.end());
+		double floatBytes = (double)(bvh.nodes().size() * sizeof(BVHNode)) / m + 6 * sizeof(float) + sizeof(uint32_t);
+
+		if (selected(scenario, "bvh-float"))
+		{
+			seconds = time_variant([&]() {
+				overlaps.clear();
+				bvh.find_overlaps(s, n, overlaps);
+				return overlaps.size();
+			}, found);
+			report(scenario, "bvh-float", n, found, seconds);
+		}
+
+		BoxBVH::BuildOptions sixteen;
+		sixteen.maxLeafSize = 16;
+		sixteen.minLeafSize = 16;
+		bvh.build(scene.boxes.arrays(), m, sixteen);
+		double float16Bytes = (double)(bvh.nodes().size() * sizeof(BVHNode)) / m + 6 * sizeof(float) + sizeof(uint32_t);
+
+		if (selected(scenario, "bvh-float-16"))
+		{
+			seconds = time_variant([&]() {
+				overlaps.clear();
+				bvh.find_overlaps(s, n, overlaps);
+				return overlaps.size();
+			}, found);
+			check(scenario, "bvh-float-16", found, expected.size());
+			report(scenario, "bvh-float-16", n, found, seconds);
+		}
+
+		QuantizedBoxBVH quantized;
+		quantized.build(bvh);
+		bvh = BoxBVH();
+
+		if (selected(scenario, "bvh-quantized"))
+		{
+			seconds = time_variant([&]() {
+				overlaps.clear();
+				quantized.find_overlaps(s, n, overlaps);
+				return overlaps.size();
+			}, found);
+			std::sort(overlaps.begin(), overlaps.end());
+			bool superset = std::includes(overlaps.begin(), overlaps.end(), expected.begin(), expected.end());
+			if (!superset)
+			{
+				std::fprintf(stderr, "MISMATCH: %s bvh-quantized missed pairs the float BVH found\n", scenario.c_str());
+				mismatches++;
+			}
+			report(scenario, "bvh-quantized", n, found, seconds);
+		}
+
+		if (!options.csv)
+			std::printf("%-48s bytes/box: float %.1f, float-16 %.1f, quantized %.1f; %zu extra pairs from rounding\n", scenario.c_str(),
+				floatBytes, float16Bytes, quantized.bytes_per_box(), found >= expected.size() ? found - expected.size() : 0);
+	}
+}
+#pragma endregion
+
+#pragma region Casts
+// Batches of ray and sphere casts across a static box set, the length of half the world.
+// "fan" casts come in groups of CAST_PACKET_SIZE from one point towards nearby targets, like sight lines or a shotgun
+// blast; "scattered" casts each start anywhere and go any way, the worst case for packets.
+// Here the "pairs" column counts casts. "brute-force" sweeps every cast against every box; "single" sends the casts
+// down the tree one at a time and "packet" CAST_PACKET_SIZE at a time, and both must give each cast the same
+// first hit (box and time, to the bit) as brute force. "any" must hit the same casts, and "all" must find the
+// same hits one at a time and in packets.
+static void bench_cast()
+{
+	const bool fans[] = { true, false };
+	const float radii[] = { 0.0f, 0.5f };
+
+	SceneParams params;
+	params.seed = options.seed;
+	params.sphereCount = 1;
+	params.boxCount = scaled(100000);
+	params.worldSize = 55.0f * (float)std::cbrt(params.boxCount / 10000.0);
+	params.distribution = SceneDistribution::Uniform;
+	Scene scene;
+	generate_scene(params, scene);
+
+	size_t m = scene.boxes.size();
+	BoxArrays b = scene.boxes.arrays();
+	BoxBVH bvh;
+	bvh.build(b, m);
+	BoxBVHView view = bvh.view();
+
+	size_t count = scaled(4096);
+	std::vector<float> x(count), y(count), z(count), radius(count), dx(count), dy(count), dz(count);
+	std::vector<CastHit> hits(count), all(count * 64);
+	std::vector<size_t> firstBox(count);
+	std::vector<float> firstTime(count);
+
+	for (bool fan : fans)
+	{
+		for (float r : radii)
+		{
+			char name[128];
+			std::snprintf(name, sizeof(name), "cast/%s/%s/%zux%zu", fan ? "fan" : "scattered", r == 0.0f ? "rays" : "spheres", count, m);
+			std::string scenario = name;
+
+			SceneRandom random(options.seed + 2);
+			float half = params.worldSize * 0.5f;
+			float targetX = 0.0f, targetY = 0.0f, targetZ = 0.0f;
+			for (size_t i = 0; i < count; i++)
+			{
+				bool newGroup = !fan || i % CAST_PACKET_SIZE == 0;
+				if (newGroup)
+				{
+					x[i] = random.range(-half, half);
+					y[i] = random.range(-half, half);
+					z[i] = random.range(-half, half);
+					targetX = random.range(-half, half);
+					targetY = random.range(-half, half);
+					targetZ = random.range(-half, half);
+				}
+				else
+				{
+					x[i] = x[i - 1]; y[i] = y[i - 1]; z[i] = z[i - 1];
+				}
+				// Aim within a couple of units of the target, and go half the world towards it.
+				float aimX = targetX + (fan ? random.range(-2.0f, 2.0f) : 0.0f) - x[i];
+				float aimY = targetY + (fan ? random.range(-2.0f, 2.0f) : 0.0f) - y[i];
+				float aimZ = targetZ + (fan ? random.range(-2.0f, 2.0f) : 0.0f) - z[i];
+				float length = std::sqrt(aimX * aimX + aimY * aimY + aimZ * aimZ);
+				float scale = length > 0.0f ? half / length : 0.0f;
+				dx[i] = aimX * scale; dy[i] = aimY * scale; dz[i] = aimZ * scale;
+				radius[i] = r;
+			}
+			SphereArrays starts = { x.data(), y.data(), z.data(), r == 0.0f ? nullptr : radius.data() };
+			MotionArrays motion = { dx.data(), dy.data(), dz.data() };
+
+			size_t found = 0, expected = 0;
+			double seconds;
+
+			// Slow enough that once is plenty.
+			Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < count; i++)
+			{
+				firstBox[i] = sweep_sphere_boxes(x[i], y[i], z[i], r, dx[i], dy[i], dz[i], b, m, firstTime[i]);
+				expected += firstBox[i] != m;
+			}
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			if (selected(scenario, "brute-force"))
+				report(scenario, "brute-force", count, expected, seconds);
+
+			// Each cast's first hit against the brute force one, box and time.
+			auto checkFirst = [&](const char* variant) {
+				size_t wrong = 0;
+				for (size_t i = 0; i < count; i++)
+				{
+					uint32_t box = firstBox[i] == m ? CAST_NO_HIT : (uint32_t)firstBox[i];
+					if (hits[i].box != box || std::memcmp(&hits[i].time, &firstTime[i], sizeof(float)) != 0)
+						wrong++;
+				}
+				if (wrong)
+				{
+					std::fprintf(stderr, "MISMATCH: %s %s gave %zu casts a different first hit than brute force\n", scenario.c_str(), variant, wrong);
+					mismatches++;
+				}
+			};
+
+			const CastTraversal traversals[] = { CastTraversal::Single, CastTraversal::Packets };
+			const char* firstNames[] = { "single", "packet" };
+			const char* anyNames[] = { "single-any", "packet-any" };
+			const char* allNames[] = { "single-all", "packet-all" };
+			size_t allTotals[2] = { 0, 0 };
+
+			for (int p = 0; p < 2; p++)
+			{
+				if (selected(scenario, firstNames[p]))
+				{
+					seconds = time_variant([&]() {
+						return cast_spheres(view, starts, motion, count, CastMode::First, hits.data(), count, traversals[p]);
+					}, found);
+					check(scenario, firstNames[p], found, expected);
+					checkFirst(firstNames[p]);
+					report(scenario, firstNames[p], count, found, seconds);
+				}
+
+				if (selected(scenario, anyNames[p]))
+				{
+					seconds = time_variant([&]() {
+						return cast_spheres(view, starts, motion, count, CastMode::Any, hits.data(), count, traversals[p]);
+					}, found);
+					check(scenario, anyNames[p], found, expected);
+					report(scenario, anyNames[p], count, found, seconds);
+				}
+
+				if (selected(scenario, allNames[p]))
+				{
+					seconds = time_variant([&]() {
+						return cast_spheres(view, starts, motion, count, CastMode::All, all.data(), all.size(), traversals[p]);
+					}, found);
+					allTotals[p] = found;
+					if (p == 1 && allTotals[0])
+						check(scenario, allNames[p], found, allTotals[0]);
+					report(scenario, allNames[p], count, found, seconds);
+				}
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Frustum culling
+// A camera in the middle of a big scene, looking down -z with a 60 degree view out to a quarter of the world.
+// The "pairs" column counts objects, and "hit %" is the share that is visible.
+// Every SIMD level, every thread count and the BVH walk must keep exactly the objects the scalar path keeps.
+static void bench_cull()
+{
+	Scene scene;
+	SceneParams params;
+	params.seed = options.seed;
+	params.sphereCount = scaled(1000000);
+	params.boxCount = scaled(1000000);
+	params.worldSize = 55.0f * (float)std::cbrt(params.boxCount / 10000.0);
+	params.distribution = SceneDistribution::Uniform;
+	generate_scene(params, scene);
+
+	// glm::perspective(60 degrees, 1, 0.1, far) with an identity view.
+	const float zNear = 0.1f, zFar = params.worldSize * 0.25f;
+	float f = 1.0f / std::tan(3.14159265f / 6.0f);
+	float PV[16] = {};
+	PV[0] = f;
+	PV[5] = f;
+	PV[10] = -(zFar + zNear) / (zFar - zNear);
+	PV[11] = -1.0f;
+	PV[14] = -(2.0f * zFar * zNear) / (zFar - zNear);
+	Frustum frustum;
+	extract_frustum_planes(PV, frustum);
+
+	std::vector<int> threadCounts;
+	int hardware = (int)std::thread::hardware_concurrency();
+	for (int t = 1; t < hardware; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(hardware > 0 ? hardware : 1);
+
+	SphereArrays spheres = scene.spheres.arrays();
+	BoxArrays boxes = scene.boxes.arrays();
+	size_t n = scene.spheres.size(), m = scene.boxes.size();
+	std::vector<uint32_t> expected, visible(n > m ? n : m);
+	size_t found = 0;
+	double seconds;
+	SimdLevel widest = active_simd_level();
+
+	for (int kind = 0; kind < 2; kind++)
+	{
+		bool sphereKind = kind == 0;
+		size_t count = sphereKind ? n : m;
+		char name[128];
+		std::snprintf(name, sizeof(name), "cull/%s/n=%zu/world=%.0f", sphereKind ? "spheres" : "boxes", count, params.worldSize);
+		std::string scenario = name;
+
+		auto cullAll = [&]() {
+			return sphereKind ? cull_spheres(frustum, spheres, 0, count, visible.data()) : cull_boxes(frustum, boxes, 0, count, visible.data());
+		};
+
+		// The plane-at-a-time scalar test, and the reference every other variant must match.
+		set_simd_level(SimdLevel::Scalar);
+		seconds = time_variant(cullAll, found);
+		expected.assign(visible.begin(), visible.begin() + found);
+		if (selected(scenario, "scalar"))
+			report(scenario, "scalar", count, found, seconds);
+
+		for (int level = 1; level <= (int)widest; level++)
+		{
+			const char* variant = simd_level_name((SimdLevel)level);
+			if (!selected(scenario, variant))
+				continue;
+			set_simd_level((SimdLevel)level);
+			seconds = time_variant(cullAll, found);
+			if (found != expected.size() || !std::equal(expected.begin(), expected.end(), visible.begin()))
+			{
+				std::fprintf(stderr, "MISMATCH: %s %s keeps different objects than the scalar path\n", scenario.c_str(), variant);
+				mismatches++;
+			}
+			report(scenario, variant, count, found, seconds);
+		}
+		set_simd_level(widest);
+
+		std::vector<uint32_t> culled;
+		for (int threads : threadCounts)
+		{
+			char variant[64];
+			std::snprintf(variant, sizeof(variant), "threads=%d", threads);
+			char bvhVariant[64];
+			std::snprintf(bvhVariant, sizeof(bvhVariant), "bvh/t=%d", threads);
+			bool bvhSelected = !sphereKind && selected(scenario, bvhVariant);
+			if (!selected(scenario, variant) && !bvhSelected)
+				continue;
+
+			WorkStealingPool pool(threads);
+			FrustumCuller culler(pool);
+
+			if (selected(scenario, variant))
+			{
+				seconds = time_variant([&]() {
+					if (sphereKind)
+						culler.cull_spheres(frustum, spheres, count, culled);
+					else
+						culler.cull_boxes(frustum, boxes, count, culled);
+					return culled.size();
+				}, found);
+				if (culled != expected)
+				{
+					std::fprintf(stderr, "MISMATCH: %s %s keeps different objects than the scalar path\n", scenario.c_str(), variant);
+					mismatches++;
+				}
+				report(scenario, variant, count, found, seconds);
+			}
+
+			if (bvhSelected)
+			{
+				BoxBVH bvh;
+				bvh.build(boxes, m);
+				seconds = time_variant([&]() {
+					culler.cull_boxes(frustum, bvh.view(), culled);
+					return culled.size();
+				}, found);
+				std::sort(culled.begin(), culled.end());
+				if (culled != expected)
+				{
+					std::fprintf(stderr, "MISMATCH: %s %s keeps different boxes than the flat cull\n", scenario.c_str(), bvhVariant);
+					mismatches++;
+				}
+				report(scenario, bvhVariant, count, found, seconds);
+				if (!options.csv)
+					std::printf("%-48s %s: %zu nodes and %zu boxes tested for %zu boxes\n", scenario.c_str(), bvhVariant,
+						culler.stats().nodes, culler.stats().tested, m);
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Frame memory
+// One collision frame: BVH candidates for every sphere, then contacts for them. Written the way setup() builds
+// its vertex lists (fresh vectors, push_back, no reserve), with a FrameArena reset at the end of the frame,
+// and with each contact taken from an ObjectPool as its candidate is found.
+static void bench_frame()
+{
+	Scene scene;
+	SceneParams params;
+	params.seed = options.seed;
+	params.sphereCount = scaled(10000);
+	params.boxCount = scaled(10000);
+	params.worldSize = 55.0f;
+	params.distribution = SceneDistribution::Clustered;
+	generate_scene(params, scene);
+
+	char name[128];
+	std::snprintf(name, sizeof(name), "frame/%s/%zux%zu", scene_distribution_name(params.distribution), params.sphereCount, params.boxCount);
+	std::string scenario = name;
+
+	size_t n = scene.spheres.size();
+	size_t pairs = n * scene.boxes.size();
+	SphereArrays s = scene.spheres.arrays();
+	BoxArrays b = scene.boxes.arrays();
+	BoxBVH bvh;
+	bvh.build(b, scene.boxes.size());
+
+	size_t found = 0;
+	double seconds;
+
+	if (selected(scenario, "vectors"))
+	{
+		auto frame = [&]() {
+			std::vector<CollisionPair> candidates;
+			for (size_t i = 0; i < n; i++)
+			{
+				bvh.for_each_overlap(s.x[i], s.y[i], s.z[i], s.radius[i], [&](uint32_t box) {
+					CollisionPair pair = { (uint32_t)i, box };
+					candidates.push_back(pair);
+				});
+			}
+			std::vector<Contact> contacts(candidates.size());
+			return generate_contacts(s, b, candidates.data(), candidates.size(), contacts.data(), contacts.size());
+		};
+
+		seconds = time_variant(frame, found);
+		size_t before = heapCalls.load();
+		frame();
+		size_t calls = heapCalls.load() - before;
+		report(scenario, "vectors", pairs, found, seconds);
+		if (!options.csv)
+			std::printf("    %zu heap calls per frame\n", calls);
+	}
+
+	if (selected(scenario, "arena"))
+	{
+		FrameArena arena;
+		auto frame = [&]() {
+			size_t result;
+			{
+				std::vector<CollisionPair, ArenaAllocator<CollisionPair>> candidates{ ArenaAllocator<CollisionPair>(arena) };
+				for (size_t i = 0; i < n; i++)
+				{
+					bvh.for_each_overlap(s.x[i], s.y[i], s.z[i], s.radius[i], [&](uint32_t box) {
+						CollisionPair pair = { (uint32_t)i, box };
+						candidates.push_back(pair);
+					});
+				}
+				Contact* contacts = arena.allocate_array<Contact>(candidates.size());
+				result = generate_contacts(s, b, candidates.data(), candidates.size(), contacts, candidates.size());
+			}
+
+			// The end of update(): everything the frame allocated goes back at once.
+			arena.reset();
+			return result;
+		};
+
+		seconds = time_variant(frame, found);
+		size_t before = heapCalls.load();
+		frame();
+		size_t calls = heapCalls.load() - before;
+		report(scenario, "arena", pairs, found, seconds);
+
+		const AllocatorStats &stats = arena.stats();
+		if (!options.csv)
+			std::printf("    %zu heap calls per frame, peak %zu KB, %zu allocations served, %zu avoided the heap\n",
+				calls, stats.peakBytes / 1024, stats.allocations, stats.allocations_avoided());
+		if (calls != 0)
+		{
+			std::fprintf(stderr, "MISMATCH: %s arena made %zu heap calls in a steady-state frame\n", scenario.c_str(), calls);
+			mismatches++;
+		}
+	}
+
+	if (selected(scenario, "pool"))
+	{
+		// Every candidate gets a contact from the pool; the ones that don't touch are destroyed again at once,
+		// so the next candidate reuses their slot through the free list.
+		ObjectPool<Contact> pool;
+		auto frame = [&]() {
+			for (size_t i = 0; i < n; i++)
+			{
+				bvh.for_each_overlap(s.x[i], s.y[i], s.z[i], s.radius[i], [&](uint32_t box) {
+					Contact* contact = pool.create();
+					if (!sphere_aabb_contact(s.x[i], s.y[i], s.z[i], s.radius[i], scene.boxes.get(box), *contact))
+						pool.destroy(contact);
+				});
+			}
+			size_t result = pool.size();
+
+			// The end of update(): every contact goes back at once.
+			pool.reset();
+			return result;
+		};
+
+		seconds = time_variant(frame, found);
+		size_t before = heapCalls.load();
+		frame();
+		size_t calls = heapCalls.load() - before;
+		report(scenario, "pool", pairs, found, seconds);
+
+		const AllocatorStats &stats = pool.stats();
+		if (!options.csv)
+			std::printf("    %zu heap calls per frame, peak %zu KB, %zu allocations served, %zu avoided the heap\n",
+				calls, stats.peakBytes / 1024, stats.allocations, stats.allocations_avoided());
+		if (calls != 0)
+		{
+			std::fprintf(stderr, "MISMATCH: %s pool made %zu heap calls in a steady-state frame\n", scenario.c_str(), calls);
+			mismatches++;
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Mesh
+// The demo's VertexFormat: a vec4 color followed by a vec3 position.
+struct LegacyVertex
+{
+	float color[4];
+	float position[3];
+};
+
+// The sphere mesh as setup() in main.cpp used to build it: 6 vertices per quad, 4 double sin/cos per corner,
+// pitch over 360 degrees so the surface is built twice, and the radius baked into the vertices.
+static void legacy_sphere_mesh(float radius, std::vector<LegacyVertex> &vertices)
+{
+	const int divisions = 40;
+	const double pi = 3.14159265;
+	float pitchDelta = 360 / divisions;
+	float yawDelta = 360 / divisions;
+	float pitch = 0.0f, yaw = 0.0f;
+
+	vertices.clear();
+	for (int i = 0; i < divisions; i++)
+	{
+		for (int j = 0; j < divisions; j++)
+		{
+			LegacyVertex p[4];
+			float corners[4][2] = { { pitch, yaw }, { pitch, yaw + yawDelta }, { pitch + pitchDelta, yaw + yawDelta }, { pitch + pitchDelta, yaw } };
+			for (int k = 0; k < 4; k++)
+			{
+				p[k].position[0] = (float)(radius * sin(corners[k][0] * pi / 180.0) * cos(corners[k][1] * pi / 180.0));
+				p[k].position[1] = (float)(radius * sin(corners[k][0] * pi / 180.0) * sin(corners[k][1] * pi / 180.0));
+				p[k].position[2] = (float)(radius * cos(corners[k][0] * pi / 180.0));
+				p[k].color[0] = 0.7f; p[k].color[1] = 0.2f; p[k].color[2] = 0.0f; p[k].color[3] = 1.0f;
+			}
+			const int order[6] = { 0, 1, 2, 0, 2, 3 };
+			for (int k = 0; k < 6; k++)
+				vertices.push_back(p[order[k]]);
+			yaw = yaw + yawDelta;
+		}
+		pitch += pitchDelta;
+	}
+}
+
+// Startup cost and vertex data of the sphere meshes for a scene of many spheres of different sizes.
+// The old mesh has the radius baked in, so each sphere needs its own; the indexed levels are built once.
+static void bench_mesh()
+{
+	size_t count = scaled(100);
+	char name[128];
+	std::snprintf(name, sizeof(name), "mesh/sphere/spheres=%zu", count);
+	std::string scenario = name;
+
+	size_t found = 0;
+	double seconds;
+
+	if (selected(scenario, "unindexed"))
+	{
+		std::vector<LegacyVertex> vertices;
+		size_t bytes = 0;
+		seconds = time_variant([&]() {
+			bytes = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				legacy_sphere_mesh(0.25f + 0.01f * (float)i, vertices);
+				bytes += vertices.size() * sizeof(LegacyVertex);
+			}
+			return (size_t)0;
+		}, found);
+		report(scenario, "unindexed", count, found, seconds);
+		if (!options.csv)
+			std::printf("    %zu vertices per sphere, %zu KB uploaded\n", vertices.size(), bytes / 1024);
+	}
+
+	if (selected(scenario, "indexed-lods"))
+	{
+		SphereMesh levels[SPHERE_LOD_COUNT];
+		size_t bytes = 0;
+		seconds = time_variant([&]() {
+			// What sphere_mesh_lod() does on its first call; after that every sphere reuses the levels.
+			build_sphere_lods(levels);
+			bytes = 0;
+			for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+				bytes += levels[lod].vertex_count() * sizeof(LegacyVertex) + levels[lod].indices.size() * sizeof(uint16_t);
+			return (size_t)0;
+		}, found);
+		report(scenario, "indexed-lods", count, found, seconds);
+
+		const SphereMesh &demo = sphere_mesh_lod(2);
+		if (!options.csv)
+			std::printf("    level 2 (the old density): %zu vertices, %zu indices; all levels %zu KB uploaded, for any number of spheres\n",
+				demo.vertex_count(), demo.indices.size(), bytes / 1024);
+	}
+}
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	if (!parse_options(argc, argv))
+		return 1;
+
+	if (!options.csv)
+		std::printf("Collision benchmark, seed %llu, widest SIMD path: %s\n\n", (unsigned long long)options.seed, simd_level_name(detect_simd_level()));
+
+	print_header();
+	bench_narrowphase();
+	bench_sweep();
+	bench_parallel();
+	bench_broadphase();
+	bench_motion();
+	bench_quantized();
+	bench_cast();
+	bench_cull();
+	bench_frame();
+	bench_mesh();
+
+	if (mismatches)
+	{
+		std::fprintf(stderr, "%d mismatches\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,295 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: HeadlessSimulation.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+The demo without a window. main.cpp needs glfwCreateWindow and glewInit before it does anything, so it
+can't run on a server. This runs the same collision logic (Simulation.h) from a scene script and a
+motion script (SimulationScript.h) in place of the mouse and keyboard, steps the frames back to back
+as fast as it can, and writes every collision that begins or ends, one per line:
+
+	FRAME begin|end SPHERE BOX
+
+--scene takes a scene script, or a binary scene file (SceneFile.h) if the name ends in .bin.
+Without --scene it uses the demo's scene (one sphere, one box). Without --motion the cursor sweeps once
+across the middle of the window, left to right, one pixel per frame.
+A summary (frames, events, frames per second) goes to stderr so it doesn't mix with the events.
+
+--profile FILE times every step, and its broadphase and narrowphase, with a FrameProfiler (FrameProfiler.h),
+prints the p50 / p99 / max table to stderr and saves it to FILE: CSV if it ends in .csv, JSON otherwise.
+--perf adds cache and branch misses per phase, where perf_event_open is allowed.
+
+--record FILE saves the run as a trace (SimulationTrace.h). --replay FILE runs a trace instead of the scripts,
+recorded here or by the demo, as fast as it can, checks every frame's events and state against it and
+prints the time; if any frame differs it says which and exits with 1. --profile works with it too.
+
+--threads N runs the exact test of frames with many pairs to test (SIMULATION_PARALLEL_PAIRS) on N threads
+(0: one per core), with a ParallelNarrowphase. The events are the same at any thread count.
+
+Usage: HeadlessSimulation [--scene FILE] [--motion FILE] [--frames N] [--out FILE] [--quiet] [--profile FILE] [--perf] [--record FILE] [--replay FILE] [--threads N]
+*/
+
+#include "../CollisionTypes.h"
+#include "../FrameProfiler.h"
+#include "../ParallelNarrowphase.h"
+#include "../SceneFile.h"
+#include "../Simulation.h"
+#include "../SimulationScript.h"
+#include "../SimulationTrace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#pragma region Options
+struct Options
+{
+	std::string scenePath;
+	std::string motionPath;
+	std::string outPath;		// Empty: stdout.
+	long long frames = -1;		// -1: what the motion script says.
+	bool quiet = false;			// Summary only, no events.
+	std::string profilePath;	// Empty: no profiling.
+	bool perf = false;			// Hardware counters in the profile.
+	std::string recordPath;		// Empty: no trace.
+	std::string replayPath;		// Set: replay this trace, ignoring the scripts.
+	int threads = 1;			// Narrowphase threads; 1: no pool.
+} options;
+
+static bool parse_options(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--scene" && hasValue)
+			options.scenePath = argv[++i];
+		else if (arg == "--motion" && hasValue)
+			options.motionPath = argv[++i];
+		else if (arg == "--frames" && hasValue)
+			options.frames = strtoll(argv[++i], nullptr, 10);
+		else if (arg == "--out" && hasValue)
+			options.outPath = argv[++i];
+		else if (arg == "--quiet")
+			options.quiet = true;
+		else if (arg == "--profile" && hasValue)
+			options.profilePath = argv[++i];
+		else if (arg == "--perf")
+			options.perf = true;
+		else if (arg == "--record" && hasValue)
+			options.recordPath = argv[++i];
+		else if (arg == "--replay" && hasValue)
+			options.replayPath = argv[++i];
+		else if (arg == "--threads" && hasValue)
+			options.threads = atoi(argv[++i]);
+		else
+		{
+			std::fprintf(stderr, "Usage: %s [--scene FILE] [--motion FILE] [--frames N] [--out FILE] [--quiet] [--profile FILE] [--perf] [--record FILE] [--replay FILE] [--threads N]\n", argv[0]);
+			return false;
+		}
+	}
+	return true;
+}
+#pragma endregion
+
+// The cursor moving across the window at mid height, as if someone dragged the mouse over the box.
+static void default_motion(MotionScript &script)
+{
+	script.frames = (uint32_t)SIMULATION_WINDOW_SIZE + 1;
+	script.commands.clear();
+	for (uint32_t f = 0; f < script.frames; f++)
+	{
+		InputCommand c = { f, InputKind::Cursor, 0, { (float)f, SIMULATION_WINDOW_SIZE / 2.0f, 0.0f } };
+		script.commands.push_back(c);
+	}
+}
+
+// Prints the profile's table and saves it, if profiling.
+static bool finish_profile(FrameProfiler* profile, std::string &error)
+{
+	if (!profile)
+		return true;
+	profile->write_table(stderr);
+	if (!profile->save(options.profilePath, error))
+	{
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return false;
+	}
+	return true;
+}
+
+static int replay(FrameProfiler* profile, ParallelNarrowphase* narrowphase)
+{
+	std::string error;
+	SimulationTrace trace;
+	if (!load_trace(options.replayPath, trace, error))
+	{
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	ReplayResult result;
+	replay_trace(trace, result, profile, narrowphase);
+
+	std::fprintf(stderr, "%u of %zu frames, %zu spheres, %zu boxes: %zu events\n",
+		result.frames, trace.frames.size(), trace.scene.spheres.size(), trace.scene.boxes.size(), result.events);
+	std::fprintf(stderr, "%.3f ms, %.0f frames/s\n", result.seconds * 1e3, result.seconds > 0.0 ? result.frames / result.seconds : 0.0);
+	if (!result.matched)
+		std::fprintf(stderr, "Mismatch at frame %u: %s\n", result.mismatchFrame, result.mismatch.c_str());
+
+	if (!finish_profile(profile, error))
+		return 1;
+	return result.matched ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	if (!parse_options(argc, argv))
+		return 1;
+
+	std::string error;
+	FrameProfiler profiler;
+	FrameProfiler* profile = options.profilePath.empty() ? nullptr : &profiler;
+	if (profile && options.perf && !profiler.enable_hardware_counters(error))
+		std::fprintf(stderr, "No hardware counters (%s): times only\n", error.c_str());
+
+	// The pool's threads are started once, here, and wait between frames.
+	std::unique_ptr<WorkStealingPool> pool;
+	std::unique_ptr<ParallelNarrowphase> narrowphase;
+	if (options.threads != 1)
+	{
+		pool.reset(new WorkStealingPool(options.threads));
+		narrowphase.reset(new ParallelNarrowphase(*pool));
+	}
+
+	if (!options.replayPath.empty())
+		return replay(profile, narrowphase.get());
+
+	Scene scene;
+	if (options.scenePath.empty())
+		demo_scene(scene);
+	else if (is_scene_file_path(options.scenePath))
+	{
+		// The simulation moves the spheres, so it works on a copy of the mapped arrays.
+		MappedScene mapped;
+		if (!mapped.open(options.scenePath, error))
+		{
+			std::fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		mapped.copy_to(scene);
+	}
+	else if (!load_scene_script(options.scenePath, scene, error))
+	{
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	MotionScript motion;
+	if (options.motionPath.empty())
+		default_motion(motion);
+	else if (!load_motion_script(options.motionPath, motion, error))
+	{
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	uint32_t frames = options.frames >= 0 ? (uint32_t)options.frames : motion.frames;
+
+	FILE* out = stdout;
+	if (!options.outPath.empty())
+	{
+		out = std::fopen(options.outPath.c_str(), "w");
+		if (!out)
+		{
+			std::fprintf(stderr, "Can't write file: %s\n", options.outPath.c_str());
+			return 1;
+		}
+	}
+	// Events are written a lot and read rarely: a big buffer keeps writing from costing more than simulating.
+	static char outBuffer[1 << 16];
+	std::setvbuf(out, outBuffer, _IOFBF, sizeof(outBuffer));
+
+	Simulation simulation(scene);
+	simulation.set_profiler(profile);
+	simulation.set_narrowphase(narrowphase.get());
+
+	TraceRecorder recorder;
+	if (!options.recordPath.empty() && !recorder.open(options.recordPath, scene, error))
+	{
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	std::vector<CollisionEvent> events;
+	size_t eventCount = 0;
+	size_t next = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t f = 0; f < frames; f++)
+	{
+		// The commands are sorted by frame, so this frame's are the next few.
+		size_t first = next;
+		while (next < motion.commands.size() && motion.commands[next].frame == f)
+			next++;
+
+		events.clear();
+		{
+			ScopedPhase timer(profile, FramePhase::Update);
+			simulation.step(motion.commands.data() + first, next - first, events);
+		}
+		eventCount += events.size();
+		if (profile)
+			profile->end_frame();
+		if (recorder.is_open())
+			recorder.record(simulation, motion.commands.data() + first, next - first, events.data(), events.size());
+
+		if (!options.quiet)
+		{
+			for (const CollisionEvent &e : events)
+				std::fprintf(out, "%u %s %u %u\n", e.frame, e.begin ? "begin" : "end", e.pair.sphere, e.pair.box);
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (out != stdout)
+		std::fclose(out);
+	else
+		std::fflush(out);
+
+	std::fprintf(stderr, "%u frames, %zu spheres, %zu boxes: %zu events, %zu touching at the end, %llu exact tests\n",
+		frames, scene.spheres.size(), scene.boxes.size(), eventCount, simulation.touching().size(), (unsigned long long)simulation.tests());
+	std::fprintf(stderr, "%.3f ms, %.0f frames/s\n", seconds * 1e3, seconds > 0.0 ? frames / seconds : 0.0);
+
+	if (recorder.is_open())
+	{
+		uint64_t recorded = recorder.frames();
+		if (!recorder.close(error))
+		{
+			std::fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		std::fprintf(stderr, "Recorded %llu frames to %s, %llu bytes\n",
+			(unsigned long long)recorded, options.recordPath.c_str(), (unsigned long long)recorder.bytes());
+	}
+
+	if (!finish_profile(profile, error))
+		return 1;
+	return 0;
+}
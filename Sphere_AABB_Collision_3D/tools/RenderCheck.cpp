@@ -0,0 +1,647 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: RenderCheck.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Offscreen check of the demo's drawing, without a window or a GPU.
+It creates an OpenGL 4.0 core context through EGL with no surface (on a server that is Mesa's software
+rasterizer, llvmpipe), and draws the demo's scene plus a crowd of spheres and boxes into a framebuffer
+object with the same shaders and the same instanced draws as renderScene() in main.cpp.
+
+Each frame writes its instances into an InstanceRing, as update() does: persistently mapped if the
+context has glBufferStorage, then again uploaded with glBufferData. The movable sphere moves every frame,
+so a part of the ring reused too early would show up in the image. The last frame is then drawn the old
+way, one draw call per object, with each object's attributes set as constant values instead of uniforms.
+All images must be identical to the pixel. It prints the draw calls, the time per frame and the ring's
+waits for each way, and can save the instanced image.
+
+With --program-cache FILE the shader program goes through the program binary cache (ProgramCache.h)
+as in init(): loaded from FILE if it fits, compiled and saved otherwise. Either way the time is printed,
+and a program loaded from the cache has to draw the same image as a compiled one.
+
+Usage: RenderCheck [--spheres N] [--boxes N] [--frames N] [--shaders DIR] [--ppm FILE] [--program-cache FILE]
+*/
+
+#include "../CollisionTypes.h"
+#include "../SceneGenerator.h"
+#include "../BoxBVH.h"
+#include "../SphereMesh.h"
+#include "../DrawInstances.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+#include "../InstanceRing.h"
+#include "../ProgramCache.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef SHADER_DIR
+#define SHADER_DIR ".."
+#endif
+
+#pragma region Options
+struct Options
+{
+	size_t spheres = 2000;
+	size_t boxes = 2000;
+	int frames = 20;				// Frames timed for each way of drawing.
+	std::string shaderDir = SHADER_DIR;
+	std::string ppmPath;			// Where to save the instanced image, if anywhere.
+	std::string programCache;		// Program binary cache file; empty to always compile.
+} options;
+
+static bool parse_options(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--spheres" && hasValue)
+			options.spheres = strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--boxes" && hasValue)
+			options.boxes = strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--frames" && hasValue)
+			options.frames = atoi(argv[++i]);
+		else if (arg == "--shaders" && hasValue)
+			options.shaderDir = argv[++i];
+		else if (arg == "--ppm" && hasValue)
+			options.ppmPath = argv[++i];
+		else if (arg == "--program-cache" && hasValue)
+			options.programCache = argv[++i];
+		else
+		{
+			std::fprintf(stderr, "Usage: %s [--spheres N] [--boxes N] [--frames N] [--shaders DIR] [--ppm FILE] [--program-cache FILE]\n", argv[0]);
+			return false;
+		}
+	}
+	if (options.frames < 1)
+		options.frames = 1;
+	return true;
+}
+#pragma endregion
+
+#pragma region Context
+const int WIDTH = 800;
+const int HEIGHT = 800;
+
+// An OpenGL 4.0 core context with no window: EGL's surfaceless platform if there is one, else the default display.
+static bool create_context()
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+		return false;
+
+	const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = nullptr;
+	EGLint configs = 0;
+	eglChooseConfig(display, configAttributes, &config, 1, &configs);
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 0,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+	EGLContext context = eglCreateContext(display, configs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT)
+		return false;
+
+	return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_TRUE;
+}
+
+static std::string read_text(const std::string &path)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+static GLuint compile_shader(const std::string &source, GLenum type)
+{
+	GLuint shader = glCreateShader(type);
+	const char* code = source.c_str();
+	glShaderSource(shader, 1, &code, nullptr);
+	glCompileShader(shader);
+
+	GLint compiled = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		std::fprintf(stderr, "The shader failed to compile with the error:\n%s\n", log);
+	}
+	return shader;
+}
+
+static GLuint create_program()
+{
+	std::string vertex = read_text(options.shaderDir + "/VertexShader.glsl");
+	std::string fragment = read_text(options.shaderDir + "/FragmentShader.glsl");
+	if (vertex.empty() || fragment.empty())
+	{
+		std::fprintf(stderr, "Can't read the shaders from %s\n", options.shaderDir.c_str());
+		return 0;
+	}
+
+	// init(): the cached program if it fits, else compile, link and save.
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool cached = !options.programCache.empty() && program_binaries_supported();
+	uint64_t key = 0;
+	std::string miss = options.programCache.empty() ? "no --program-cache" : "program binaries not supported";
+	GLuint program = 0;
+	if (cached)
+	{
+		key = program_cache_key(vertex, fragment);
+		program = load_cached_program(options.programCache, key, miss);
+	}
+	bool fromCache = program != 0;
+
+	if (!fromCache)
+	{
+		program = glCreateProgram();
+		glAttachShader(program, compile_shader(vertex, GL_VERTEX_SHADER));
+		glAttachShader(program, compile_shader(fragment, GL_FRAGMENT_SHADER));
+		if (cached)
+			keep_program_binary(program);
+		glLinkProgram(program);
+
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+			return 0;
+
+		std::string error;
+		if (cached && !save_cached_program(options.programCache, key, program, error))
+			std::fprintf(stderr, "%s\n", error.c_str());
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (fromCache)
+		std::printf("Program loaded from %s in %.3f ms\n", options.programCache.c_str(), ms);
+	else
+		std::printf("Program compiled in %.3f ms (%s)\n", ms, miss.c_str());
+	return program;
+}
+#pragma endregion
+
+#pragma region Scene
+// main.cpp's VertexFormat: a vec4 color, then a vec3 position.
+struct Vertex
+{
+	float color[4];
+	float position[3];
+};
+
+struct Mesh
+{
+	GLuint vbo;
+	GLuint ibo;			// 0 for the cube, which is drawn without indices like the demo's.
+	GLsizei count;		// Indices, or vertices without an index buffer.
+};
+
+static Mesh upload_mesh(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices)
+{
+	Mesh mesh;
+	glGenBuffers(1, &mesh.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+
+	mesh.ibo = 0;
+	mesh.count = (GLsizei)vertices.size();
+	if (!indices.empty())
+	{
+		glGenBuffers(1, &mesh.ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * indices.size(), indices.data(), GL_STATIC_DRAW);
+		mesh.count = (GLsizei)indices.size();
+	}
+	return mesh;
+}
+
+static Vertex make_vertex(float x, float y, float z)
+{
+	Vertex v = { { 0.7f, 0.2f, 0.0f, 1.0f }, { x, y, z } };
+	return v;
+}
+
+// The demo's unit cube, with its 12 triangles in the same order as setup() builds them.
+static std::vector<Vertex> cube_vertices()
+{
+	// A B C D on the front (z = 0.5), A2 B2 C2 D2 on the back.
+	const float corners[8][3] = {
+		{ -0.5f, -0.5f, 0.5f }, { 0.5f, -0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f },
+		{ -0.5f, -0.5f, -0.5f }, { 0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, -0.5f }, { -0.5f, 0.5f, -0.5f } };
+	enum { A, B, C, D, A2, B2, C2, D2 };
+	const int order[36] = {
+		A, B, C, A, C, D,			// Front
+		A2, C2, B2, A2, D2, C2,		// Back
+		A2, D, D2, A2, A, D,		// Left
+		B, B2, C2, B, C2, C,		// Right
+		D, C, C2, D, C2, D2,		// Top
+		A, B2, B, A, A2, B2 };		// Bottom
+
+	std::vector<Vertex> vertices;
+	for (int i = 0; i < 36; i++)
+		vertices.push_back(make_vertex(corners[order[i]][0], corners[order[i]][1], corners[order[i]][2]));
+	return vertices;
+}
+
+// The camera from init(): glm::lookAt from (0, 0, 2) toward the origin, and glm::perspective(45, 1, 0.1, 100),
+// which glm reads as 45 radians.
+static void demo_camera(float* PV, float &pixelScale)
+{
+	const float fovy = 45.0f, aspect = 1.0f, zNear = 0.1f, zFar = 100.0f;
+	float f = 1.0f / std::tan(fovy / 2.0f);
+
+	float proj[16] = {};
+	proj[0] = f / aspect;
+	proj[5] = f;
+	proj[10] = -(zFar + zNear) / (zFar - zNear);
+	proj[11] = -1.0f;
+	proj[14] = -(2.0f * zFar * zNear) / (zFar - zNear);
+
+	// Looking down -z from z = 2 with y up is just a translation by -2 along z.
+	float view[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -2, 1 };
+
+	multiply_matrix(proj, view, PV);
+	pixelScale = f * HEIGHT / 2.0f;
+}
+#pragma endregion
+
+#pragma region Drawing
+struct Renderer
+{
+	GLuint program;
+	GLint uniPV;
+	float PV[16];
+	float pixelScale;
+	Mesh sphereMeshes[SPHERE_LOD_COUNT];
+	Mesh cube;
+
+	SphereSet spheres;			// The movable sphere first, then the crowd's.
+	std::vector<uint8_t> hits;
+	BoxSet boxes;
+	SphereLods lods;
+	InstanceRing* ring;			// Where draw_instanced writes each frame's instances.
+	int frame;
+	int drawCalls;
+};
+
+static void bind_mesh(const Mesh &mesh)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+}
+
+// bindInstances() from main.cpp.
+static void bind_instances(GLuint buffer, size_t first)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	size_t start = first * sizeof(DrawInstance);
+	glVertexAttribPointer(INSTANCE_POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(start + offsetof(DrawInstance, position)));
+	glVertexAttribPointer(INSTANCE_SCALE_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(start + offsetof(DrawInstance, scale)));
+	glVertexAttribPointer(INSTANCE_BLUE_LOCATION, 1, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(start + offsetof(DrawInstance, blue)));
+}
+
+static void set_instance_arrays(bool enabled)
+{
+	for (int location = INSTANCE_POSITION_LOCATION; location <= INSTANCE_BLUE_LOCATION; location++)
+	{
+		if (enabled)
+			glEnableVertexAttribArray(location);
+		else
+			glDisableVertexAttribArray(location);
+	}
+}
+
+// The movable sphere sweeps across the cuboid, one step a frame, like the cursor moving it in the demo.
+static void move_sphere(Renderer &r)
+{
+	r.spheres.x[0] = -1.0f + 2.0f * (float)(r.frame % 64) / 63.0f;
+	r.hits[0] = sphere_aabb_overlap(r.spheres.x[0], r.spheres.y[0], r.spheres.z[0], r.spheres.radius[0], r.boxes.get(0));
+	r.frame++;
+}
+
+// update(), for frame r.frame: writes the instances, spheres by level of detail then boxes, to out.
+static void write_instances(Renderer &r, DrawInstance* out)
+{
+	build_sphere_instances(r.PV, r.pixelScale, r.spheres.arrays(), r.spheres.size(), r.hits.data(), r.lods, out);
+	build_box_instances(r.boxes.arrays(), r.boxes.size(), nullptr, out + r.spheres.size());
+}
+
+static void clear_frame(const Renderer &r)
+{
+	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glUseProgram(r.program);
+	glUniformMatrix4fv(r.uniPV, 1, GL_FALSE, r.PV);
+}
+
+// update() and renderScene(): the instances go into the ring, then one draw per level of detail and one for all boxes.
+static void draw_instanced(Renderer &r)
+{
+	move_sphere(r);
+	write_instances(r, r.ring->begin_frame(r.spheres.size() + r.boxes.size()));
+
+	clear_frame(r);
+	set_instance_arrays(true);
+
+	size_t base = r.ring->end_writes();
+	GLuint buffer = r.ring->instance_buffer();
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+	{
+		size_t first = r.lods.first[lod];
+		size_t count = r.lods.first[lod + 1] - first;
+		if (count == 0)
+			continue;
+
+		bind_mesh(r.sphereMeshes[lod]);
+		bind_instances(buffer, base + first);
+		glDrawElementsInstanced(GL_TRIANGLES, r.sphereMeshes[lod].count, GL_UNSIGNED_SHORT, (void*)0, (GLsizei)count);
+		r.drawCalls++;
+	}
+
+	bind_mesh(r.cube);
+	bind_instances(buffer, base + r.spheres.size());
+	glDrawArraysInstanced(GL_TRIANGLES, 0, r.cube.count, (GLsizei)r.boxes.size());
+	r.drawCalls++;
+
+	r.ring->end_frame();
+}
+
+// The old way: one draw per object, its attributes set before each draw.
+static void draw_one_by_one(Renderer &r)
+{
+	move_sphere(r);
+	std::vector<DrawInstance> instances(r.spheres.size() + r.boxes.size());
+	write_instances(r, instances.data());
+
+	clear_frame(r);
+	set_instance_arrays(false);
+
+	auto set_instance = [](const DrawInstance &instance) {
+		glVertexAttrib3fv(INSTANCE_POSITION_LOCATION, instance.position);
+		glVertexAttrib3fv(INSTANCE_SCALE_LOCATION, instance.scale);
+		glVertexAttrib1f(INSTANCE_BLUE_LOCATION, instance.blue);
+	};
+
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+	{
+		bind_mesh(r.sphereMeshes[lod]);
+		for (size_t i = r.lods.first[lod]; i < r.lods.first[lod + 1]; i++)
+		{
+			set_instance(instances[i]);
+			glDrawElements(GL_TRIANGLES, r.sphereMeshes[lod].count, GL_UNSIGNED_SHORT, (void*)0);
+			r.drawCalls++;
+		}
+	}
+
+	bind_mesh(r.cube);
+	for (size_t i = r.spheres.size(); i < instances.size(); i++)
+	{
+		set_instance(instances[i]);
+		glDrawArrays(GL_TRIANGLES, 0, r.cube.count);
+		r.drawCalls++;
+	}
+}
+
+// Draws options.frames frames one way, starting from frame 0, and returns the milliseconds per frame.
+// glFinish makes the time include the drawing itself.
+template <class Draw>
+static double time_frames(Renderer &r, Draw &&draw, int &drawCallsPerFrame)
+{
+	r.frame = 0;
+	r.drawCalls = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int f = 0; f < options.frames; f++)
+		draw(r);
+	glFinish();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	drawCallsPerFrame = r.drawCalls / options.frames;
+	return seconds * 1e3 / options.frames;
+}
+
+// glBufferStorage is core in OpenGL 4.4, and an extension before.
+static bool has_buffer_storage()
+{
+	GLint major = 0, minor = 0, extensions = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 4))
+		return true;
+
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+	for (GLint i = 0; i < extensions; i++)
+	{
+		if (std::string((const char*)glGetStringi(GL_EXTENSIONS, i)) == "GL_ARB_buffer_storage")
+			return true;
+	}
+	return false;
+}
+
+static size_t different_pixels(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+	size_t different = 0;
+	for (size_t p = 0; p < a.size(); p += 4)
+		different += a[p] != b[p] || a[p + 1] != b[p + 1] || a[p + 2] != b[p + 2];
+	return different;
+}
+
+static void read_image(std::vector<uint8_t> &pixels)
+{
+	pixels.resize((size_t)WIDTH * HEIGHT * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+static bool write_ppm(const std::string &path, const std::vector<uint8_t> &pixels)
+{
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	std::fprintf(file, "P6\n%d %d\n255\n", WIDTH, HEIGHT);
+	// glReadPixels starts at the bottom row; PPM starts at the top.
+	for (int y = HEIGHT - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < WIDTH; x++)
+			std::fwrite(&pixels[((size_t)y * WIDTH + x) * 4], 1, 3, file);
+	}
+	std::fclose(file);
+	return true;
+}
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	if (!parse_options(argc, argv))
+		return 1;
+
+	if (!create_context())
+	{
+		std::fprintf(stderr, "Can't create an OpenGL 4.0 core context through EGL\n");
+		return 1;
+	}
+	std::printf("Renderer: %s, OpenGL %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+
+	Renderer r;
+	r.program = create_program();
+	if (!r.program)
+		return 1;
+
+	// The core profile draws nothing without a vertex array object; the demo's compatibility context has a default one.
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	for (int location = INSTANCE_POSITION_LOCATION; location <= INSTANCE_BLUE_LOCATION; location++)
+		glVertexAttribDivisor(location, 1);
+	r.uniPV = glGetUniformLocation(r.program, "PV");
+
+	// The render target: color and depth, the size of the demo's window.
+	GLuint framebuffer, colorBuffer, depthBuffer;
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WIDTH, HEIGHT);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, WIDTH, HEIGHT);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::fprintf(stderr, "Framebuffer incomplete\n");
+		return 1;
+	}
+	glViewport(0, 0, WIDTH, HEIGHT);
+
+	// The render state from init().
+	glEnable(GL_DEPTH_TEST);
+	glFrontFace(GL_CCW);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+	{
+		const SphereMesh &mesh = sphere_mesh_lod(lod);
+		std::vector<Vertex> vertices;
+		for (size_t v = 0; v < mesh.vertex_count(); v++)
+			vertices.push_back(make_vertex(mesh.positions[v * 3], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2]));
+		r.sphereMeshes[lod] = upload_mesh(vertices, mesh.indices);
+	}
+	r.cube = upload_mesh(cube_vertices(), std::vector<uint16_t>());
+
+	// The demo's scene, with the movable sphere resting on the cuboid, and a crowd generated the way setup() does.
+	Scene crowd;
+	SceneParams params;
+	params.sphereCount = options.spheres;
+	params.boxCount = options.boxes;
+	params.worldSize = 2.0f;
+	params.minRadius = 0.01f;
+	params.maxRadius = 0.04f;
+	params.minExtent = 0.02f;
+	params.maxExtent = 0.1f;
+	generate_scene(params, crowd);
+
+	BoxBVH bvh;
+	bvh.build(crowd.boxes.arrays(), crowd.boxes.size());
+	AABB cuboid = make_aabb(0.0f, 0.0f, 0.0f, 1.0f, 0.5f, 0.5f);
+
+	r.spheres.add(0.3f, 0.2f, 0.0f, 0.25f);
+	r.boxes.add(cuboid);
+	r.hits.push_back(1);
+	for (size_t i = 0; i < crowd.spheres.size(); i++)
+	{
+		const SphereSet &s = crowd.spheres;
+		r.spheres.add(s.x[i], s.y[i], s.z[i], s.radius[i]);
+		r.hits.push_back(bvh.any_overlap(s.x[i], s.y[i], s.z[i], s.radius[i]) || sphere_aabb_overlap(s.x[i], s.y[i], s.z[i], s.radius[i], cuboid));
+	}
+	for (size_t i = 0; i < crowd.boxes.size(); i++)
+		r.boxes.add(crowd.boxes.get(i));
+	demo_camera(r.PV, r.pixelScale);
+
+	// Each way of writing the instances draws the same frames; the last frame of each is kept for the comparison.
+	InstanceRing mappedRing, uploadedRing;
+	mappedRing.init(has_buffer_storage());
+	uploadedRing.init(false);
+
+	int mappedCalls, uploadedCalls, oneByOneCalls;
+	std::vector<uint8_t> mappedImage, uploadedImage, oneByOneImage;
+	r.ring = &mappedRing;
+	double mappedMs = time_frames(r, draw_instanced, mappedCalls);
+	read_image(mappedImage);
+	r.ring = &uploadedRing;
+	double uploadedMs = time_frames(r, draw_instanced, uploadedCalls);
+	read_image(uploadedImage);
+	double oneByOneMs = time_frames(r, draw_one_by_one, oneByOneCalls);
+	read_image(oneByOneImage);
+
+	if (glGetError() != GL_NO_ERROR)
+	{
+		std::fprintf(stderr, "OpenGL error while drawing\n");
+		return 1;
+	}
+
+	size_t drawn = 0;
+	for (size_t p = 0; p < mappedImage.size(); p += 4)
+		drawn += mappedImage[p] != 255 || mappedImage[p + 1] != 255 || mappedImage[p + 2] != 255;
+	size_t uploadedDifferent = different_pixels(mappedImage, uploadedImage);
+	size_t oneByOneDifferent = different_pixels(mappedImage, oneByOneImage);
+
+	std::printf("%zu spheres, %zu boxes, %d frames each, %dx%d, %zu instance bytes a frame\n", r.spheres.size(), r.boxes.size(),
+		options.frames, WIDTH, HEIGHT, sizeof(DrawInstance) * (r.spheres.size() + r.boxes.size()));
+	std::printf("%-14s %8s %12s %8s %14s\n", "path", "draws", "ms/frame", "waits", "differ");
+	std::printf("%-14s %8d %12.3f %8zu %14s\n", mappedRing.persistent() ? "ring-mapped" : "ring-fallback", mappedCalls, mappedMs,
+		mappedRing.waits(), "(reference)");
+	std::printf("%-14s %8d %12.3f %8s %14zu\n", "bufferdata", uploadedCalls, uploadedMs, "-", uploadedDifferent);
+	std::printf("%-14s %8d %12.3f %8s %14zu\n", "one-by-one", oneByOneCalls, oneByOneMs, "-", oneByOneDifferent);
+	std::printf("%zu pixels drawn\n", drawn);
+
+	if (!options.ppmPath.empty() && !write_ppm(options.ppmPath, mappedImage))
+		std::fprintf(stderr, "Can't write file: %s\n", options.ppmPath.c_str());
+
+	mappedRing.destroy();
+	uploadedRing.destroy();
+
+	if (uploadedDifferent != 0 || oneByOneDifferent != 0 || drawn == 0)
+	{
+		std::fprintf(stderr, "MISMATCH: the images of the mapped ring, glBufferData and one draw per object differ\n");
+		return 1;
+	}
+	return 0;
+}
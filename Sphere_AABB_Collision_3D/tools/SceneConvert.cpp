@@ -0,0 +1,115 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SceneConvert.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Turns a scene script (SimulationScript.h) into a binary scene file (SceneFile.h), which the tools
+then map into memory instead of reading line by line. A script of one "random" line is enough for
+a world of millions of objects.
+
+--bvh also builds a BoxBVH over the boxes and stores it in the file, so programs that load it can
+query the tree without building it. --leaf-size sets the BVH's largest leaf.
+The time each step took goes to stderr.
+
+Usage: SceneConvert --scene FILE --out FILE.bin [--bvh] [--leaf-size N]
+*/
+
+#include "../BoxBVH.h"
+#include "../SceneFile.h"
+#include "../SimulationScript.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#pragma region Options
+struct Options
+{
+	std::string scenePath;
+	std::string outPath;
+	bool bvh = false;		// Store a prebuilt BVH over the boxes.
+	int leafSize = 4;		// BVH leaves hold at most this many boxes.
+} options;
+
+static bool parse_options(int argc, char** argv)
+{
+	bool ok = true;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--scene" && hasValue)
+			options.scenePath = argv[++i];
+		else if (arg == "--out" && hasValue)
+			options.outPath = argv[++i];
+		else if (arg == "--bvh")
+			options.bvh = true;
+		else if (arg == "--leaf-size" && hasValue)
+			options.leafSize = atoi(argv[++i]);
+		else
+			ok = false;
+	}
+
+	if (!ok || options.scenePath.empty() || options.outPath.empty() || options.leafSize < 1)
+	{
+		std::fprintf(stderr, "Usage: %s --scene FILE --out FILE.bin [--bvh] [--leaf-size N]\n", argv[0]);
+		return false;
+	}
+	return true;
+}
+#pragma endregion
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	if (!parse_options(argc, argv))
+		return 1;
+
+	std::string error;
+	Scene scene;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!load_scene_script(options.scenePath, scene, error))
+	{
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	std::fprintf(stderr, "Read %zu spheres, %zu boxes in %.1f ms\n", scene.spheres.size(), scene.boxes.size(), seconds_since(start) * 1e3);
+
+	BoxBVH bvh;
+	if (options.bvh)
+	{
+		BoxBVH::BuildOptions build;
+		build.maxLeafSize = options.leafSize;
+		start = std::chrono::steady_clock::now();
+		bvh.build(scene.boxes.arrays(), scene.boxes.size(), build);
+		std::fprintf(stderr, "Built the BVH (%zu nodes, depth %d) in %.1f ms\n", bvh.nodes().size(), bvh.depth(), seconds_since(start) * 1e3);
+	}
+
+	start = std::chrono::steady_clock::now();
+	if (!write_scene_file(options.outPath, scene, options.bvh ? &bvh : nullptr, error))
+	{
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	std::fprintf(stderr, "Wrote %s in %.1f ms\n", options.outPath.c_str(), seconds_since(start) * 1e3);
+	return 0;
+}
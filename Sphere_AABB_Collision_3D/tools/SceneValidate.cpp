@@ -0,0 +1,161 @@
+/*
+Title: Sphere-AABB 3D collision Detection
+File Name: SceneValidate.cpp
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+Description:
+Checks a binary scene file (SceneFile.h) and says what is in it.
+
+It maps the file and prints the header, then reads everything with MappedScene::validate: the checksum,
+the spheres and boxes, and the stored BVH's structure. If there is a BVH, it also queries it, straight
+from the mapping, with the first --queries spheres of the file and compares what it finds against testing
+each of those spheres against every box, so a tree that is well formed but wrong is caught too.
+Each step is timed; the time to open shows that loading doesn't depend on the size of the world.
+
+Exits with 0 if the file is good, 1 if not.
+
+Usage: SceneValidate FILE.bin [--queries N]
+*/
+
+#include "../BoxBVH.h"
+#include "../SceneFile.h"
+#include "../SphereAABBBatch.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#pragma region Options
+struct Options
+{
+	std::string path;
+	long long queries = 64;		// Spheres to check the BVH with.
+} options;
+
+static bool parse_options(int argc, char** argv)
+{
+	bool ok = true;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--queries" && hasValue)
+			options.queries = strtoll(argv[++i], nullptr, 10);
+		else if (options.path.empty() && arg.compare(0, 2, "--") != 0)
+			options.path = arg;
+		else
+			ok = false;
+	}
+
+	if (!ok || options.path.empty() || options.queries < 0)
+	{
+		std::fprintf(stderr, "Usage: %s FILE.bin [--queries N]\n", argv[0]);
+		return false;
+	}
+	return true;
+}
+#pragma endregion
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The first count spheres queried through the BVH and against every box. True if both find the same number of
+// boxes for every sphere (ids are unique in both, so equal counts of boxes that really overlap means the same boxes).
+static bool check_queries(const MappedScene &scene, size_t count, size_t &overlaps)
+{
+	SphereArrays s = scene.spheres();
+	BoxArrays b = scene.boxes();
+	BoxBVHView bvh = scene.bvh();
+	overlaps = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t found = 0;
+		bool wrong = false;
+		bvh.for_each_overlap(s.x[i], s.y[i], s.z[i], s.radius[i], [&](uint32_t id) {
+			found++;
+			if (!sphere_aabb_overlap(s.x[i], s.y[i], s.z[i], s.radius[i], b.minX[id], b.minY[id], b.minZ[id], b.maxX[id], b.maxY[id], b.maxZ[id]))
+				wrong = true;
+		});
+
+		size_t expected = 0;
+		for (size_t k = 0; k < scene.box_count(); k++)
+		{
+			if (sphere_aabb_overlap(s.x[i], s.y[i], s.z[i], s.radius[i], b.minX[k], b.minY[k], b.minZ[k], b.maxX[k], b.maxY[k], b.maxZ[k]))
+				expected++;
+		}
+
+		if (wrong || found != expected)
+		{
+			std::fprintf(stderr, "BVH query for sphere %zu found %zu boxes, expected %zu\n", i, found, expected);
+			return false;
+		}
+		overlaps += found;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (!parse_options(argc, argv))
+		return 1;
+
+	std::string error;
+	MappedScene scene;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!scene.open(options.path, error))
+	{
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	double openSeconds = seconds_since(start);
+
+	const SceneFileHeader &h = scene.header();
+	std::printf("%s: version %u, %.1f MB\n", options.path.c_str(), h.version, scene.file_bytes() / 1048576.0);
+	std::printf("  %llu spheres, %llu boxes\n", (unsigned long long)h.sphereCount, (unsigned long long)h.boxCount);
+	if (scene.has_bvh())
+		std::printf("  BVH: %llu nodes, depth %u\n", (unsigned long long)h.nodeCount, h.bvhDepth);
+	else
+		std::printf("  no BVH\n");
+	std::printf("  opened in %.3f ms\n", openSeconds * 1e3);
+
+	start = std::chrono::steady_clock::now();
+	if (!scene.validate(error))
+	{
+		std::printf("BAD: %s\n", error.c_str());
+		return 1;
+	}
+	std::printf("  checked in %.1f ms\n", seconds_since(start) * 1e3);
+
+	if (scene.has_bvh())
+	{
+		size_t count = (size_t)options.queries < scene.sphere_count() ? (size_t)options.queries : scene.sphere_count();
+		size_t overlaps = 0;
+		start = std::chrono::steady_clock::now();
+		if (!check_queries(scene, count, overlaps))
+		{
+			std::printf("BAD: the BVH gives wrong answers\n");
+			return 1;
+		}
+		std::printf("  %zu BVH queries match testing every box (%zu overlaps) in %.1f ms\n", count, overlaps, seconds_since(start) * 1e3);
+	}
+
+	std::printf("OK\n");
+	return 0;
+}